@@ -0,0 +1,54 @@
+#include "sensors/sensor_group.h"
+#include "pico/stdlib.h"
+#include <vector>
+
+using std::vector;
+
+#include "board_hardware/pico_w_onboard_led_indicator.h"
+#include "sensors/sensor_types/dummy_sensor.h"
+#include "sensors/sensor_types/stemma_soil_sensor.h"
+
+// As wired on the sensor pod
+#define STEMMA_I2C_PORT                     (i2c1)
+extern const uint8_t STEMMA_I2C_SDA_PIN     = 2;
+extern const uint8_t STEMMA_I2C_SCL_PIN     = 3;
+static const uint STEMMA_I2C_BAUDRATE       = (25 * 1000);
+static const uint STEMMA_I2C_MAX_BAUDRATE   = (400 * 1000);
+
+I2CInterface _stemmaInterface = I2CInterface(
+    STEMMA_I2C_PORT,
+    STEMMA_I2C_BAUDRATE,
+    STEMMA_I2C_SDA_PIN,
+    STEMMA_I2C_SCL_PIN,
+    true,
+    STEMMA_I2C_MAX_BAUDRATE
+);
+
+StemmaSoilSensor _stemmaSensor(
+    _stemmaInterface,
+    {
+        StemmaSoilSensor::SOIL_SENSOR_1_ADDRESS,
+        StemmaSoilSensor::SOIL_SENSOR_2_ADDRESS
+    }
+);
+
+DummySensor _dummySensor;
+PicoWOnboardLEDIndicator _ledIndicator;
+
+// The soil readings go at QoS 1, so the harness sees both publish paths
+vector<SensorGroup> _SENSOR_GROUPS = {
+    SensorGroup(
+        {
+            &_dummySensor
+        }
+    ),
+    SensorGroup(
+        {
+            &_stemmaSensor
+        },
+        1
+    )
+};
+
+extern const int NUM_SENSOR_GROUPS      = 2;
+WiFiIndicator* _wifiIndicator           = &_ledIndicator;
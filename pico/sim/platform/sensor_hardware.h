@@ -0,0 +1,14 @@
+#ifndef _SENSOR_HARDWARE_H_
+#define _SENSOR_HARDWARE_H_
+
+#include "pico/types.h"
+#include "sensors/sensor_types/dummy_sensor.h"
+#include "sensors/sensor_types/stemma_soil_sensor.h"
+
+// The soak harness's board: a DummySensor group and a pair of Stemma probes on their own bus
+constexpr const uint32_t TOTAL_RAW_DATA_SIZE = (
+    (DummySensor::RAW_DATA_SIZE + 2) +
+    (StemmaSoilSensor::RAW_DATA_SIZE + 2)
+);
+
+#endif      // _SENSOR_HARDWARE_H_
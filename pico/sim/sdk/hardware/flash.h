@@ -0,0 +1,21 @@
+#ifndef _SIM_HARDWARE_FLASH_H_
+#define _SIM_HARDWARE_FLASH_H_
+
+#include "pico/types.h"
+
+#define FLASH_PAGE_SIZE         (1u << 8)
+#define FLASH_SECTOR_SIZE       (1u << 12)
+#define XIP_BASE                (0x10000000u)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void flash_range_erase(uint32_t flash_offs, size_t count);
+void flash_range_program(uint32_t flash_offs, const uint8_t* data, size_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif      // _SIM_HARDWARE_FLASH_H_
@@ -0,0 +1,34 @@
+#ifndef _SIM_HARDWARE_GPIO_H_
+#define _SIM_HARDWARE_GPIO_H_
+
+#include "pico/types.h"
+
+enum gpio_function {
+    GPIO_FUNC_SPI       = 1,
+    GPIO_FUNC_UART      = 2,
+    GPIO_FUNC_I2C       = 3,
+    GPIO_FUNC_SIO       = 5,
+    GPIO_FUNC_NULL      = 0x1f
+};
+
+#define GPIO_OUT        1
+#define GPIO_IN         0
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void gpio_init(uint gpio);
+void gpio_set_function(uint gpio, enum gpio_function fn);
+void gpio_set_dir(uint gpio, bool out);
+void gpio_put(uint gpio, bool value);
+bool gpio_get(uint gpio);
+void gpio_pull_up(uint gpio);
+void gpio_pull_down(uint gpio);
+void gpio_disable_pulls(uint gpio);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif      // _SIM_HARDWARE_GPIO_H_
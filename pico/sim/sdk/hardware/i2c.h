@@ -0,0 +1,32 @@
+#ifndef _SIM_HARDWARE_I2C_H_
+#define _SIM_HARDWARE_I2C_H_
+
+#include "pico/types.h"
+#include "hardware/gpio.h"
+
+typedef struct i2c_inst i2c_inst_t;
+
+extern i2c_inst_t i2c0_inst;
+extern i2c_inst_t i2c1_inst;
+
+#define i2c0            (&i2c0_inst)
+#define i2c1            (&i2c1_inst)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint i2c_init(i2c_inst_t* i2c, uint baudrate);
+void i2c_deinit(i2c_inst_t* i2c);
+uint i2c_set_baudrate(i2c_inst_t* i2c, uint baudrate);
+uint i2c_hw_index(i2c_inst_t* i2c);
+int i2c_write_blocking_until(i2c_inst_t* i2c, uint8_t addr, const uint8_t* src, size_t len, bool nostop, absolute_time_t until);
+int i2c_read_blocking_until(i2c_inst_t* i2c, uint8_t addr, uint8_t* dst, size_t len, bool nostop, absolute_time_t until);
+int i2c_write_blocking(i2c_inst_t* i2c, uint8_t addr, const uint8_t* src, size_t len, bool nostop);
+int i2c_read_blocking(i2c_inst_t* i2c, uint8_t addr, uint8_t* dst, size_t len, bool nostop);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif      // _SIM_HARDWARE_I2C_H_
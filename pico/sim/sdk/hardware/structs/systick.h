@@ -0,0 +1,24 @@
+#ifndef _SIM_HARDWARE_STRUCTS_SYSTICK_H_
+#define _SIM_HARDWARE_STRUCTS_SYSTICK_H_
+
+#include "pico/types.h"
+
+// Only touched by the payload benchmark, which counts nothing on the host
+typedef struct {
+    volatile uint32_t csr;
+    volatile uint32_t rvr;
+    volatile uint32_t cvr;
+    volatile uint32_t calib;
+} systick_hw_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern systick_hw_t* systick_hw;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif      // _SIM_HARDWARE_STRUCTS_SYSTICK_H_
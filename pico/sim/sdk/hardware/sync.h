@@ -0,0 +1,6 @@
+#ifndef _SIM_HARDWARE_SYNC_H_
+#define _SIM_HARDWARE_SYNC_H_
+
+#include "pico/sync.h"
+
+#endif      // _SIM_HARDWARE_SYNC_H_
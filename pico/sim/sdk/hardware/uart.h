@@ -0,0 +1,34 @@
+#ifndef _SIM_HARDWARE_UART_H_
+#define _SIM_HARDWARE_UART_H_
+
+#include "pico/types.h"
+
+typedef struct uart_inst uart_inst_t;
+
+extern uart_inst_t uart0_inst;
+extern uart_inst_t uart1_inst;
+
+#define uart0           (&uart0_inst)
+#define uart1           (&uart1_inst)
+
+typedef enum {
+    UART_PARITY_NONE,
+    UART_PARITY_EVEN,
+    UART_PARITY_ODD
+} uart_parity_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint uart_init(uart_inst_t* uart, uint baudrate);
+void uart_deinit(uart_inst_t* uart);
+void uart_set_format(uart_inst_t* uart, uint data_bits, uint stop_bits, uart_parity_t parity);
+void uart_set_hw_flow(uart_inst_t* uart, bool cts, bool rts);
+void uart_puts(uart_inst_t* uart, const char* s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif      // _SIM_HARDWARE_UART_H_
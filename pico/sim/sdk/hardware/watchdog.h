@@ -0,0 +1,18 @@
+#ifndef _SIM_HARDWARE_WATCHDOG_H_
+#define _SIM_HARDWARE_WATCHDOG_H_
+
+#include "pico/types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void watchdog_enable(uint32_t delay_ms, bool pause_on_debug);
+void watchdog_update(void);
+bool watchdog_caused_reboot(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif      // _SIM_HARDWARE_WATCHDOG_H_
@@ -0,0 +1,17 @@
+#ifndef _SIM_LWIP_DHCP_H_
+#define _SIM_LWIP_DHCP_H_
+
+#include "lwip/netif.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+err_t dhcp_start(struct netif* netif);
+void dhcp_stop(struct netif* netif);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif      // _SIM_LWIP_DHCP_H_
@@ -0,0 +1,19 @@
+#ifndef _SIM_LWIP_DNS_H_
+#define _SIM_LWIP_DNS_H_
+
+#include "lwip/ip_addr.h"
+
+typedef void (*dns_found_callback)(const char* name, const ip_addr_t* ipaddr, void* callback_arg);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void dns_setserver(u8_t numdns, const ip_addr_t* dnsserver);
+err_t dns_gethostbyname(const char* hostname, ip_addr_t* addr, dns_found_callback found, void* callback_arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif      // _SIM_LWIP_DNS_H_
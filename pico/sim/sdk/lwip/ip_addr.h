@@ -0,0 +1,37 @@
+#ifndef _SIM_LWIP_IP_ADDR_H_
+#define _SIM_LWIP_IP_ADDR_H_
+
+#include "lwip/err.h"
+
+// IPv4 only, as the firmware is built
+typedef struct ip4_addr {
+    u32_t addr;
+} ip4_addr_t;
+
+typedef ip4_addr_t ip_addr_t;
+
+#define ip4_addr_get_u32(src_ipaddr)            ((src_ipaddr)->addr)
+#define ip4_addr_set_u32(dest_ipaddr, src_u32)  ((dest_ipaddr)->addr = (src_u32))
+#define ip_addr_get_ip4_u32(ipaddr)             ip4_addr_get_u32(ipaddr)
+#define ip_addr_set_zero(ipaddr)                ((ipaddr)->addr = 0)
+#define ip_2_ip4(ipaddr)                        (ipaddr)
+#define IP4_ADDR(ipaddr, a, b, c, d)            ((ipaddr)->addr = ((u32_t) ((d) & 0xff) << 24) | \
+                                                                  ((u32_t) ((c) & 0xff) << 16) | \
+                                                                  ((u32_t) ((b) & 0xff) << 8)  | \
+                                                                   (u32_t) ((a) & 0xff))
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int ip4addr_aton(const char* cp, ip4_addr_t* addr);
+char* ip4addr_ntoa(const ip4_addr_t* addr);
+
+#define ipaddr_aton(cp, addr)                   ip4addr_aton(cp, addr)
+#define ipaddr_ntoa(addr)                       ip4addr_ntoa(addr)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif      // _SIM_LWIP_IP_ADDR_H_
@@ -0,0 +1,41 @@
+#ifndef _SIM_LWIP_NETIF_H_
+#define _SIM_LWIP_NETIF_H_
+
+#include "lwip/ip_addr.h"
+
+#define NETIF_FLAG_UP           0x01U
+#define NETIF_FLAG_LINK_UP      0x04U
+
+struct netif;
+typedef void (*netif_status_callback_fn)(struct netif* netif);
+
+struct netif {
+    ip4_addr_t ip_addr;
+    ip4_addr_t netmask;
+    ip4_addr_t gw;
+    netif_status_callback_fn status_callback;
+    netif_status_callback_fn link_callback;
+    const char* hostname;
+    u8_t flags;
+};
+
+#define netif_ip4_addr(netif)                   ((const ip4_addr_t*) &((netif)->ip_addr))
+#define netif_ip4_netmask(netif)                ((const ip4_addr_t*) &((netif)->netmask))
+#define netif_ip4_gw(netif)                     ((const ip4_addr_t*) &((netif)->gw))
+#define netif_is_up(netif)                      (((netif)->flags & NETIF_FLAG_UP) ? (u8_t) 1 : (u8_t) 0)
+#define netif_is_link_up(netif)                 (((netif)->flags & NETIF_FLAG_LINK_UP) ? (u8_t) 1 : (u8_t) 0)
+#define netif_set_hostname(netif, name)         do { if((netif) != NULL) { (netif)->hostname = name; } } while(0)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void netif_set_addr(struct netif* netif, const ip4_addr_t* ipaddr, const ip4_addr_t* netmask, const ip4_addr_t* gw);
+void netif_set_status_callback(struct netif* netif, netif_status_callback_fn status_callback);
+void netif_set_link_callback(struct netif* netif, netif_status_callback_fn link_callback);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif      // _SIM_LWIP_NETIF_H_
@@ -0,0 +1,20 @@
+#ifndef _SIM_LWIP_OPT_H_
+#define _SIM_LWIP_OPT_H_
+
+// The firmware's own lwIP options, with lwIP's defaults for anything it leaves out
+#include "lwipopts.h"
+
+#ifndef MQTT_REQ_MAX_IN_FLIGHT
+#define MQTT_REQ_MAX_IN_FLIGHT      4
+#endif
+#ifndef MQTT_REQ_TIMEOUT
+#define MQTT_REQ_TIMEOUT            30
+#endif
+#ifndef MQTT_OUTPUT_RINGBUF_SIZE
+#define MQTT_OUTPUT_RINGBUF_SIZE    256
+#endif
+#ifndef MQTT_VAR_HEADER_BUFFER_LEN
+#define MQTT_VAR_HEADER_BUFFER_LEN  128
+#endif
+
+#endif      // _SIM_LWIP_OPT_H_
@@ -0,0 +1,20 @@
+#ifndef _SIM_PICO_ASYNC_CONTEXT_POLL_H_
+#define _SIM_PICO_ASYNC_CONTEXT_POLL_H_
+
+#include "pico/async_context.h"
+
+typedef struct async_context_poll {
+    async_context_t core;
+} async_context_poll_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+bool async_context_poll_init_with_defaults(async_context_poll_t* self);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif      // _SIM_PICO_ASYNC_CONTEXT_POLL_H_
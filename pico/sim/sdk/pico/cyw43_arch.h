@@ -0,0 +1,62 @@
+#ifndef _SIM_PICO_CYW43_ARCH_H_
+#define _SIM_PICO_CYW43_ARCH_H_
+
+#include "pico/types.h"
+#include "pico/async_context.h"
+#include "lwip/netif.h"
+
+#define CYW43_ITF_STA               0
+#define CYW43_ITF_AP                1
+
+#define CYW43_LINK_DOWN             (0)
+#define CYW43_LINK_JOIN             (1)
+#define CYW43_LINK_NOIP             (2)
+#define CYW43_LINK_UP               (3)
+#define CYW43_LINK_FAIL             (-1)
+#define CYW43_LINK_NONET            (-2)
+#define CYW43_LINK_BADAUTH          (-3)
+
+#define CYW43_COUNTRY(A, B, REV)    ((unsigned char) (A) | ((unsigned char) (B) << 8) | ((REV) << 16))
+#define CYW43_COUNTRY_CANADA        CYW43_COUNTRY('C', 'A', 0)
+
+#define CYW43_AUTH_OPEN             (0)
+#define CYW43_AUTH_WPA_TKIP_PSK     (0x00200002)
+#define CYW43_AUTH_WPA2_AES_PSK     (0x00400004)
+#define CYW43_AUTH_WPA2_MIXED_PSK   (0x00400006)
+
+#define CYW43_IOCTL_GET_CHANNEL     (0x3a)
+#define CYW43_WL_GPIO_LED_PIN       0
+
+typedef struct _cyw43_t {
+    struct netif netif[2];
+} cyw43_t;
+
+extern cyw43_t cyw43_state;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int cyw43_arch_init_with_country(uint32_t country);
+void cyw43_arch_deinit(void);
+void cyw43_arch_enable_sta_mode(void);
+void cyw43_arch_disable_sta_mode(void);
+async_context_t* cyw43_arch_async_context(void);
+void cyw43_arch_lwip_begin(void);
+void cyw43_arch_lwip_end(void);
+int cyw43_arch_wifi_connect_async(const char* ssid, const char* pw, uint32_t auth);
+void cyw43_arch_gpio_put(uint wl_gpio, bool value);
+
+int cyw43_wifi_join(cyw43_t* self, size_t ssid_len, const uint8_t* ssid, size_t key_len, const uint8_t* key,
+                    uint32_t auth_type, const uint8_t* bssid, uint32_t channel);
+int cyw43_wifi_leave(cyw43_t* self, int itf);
+int cyw43_wifi_link_status(cyw43_t* self, int itf);
+int cyw43_tcpip_link_status(cyw43_t* self, int itf);
+int cyw43_wifi_get_bssid(cyw43_t* self, uint8_t bssid[6]);
+int cyw43_ioctl(cyw43_t* self, uint32_t cmd, size_t len, uint8_t* buf, uint32_t iface);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif      // _SIM_PICO_CYW43_ARCH_H_
@@ -0,0 +1,19 @@
+#ifndef _SIM_PICO_MULTICORE_H_
+#define _SIM_PICO_MULTICORE_H_
+
+#include "pico/types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void multicore_launch_core1(void (*entry)(void));
+void multicore_lockout_victim_init(void);
+void multicore_lockout_start_blocking(void);
+void multicore_lockout_end_blocking(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif      // _SIM_PICO_MULTICORE_H_
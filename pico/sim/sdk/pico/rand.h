@@ -0,0 +1,17 @@
+#ifndef _SIM_PICO_RAND_H_
+#define _SIM_PICO_RAND_H_
+
+#include "pico/types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint32_t get_rand_32(void);
+uint64_t get_rand_64(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif      // _SIM_PICO_RAND_H_
@@ -0,0 +1,19 @@
+#ifndef _SIM_PICO_STDIO_H_
+#define _SIM_PICO_STDIO_H_
+
+#include "pico/types.h"
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+bool stdio_init_all(void);
+int getchar_timeout_us(uint32_t timeout_us);
+void stdio_set_chars_available_callback(void (*fn)(void*), void* param);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif      // _SIM_PICO_STDIO_H_
@@ -0,0 +1,10 @@
+#ifndef _SIM_PICO_STDLIB_H_
+#define _SIM_PICO_STDLIB_H_
+
+#include "pico/types.h"
+#include "pico/time.h"
+#include "pico/stdio.h"
+#include "hardware/gpio.h"
+#include "hardware/uart.h"
+
+#endif      // _SIM_PICO_STDLIB_H_
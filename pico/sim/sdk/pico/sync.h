@@ -0,0 +1,33 @@
+#ifndef _SIM_PICO_SYNC_H_
+#define _SIM_PICO_SYNC_H_
+
+#include "pico/types.h"
+
+// Zero is unlocked, so mutexes in zeroed memory work without mutex_init() like auto_init_mutex ones
+typedef struct mutex {
+    int8_t owner;               // Owning core plus one
+} mutex_t;
+
+#define auto_init_mutex(name)       mutex_t name
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void mutex_init(mutex_t* mtx);
+void mutex_enter_blocking(mutex_t* mtx);
+bool mutex_try_enter(mutex_t* mtx, uint32_t* owner_out);
+void mutex_exit(mutex_t* mtx);
+
+uint32_t save_and_disable_interrupts(void);
+void restore_interrupts(uint32_t status);
+
+void __sev(void);
+void __wfe(void);
+void __dmb(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif      // _SIM_PICO_SYNC_H_
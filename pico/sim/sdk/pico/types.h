@@ -0,0 +1,61 @@
+#ifndef _SIM_PICO_TYPES_H_
+#define _SIM_PICO_TYPES_H_
+
+// Host stand-ins for the parts of the pico SDK the firmware uses. The declarations and inline
+// helpers match the SDK's (including how time saturates and wraps), the rest is in sim_sdk.cpp
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <assert.h>
+
+typedef unsigned int uint;
+typedef uint64_t absolute_time_t;
+
+#define nil_time                ((absolute_time_t) 0)
+#define at_the_end_of_time      ((absolute_time_t) INT64_MAX)
+
+enum pico_error_codes {
+    PICO_OK                 = 0,
+    PICO_ERROR_NONE         = 0,
+    PICO_ERROR_GENERIC      = -1,
+    PICO_ERROR_TIMEOUT      = -2,
+    PICO_ERROR_NO_DATA      = -3
+};
+
+#define __not_in_flash_func(func_name)      func_name
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+static inline uint64_t to_us_since_boot(absolute_time_t t) { return t; }
+static inline uint32_t to_ms_since_boot(absolute_time_t t) { return (uint32_t) (t / 1000); }
+static inline bool is_nil_time(absolute_time_t t) { return t == nil_time; }
+
+static inline absolute_time_t delayed_by_us(const absolute_time_t t, uint64_t us) {
+    uint64_t delayed = t + us;
+    return ((int64_t) delayed < 0) ? (absolute_time_t) INT64_MAX : delayed;
+}
+
+static inline absolute_time_t delayed_by_ms(const absolute_time_t t, uint32_t ms) {
+    uint64_t delayed = t + (ms * 1000ull);
+    return ((int64_t) delayed < 0) ? (absolute_time_t) INT64_MAX : delayed;
+}
+
+static inline int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to) {
+    return (int64_t) (to - from);
+}
+
+static inline absolute_time_t absolute_time_min(absolute_time_t a, absolute_time_t b) {
+    return (a < b) ? a : b;
+}
+
+uint32_t get_core_num(void);
+void tight_loop_contents(void);
+void panic(const char* format, ...);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif      // _SIM_PICO_TYPES_H_
@@ -0,0 +1,366 @@
+#include "sim_i2c.h"
+#include "virtual_clock.h"
+
+#include "hardware/i2c.h"
+#include "hardware/gpio.h"
+
+#include <cmath>
+
+
+// Seesaw registers, as in stemma_soil_sensor.cpp
+constexpr uint8_t SEESAW_STATUS_BASE            = 0x00;
+constexpr uint8_t SEESAW_STATUS_HW_ID           = 0x01;
+constexpr uint8_t SEESAW_STATUS_VERSION         = 0x02;
+constexpr uint8_t SEESAW_STATUS_TEMP            = 0x04;
+constexpr uint8_t SEESAW_STATUS_SWRST           = 0x7F;
+constexpr uint8_t SEESAW_TOUCH_BASE             = 0x0F;
+constexpr uint8_t SEESAW_TOUCH_CHANNEL_OFFSET   = 0x10;
+constexpr uint8_t SEESAW_HW_ID_CODE             = 0x55;
+constexpr uint32_t SEESAW_VERSION               = 0x0FBA2A1B;      // Product 4026
+
+constexpr double US_PER_DAY                     = 86400e6;
+
+
+SimSeesawProbe::SimSeesawProbe(uint8_t address) :
+    SimI2CDevice(address),
+    mRegBase(0),
+    mReg(0),
+    mResetUntilUS(0),
+    mResetCount(0)
+{}
+
+bool SimSeesawProbe::write(const uint8_t* data, size_t length) {
+    if(VirtualClock::now() < mResetUntilUS) {
+        return false;
+    }
+
+    if(length < 2) {
+        return true;
+    }
+
+    mRegBase = data[0];
+    mReg = data[1];
+
+    if((mRegBase == SEESAW_STATUS_BASE) && (mReg == SEESAW_STATUS_SWRST)) {
+        mResetUntilUS = VirtualClock::now() + RESET_TIME_US;
+        ++mResetCount;
+    }
+
+    return true;
+}
+
+bool SimSeesawProbe::read(uint8_t* data, size_t length) {
+    if(VirtualClock::now() < mResetUntilUS) {
+        return false;
+    }
+
+    double days = VirtualClock::now() / US_PER_DAY;
+    uint32_t value = 0xFFFFFFFF;
+
+    if(mRegBase == SEESAW_STATUS_BASE) {
+        switch(mReg) {
+            case SEESAW_STATUS_HW_ID:
+                value = (uint32_t) SEESAW_HW_ID_CODE << 24;
+                break;
+
+            case SEESAW_STATUS_VERSION:
+                value = SEESAW_VERSION;
+                break;
+
+            case SEESAW_STATUS_TEMP:
+                // 16.16 fixed point, warmest in the afternoon
+                value = (uint32_t) ((20.0 + (3.0 * sin(2 * M_PI * (days - 0.375)))) * 65536.0);
+                break;
+        }
+    } else if((mRegBase == SEESAW_TOUCH_BASE) && (mReg == SEESAW_TOUCH_CHANNEL_OFFSET)) {
+        // Dries out over a few days, with a little noise
+        uint32_t touch = 650 + (uint32_t) (150.0 * sin(2 * M_PI * days / 3.0)) + (VirtualClock::now() % 7);
+        value = touch << 16;
+    }
+
+    for(size_t i = 0; i < length; ++i) {
+        data[i] = (i < 4) ? (uint8_t) (value >> (24 - (8 * i))) : 0xFF;
+    }
+
+    return true;
+}
+
+
+SimI2CBus* SimI2CBus::sBuses[MAX_BUSES] = {};
+
+SimI2CBus::SimI2CBus(uint index, uint sdaPin, uint sclPin) :
+    mIndex(index),
+    mSDAPin(sdaPin),
+    mSCLPin(sclPin),
+    mInitialized(false),
+    mBaud(0),
+    mSDAHeld(false),
+    mClocksToRelease(0),
+    mNoisePerThousand(0),
+    mNoiseState(0x9E3779B97F4A7C15ull * (index + 1)),
+    mStats{}
+{
+    if(index < MAX_BUSES) {
+        sBuses[index] = this;
+    }
+}
+
+void SimI2CBus::addDevice(SimI2CDevice& device) {
+    mDevices.push_back(&device);
+}
+
+void SimI2CBus::holdSDA(uint32_t releaseAfterClocks) {
+    mSDAHeld = true;
+    mClocksToRelease = releaseAfterClocks;
+}
+
+void SimI2CBus::clearStuckSDA() {
+    mSDAHeld = false;
+    mClocksToRelease = 0;
+}
+
+SimI2CBus* SimI2CBus::getBus(uint index) {
+    return (index < MAX_BUSES) ? sBuses[index] : nullptr;
+}
+
+SimI2CBus* SimI2CBus::getBusForPin(uint pin) {
+    for(auto bus : sBuses) {
+        if(bus && ((bus->mSDAPin == pin) || (bus->mSCLPin == pin))) {
+            return bus;
+        }
+    }
+
+    return nullptr;
+}
+
+void SimI2CBus::init(uint baud) {
+    mInitialized = true;
+    setBaud(baud);
+}
+
+void SimI2CBus::deinit() {
+    mInitialized = false;
+}
+
+uint SimI2CBus::setBaud(uint baud) {
+    mBaud = baud;
+    if(baud > mStats.mMaxBaud) {
+        mStats.mMaxBaud = baud;
+    }
+
+    return baud;
+}
+
+int SimI2CBus::transfer(uint8_t address, uint8_t* data, size_t length, bool read, absolute_time_t until) {
+    if(!mInitialized) {
+        VirtualClock::stop("I2C%d used while it wasn't initialized", mIndex);
+    }
+
+    // The SDK turns zero length transfers away without touching the bus
+    if(!length) {
+        return 0;
+    }
+
+    ++mStats.mTransfers;
+
+    // Nothing gets onto a bus with SDA held low, not even a START
+    if(mSDAHeld) {
+        ++mStats.mTimeouts;
+        VirtualClock::waitUntil(until, false);
+        return PICO_ERROR_TIMEOUT;
+    }
+
+    SimI2CDevice* device = nullptr;
+    for(auto d : mDevices) {
+        if((d->getAddress() == address) && d->isConnected()) {
+            device = d;
+        }
+    }
+
+    if(!device) {
+        ++mStats.mNacks;
+        VirtualClock::waitUntil(VirtualClock::now() + transferTimeUS(1), false);
+        return PICO_ERROR_GENERIC;
+    }
+
+    if(noiseFails()) {
+        ++mStats.mNoiseFailures;
+        VirtualClock::waitUntil(VirtualClock::now() + transferTimeUS(1 + (length / 2)), false);
+        return PICO_ERROR_GENERIC;
+    }
+
+    uint64_t endUS = VirtualClock::now() + transferTimeUS(length + 1);
+    if(endUS > until) {
+        ++mStats.mTimeouts;
+        VirtualClock::waitUntil(until, false);
+        return PICO_ERROR_TIMEOUT;
+    }
+
+    VirtualClock::waitUntil(endUS, false);
+    if(!(read ? device->read(data, length) : device->write(data, length))) {
+        ++mStats.mNacks;
+        return PICO_ERROR_GENERIC;
+    }
+
+    return (int) length;
+}
+
+uint64_t SimI2CBus::transferTimeUS(size_t bytes) const {
+    // Eight bits and an ACK per byte
+    return ((bytes * 9 * 1000000ull) / (mBaud ? mBaud : 100000)) + 1;
+}
+
+bool SimI2CBus::noiseFails() {
+    if(!mNoisePerThousand) {
+        return false;
+    }
+
+    mNoiseState ^= mNoiseState << 13;
+    mNoiseState ^= mNoiseState >> 7;
+    mNoiseState ^= mNoiseState << 17;
+    return (mNoiseState % 1000) < mNoisePerThousand;
+}
+
+
+// GPIO. Only the I2C pins are wired to anything - open drain lines, pulled up unless a pin drives
+// them low or a device is holding SDA
+namespace {
+    constexpr uint NUM_GPIO = 30;
+
+    struct Pin {
+        enum gpio_function mFunction;
+        bool mOutput;
+        bool mValue;
+    };
+
+    Pin sPins[NUM_GPIO];
+
+    bool drivesLow(uint gpio) {
+        return (gpio < NUM_GPIO) && (sPins[gpio].mFunction == GPIO_FUNC_SIO) && sPins[gpio].mOutput && !sPins[gpio].mValue;
+    }
+}
+
+bool SimI2CBus::getLine(uint pin) const {
+    if(drivesLow(pin)) {
+        return false;
+    }
+
+    return (pin == mSDAPin) ? !mSDAHeld : true;
+}
+
+void SimI2CBus::onPinReleased(uint pin) {
+    // Each rising edge on SCL clocks another bit out of the device holding SDA
+    if((pin == mSCLPin) && mSDAHeld && mClocksToRelease && !--mClocksToRelease) {
+        mSDAHeld = false;
+        ++mStats.mClockedOut;
+    }
+}
+
+void gpio_init(uint gpio) {
+    if(gpio < NUM_GPIO) {
+        sPins[gpio] = {GPIO_FUNC_SIO, false, false};
+    }
+}
+
+void gpio_set_function(uint gpio, enum gpio_function fn) {
+    if(gpio < NUM_GPIO) {
+        bool wasLow = drivesLow(gpio);
+        sPins[gpio].mFunction = fn;
+
+        SimI2CBus* bus = SimI2CBus::getBusForPin(gpio);
+        if(bus && wasLow && !drivesLow(gpio)) {
+            bus->onPinReleased(gpio);
+        }
+    }
+}
+
+void gpio_set_dir(uint gpio, bool out) {
+    if(gpio < NUM_GPIO) {
+        bool wasLow = drivesLow(gpio);
+        sPins[gpio].mOutput = out;
+
+        SimI2CBus* bus = SimI2CBus::getBusForPin(gpio);
+        if(bus && wasLow && !drivesLow(gpio)) {
+            bus->onPinReleased(gpio);
+        }
+    }
+}
+
+void gpio_put(uint gpio, bool value) {
+    if(gpio < NUM_GPIO) {
+        bool wasLow = drivesLow(gpio);
+        sPins[gpio].mValue = value;
+
+        SimI2CBus* bus = SimI2CBus::getBusForPin(gpio);
+        if(bus && wasLow && !drivesLow(gpio)) {
+            bus->onPinReleased(gpio);
+        }
+    }
+}
+
+bool gpio_get(uint gpio) {
+    // Reading a pin takes a moment, so loops polling one until a timeout see the time pass
+    VirtualClock::waitUntil(VirtualClock::now() + 1, false);
+
+    SimI2CBus* bus = SimI2CBus::getBusForPin(gpio);
+    if(bus) {
+        return bus->getLine(gpio);
+    }
+
+    return !drivesLow(gpio);
+}
+
+void gpio_pull_up(uint gpio) {}
+void gpio_pull_down(uint gpio) {}
+void gpio_disable_pulls(uint gpio) {}
+
+
+// I2C controllers
+struct i2c_inst {
+    uint mIndex;
+};
+
+i2c_inst_t i2c0_inst = {0};
+i2c_inst_t i2c1_inst = {1};
+
+static SimI2CBus& busFor(i2c_inst_t* i2c) {
+    SimI2CBus* bus = SimI2CBus::getBus(i2c->mIndex);
+    if(!bus) {
+        VirtualClock::stop("I2C%d has nothing on it in the simulated hardware", i2c->mIndex);
+    }
+
+    return *bus;
+}
+
+uint i2c_init(i2c_inst_t* i2c, uint baudrate) {
+    busFor(i2c).init(baudrate);
+    return baudrate;
+}
+
+void i2c_deinit(i2c_inst_t* i2c) {
+    busFor(i2c).deinit();
+}
+
+uint i2c_set_baudrate(i2c_inst_t* i2c, uint baudrate) {
+    return busFor(i2c).setBaud(baudrate);
+}
+
+uint i2c_hw_index(i2c_inst_t* i2c) {
+    return i2c->mIndex;
+}
+
+int i2c_write_blocking_until(i2c_inst_t* i2c, uint8_t addr, const uint8_t* src, size_t len, bool nostop, absolute_time_t until) {
+    return busFor(i2c).transfer(addr, const_cast<uint8_t*>(src), len, false, until);
+}
+
+int i2c_read_blocking_until(i2c_inst_t* i2c, uint8_t addr, uint8_t* dst, size_t len, bool nostop, absolute_time_t until) {
+    return busFor(i2c).transfer(addr, dst, len, true, until);
+}
+
+int i2c_write_blocking(i2c_inst_t* i2c, uint8_t addr, const uint8_t* src, size_t len, bool nostop) {
+    return i2c_write_blocking_until(i2c, addr, src, len, nostop, at_the_end_of_time);
+}
+
+int i2c_read_blocking(i2c_inst_t* i2c, uint8_t addr, uint8_t* dst, size_t len, bool nostop) {
+    return i2c_read_blocking_until(i2c, addr, dst, len, nostop, at_the_end_of_time);
+}
@@ -0,0 +1,112 @@
+#ifndef _SIM_I2C_H_
+#define _SIM_I2C_H_
+
+#include "pico/types.h"
+
+#include <vector>
+
+using std::vector;
+
+
+// A device on a simulated bus. Unplugged devices don't ACK their address
+class SimI2CDevice {
+    public:
+        explicit SimI2CDevice(uint8_t address) : mAddress(address), mConnected(true) {}
+        virtual ~SimI2CDevice() {}
+
+        // False for a NACK
+        virtual bool write(const uint8_t* data, size_t length) = 0;
+        virtual bool read(uint8_t* data, size_t length) = 0;
+
+        uint8_t getAddress() const { return mAddress; }
+        bool isConnected() const { return mConnected; }
+        void setConnected(bool connected) { mConnected = connected; }
+
+    private:
+        uint8_t mAddress;
+        bool mConnected;
+};
+
+
+// An Adafruit Stemma soil probe, enough of the Seesaw protocol for StemmaSoilSensor. Readings
+// follow a daily cycle
+class SimSeesawProbe : public SimI2CDevice {
+    public:
+        explicit SimSeesawProbe(uint8_t address);
+
+        virtual bool write(const uint8_t* data, size_t length);
+        virtual bool read(uint8_t* data, size_t length);
+
+        uint32_t getResetCount() const { return mResetCount; }
+
+        static constexpr uint32_t RESET_TIME_US     = 5000;     // Doesn't answer while it restarts
+
+    private:
+        uint8_t mRegBase;
+        uint8_t mReg;
+        uint64_t mResetUntilUS;
+        uint32_t mResetCount;
+};
+
+
+// One of the RP2040's I2C controllers, its two GPIO and whatever is on the bus. Transfers take as
+// long as their bytes would at the bus clock rate.
+//
+// Faults are injected from here: a device can hold SDA low (as one stuck part way through a byte
+// does) until it's clocked out or indefinitely, and a noisy bus fails a share of transfers
+class SimI2CBus {
+    public:
+        SimI2CBus(uint index, uint sdaPin, uint sclPin);
+
+        void addDevice(SimI2CDevice& device);
+
+        // Released after the given number of clocks on SCL, never if 0 (it takes clearStuckSDA())
+        void holdSDA(uint32_t releaseAfterClocks);
+        void clearStuckSDA();
+        bool isSDAStuck() const { return mSDAHeld; }
+
+        // Chance in a thousand of each transfer failing
+        void setNoise(uint32_t failuresPerThousand) { mNoisePerThousand = failuresPerThousand; }
+
+        struct Stats {
+            uint32_t mTransfers;
+            uint32_t mNacks;
+            uint32_t mTimeouts;
+            uint32_t mNoiseFailures;
+            uint32_t mClockedOut;           // Times the firmware clocked a stuck device free
+            uint32_t mMaxBaud;
+        };
+        const Stats& getStats() const { return mStats; }
+
+        static SimI2CBus* getBus(uint index);
+        static SimI2CBus* getBusForPin(uint pin);
+
+        // For the SDK's i2c_ and gpio_ functions
+        void init(uint baud);
+        void deinit();
+        uint setBaud(uint baud);
+        int transfer(uint8_t address, uint8_t* data, size_t length, bool read, absolute_time_t until);
+        bool getLine(uint pin) const;
+        void onPinReleased(uint pin);
+
+    private:
+        uint64_t transferTimeUS(size_t bytes) const;
+        bool noiseFails();
+
+        static constexpr int MAX_BUSES      = 2;
+        static SimI2CBus* sBuses[MAX_BUSES];
+
+        uint mIndex;
+        uint mSDAPin;
+        uint mSCLPin;
+        vector<SimI2CDevice*> mDevices;
+        bool mInitialized;
+        uint mBaud;
+        bool mSDAHeld;
+        uint32_t mClocksToRelease;
+        uint32_t mNoisePerThousand;
+        uint64_t mNoiseState;
+        Stats mStats;
+};
+
+#endif      // _SIM_I2C_H_
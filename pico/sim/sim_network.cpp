@@ -0,0 +1,883 @@
+#include "sim_network.h"
+#include "sim_sdk.h"
+#include "virtual_clock.h"
+
+#include "pico/cyw43_arch.h"
+#include "lwip/apps/mqtt.h"
+#include "lwip/dhcp.h"
+#include "lwip/dns.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+
+cyw43_t cyw43_state;
+
+constexpr uint8_t AP_BSSID[6]                   = {0x02, 0x5E, 0x00, 0x00, 0x00, 0x01};
+constexpr int MAX_MQTT_CLIENTS                  = 4;        // As many as fit in lwIP's heap
+constexpr uint64_t LOCK_RETRY_US                = 10;
+constexpr uint64_t RETRANSMIT_US                = 1000000;
+constexpr uint64_t DNS_FAIL_TIME_US             = 10000000;
+constexpr uint64_t MQTT_CYCLIC_TIMER_US         = 1000000;
+constexpr size_t MQTT_FIXED_HEADER_SIZE         = 2;
+
+// The broker's connection as lwIP's MQTT client holds it
+struct mqtt_client_s {
+    enum State {
+        STATE_IDLE,
+        STATE_CONNECTING,
+        STATE_CONNECTED
+    };
+
+    struct Request {
+        bool mInUse;
+        uint16_t mPacketId;                 // 0 for QoS 0 publishes, which complete once TCP has sent them
+        mqtt_request_cb_t mCallback;
+        void* mArg;
+        uint64_t mDeadlineUS;
+    };
+
+    bool mInUse;
+    uint32_t mGeneration;                   // Bumped when a connection ends, so whatever was still on the way is dropped
+    State mState;
+    mqtt_connection_cb_t mConnectCallback;
+    void* mConnectArg;
+    mqtt_incoming_publish_cb_t mPublishCallback;
+    mqtt_incoming_data_cb_t mDataCallback;
+    void* mIncomingArg;
+    uint16_t mKeepAliveS;
+    uint64_t mLastHeardUS;                  // lwIP's server watchdog, reset by anything from the broker
+    uint64_t mLastPingUS;
+    size_t mUnackedBytes;
+    uint16_t mNextPacketId;
+    Request mRequests[MQTT_REQ_MAX_IN_FLIGHT];
+    vector<string> mSubscriptions;          // The broker's side of the session
+};
+
+namespace {
+    SimNetwork::Stats sStats = {};
+    SimNetwork::PublishObserver sPublishObserver = nullptr;
+
+    string sSSID;
+    string sPassword;
+    string sBrokerHost;
+    bool sAccessPointUp = true;
+    SimNetwork::BrokerState sBrokerState = SimNetwork::BROKER_UP;
+
+    bool sChipUp = false;
+    bool sSTAEnabled = false;
+    int sJoinState = CYW43_LINK_DOWN;       // What cyw43_wifi_link_status() reports
+    uint32_t sLinkGeneration = 0;           // Bumped by every join and leave
+    bool sDHCPRunning = false;
+    int sLwIPLockDepth = 0;
+    async_context_t sCyw43Context;
+
+    struct DNSEntry {
+        uint32_t mAddress;
+        uint64_t mExpiresUS;
+    };
+    std::map<string, DNSEntry> sDNSCache;
+
+    mqtt_client_t sClients[MAX_MQTT_CLIENTS];
+    bool sCyclicTimerRunning = false;
+
+    ip4_addr_t makeAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) {
+        ip4_addr_t address;
+        IP4_ADDR(&address, a, b, c, d);
+        return address;
+    }
+
+    const ip4_addr_t DHCP_ADDRESS   = makeAddress(192, 168, 4, 50);
+    const ip4_addr_t DHCP_NETMASK   = makeAddress(255, 255, 255, 0);
+    const ip4_addr_t DHCP_GATEWAY   = makeAddress(192, 168, 4, 1);
+    const ip4_addr_t BROKER_ADDRESS = makeAddress(192, 168, 4, 10);
+
+    struct netif& sta() {
+        return cyw43_state.netif[CYW43_ITF_STA];
+    }
+
+    bool isLinked() {
+        return sta().flags & NETIF_FLAG_LINK_UP;
+    }
+
+    // Packets get between the firmware and the broker's host
+    bool isReachable() {
+        return sAccessPointUp && isLinked() && (sta().ip_addr.addr != 0);
+    }
+
+    void requireLock(const char* function) {
+        if(VirtualClock::getCoreNum() != 0) {
+            VirtualClock::stop("%s called from core1", function);
+        }
+        if(!sLwIPLockDepth && !VirtualClock::inEvent()) {
+            VirtualClock::stop("%s called without the lwIP lock", function);
+        }
+    }
+
+    // Anything which may call back into the firmware waits for it to let go of the lwIP lock
+    void deliver(uint64_t delayUS, VirtualClock::Event event) {
+        VirtualClock::scheduleIn(delayUS, [event = std::move(event)]() mutable {
+            if(sLwIPLockDepth) {
+                deliver(LOCK_RETRY_US, std::move(event));
+            } else {
+                event();
+            }
+        });
+    }
+
+
+    // Wi-Fi
+    void setAddress(const ip4_addr_t& ipAddress, const ip4_addr_t& netmask, const ip4_addr_t& gateway) {
+        bool changed = (sta().ip_addr.addr != ipAddress.addr);
+        sta().ip_addr = ipAddress;
+        sta().netmask = netmask;
+        sta().gw = gateway;
+
+        if(changed && netif_is_up(&sta()) && sta().status_callback) {
+            sta().status_callback(&sta());
+        }
+    }
+
+    void setLinkDown() {
+        sDHCPRunning = false;
+
+        if(isLinked()) {
+            sta().flags &= ~NETIF_FLAG_LINK_UP;
+            ++sStats.mWiFiLinksLost;
+            if(sta().link_callback) {
+                sta().link_callback(&sta());
+            }
+        }
+    }
+
+    void setLinkUp(uint32_t generation) {
+        sJoinState = CYW43_LINK_JOIN;
+        sta().flags |= NETIF_FLAG_LINK_UP;
+        ++sStats.mWiFiLinksUp;
+        if(sta().link_callback) {
+            sta().link_callback(&sta());
+        }
+
+        // The driver (re)starts DHCP on every link up. Its lease is always the same address
+        sDHCPRunning = true;
+        deliver(SimNetwork::DHCP_TIME_US, [generation]() {
+            if((generation == sLinkGeneration) && sDHCPRunning && isLinked()) {
+                setAddress(DHCP_ADDRESS, DHCP_NETMASK, DHCP_GATEWAY);
+            }
+        });
+    }
+
+    int startJoin(bool accepted, uint64_t joinTimeUS) {
+        if(!sChipUp || !sSTAEnabled) {
+            return PICO_ERROR_GENERIC;
+        }
+
+        ++sStats.mWiFiJoins;
+        setLinkDown();
+
+        uint32_t generation = ++sLinkGeneration;
+        sJoinState = CYW43_LINK_JOIN;
+
+        if(accepted && sAccessPointUp) {
+            deliver(joinTimeUS, [generation]() {
+                if(generation != sLinkGeneration) {
+                    return;
+                }
+
+                if(sAccessPointUp) {
+                    setLinkUp(generation);
+                } else {
+                    sJoinState = CYW43_LINK_NONET;
+                }
+            });
+        } else {
+            int result = sAccessPointUp ? CYW43_LINK_BADAUTH : CYW43_LINK_NONET;
+            deliver(SimNetwork::JOIN_FAIL_TIME_US, [generation, result]() {
+                if(generation == sLinkGeneration) {
+                    sJoinState = result;
+                }
+            });
+        }
+
+        return 0;
+    }
+
+    void leave() {
+        ++sLinkGeneration;
+        setLinkDown();
+        sJoinState = CYW43_LINK_DOWN;
+    }
+
+
+    // MQTT
+    void wipeClient(mqtt_client_t* client) {
+        bool inUse = client->mInUse;
+        uint32_t generation = client->mGeneration;
+
+        *client = mqtt_client_t{};
+        client->mInUse = inUse;
+        client->mGeneration = generation + 1;
+    }
+
+    // Connections are closed without calling back any of their requests, as lwIP's mqtt_close() does
+    void endConnection(mqtt_client_t* client) {
+        client->mState = mqtt_client_t::STATE_IDLE;
+        ++client->mGeneration;
+        client->mUnackedBytes = 0;
+        client->mSubscriptions.clear();
+        for(auto& r : client->mRequests) {
+            r.mInUse = false;
+        }
+    }
+
+    void closeConnection(mqtt_client_t* client, mqtt_connection_status_t status) {
+        if(client->mState == mqtt_client_t::STATE_IDLE) {
+            return;
+        }
+
+        endConnection(client);
+        if(client->mConnectCallback) {
+            client->mConnectCallback(client, client->mConnectArg, status);
+        }
+    }
+
+    mqtt_client_t::Request* allocateRequest(mqtt_client_t* client, uint16_t packetId, mqtt_request_cb_t callback, void* arg) {
+        for(auto& r : client->mRequests) {
+            if(!r.mInUse) {
+                r = {true, packetId, callback, arg, VirtualClock::now() + (MQTT_REQ_TIMEOUT * 1000000ull)};
+                return &r;
+            }
+        }
+
+        return nullptr;
+    }
+
+    void completeRequest(mqtt_client_t* client, uint16_t packetId, err_t err) {
+        for(auto& r : client->mRequests) {
+            if(r.mInUse && (r.mPacketId == packetId)) {
+                r.mInUse = false;
+                if(r.mCallback) {
+                    r.mCallback(r.mArg, err);
+                }
+                return;
+            }
+        }
+    }
+
+    uint16_t nextPacketId(mqtt_client_t* client) {
+        if(++client->mNextPacketId == 0) {
+            client->mNextPacketId = 1;
+        }
+
+        return client->mNextPacketId;
+    }
+
+    // Whatever TCP hasn't had acknowledged yet fills its send buffer first, then lwIP's ring buffer
+    bool hasOutputSpace(mqtt_client_t* client, size_t bytes) {
+        size_t capacity = TCP_SND_BUF + MQTT_OUTPUT_RINGBUF_SIZE;
+        return (client->mUnackedBytes + bytes) <= capacity;
+    }
+
+    void onAcked(mqtt_client_t* client, size_t bytes) {
+        client->mUnackedBytes = (bytes < client->mUnackedBytes) ? (client->mUnackedBytes - bytes) : 0;
+        client->mLastHeardUS = VirtualClock::now();
+
+        // As in lwIP's mqtt_tcp_sent_cb(), any ACK completes every QoS 0 publish waiting on one
+        for(auto& r : client->mRequests) {
+            if(r.mInUse && (r.mPacketId == 0)) {
+                r.mInUse = false;
+                if(r.mCallback) {
+                    r.mCallback(r.mArg, ERR_OK);
+                }
+            }
+        }
+    }
+
+    // Sends a packet to the broker. TCP keeps retransmitting while it can't get there, and the broker
+    // only acts on it if it's up. The ACK comes back a round trip after it gets through
+    void transmit(mqtt_client_t* client, size_t bytes, std::function<void()> atBroker, uint64_t delayUS = SimNetwork::ONE_WAY_LATENCY_US) {
+        uint32_t generation = client->mGeneration;
+        client->mUnackedBytes += bytes;
+
+        deliver(delayUS, [=]() {
+            if(client->mGeneration != generation) {
+                return;
+            }
+
+            if(!isReachable()) {
+                client->mUnackedBytes -= bytes;
+                transmit(client, bytes, atBroker, RETRANSMIT_US);
+                return;
+            }
+
+            if(sBrokerState == SimNetwork::BROKER_DOWN) {
+                // Nothing is listening any more, so the broker's host answers with a reset
+                deliver(SimNetwork::ONE_WAY_LATENCY_US, [=]() {
+                    if(client->mGeneration == generation) {
+                        ++sStats.mConnectionsLost;
+                        closeConnection(client, MQTT_CONNECT_DISCONNECTED);
+                    }
+                });
+                return;
+            }
+
+            deliver(SimNetwork::ONE_WAY_LATENCY_US, [=]() {
+                if(client->mGeneration == generation) {
+                    onAcked(client, bytes);
+                }
+            });
+
+            if((sBrokerState == SimNetwork::BROKER_UP) && atBroker) {
+                atBroker();
+            }
+        });
+    }
+
+    // A reply from the broker, lost if the network went away in the meantime
+    void reply(mqtt_client_t* client, std::function<void()> atClient) {
+        uint32_t generation = client->mGeneration;
+
+        deliver(SimNetwork::ONE_WAY_LATENCY_US, [=]() {
+            if((client->mGeneration == generation) && isReachable()) {
+                client->mLastHeardUS = VirtualClock::now();
+                atClient();
+            }
+        });
+    }
+
+    bool topicMatches(const string& filter, const char* topic) {
+        size_t f = 0;
+        const char* t = topic;
+
+        while(f < filter.size()) {
+            if(filter[f] == '#') {
+                return true;
+            }
+
+            if(filter[f] == '+') {
+                while(*t && (*t != '/')) {
+                    ++t;
+                }
+                ++f;
+                continue;
+            }
+
+            if(filter[f] != *t) {
+                return false;
+            }
+            ++f;
+            ++t;
+        }
+
+        return (*t == '\0');
+    }
+
+    // lwIP's mqtt_cyclic_timer(), for every client at once
+    void cyclicTimer() {
+        uint64_t now = VirtualClock::now();
+
+        for(auto& client : sClients) {
+            if(!client.mInUse || (client.mState == mqtt_client_t::STATE_IDLE)) {
+                continue;
+            }
+
+            for(auto& r : client.mRequests) {
+                if(r.mInUse && (r.mDeadlineUS <= now)) {
+                    ++sStats.mRequestTimeouts;
+                    r.mInUse = false;
+                    if(r.mCallback) {
+                        r.mCallback(r.mArg, ERR_TIMEOUT);
+                    }
+                }
+            }
+
+            if((client.mState != mqtt_client_t::STATE_CONNECTED) || !client.mKeepAliveS) {
+                continue;
+            }
+
+            uint64_t keepAliveUS = client.mKeepAliveS * 1000000ull;
+            if((now - client.mLastHeardUS) >= (keepAliveUS + (keepAliveUS / 2))) {
+                ++sStats.mConnectionsLost;
+                closeConnection(&client, MQTT_CONNECT_TIMEOUT);
+                continue;
+            }
+
+            uint64_t lastActivityUS = (client.mLastPingUS > client.mLastHeardUS) ? client.mLastPingUS : client.mLastHeardUS;
+            if((now - lastActivityUS) >= keepAliveUS) {
+                mqtt_client_t* c = &client;
+                client.mLastPingUS = now;
+                transmit(c, MQTT_FIXED_HEADER_SIZE, [c]() {
+                    reply(c, []() {});
+                });
+            }
+        }
+
+        deliver(MQTT_CYCLIC_TIMER_US, cyclicTimer);
+    }
+}
+
+
+// Harness side
+void SimNetwork::setPublishObserver(PublishObserver observer) {
+    sPublishObserver = observer;
+}
+
+const SimNetwork::Stats& SimNetwork::getStats() {
+    return sStats;
+}
+
+void SimNetwork::configure(const char* ssid, const char* password, const char* brokerHost) {
+    sSSID = ssid;
+    sPassword = password;
+    sBrokerHost = brokerHost;
+}
+
+void SimNetwork::setAccessPointUp(bool up) {
+    sAccessPointUp = up;
+
+    // The link goes once the driver misses enough beacons
+    if(!up) {
+        uint32_t generation = sLinkGeneration;
+        deliver(BEACON_LOSS_TIME_US, [generation]() {
+            if((generation == sLinkGeneration) && !sAccessPointUp && isLinked()) {
+                leave();
+            }
+        });
+    }
+}
+
+void SimNetwork::setBrokerState(BrokerState state) {
+    sBrokerState = state;
+
+    if(state != BROKER_DOWN) {
+        return;
+    }
+
+    // The broker's connections are closed as it goes, if the device can hear about it
+    for(auto& client : sClients) {
+        if(!client.mInUse || (client.mState == mqtt_client_t::STATE_IDLE)) {
+            continue;
+        }
+
+        mqtt_client_t* c = &client;
+        uint32_t generation = c->mGeneration;
+        deliver(ONE_WAY_LATENCY_US, [c, generation]() {
+            if((c->mGeneration == generation) && isReachable()) {
+                ++sStats.mConnectionsLost;
+                closeConnection(c, MQTT_CONNECT_DISCONNECTED);
+            }
+        });
+    }
+}
+
+void SimNetwork::sendToDevice(const char* topic, const char* payload) {
+    if(sBrokerState != BROKER_UP) {
+        return;
+    }
+
+    for(auto& client : sClients) {
+        if(!client.mInUse || (client.mState != mqtt_client_t::STATE_CONNECTED)) {
+            continue;
+        }
+
+        bool subscribed = false;
+        for(auto& s : client.mSubscriptions) {
+            subscribed = subscribed || topicMatches(s, topic);
+        }
+        if(!subscribed) {
+            continue;
+        }
+
+        mqtt_client_t* c = &client;
+        string t = topic;
+        string p = payload;
+        reply(c, [c, t, p]() {
+            // Counted as soon as it reaches lwIP, whatever the firmware then does with it
+            ++sStats.mControlDelivered;
+
+            if(c->mPublishCallback) {
+                c->mPublishCallback(c->mIncomingArg, t.c_str(), p.size());
+            }
+            if(c->mDataCallback) {
+                c->mDataCallback(c->mIncomingArg, (const u8_t*) p.data(), p.size(), MQTT_DATA_FLAG_LAST);
+            }
+        });
+    }
+}
+
+bool SimSDK::isLwIPLocked() {
+    return sLwIPLockDepth > 0;
+}
+
+
+// cyw43 driver and architecture
+int cyw43_arch_init_with_country(uint32_t country) {
+    sChipUp = true;
+    sJoinState = CYW43_LINK_DOWN;
+    return 0;
+}
+
+void cyw43_arch_deinit(void) {
+    if(sSTAEnabled) {
+        cyw43_arch_disable_sta_mode();
+    }
+
+    sChipUp = false;
+}
+
+void cyw43_arch_enable_sta_mode(void) {
+    // The STA interface is added afresh, without any of the callbacks
+    sta() = {};
+    sta().flags = NETIF_FLAG_UP;
+    sSTAEnabled = true;
+}
+
+void cyw43_arch_disable_sta_mode(void) {
+    leave();
+    sta().flags = 0;
+    sSTAEnabled = false;
+}
+
+async_context_t* cyw43_arch_async_context(void) {
+    return sChipUp ? &sCyw43Context : nullptr;
+}
+
+void cyw43_arch_lwip_begin(void) {
+    if(VirtualClock::inEvent()) {
+        VirtualClock::stop("The lwIP lock was taken from an interrupt");
+    }
+
+    ++sLwIPLockDepth;
+}
+
+void cyw43_arch_lwip_end(void) {
+    if(!sLwIPLockDepth) {
+        VirtualClock::stop("The lwIP lock was released without being held");
+    }
+
+    --sLwIPLockDepth;
+}
+
+int cyw43_arch_wifi_connect_async(const char* ssid, const char* pw, uint32_t auth) {
+    return startJoin((sSSID == ssid) && (sPassword == pw), SimNetwork::SCAN_JOIN_TIME_US);
+}
+
+void cyw43_arch_gpio_put(uint wl_gpio, bool value) {}
+
+int cyw43_wifi_join(cyw43_t* self, size_t ssid_len, const uint8_t* ssid, size_t key_len, const uint8_t* key,
+                    uint32_t auth_type, const uint8_t* bssid, uint32_t channel) {
+    bool accepted =
+        (sSSID == string((const char*) ssid, ssid_len)) &&
+        (sPassword == string((const char*) key, key_len)) &&
+        (!bssid || !memcmp(bssid, AP_BSSID, sizeof(AP_BSSID))) &&
+        (!channel || (channel == SimNetwork::AP_CHANNEL));
+
+    return startJoin(accepted, SimNetwork::FAST_JOIN_TIME_US);
+}
+
+int cyw43_wifi_leave(cyw43_t* self, int itf) {
+    leave();
+    return 0;
+}
+
+int cyw43_wifi_link_status(cyw43_t* self, int itf) {
+    return sJoinState;
+}
+
+int cyw43_tcpip_link_status(cyw43_t* self, int itf) {
+    struct netif& n = self->netif[itf];
+    if((n.flags & (NETIF_FLAG_UP | NETIF_FLAG_LINK_UP)) == (NETIF_FLAG_UP | NETIF_FLAG_LINK_UP)) {
+        return n.ip_addr.addr ? CYW43_LINK_UP : CYW43_LINK_NOIP;
+    }
+
+    return cyw43_wifi_link_status(self, itf);
+}
+
+int cyw43_wifi_get_bssid(cyw43_t* self, uint8_t bssid[6]) {
+    if(!isLinked()) {
+        return PICO_ERROR_GENERIC;
+    }
+
+    memcpy(bssid, AP_BSSID, sizeof(AP_BSSID));
+    return 0;
+}
+
+int cyw43_ioctl(cyw43_t* self, uint32_t cmd, size_t len, uint8_t* buf, uint32_t iface) {
+    if((cmd != CYW43_IOCTL_GET_CHANNEL) || (len < sizeof(uint32_t))) {
+        return PICO_ERROR_GENERIC;
+    }
+
+    uint32_t channel = SimNetwork::AP_CHANNEL;
+    memcpy(buf, &channel, sizeof(channel));
+    return 0;
+}
+
+
+// lwIP
+void netif_set_addr(struct netif* netif, const ip4_addr_t* ipaddr, const ip4_addr_t* netmask, const ip4_addr_t* gw) {
+    requireLock("netif_set_addr");
+    setAddress(*ipaddr, *netmask, *gw);
+}
+
+void netif_set_status_callback(struct netif* netif, netif_status_callback_fn status_callback) {
+    netif->status_callback = status_callback;
+}
+
+void netif_set_link_callback(struct netif* netif, netif_status_callback_fn link_callback) {
+    netif->link_callback = link_callback;
+}
+
+err_t dhcp_start(struct netif* netif) {
+    sDHCPRunning = true;
+    return ERR_OK;
+}
+
+void dhcp_stop(struct netif* netif) {
+    sDHCPRunning = false;
+}
+
+void dns_setserver(u8_t numdns, const ip_addr_t* dnsserver) {}
+
+err_t dns_gethostbyname(const char* hostname, ip_addr_t* addr, dns_found_callback found, void* callback_arg) {
+    requireLock("dns_gethostbyname");
+
+    if(ip4addr_aton(hostname, addr)) {
+        return ERR_OK;
+    }
+
+    auto entry = sDNSCache.find(hostname);
+    if((entry != sDNSCache.end()) && (VirtualClock::now() < entry->second.mExpiresUS)) {
+        addr->addr = entry->second.mAddress;
+        return ERR_OK;
+    }
+
+    ++sStats.mDNSLookups;
+    string name = hostname;
+
+    if(!isReachable()) {
+        // lwIP retries a few times before giving up
+        deliver(DNS_FAIL_TIME_US, [name, found, callback_arg]() {
+            found(name.c_str(), nullptr, callback_arg);
+        });
+        return ERR_INPROGRESS;
+    }
+
+    deliver(2 * SimNetwork::ONE_WAY_LATENCY_US, [name, found, callback_arg]() {
+        if(name != sBrokerHost) {
+            found(name.c_str(), nullptr, callback_arg);
+            return;
+        }
+
+        sDNSCache[name] = {BROKER_ADDRESS.addr, VirtualClock::now() + SimNetwork::DNS_TTL_US};
+        found(name.c_str(), &BROKER_ADDRESS, callback_arg);
+    });
+    return ERR_INPROGRESS;
+}
+
+int ip4addr_aton(const char* cp, ip4_addr_t* addr) {
+    unsigned int a, b, c, d;
+    char extra;
+
+    if(!cp || (sscanf(cp, "%u.%u.%u.%u%c", &a, &b, &c, &d, &extra) != 4) || (a > 255) || (b > 255) || (c > 255) || (d > 255)) {
+        return 0;
+    }
+
+    if(addr) {
+        IP4_ADDR(addr, a, b, c, d);
+    }
+    return 1;
+}
+
+char* ip4addr_ntoa(const ip4_addr_t* addr) {
+    static char buffer[16];
+    uint32_t a = addr->addr;
+    snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u", a & 0xFF, (a >> 8) & 0xFF, (a >> 16) & 0xFF, (a >> 24) & 0xFF);
+    return buffer;
+}
+
+
+// lwIP's MQTT client
+mqtt_client_t* mqtt_client_new(void) {
+    for(auto& client : sClients) {
+        if(client.mInUse) {
+            continue;
+        }
+
+        wipeClient(&client);
+        client.mInUse = true;
+
+        if(++sStats.mClientsInUse > sStats.mMaxClientsInUse) {
+            sStats.mMaxClientsInUse = sStats.mClientsInUse;
+        }
+
+        if(!sCyclicTimerRunning) {
+            sCyclicTimerRunning = true;
+            deliver(MQTT_CYCLIC_TIMER_US, cyclicTimer);
+        }
+        return &client;
+    }
+
+    return nullptr;
+}
+
+void mqtt_client_free(mqtt_client_t* client) {
+    // lwIP would go on using the memory for the connection
+    if(client->mState != mqtt_client_t::STATE_IDLE) {
+        VirtualClock::stop("MQTT client freed with its connection still open");
+    }
+
+    client->mInUse = false;
+    ++client->mGeneration;
+    --sStats.mClientsInUse;
+}
+
+err_t mqtt_client_connect(mqtt_client_t* client, const ip_addr_t* ipaddr, u16_t port, mqtt_connection_cb_t cb, void* arg,
+                          const struct mqtt_connect_client_info_t* client_info) {
+    requireLock("mqtt_client_connect");
+
+    if(client->mState != mqtt_client_t::STATE_IDLE) {
+        return ERR_ISCONN;
+    }
+
+    // lwIP wipes the whole client, so incoming publish callbacks set before this are lost
+    wipeClient(client);
+    client->mConnectCallback = cb;
+    client->mConnectArg = arg;
+    client->mKeepAliveS = client_info->keep_alive;
+
+    if(!isLinked() || !sta().ip_addr.addr) {
+        return ERR_RTE;
+    }
+
+    client->mState = mqtt_client_t::STATE_CONNECTING;
+    client->mLastHeardUS = VirtualClock::now();
+    uint32_t generation = client->mGeneration;
+    bool knownAddress = (ipaddr->addr == BROKER_ADDRESS.addr) && (port == MQTT_PORT);
+
+    // SYN and SYN-ACK, then CONNECT and CONNACK. A lost SYN is retried by TCP for longer than the
+    // firmware waits, so it never comes back
+    deliver(SimNetwork::ONE_WAY_LATENCY_US, [client, generation, knownAddress]() {
+        if((client->mGeneration != generation) || !isReachable() || !knownAddress) {
+            return;
+        }
+
+        if(sBrokerState == SimNetwork::BROKER_DOWN) {
+            ++sStats.mBrokerRefused;
+            reply(client, [client]() {
+                closeConnection(client, MQTT_CONNECT_DISCONNECTED);
+            });
+            return;
+        }
+
+        deliver(2 * SimNetwork::ONE_WAY_LATENCY_US, [client, generation]() {
+            if((client->mGeneration != generation) || !isReachable() || (sBrokerState != SimNetwork::BROKER_UP)) {
+                return;
+            }
+
+            ++sStats.mBrokerConnects;
+            reply(client, [client]() {
+                client->mState = mqtt_client_t::STATE_CONNECTED;
+                if(client->mConnectCallback) {
+                    client->mConnectCallback(client, client->mConnectArg, MQTT_CONNECT_ACCEPTED);
+                }
+            });
+        });
+    });
+
+    return ERR_OK;
+}
+
+void mqtt_disconnect(mqtt_client_t* client) {
+    if(client && (client->mState != mqtt_client_t::STATE_IDLE)) {
+        endConnection(client);
+    }
+}
+
+u8_t mqtt_client_is_connected(mqtt_client_t* client) {
+    return client && (client->mState == mqtt_client_t::STATE_CONNECTED);
+}
+
+void mqtt_set_inpub_callback(mqtt_client_t* client, mqtt_incoming_publish_cb_t pub_cb, mqtt_incoming_data_cb_t data_cb, void* arg) {
+    client->mPublishCallback = pub_cb;
+    client->mDataCallback = data_cb;
+    client->mIncomingArg = arg;
+}
+
+err_t mqtt_sub_unsub(mqtt_client_t* client, const char* topic, u8_t qos, mqtt_request_cb_t cb, void* arg, u8_t sub) {
+    requireLock("mqtt_sub_unsub");
+
+    if(client->mState != mqtt_client_t::STATE_CONNECTED) {
+        return ERR_CONN;
+    }
+
+    size_t bytes = MQTT_FIXED_HEADER_SIZE + 2 + 2 + strlen(topic) + (sub ? 1 : 0);
+    if(!hasOutputSpace(client, bytes)) {
+        return ERR_MEM;
+    }
+
+    mqtt_client_t::Request* request = allocateRequest(client, nextPacketId(client), cb, arg);
+    if(!request) {
+        return ERR_MEM;
+    }
+
+    uint16_t packetId = request->mPacketId;
+    string t = topic;
+    transmit(client, bytes, [client, packetId, t, sub]() {
+        auto& subscriptions = client->mSubscriptions;
+        subscriptions.erase(std::remove(subscriptions.begin(), subscriptions.end(), t), subscriptions.end());
+        if(sub) {
+            subscriptions.push_back(t);
+        }
+
+        reply(client, [client, packetId]() {
+            completeRequest(client, packetId, ERR_OK);
+        });
+    });
+
+    return ERR_OK;
+}
+
+err_t mqtt_publish(mqtt_client_t* client, const char* topic, const void* payload, u16_t payload_length, u8_t qos, u8_t retain,
+                   mqtt_request_cb_t cb, void* arg) {
+    requireLock("mqtt_publish");
+
+    if(client->mState != mqtt_client_t::STATE_CONNECTED) {
+        return ERR_CONN;
+    }
+
+    size_t bytes = MQTT_FIXED_HEADER_SIZE + 2 + strlen(topic) + (qos ? 2 : 0) + payload_length;
+    if(!hasOutputSpace(client, bytes)) {
+        ++sStats.mOutputFull;
+        return ERR_MEM;
+    }
+
+    mqtt_client_t::Request* request = allocateRequest(client, qos ? nextPacketId(client) : 0, cb, arg);
+    if(!request) {
+        return ERR_MEM;
+    }
+
+    uint16_t packetId = request->mPacketId;
+    string t = topic;
+    vector<uint8_t> p((const uint8_t*) payload, (const uint8_t*) payload + payload_length);
+    transmit(client, bytes, [client, packetId, t, p, qos, retain]() {
+        ++sStats.mPublishesReceived;
+        if(sPublishObserver) {
+            sPublishObserver({t.c_str(), p.data(), p.size(), qos, retain != 0});
+        }
+
+        if(qos) {
+            reply(client, [client, packetId]() {
+                completeRequest(client, packetId, ERR_OK);
+            });
+        }
+    });
+
+    return ERR_OK;
+}
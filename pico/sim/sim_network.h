@@ -0,0 +1,70 @@
+#ifndef _SIM_NETWORK_H_
+#define _SIM_NETWORK_H_
+
+#include <cstddef>
+#include <cstdint>
+
+
+// The access point, the broker and the network between them and the firmware, seen through the
+// cyw43 driver and lwIP calls the firmware makes. Timings are round numbers in the right ballpark,
+// what matters is that things arrive late, out of step with the firmware and sometimes not at all.
+//
+// As with lwIP on the Pico W, callbacks come in as interrupts on core0, except while the firmware
+// holds the lwIP lock
+class SimNetwork {
+    public:
+        enum BrokerState {
+            BROKER_UP,
+            BROKER_DOWN,            // Closes its connections and refuses new ones
+            BROKER_STALLED          // TCP still works, but MQTT packets go unanswered
+        };
+
+        struct Publish {
+            const char* mTopic;
+            const uint8_t* mPayload;
+            size_t mLength;
+            uint8_t mQoS;
+            bool mRetain;
+        };
+        typedef void (*PublishObserver)(const Publish& publish);
+
+        struct Stats {
+            uint32_t mWiFiJoins;
+            uint32_t mWiFiLinksUp;
+            uint32_t mWiFiLinksLost;
+            uint32_t mDNSLookups;
+            uint32_t mBrokerConnects;           // Accepted
+            uint32_t mBrokerRefused;
+            uint32_t mConnectionsLost;          // Closed by the broker or lwIP's keep alive
+            uint32_t mPublishesReceived;
+            uint32_t mRequestTimeouts;
+            uint32_t mOutputFull;               // mqtt_publish() turned away for lack of buffer
+            uint32_t mControlDelivered;
+            uint32_t mClientsInUse;
+            uint32_t mMaxClientsInUse;
+        };
+
+        // What the access point and broker expect, the broker's address comes from DNS
+        static void configure(const char* ssid, const char* password, const char* brokerHost);
+
+        static void setAccessPointUp(bool up);
+        static void setBrokerState(BrokerState state);
+
+        // A publish from another client to a topic the device may be subscribed to. Counted as
+        // delivered once it reaches lwIP, so callbacks the firmware lost still show up as missing
+        static void sendToDevice(const char* topic, const char* payload);
+
+        static void setPublishObserver(PublishObserver observer);
+        static const Stats& getStats();
+
+        static constexpr uint64_t ONE_WAY_LATENCY_US    = 5000;
+        static constexpr uint64_t SCAN_JOIN_TIME_US     = 2500000;
+        static constexpr uint64_t FAST_JOIN_TIME_US     = 300000;
+        static constexpr uint64_t JOIN_FAIL_TIME_US     = 4000000;
+        static constexpr uint64_t DHCP_TIME_US          = 500000;
+        static constexpr uint64_t BEACON_LOSS_TIME_US   = 1000000;   // Before the link goes down with the AP
+        static constexpr uint64_t DNS_TTL_US            = 300000000;
+        static constexpr uint8_t AP_CHANNEL             = 6;
+};
+
+#endif      // _SIM_NETWORK_H_
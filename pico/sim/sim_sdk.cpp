@@ -0,0 +1,472 @@
+#include "sim_sdk.h"
+#include "virtual_clock.h"
+
+#include "pico/time.h"
+#include "pico/sync.h"
+#include "pico/stdio.h"
+#include "pico/multicore.h"
+#include "pico/rand.h"
+#include "pico/async_context_poll.h"
+#include "hardware/uart.h"
+#include "hardware/flash.h"
+#include "hardware/watchdog.h"
+#include "hardware/structs/systick.h"
+
+#include <cstdarg>
+#include <cstring>
+#include <random>
+
+
+// Time
+absolute_time_t get_absolute_time() {
+    return VirtualClock::now();
+}
+
+uint32_t time_us_32() {
+    return (uint32_t) VirtualClock::now();
+}
+
+uint64_t time_us_64() {
+    return VirtualClock::now();
+}
+
+// The SDK's sleeps wait for events between alarms, but only return once the time is up
+void sleep_until(absolute_time_t target) {
+    VirtualClock::waitUntil(target, false);
+}
+
+void sleep_us(uint64_t us) {
+    sleep_until(delayed_by_us(get_absolute_time(), us));
+}
+
+void sleep_ms(uint32_t ms) {
+    sleep_until(delayed_by_ms(get_absolute_time(), ms));
+}
+
+bool best_effort_wfe_or_timeout(absolute_time_t timeout_timestamp) {
+    return VirtualClock::waitUntil(timeout_timestamp, true);
+}
+
+void busy_wait_us_32(uint32_t delay_us) {
+    VirtualClock::waitUntil(VirtualClock::now() + delay_us, false);
+}
+
+void busy_wait_us(uint64_t delay_us) {
+    VirtualClock::waitUntil(VirtualClock::now() + delay_us, false);
+}
+
+void busy_wait_ms(uint32_t delay_ms) {
+    busy_wait_us(delay_ms * 1000ull);
+}
+
+void tight_loop_contents() {
+    VirtualClock::waitUntil(VirtualClock::now() + 1, false);
+}
+
+uint32_t get_core_num() {
+    return VirtualClock::getCoreNum();
+}
+
+void panic(const char* format, ...) {
+    char message[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+
+    VirtualClock::stop("Panic: %s", message);
+}
+
+
+// Sync. Cores only switch when one waits, so a mutex is only ever seen held by the other core
+// while it's waiting with it held
+void mutex_init(mutex_t* mtx) {
+    mtx->owner = 0;
+}
+
+void mutex_enter_blocking(mutex_t* mtx) {
+    int8_t self = get_core_num() + 1;
+
+    while(mtx->owner) {
+        if(VirtualClock::inEvent() || (mtx->owner == self)) {
+            VirtualClock::stop("Deadlock on a mutex held by core%d", mtx->owner - 1);
+        }
+
+        // mutex_exit() sends an event
+        VirtualClock::waitUntil(VirtualClock::now() + 1, true);
+    }
+
+    mtx->owner = self;
+}
+
+bool mutex_try_enter(mutex_t* mtx, uint32_t* owner_out) {
+    if(mtx->owner) {
+        if(owner_out) {
+            *owner_out = mtx->owner - 1;
+        }
+        return false;
+    }
+
+    mtx->owner = get_core_num() + 1;
+    return true;
+}
+
+void mutex_exit(mutex_t* mtx) {
+    mtx->owner = 0;
+    __sev();
+}
+
+namespace {
+    bool sInterruptsDisabled = false;
+}
+
+uint32_t save_and_disable_interrupts() {
+    uint32_t status = sInterruptsDisabled ? 0 : 1;
+    sInterruptsDisabled = true;
+    return status;
+}
+
+void restore_interrupts(uint32_t status) {
+    sInterruptsDisabled = !status;
+}
+
+void __sev() {
+    VirtualClock::sendEvent();
+}
+
+void __wfe() {
+    VirtualClock::waitUntil(UINT64_MAX, true);
+}
+
+void __dmb() {}
+
+
+// Multicore
+namespace {
+    bool sLockoutVictim = false;
+    bool sLockedOut = false;
+}
+
+void multicore_launch_core1(void (*entry)(void)) {
+    VirtualClock::launchCore1(entry);
+}
+
+void multicore_lockout_victim_init() {
+    if(get_core_num() != 1) {
+        VirtualClock::stop("multicore_lockout_victim_init() called from core0");
+    }
+
+    sLockoutVictim = true;
+}
+
+void multicore_lockout_start_blocking() {
+    // On the real thing this never returns if core1 isn't listening for the lockout
+    if(!sLockoutVictim) {
+        VirtualClock::stop("Lockout started before core1 was a lockout victim");
+    }
+
+    sLockedOut = true;
+}
+
+void multicore_lockout_end_blocking() {
+    sLockedOut = false;
+}
+
+
+// Random numbers
+namespace {
+    std::mt19937_64 sFirmwareRandom;
+}
+
+uint32_t get_rand_32() {
+    return (uint32_t) sFirmwareRandom();
+}
+
+uint64_t get_rand_64() {
+    return sFirmwareRandom();
+}
+
+void SimSDK::setRandomSeed(uint64_t seed) {
+    sFirmwareRandom.seed(seed);
+}
+
+
+// Watchdog - only ever enabled to reboot the board
+void watchdog_enable(uint32_t delay_ms, bool pause_on_debug) {
+    VirtualClock::stop("Watchdog reboot requested at %llums", (unsigned long long) (VirtualClock::now() / 1000));
+}
+
+void watchdog_update() {}
+
+bool watchdog_caused_reboot() {
+    return false;
+}
+
+
+// Flash. The linker script reserves a sector at ADDR_PERSISTENT for the user data, which here is
+// an ordinary array. Erasing and programming take no simulated time
+alignas(FLASH_SECTOR_SIZE) uint32_t ADDR_PERSISTENT[FLASH_SECTOR_SIZE / sizeof(uint32_t)];
+
+namespace {
+    uint32_t sFlashEraseCount = 0;
+
+    uint8_t* flashAddress(uint32_t flash_offs, size_t count, const char* operation) {
+        uint32_t persistentOffset = (uint32_t) ((uintptr_t) ADDR_PERSISTENT - XIP_BASE);
+        if((flash_offs < persistentOffset) || ((flash_offs - persistentOffset + count) > sizeof(ADDR_PERSISTENT))) {
+            VirtualClock::stop("Flash %s outside the persistent sector (offset 0x%08x, %d bytes)", operation, flash_offs, (int) count);
+        }
+
+        if(!sLockedOut || !sInterruptsDisabled) {
+            VirtualClock::stop("Flash %s with %s", operation, sLockedOut ? "interrupts enabled" : "core1 running");
+        }
+
+        return (uint8_t*) ADDR_PERSISTENT + (flash_offs - persistentOffset);
+    }
+
+    struct FlashInitializer {
+        FlashInitializer() { memset(ADDR_PERSISTENT, 0xFF, sizeof(ADDR_PERSISTENT)); }
+    } sFlashInitializer;
+}
+
+void flash_range_erase(uint32_t flash_offs, size_t count) {
+    memset(flashAddress(flash_offs, count, "erase"), 0xFF, count);
+    ++sFlashEraseCount;
+}
+
+void flash_range_program(uint32_t flash_offs, const uint8_t* data, size_t count) {
+    uint8_t* flash = flashAddress(flash_offs, count, "program");
+
+    // Programming can only clear bits
+    for(size_t i = 0; i < count; ++i) {
+        flash[i] &= data[i];
+    }
+}
+
+void SimSDK::provisionFlash(void (*write)()) {
+    sLockedOut = true;
+    write();
+    sLockedOut = false;
+    sFlashEraseCount = 0;
+}
+
+uint32_t SimSDK::getFlashEraseCount() {
+    return sFlashEraseCount;
+}
+
+
+// The heap limits Core0Executor::getHeapSize() finds from the linker script
+extern "C" {
+    alignas(8) char sim_heap_limits[8];
+}
+asm(".globl __bss_end__\n"
+    ".set __bss_end__, sim_heap_limits\n"
+    ".globl __StackLimit\n"
+    ".set __StackLimit, sim_heap_limits + 0x100000\n");
+
+
+// UART and stdio. Lines are put together from the pieces DEBUG_PRINT writes them out in
+struct uart_inst {};
+uart_inst_t uart0_inst;
+uart_inst_t uart1_inst;
+
+namespace {
+    FILE* sLogFile = nullptr;
+    char sLogLine[SimSDK::MAX_LOG_LINE];
+    int sLogLineLength = 0;
+    uint64_t sLogLineCount = 0;
+
+    struct LogWatch {
+        const char* mText;
+        uint32_t mCount;
+    };
+    LogWatch sLogWatches[SimSDK::MAX_LOG_WATCHES];
+    int sLogWatchCount = 0;
+
+    void endLogLine() {
+        sLogLine[sLogLineLength] = 0;
+        sLogLineLength = 0;
+        ++sLogLineCount;
+
+        for(int i = 0; i < sLogWatchCount; ++i) {
+            if(strstr(sLogLine, sLogWatches[i].mText)) {
+                ++sLogWatches[i].mCount;
+            }
+        }
+
+        if(sLogFile) {
+            uint64_t ms = VirtualClock::now() / 1000;
+            fprintf(sLogFile, "%3llud %02llu:%02llu:%02llu.%03llu %s\n",
+                (unsigned long long) (ms / 86400000),
+                (unsigned long long) ((ms / 3600000) % 24),
+                (unsigned long long) ((ms / 60000) % 60),
+                (unsigned long long) ((ms / 1000) % 60),
+                (unsigned long long) (ms % 1000),
+                sLogLine
+            );
+        }
+    }
+}
+
+uint uart_init(uart_inst_t* uart, uint baudrate) {
+    return baudrate;
+}
+
+void uart_deinit(uart_inst_t* uart) {}
+void uart_set_format(uart_inst_t* uart, uint data_bits, uint stop_bits, uart_parity_t parity) {}
+void uart_set_hw_flow(uart_inst_t* uart, bool cts, bool rts) {}
+
+void uart_puts(uart_inst_t* uart, const char* s) {
+    for(; *s; ++s) {
+        if(*s == '\n') {
+            endLogLine();
+        } else if(sLogLineLength < (SimSDK::MAX_LOG_LINE - 1)) {
+            sLogLine[sLogLineLength++] = *s;
+        }
+    }
+}
+
+bool stdio_init_all() {
+    return true;
+}
+
+int getchar_timeout_us(uint32_t timeout_us) {
+    return PICO_ERROR_TIMEOUT;
+}
+
+void stdio_set_chars_available_callback(void (*fn)(void*), void* param) {}
+
+void SimSDK::setLogFile(FILE* file) {
+    sLogFile = file;
+}
+
+int SimSDK::addLogWatch(const char* text) {
+    if(sLogWatchCount >= MAX_LOG_WATCHES) {
+        return -1;
+    }
+
+    sLogWatches[sLogWatchCount] = {text, 0};
+    return sLogWatchCount++;
+}
+
+uint32_t SimSDK::getLogWatchCount(int watch) {
+    return ((watch >= 0) && (watch < sLogWatchCount)) ? sLogWatches[watch].mCount : 0;
+}
+
+uint64_t SimSDK::getLogLineCount() {
+    return sLogLineCount;
+}
+
+
+// Systick only counts cycles for the payload benchmark
+namespace {
+    systick_hw_t sSysTick;
+}
+systick_hw_t* systick_hw = &sSysTick;
+
+
+// async_context, as the polled version. A worker is due once the clock reaches its time
+bool async_context_poll_init_with_defaults(async_context_poll_t* self) {
+    memset(self, 0, sizeof(*self));
+    self->core.core_num = get_core_num();
+    return true;
+}
+
+bool async_context_add_at_time_worker(async_context_t* context, async_at_time_worker_t* worker) {
+    for(async_at_time_worker_t* w = context->at_time_list; w; w = w->next) {
+        if(w == worker) {
+            return false;
+        }
+    }
+
+    worker->next = context->at_time_list;
+    context->at_time_list = worker;
+    return true;
+}
+
+bool async_context_add_at_time_worker_at(async_context_t* context, async_at_time_worker_t* worker, absolute_time_t at) {
+    worker->next_time = at;
+    return async_context_add_at_time_worker(context, worker);
+}
+
+bool async_context_add_at_time_worker_in_ms(async_context_t* context, async_at_time_worker_t* worker, uint32_t ms) {
+    return async_context_add_at_time_worker_at(context, worker, make_timeout_time_ms(ms));
+}
+
+bool async_context_remove_at_time_worker(async_context_t* context, async_at_time_worker_t* worker) {
+    for(async_at_time_worker_t** w = &context->at_time_list; *w; w = &(*w)->next) {
+        if(*w == worker) {
+            *w = worker->next;
+            worker->next = nullptr;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool async_context_add_when_pending_worker(async_context_t* context, async_when_pending_worker_t* worker) {
+    for(async_when_pending_worker_t* w = context->when_pending_list; w; w = w->next) {
+        if(w == worker) {
+            return false;
+        }
+    }
+
+    worker->next = context->when_pending_list;
+    context->when_pending_list = worker;
+    return true;
+}
+
+bool async_context_remove_when_pending_worker(async_context_t* context, async_when_pending_worker_t* worker) {
+    for(async_when_pending_worker_t** w = &context->when_pending_list; *w; w = &(*w)->next) {
+        if(*w == worker) {
+            *w = worker->next;
+            worker->next = nullptr;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void async_context_set_work_pending(async_context_t* context, async_when_pending_worker_t* worker) {
+    worker->work_pending = true;
+    __sev();
+}
+
+void async_context_poll(async_context_t* context) {
+    // Each due at-time worker is removed before it runs, so it can add itself back
+    bool ranWorker;
+    do {
+        ranWorker = false;
+        for(async_at_time_worker_t* w = context->at_time_list; w; w = w->next) {
+            if(w->next_time <= get_absolute_time()) {
+                async_context_remove_at_time_worker(context, w);
+                w->do_work(context, w);
+                ranWorker = true;
+                break;
+            }
+        }
+    } while(ranWorker);
+
+    for(async_when_pending_worker_t* w = context->when_pending_list; w; w = w->next) {
+        if(w->work_pending) {
+            w->work_pending = false;
+            w->do_work(context, w);
+        }
+    }
+}
+
+void async_context_wait_for_work_until(async_context_t* context, absolute_time_t until) {
+    for(async_when_pending_worker_t* w = context->when_pending_list; w; w = w->next) {
+        if(w->work_pending) {
+            return;
+        }
+    }
+
+    absolute_time_t next = until;
+    for(async_at_time_worker_t* w = context->at_time_list; w; w = w->next) {
+        next = absolute_time_min(next, w->next_time);
+    }
+
+    VirtualClock::waitUntil(next, true);
+}
@@ -0,0 +1,35 @@
+#ifndef _SIM_SDK_H_
+#define _SIM_SDK_H_
+
+#include <cstdint>
+#include <cstdio>
+
+
+// The harness's side of the simulated SDK - the firmware's random numbers, its log and the flash
+// behind its user data
+class SimSDK {
+    public:
+        // Seeds get_rand_32(), so a run can be repeated exactly
+        static void setRandomSeed(uint64_t seed);
+
+        // Every line the firmware logs goes to the log file (if there is one), stamped with the
+        // simulated time. Watches count the lines containing a piece of text
+        static void setLogFile(FILE* file);
+        static int addLogWatch(const char* text);
+        static uint32_t getLogWatchCount(int watch);
+        static uint64_t getLogLineCount();
+
+        // Fills the flash before boot, as provisioning would have. The writes happen as if core1
+        // were locked out, and don't count as erases
+        static void provisionFlash(void (*write)());
+        static uint32_t getFlashEraseCount();
+
+        // Held between cyw43_arch_lwip_begin() and cyw43_arch_lwip_end(), when the network stack
+        // can't call back into the firmware
+        static bool isLwIPLocked();
+
+        static constexpr int MAX_LOG_WATCHES    = 16;
+        static constexpr int MAX_LOG_LINE       = 512;
+};
+
+#endif      // _SIM_SDK_H_
@@ -0,0 +1,747 @@
+// Soak test for the firmware on the host. Both cores run the real firmware against simulated
+// sensors, Wi-Fi and broker on a virtual clock, so a month of uptime takes minutes. The scenario
+// injects sensor disconnects, stuck and noisy buses, and broker and access point outages, while
+// the harness tracks memory, publish gaps and counts, and sensor resets over time and fails the
+// run if any of them drift or stop recovering.
+//
+//   sensor_pod_soak [--days N] [--start-days N] [--scenario steady|sensors|network|all]
+//                   [--seed N] [--log FILE] [--report-hours N]
+//
+// --start-days starts the clock part way into uptime, e.g. 49.5 to cross the point where
+// to_ms_since_boot() wraps
+
+#include "util/debug_io.h"
+#include "util/task.h"
+#include "messaging/multicore_mailbox.h"
+#include "cores/core_0_executor.h"
+#include "cores/core_1_executor.h"
+#include "cores/work_executor.h"
+#include "board_hardware/wifi_indicator.h"
+#include "userdata/user_data.h"
+
+#include "pico/multicore.h"
+
+#include "virtual_clock.h"
+#include "sim_sdk.h"
+#include "sim_i2c.h"
+#include "sim_network.h"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+
+namespace {
+    bool sTrackHeap = false;
+}
+
+// The firmware, as main.cpp puts it together
+extern WiFiIndicator* _wifiIndicator;
+extern vector<SensorGroup> _SENSOR_GROUPS;
+MulticoreMailbox multicoreMailbox;
+WorkExecutor workExecutor;
+
+Core0Executor dataCore0(
+    multicoreMailbox,
+    workExecutor,
+    _SENSOR_GROUPS,
+    _wifiIndicator
+);
+
+Core1Executor dataCore1(
+    multicoreMailbox,
+    workExecutor,
+    _SENSOR_GROUPS
+);
+
+static void firmwareMain() {
+    sTrackHeap = true;
+
+    DEBUG_PRINT_INIT()
+
+    dataCore0.loadUserData();
+    dataCore1.initialize();
+    Core1Executor::setExecutor(dataCore1);
+    multicore_launch_core1(Core1Executor::loop);
+
+    dataCore0.initialize();
+    Core0Executor::setExecutor(dataCore0);
+    Core0Executor::loop();
+}
+
+
+// What the board was provisioned with
+constexpr const char* WIFI_SSID                 = "soak-net";
+constexpr const char* WIFI_PSK                  = "soak-password";
+constexpr const char* HOST_NAME                 = "soakpod";
+constexpr const char* BROKER_HOST               = "broker.local";
+constexpr const char* GROUP_NAMES[]             = {"dummy", "soil"};
+constexpr const char* GROUP_LOCATIONS[]         = {"lab", "bench"};
+
+// The simulated sensor hardware, on i2c1 as the sensor pod wires it
+SimI2CBus stemmaBus(1, 2, 3);
+SimSeesawProbe probes[] = {SimSeesawProbe(0x36), SimSeesawProbe(0x37)};
+
+constexpr uint64_t US_PER_MINUTE                = 60000000ull;
+constexpr uint64_t US_PER_HOUR                  = 60 * US_PER_MINUTE;
+constexpr uint64_t US_PER_DAY                   = 24 * US_PER_HOUR;
+
+// Pass/fail limits
+constexpr uint64_t WARM_UP_US                   = US_PER_HOUR;          // Before faults start and the heap baseline is taken
+constexpr uint64_t MAX_PUBLISH_GAP_US           = 10000000;             // Between DummySensor publishes, with the network up
+constexpr uint64_t MAX_RECOVERY_US              = 180000000;            // From a network fault ending to the next publish
+constexpr int64_t MAX_HEAP_DRIFT_BYTES          = 2048;
+constexpr uint32_t MAX_RESETS_PER_HOUR          = 60;
+constexpr uint32_t MAX_FLASH_ERASES_PER_DAY     = 6;                    // Config writes only; 100k cycles over ten years allows 27
+constexpr uint64_t CONTROL_PERIOD_US            = 10 * US_PER_MINUTE;
+constexpr uint64_t CONTROL_BURST_PERIOD_US      = 6 * US_PER_HOUR;
+constexpr int CONTROL_BURST_SIZE                = 8;
+constexpr uint64_t CONTROL_QUIET_US             = 2 * US_PER_MINUTE;    // At the end, so nothing is still in flight
+
+
+// Heap use by the firmware. Allocations made while a core is running (rather than in the
+// harness's events) are tagged, so the harness's own allocations don't show up as drift
+namespace {
+    struct AllocationHeader {
+        size_t mSize;
+        bool mFirmware;
+        uint8_t mPadding[16 - sizeof(size_t) - sizeof(bool)];
+    };
+    static_assert(sizeof(AllocationHeader) == 16);
+
+    int64_t sFirmwareHeapBytes = 0;
+
+    void* trackedAllocate(size_t size) {
+        AllocationHeader* header = (AllocationHeader*) malloc(sizeof(AllocationHeader) + size);
+        if(!header) {
+            throw std::bad_alloc();
+        }
+
+        header->mSize = size;
+        header->mFirmware = sTrackHeap && !VirtualClock::inEvent();
+        if(header->mFirmware) {
+            sFirmwareHeapBytes += size;
+        }
+        return header + 1;
+    }
+
+    void trackedFree(void* p) {
+        if(!p) {
+            return;
+        }
+
+        AllocationHeader* header = ((AllocationHeader*) p) - 1;
+        if(header->mFirmware) {
+            sFirmwareHeapBytes -= header->mSize;
+        }
+        free(header);
+    }
+}
+
+void* operator new(size_t size) { return trackedAllocate(size); }
+void* operator new[](size_t size) { return trackedAllocate(size); }
+void operator delete(void* p) noexcept { trackedFree(p); }
+void operator delete[](void* p) noexcept { trackedFree(p); }
+void operator delete(void* p, size_t) noexcept { trackedFree(p); }
+void operator delete[](void* p, size_t) noexcept { trackedFree(p); }
+
+
+struct Options {
+    double mDays = 30;
+    double mStartDays = 0;
+    bool mSensorFaults = true;
+    bool mNetworkFaults = true;
+    const char* mScenario = "all";
+    uint64_t mSeed = 1;
+    const char* mLogPath = nullptr;
+    uint32_t mReportHours = 24;
+};
+
+enum FaultType {
+    FAULT_PROBE_DISCONNECTED,
+    FAULT_SDA_STUCK,                    // Until the firmware clocks it free
+    FAULT_SDA_HELD,                     // For a while, whatever the firmware does
+    FAULT_NOISY_BUS,
+    FAULT_BROKER_DOWN,
+    FAULT_BROKER_STALLED,
+    FAULT_ACCESS_POINT_DOWN,
+    NUM_FAULT_TYPES
+};
+
+constexpr const char* FAULT_NAMES[NUM_FAULT_TYPES] = {
+    "probe disconnected",
+    "SDA stuck",
+    "SDA held",
+    "noisy bus",
+    "broker down",
+    "broker stalled",
+    "AP down"
+};
+
+struct Fault {
+    FaultType mType;
+    uint64_t mStartUS;
+    uint64_t mEndUS;
+    uint32_t mParameter;
+
+    bool isNetwork() const { return mType >= FAULT_BROKER_DOWN; }
+};
+
+// One report row
+struct Period {
+    int64_t mHeapMin;
+    int64_t mHeapMax;
+    uint32_t mPublishes[2];
+    uint64_t mMaxGapUS;
+    uint32_t mResets;
+    uint32_t mFaults;
+};
+
+namespace {
+    Options sOptions;
+    std::mt19937_64 sHarnessRandom;
+    vector<Fault> sFaults;
+
+    // Publishes seen by the broker, per group data topic
+    uint64_t sLastPublishUS[2] = {};
+    uint64_t sPublishCount[2] = {};
+    uint64_t sMaxUnexcusedGapUS = 0;
+    uint64_t sUnexcusedGapAtUS = 0;
+    uint32_t sUnexcusedGaps = 0;
+
+    // Network faults waiting on the first publish after them
+    vector<uint64_t> sAwaitingRecovery;
+    uint64_t sMaxRecoveryUS = 0;
+
+    uint32_t sControlSent = 0;
+    uint32_t sStuckNotCleared = 0;
+
+    // Sampled every minute
+    int64_t sBaselineHeap = -1;
+    int64_t sLatestHeapMin = -1;
+    uint32_t sLastResetTotal = 0;
+    uint32_t sWorstResetsPerHour = 0;
+    uint32_t sResetsOutsideFaults = 0;
+    uint32_t sHourResets = 0;
+    uint64_t sHourStartUS = 0;
+    int64_t sHourHeapMin = -1;
+    Period sPeriod;
+    uint32_t sLastBrokerConnects = 0;
+    uint32_t sLastWiFiJoins = 0;
+
+    int sHandledWatch;
+    int sUnhandledWatch;
+    int sBusResetWatch;
+    int sStuckWatch;
+
+    uint64_t sRunStartUS;
+    uint64_t sRunEndUS;
+
+    uint64_t randomBetween(uint64_t low, uint64_t high) {
+        return low + (sHarnessRandom() % (high - low + 1));
+    }
+
+    double days(uint64_t us) {
+        return (double) (us - sRunStartUS) / US_PER_DAY;
+    }
+
+    bool overlapsFault(uint64_t fromUS, uint64_t toUS, bool networkOnly) {
+        for(auto& f : sFaults) {
+            if(networkOnly && !f.isNetwork()) {
+                continue;
+            }
+            if((fromUS <= (f.mEndUS + MAX_RECOVERY_US)) && (toUS >= f.mStartUS)) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool isNetworkFaulty(uint64_t timeUS, const Fault* except) {
+        for(auto& f : sFaults) {
+            if(f.isNetwork() && (&f != except) && (f.mStartUS <= timeUS) && (timeUS < f.mEndUS)) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    uint32_t totalSensorResets() {
+        uint32_t total = 0;
+        for(auto& group : _SENSOR_GROUPS) {
+            for(int i = 0; i < group.getSensorCount(); ++i) {
+                total += group.getSensor(i).getResetCount();
+            }
+        }
+
+        return total;
+    }
+}
+
+
+static void onPublish(const SimNetwork::Publish& publish) {
+    uint64_t now = VirtualClock::now();
+
+    for(int g = 0; g < 2; ++g) {
+        if(strcmp(publish.mTopic, _SENSOR_GROUPS[g].getTopic())) {
+            continue;
+        }
+
+        ++sPublishCount[g];
+        ++sPeriod.mPublishes[g];
+
+        if(sLastPublishUS[g]) {
+            uint64_t gap = now - sLastPublishUS[g];
+            if(g == 0) {
+                sPeriod.mMaxGapUS = std::max(sPeriod.mMaxGapUS, gap);
+            }
+
+            // DummySensor publishes every couple of seconds whatever the I2C bus is doing, so only
+            // the network is an excuse for it going quiet
+            if((g == 0) && (gap > MAX_PUBLISH_GAP_US) && !overlapsFault(sLastPublishUS[g], now, true)) {
+                ++sUnexcusedGaps;
+                if(gap > sMaxUnexcusedGapUS) {
+                    sMaxUnexcusedGapUS = gap;
+                    sUnexcusedGapAtUS = now;
+                }
+            }
+        }
+        sLastPublishUS[g] = now;
+
+        if(g == 0) {
+            for(auto endUS : sAwaitingRecovery) {
+                sMaxRecoveryUS = std::max(sMaxRecoveryUS, now - endUS);
+            }
+            sAwaitingRecovery.clear();
+        }
+    }
+}
+
+static void startFault(const Fault& fault) {
+    switch(fault.mType) {
+        case FAULT_PROBE_DISCONNECTED:
+            probes[fault.mParameter].setConnected(false);
+            break;
+
+        case FAULT_SDA_STUCK:
+            stemmaBus.holdSDA(fault.mParameter);
+            break;
+
+        case FAULT_SDA_HELD:
+            stemmaBus.holdSDA(0);
+            break;
+
+        case FAULT_NOISY_BUS:
+            stemmaBus.setNoise(fault.mParameter);
+            break;
+
+        case FAULT_BROKER_DOWN:
+            SimNetwork::setBrokerState(SimNetwork::BROKER_DOWN);
+            break;
+
+        case FAULT_BROKER_STALLED:
+            SimNetwork::setBrokerState(SimNetwork::BROKER_STALLED);
+            break;
+
+        case FAULT_ACCESS_POINT_DOWN:
+            SimNetwork::setAccessPointUp(false);
+            break;
+
+        default:
+            break;
+    }
+
+    ++sPeriod.mFaults;
+}
+
+static void endFault(const Fault& fault) {
+    switch(fault.mType) {
+        case FAULT_PROBE_DISCONNECTED:
+            probes[fault.mParameter].setConnected(true);
+            break;
+
+        case FAULT_SDA_STUCK:
+            // The firmware should have clocked it free long before now
+            if(stemmaBus.isSDAStuck()) {
+                ++sStuckNotCleared;
+                stemmaBus.clearStuckSDA();
+            }
+            break;
+
+        case FAULT_SDA_HELD:
+            stemmaBus.clearStuckSDA();
+            break;
+
+        case FAULT_NOISY_BUS:
+            stemmaBus.setNoise(0);
+            break;
+
+        case FAULT_BROKER_DOWN:
+        case FAULT_BROKER_STALLED:
+            SimNetwork::setBrokerState(SimNetwork::BROKER_UP);
+            break;
+
+        case FAULT_ACCESS_POINT_DOWN:
+            SimNetwork::setAccessPointUp(true);
+            break;
+
+        default:
+            break;
+    }
+
+    // Recovery is timed from the last of any overlapping network faults
+    if(fault.isNetwork() && !isNetworkFaulty(VirtualClock::now(), &fault)) {
+        sAwaitingRecovery.push_back(VirtualClock::now());
+    }
+}
+
+// Each kind of fault comes round every so often, never overlapping one of its own kind
+static void planFaults(FaultType type, uint64_t minGapUS, uint64_t maxGapUS, uint64_t minLengthUS, uint64_t maxLengthUS) {
+    uint64_t timeUS = sRunStartUS + WARM_UP_US + randomBetween(0, maxGapUS);
+
+    while(true) {
+        Fault fault = {type, timeUS, timeUS + randomBetween(minLengthUS, maxLengthUS), 0};
+        if(fault.mEndUS >= (sRunEndUS - CONTROL_QUIET_US - MAX_RECOVERY_US)) {
+            break;
+        }
+
+        switch(type) {
+            case FAULT_PROBE_DISCONNECTED:
+                fault.mParameter = randomBetween(0, 1);
+                break;
+
+            case FAULT_SDA_STUCK:
+                fault.mParameter = randomBetween(1, 9);        // Clocks until it lets go
+                break;
+
+            case FAULT_NOISY_BUS:
+                fault.mParameter = randomBetween(20, 100);     // Failures per thousand
+                break;
+
+            default:
+                break;
+        }
+
+        sFaults.push_back(fault);
+        timeUS = fault.mEndUS + randomBetween(minGapUS, maxGapUS);
+    }
+}
+
+static void scheduleFaults() {
+    if(sOptions.mSensorFaults) {
+        planFaults(FAULT_PROBE_DISCONNECTED, 3 * US_PER_HOUR, 9 * US_PER_HOUR, 10000000, 20 * US_PER_MINUTE);
+        planFaults(FAULT_SDA_STUCK, 8 * US_PER_HOUR, 16 * US_PER_HOUR, 10 * US_PER_MINUTE, 10 * US_PER_MINUTE);
+        planFaults(FAULT_SDA_HELD, 12 * US_PER_HOUR, 36 * US_PER_HOUR, US_PER_MINUTE, 5 * US_PER_MINUTE);
+        planFaults(FAULT_NOISY_BUS, 12 * US_PER_HOUR, 24 * US_PER_HOUR, 10 * US_PER_MINUTE, US_PER_HOUR);
+    }
+
+    if(sOptions.mNetworkFaults) {
+        planFaults(FAULT_BROKER_DOWN, 6 * US_PER_HOUR, 12 * US_PER_HOUR, 30000000, 30 * US_PER_MINUTE);
+        planFaults(FAULT_BROKER_STALLED, 12 * US_PER_HOUR, 24 * US_PER_HOUR, 30000000, 10 * US_PER_MINUTE);
+        planFaults(FAULT_ACCESS_POINT_DOWN, 12 * US_PER_HOUR, 36 * US_PER_HOUR, US_PER_MINUTE, 10 * US_PER_MINUTE);
+    }
+
+    for(size_t i = 0; i < sFaults.size(); ++i) {
+        VirtualClock::schedule(sFaults[i].mStartUS, [i]() { startFault(sFaults[i]); });
+        VirtualClock::schedule(sFaults[i].mEndUS, [i]() { endFault(sFaults[i]); });
+    }
+}
+
+static void sendControlMessage(int group) {
+    char topic[MQTTMessage::MQTT_MAX_TOPIC_LENGTH];
+    snprintf(topic, sizeof(topic), "%s", _SENSOR_GROUPS[group].getControlTopic());
+
+    SimNetwork::sendToDevice(topic, "ABCD 1");
+    ++sControlSent;
+}
+
+static void scheduleControlMessages() {
+    uint64_t lastUS = sRunEndUS - CONTROL_QUIET_US;
+
+    // DummySensor handles these, the soil group leaves them unhandled
+    for(uint64_t t = sRunStartUS + CONTROL_PERIOD_US; t < lastUS; t += CONTROL_PERIOD_US) {
+        VirtualClock::schedule(t, []() { sendControlMessage(sControlSent % 2); });
+    }
+
+    // More at once than the mailbox holds
+    for(uint64_t t = sRunStartUS + CONTROL_BURST_PERIOD_US; t < lastUS; t += CONTROL_BURST_PERIOD_US) {
+        VirtualClock::schedule(t, []() {
+            for(int i = 0; i < CONTROL_BURST_SIZE; ++i) {
+                sendControlMessage(0);
+            }
+        });
+    }
+}
+
+static void printPeriod(uint64_t now) {
+    const SimNetwork::Stats& network = SimNetwork::getStats();
+
+    printf("%7.2f %9lld %9lld %9u %9u %8.1fs %7u %8u %6u %6u\n",
+        days(now),
+        (long long) sPeriod.mHeapMin,
+        (long long) sPeriod.mHeapMax,
+        sPeriod.mPublishes[0],
+        sPeriod.mPublishes[1],
+        sPeriod.mMaxGapUS / 1e6,
+        sPeriod.mResets,
+        network.mBrokerConnects - sLastBrokerConnects,
+        network.mWiFiJoins - sLastWiFiJoins,
+        sPeriod.mFaults
+    );
+    fflush(stdout);
+
+    sLastBrokerConnects = network.mBrokerConnects;
+    sLastWiFiJoins = network.mWiFiJoins;
+    sPeriod = {-1, -1};
+}
+
+static void sample() {
+    uint64_t now = VirtualClock::now();
+    int64_t heap = sFirmwareHeapBytes;
+
+    if((sPeriod.mHeapMin < 0) || (heap < sPeriod.mHeapMin)) {
+        sPeriod.mHeapMin = heap;
+    }
+    sPeriod.mHeapMax = std::max(sPeriod.mHeapMax, heap);
+    if((sHourHeapMin < 0) || (heap < sHourHeapMin)) {
+        sHourHeapMin = heap;
+    }
+
+    uint32_t resets = totalSensorResets();
+    sHourResets += resets - sLastResetTotal;
+    sPeriod.mResets += resets - sLastResetTotal;
+    sLastResetTotal = resets;
+
+    if((now - sHourStartUS) >= US_PER_HOUR) {
+        // Sensors are allowed to reset while their bus is faulty, never otherwise
+        sWorstResetsPerHour = std::max(sWorstResetsPerHour, sHourResets);
+        if(sHourResets && !overlapsFault(sHourStartUS, now, false)) {
+            sResetsOutsideFaults += sHourResets;
+        }
+
+        // The heap is compared at its lowest point in each hour, after the warm up
+        if(now >= (sRunStartUS + WARM_UP_US + US_PER_HOUR)) {
+            if(sBaselineHeap < 0) {
+                sBaselineHeap = sHourHeapMin;
+            }
+            sLatestHeapMin = sHourHeapMin;
+        }
+
+        sHourStartUS = now;
+        sHourResets = 0;
+        sHourHeapMin = -1;
+
+        if(!((now - sRunStartUS) % (sOptions.mReportHours * US_PER_HOUR))) {
+            printPeriod(now);
+        }
+    }
+
+    VirtualClock::schedule(now + US_PER_MINUTE, sample);
+}
+
+static void provisionUserData() {
+    UserData userData;
+    userData.setSSID(WIFI_SSID);
+    userData.setPSK(WIFI_PSK);
+    userData.setHostName(HOST_NAME);
+    userData.setBrokerAddress(BROKER_HOST);
+    for(int i = 0; i < 2; ++i) {
+        userData.setSensorGroupName(i, GROUP_NAMES[i]);
+        userData.setSensorGroupLocation(i, GROUP_LOCATIONS[i]);
+    }
+    userData.writeToFlash();
+}
+
+static bool parseOptions(int argc, char** argv) {
+    for(int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        if(!value) {
+            return false;
+        }
+        ++i;
+
+        if(!strcmp(arg, "--days")) {
+            sOptions.mDays = atof(value);
+        } else if(!strcmp(arg, "--start-days")) {
+            sOptions.mStartDays = atof(value);
+        } else if(!strcmp(arg, "--seed")) {
+            sOptions.mSeed = strtoull(value, nullptr, 0);
+        } else if(!strcmp(arg, "--log")) {
+            sOptions.mLogPath = value;
+        } else if(!strcmp(arg, "--report-hours")) {
+            sOptions.mReportHours = std::max(1, atoi(value));
+        } else if(!strcmp(arg, "--scenario")) {
+            string scenario = value;
+            if((scenario != "steady") && (scenario != "sensors") && (scenario != "network") && (scenario != "all")) {
+                return false;
+            }
+            sOptions.mSensorFaults = (scenario == "sensors") || (scenario == "all");
+            sOptions.mNetworkFaults = (scenario == "network") || (scenario == "all");
+            sOptions.mScenario = value;
+        } else {
+            return false;
+        }
+    }
+
+    return sOptions.mDays > 0;
+}
+
+static bool check(bool ok, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    printf("  %s ", ok ? "PASS" : "FAIL");
+    vprintf(format, args);
+    printf("\n");
+    va_end(args);
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    if(!parseOptions(argc, argv)) {
+        fprintf(stderr, "Usage: %s [--days N] [--start-days N] [--scenario steady|sensors|network|all] [--seed N] [--log FILE] [--report-hours N]\n", argv[0]);
+        return 2;
+    }
+
+    FILE* log = nullptr;
+    if(sOptions.mLogPath) {
+        log = fopen(sOptions.mLogPath, "w");
+        if(!log) {
+            perror(sOptions.mLogPath);
+            return 2;
+        }
+        SimSDK::setLogFile(log);
+    }
+
+    sRunStartUS = (uint64_t) (sOptions.mStartDays * US_PER_DAY);
+    sRunEndUS = sRunStartUS + (uint64_t) (sOptions.mDays * US_PER_DAY);
+    sHourStartUS = sRunStartUS;
+    sPeriod = {-1, -1};
+    sHarnessRandom.seed(sOptions.mSeed ^ 0x5A5A5A5A5A5A5A5Aull);
+    SimSDK::setRandomSeed(sOptions.mSeed);
+
+    for(auto& probe : probes) {
+        stemmaBus.addDevice(probe);
+    }
+    SimNetwork::configure(WIFI_SSID, WIFI_PSK, BROKER_HOST);
+    SimNetwork::setPublishObserver(onPublish);
+    SimSDK::provisionFlash(provisionUserData);
+
+    sHandledWatch = SimSDK::addLogWatch(") handled");
+    sUnhandledWatch = SimSDK::addLogWatch(") went unhandled");
+    sBusResetWatch = SimSDK::addLogWatch("resetting bus");
+    sStuckWatch = SimSDK::addLogWatch("stuck with SDA held low");
+
+    scheduleFaults();
+    scheduleControlMessages();
+    VirtualClock::schedule(sRunStartUS + US_PER_MINUTE, sample);
+
+    printf("Soak: %.2f days from day %.2f, %s scenario, seed %llu, %d faults planned\n\n",
+        sOptions.mDays,
+        sOptions.mStartDays,
+        sOptions.mScenario,
+        (unsigned long long) sOptions.mSeed,
+        (int) sFaults.size()
+    );
+    printf("    day  heap min  heap max  dummy pub  soil pub  max gap  resets  connects  joins faults\n");
+
+    bool completed = VirtualClock::run(firmwareMain, sRunStartUS, sRunEndUS);
+    sTrackHeap = false;
+
+    const SimNetwork::Stats& network = SimNetwork::getStats();
+    const SimI2CBus::Stats& bus = stemmaBus.getStats();
+    uint32_t handled = SimSDK::getLogWatchCount(sHandledWatch);
+    uint32_t unhandled = SimSDK::getLogWatchCount(sUnhandledWatch);
+    uint32_t dropped = multicoreMailbox.getDroppedSensorControlMessageCount();
+    double simulatedDays = days(VirtualClock::now());
+
+    uint32_t faultCounts[NUM_FAULT_TYPES] = {};
+    for(auto& fault : sFaults) {
+        if(fault.mStartUS <= VirtualClock::now()) {
+            ++faultCounts[fault.mType];
+        }
+    }
+
+    printf("\nFaults:");
+    for(int i = 0; i < NUM_FAULT_TYPES; ++i) {
+        printf("%s %u %s", i ? "," : "", faultCounts[i], FAULT_NAMES[i]);
+    }
+    printf("\nNetwork: %u joins, %u links lost, %u broker connects (%u refused), %u connections lost, %u DNS lookups\n",
+        network.mWiFiJoins, network.mWiFiLinksLost, network.mBrokerConnects, network.mBrokerRefused,
+        network.mConnectionsLost, network.mDNSLookups);
+    printf("MQTT: %u publishes received, %u request timeouts, %u output full, max %u clients\n",
+        network.mPublishesReceived, network.mRequestTimeouts, network.mOutputFull, network.mMaxClientsInUse);
+    printf("I2C: %u transfers, %u NACKs, %u timeouts, %u noise failures, %u clocked free, %u bus resets, %u stuck bus reports, max %ukHz\n",
+        bus.mTransfers, bus.mNacks, bus.mTimeouts, bus.mNoiseFailures, bus.mClockedOut,
+        SimSDK::getLogWatchCount(sBusResetWatch), SimSDK::getLogWatchCount(sStuckWatch), bus.mMaxBaud / 1000);
+    printf("Sensors: %u resets, probe resets %u/%u\n",
+        totalSensorResets(), probes[0].getResetCount(), probes[1].getResetCount());
+    printf("Control: %u sent, %u delivered, %u handled, %u unhandled, %u dropped\n",
+        sControlSent, network.mControlDelivered, handled, unhandled, dropped);
+    printf("Tasks: max %u frames in use, %u allocation failures\n",
+        TaskFramePool::getMaxFramesInUse(), TaskFramePool::getAllocationFailures());
+    printf("Host: %llu core switches, %llu log lines, %u flash erases\n\n",
+        (unsigned long long) VirtualClock::getSwitchCount(), (unsigned long long) SimSDK::getLogLineCount(),
+        SimSDK::getFlashEraseCount());
+
+    bool passed = true;
+    if(!completed) {
+        passed &= check(false, "Run stopped at day %.3f: %s", simulatedDays, VirtualClock::getStopReason());
+    } else {
+        passed &= check(true, "Ran for %.2f days", simulatedDays);
+    }
+
+    passed &= check((sPublishCount[0] > 0) && (sPublishCount[1] > 0),
+        "Both groups published (%llu, %llu)", (unsigned long long) sPublishCount[0], (unsigned long long) sPublishCount[1]);
+    passed &= check(!sUnexcusedGaps,
+        "No DummySensor publish gaps over %llus with the network up (%u, worst %.1fs at day %.3f)",
+        (unsigned long long) (MAX_PUBLISH_GAP_US / 1000000), sUnexcusedGaps, sMaxUnexcusedGapUS / 1e6, sUnexcusedGaps ? days(sUnexcusedGapAtUS) : 0.0);
+    passed &= check(sAwaitingRecovery.empty() && (sMaxRecoveryUS <= MAX_RECOVERY_US),
+        "Publishing resumed within %llus of every network fault (worst %.1fs)",
+        (unsigned long long) (MAX_RECOVERY_US / 1000000), sMaxRecoveryUS / 1e6);
+
+    if(sBaselineHeap >= 0) {
+        int64_t drift = sLatestHeapMin - sBaselineHeap;
+        passed &= check(drift <= MAX_HEAP_DRIFT_BYTES,
+            "Heap drift under %lld bytes (%lld to %lld, %+lld)",
+            (long long) MAX_HEAP_DRIFT_BYTES, (long long) sBaselineHeap, (long long) sLatestHeapMin, (long long) drift);
+    }
+
+    passed &= check(!sResetsOutsideFaults, "No sensor resets without a fault (%u)", sResetsOutsideFaults);
+    passed &= check(sWorstResetsPerHour <= MAX_RESETS_PER_HOUR,
+        "No reset storms, at most %u resets an hour (worst %u)", MAX_RESETS_PER_HOUR, sWorstResetsPerHour);
+    passed &= check(!sStuckNotCleared, "Every stuck SDA was clocked free (%u left stuck)", sStuckNotCleared);
+    passed &= check(network.mControlDelivered == (handled + unhandled + dropped),
+        "Every control message delivered was handled, unhandled or counted as dropped (%u vs %u)",
+        network.mControlDelivered, handled + unhandled + dropped);
+    passed &= check(!multicoreMailbox.getSensorFrameExhaustedCount(),
+        "Sensor frames never ran out (%u)", multicoreMailbox.getSensorFrameExhaustedCount());
+    passed &= check(!TaskFramePool::getAllocationFailures(),
+        "Task frames never ran out (%u)", TaskFramePool::getAllocationFailures());
+    passed &= check(network.mMaxClientsInUse <= 1, "MQTT clients never leaked (max %u)", network.mMaxClientsInUse);
+
+    uint32_t maxErases = MAX_FLASH_ERASES_PER_DAY * (uint32_t) (simulatedDays + 1);
+    passed &= check(SimSDK::getFlashEraseCount() <= maxErases,
+        "Flash erased at most %u times (%u)", maxErases, SimSDK::getFlashEraseCount());
+
+    printf("\n%s\n", passed ? "SOAK PASSED" : "SOAK FAILED");
+
+    fflush(stdout);
+    if(log) {
+        fclose(log);
+    }
+
+    // The cores are still parked on their own stacks, so there's nothing to unwind
+    _Exit(passed ? 0 : 1);
+}
@@ -0,0 +1,249 @@
+#include "virtual_clock.h"
+
+#include <csetjmp>
+#include <cstdarg>
+#include <cstdio>
+#include <queue>
+#include <vector>
+#include <ucontext.h>
+
+
+// Switching cores is a _setjmp()/_longjmp() pair, which unlike swapcontext() doesn't make a system
+// call. ucontext is only used to start each core on its own stack
+struct VirtualClock::Core {
+    ucontext_t mStartContext;
+    jmp_buf mJump;
+    std::vector<uint8_t> mStack;
+    void (*mEntry)();
+    bool mLaunched;
+    bool mStarted;
+    bool mWaiting;
+    bool mWakeOnEvent;
+    bool mEventPending;             // The event register, set by SEV and cleared by WFE
+    uint64_t mWakeUS;
+};
+
+namespace {
+    struct ScheduledEvent {
+        uint64_t mTimeUS;
+        uint64_t mSequence;         // Events due at the same time run in the order they were scheduled
+        VirtualClock::Event mEvent;
+
+        bool operator>(const ScheduledEvent& other) const {
+            return (mTimeUS != other.mTimeUS) ? (mTimeUS > other.mTimeUS) : (mSequence > other.mSequence);
+        }
+    };
+
+    std::priority_queue<ScheduledEvent, std::vector<ScheduledEvent>, std::greater<ScheduledEvent>> sEvents;
+    uint64_t sEventSequence = 0;
+    jmp_buf sHostJump;
+    char sStopMessage[256];
+}
+
+VirtualClock::Core VirtualClock::sCores[NUM_CORES];
+int VirtualClock::sCurrentCore = 0;
+bool VirtualClock::sInEvent = false;
+uint64_t VirtualClock::sNowUS = 0;
+uint64_t VirtualClock::sEndUS = 0;
+uint64_t VirtualClock::sSwitchCount = 0;
+uint64_t VirtualClock::sLastProgressUS = 0;
+uint32_t VirtualClock::sWakesWithoutProgress = 0;
+const char* VirtualClock::sStopReason = nullptr;
+
+
+bool VirtualClock::run(void (*core0Entry)(), uint64_t startUS, uint64_t endUS) {
+    sNowUS = startUS;
+    sEndUS = endUS;
+    sLastProgressUS = startUS;
+    sStopReason = nullptr;
+
+    // Both stacks up front, so the firmware's heap use doesn't include them
+    for(auto& core : sCores) {
+        core.mStack.resize(CORE_STACK_SIZE);
+    }
+
+    sCores[0].mEntry = core0Entry;
+    sCores[0].mLaunched = true;
+    startCore(0);
+
+    // Both finish() and stop() come back here, from whichever core was running at the time
+    if(!_setjmp(sHostJump)) {
+        sCurrentCore = 0;
+        sCores[0].mStarted = true;
+        setcontext(&sCores[0].mStartContext);
+    }
+
+    return (sStopReason == nullptr);
+}
+
+void VirtualClock::launchCore1(void (*entry)()) {
+    Core& core = sCores[1];
+    if(core.mLaunched) {
+        stop("Core1 launched twice");
+    }
+
+    core.mEntry = entry;
+    core.mLaunched = true;
+    core.mWaiting = false;
+    startCore(1);
+}
+
+void VirtualClock::stop(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    vsnprintf(sStopMessage, sizeof(sStopMessage), format, args);
+    va_end(args);
+
+    sStopReason = sStopMessage;
+    _longjmp(sHostJump, 1);
+}
+
+bool VirtualClock::waitUntil(uint64_t wakeUS, bool wakeOnEvent) {
+    if(sInEvent) {
+        stop("Interrupt handler waited at %lluus", (unsigned long long) sNowUS);
+    }
+
+    Core& core = sCores[sCurrentCore];
+    if(wakeOnEvent && core.mEventPending) {
+        core.mEventPending = false;
+        return false;
+    }
+
+    core.mWaiting = true;
+    core.mWakeUS = wakeUS;
+    core.mWakeOnEvent = wakeOnEvent;
+    reschedule();
+    core.mWaiting = false;
+
+    if(wakeOnEvent && core.mEventPending && (sNowUS < wakeUS)) {
+        core.mEventPending = false;
+        return false;
+    }
+
+    return true;
+}
+
+void VirtualClock::sendEvent() {
+    // On the RP2040 SEV also sets the sending core's own event register, so a loop which takes a
+    // mutex before its WFE never sleeps. Code takes no time here, so that would stop the clock.
+    // Waking only the other core is stricter - a wake up the firmware relies on its own SEV for
+    // is lost, rather than hidden
+    for(int i = 0; i < NUM_CORES; ++i) {
+        if(sInEvent || (i != sCurrentCore)) {
+            sCores[i].mEventPending = true;
+        }
+    }
+}
+
+void VirtualClock::schedule(uint64_t timeUS, Event event) {
+    sEvents.push({(timeUS < sNowUS) ? sNowUS : timeUS, sEventSequence++, std::move(event)});
+}
+
+void VirtualClock::startCore(int index) {
+    Core& core = sCores[index];
+
+    getcontext(&core.mStartContext);
+    core.mStartContext.uc_stack.ss_sp = core.mStack.data();
+    core.mStartContext.uc_stack.ss_size = core.mStack.size();
+    core.mStartContext.uc_link = nullptr;
+    makecontext(&core.mStartContext, &VirtualClock::coreMain, 0);
+}
+
+void VirtualClock::coreMain() {
+    sCores[sCurrentCore].mEntry();
+
+    // Neither core's loop ever returns on the real thing
+    stop("Core%d returned from its entry point", sCurrentCore);
+}
+
+void VirtualClock::reschedule() {
+    int self = sCurrentCore;
+
+    while(true) {
+        runDueEvents();
+
+        // The other core goes first, so when both are ready they take turns
+        for(int i = 1; i <= NUM_CORES; ++i) {
+            int index = (self + i) % NUM_CORES;
+            if(!isReady(sCores[index])) {
+                continue;
+            }
+
+            if(sNowUS != sLastProgressUS) {
+                sLastProgressUS = sNowUS;
+                sWakesWithoutProgress = 0;
+            } else if(++sWakesWithoutProgress > MAX_WAKES_WITHOUT_PROGRESS) {
+                stop("Cores stopped making progress at %lluus", (unsigned long long) sNowUS);
+            }
+
+            if(index != self) {
+                switchTo(index);
+            }
+            return;
+        }
+
+        // Nothing to do until the next core or event is due. Every wait takes some time, so two
+        // cores polling each other still move the clock on
+        uint64_t nextUS = sEvents.empty() ? UINT64_MAX : sEvents.top().mTimeUS;
+        for(auto& core : sCores) {
+            if(core.mLaunched && core.mWaiting && (core.mWakeUS < nextUS)) {
+                nextUS = core.mWakeUS;
+            }
+        }
+
+        if(nextUS <= sNowUS) {
+            nextUS = sNowUS + 1;
+        }
+        if(nextUS > sEndUS) {
+            finish();
+        }
+        sNowUS = nextUS;
+    }
+}
+
+void VirtualClock::switchTo(int index) {
+    ++sSwitchCount;
+
+    if(_setjmp(sCores[sCurrentCore].mJump)) {
+        return;
+    }
+
+    sCurrentCore = index;
+    Core& core = sCores[index];
+    if(!core.mStarted) {
+        core.mStarted = true;
+        setcontext(&core.mStartContext);
+    }
+
+    _longjmp(core.mJump, 1);
+}
+
+bool VirtualClock::isReady(const Core& core) {
+    if(!core.mLaunched) {
+        return false;
+    }
+
+    // Launched but not run yet
+    if(!core.mStarted) {
+        return true;
+    }
+
+    return core.mWaiting && ((core.mWakeUS <= sNowUS) || (core.mWakeOnEvent && core.mEventPending));
+}
+
+void VirtualClock::runDueEvents() {
+    while(!sEvents.empty() && (sEvents.top().mTimeUS <= sNowUS)) {
+        // Moved out first, the event may well schedule more
+        Event event = std::move(const_cast<ScheduledEvent&>(sEvents.top()).mEvent);
+        sEvents.pop();
+
+        sInEvent = true;
+        event();
+        sInEvent = false;
+    }
+}
+
+void VirtualClock::finish() {
+    sNowUS = sEndUS;
+    _longjmp(sHostJump, 1);
+}
@@ -0,0 +1,70 @@
+#ifndef _VIRTUAL_CLOCK_H_
+#define _VIRTUAL_CLOCK_H_
+
+#include <cstdint>
+#include <functional>
+
+
+// Simulated time for both of the firmware's cores. Running code takes no time, only waiting moves
+// the clock on, so a month of uptime goes by in minutes.
+//
+// The cores run on one host thread, each on its own stack, and only one runs at a time - a core
+// keeps going until it waits, then whichever core is due next goes. Events stand in for interrupts
+// and the outside world (the network, the sensors and any faults injected into them). They run
+// in between, as core0, which is where the firmware takes its interrupts
+class VirtualClock {
+    public:
+        typedef std::function<void()> Event;
+
+        // Boots core0 at startUS and runs until endUS or stop(). Returns false if it was stopped
+        static bool run(void (*core0Entry)(), uint64_t startUS, uint64_t endUS);
+        static void launchCore1(void (*entry)());
+
+        // Ends the run from anywhere, as a failure
+        [[noreturn]] static void stop(const char* format, ...);
+        static const char* getStopReason() { return sStopReason; }
+
+        static uint64_t now() { return sNowUS; }
+        static uint32_t getCoreNum() { return sInEvent ? 0 : sCurrentCore; }
+        static bool inEvent() { return sInEvent; }
+
+        // Waits on the calling core. A wait which wakes on events (WFE) also ends as soon as there's
+        // one from sendEvent(), returning false, and returns straight away if one came in since.
+        // Events from a core only wake the other one
+        static bool waitUntil(uint64_t wakeUS, bool wakeOnEvent);
+        static void sendEvent();
+
+        static void schedule(uint64_t timeUS, Event event);
+        static void scheduleIn(uint64_t delayUS, Event event) { schedule(sNowUS + delayUS, std::move(event)); }
+
+        static uint64_t getSwitchCount() { return sSwitchCount; }
+
+        static constexpr int NUM_CORES              = 2;
+
+    private:
+        struct Core;
+
+        static void startCore(int index);
+        static void coreMain();
+        static void reschedule();
+        static void switchTo(int index);
+        static bool isReady(const Core& core);
+        static void runDueEvents();
+        [[noreturn]] static void finish();
+
+        // A core which keeps waking without time moving on is spinning on something which never comes
+        static constexpr uint32_t MAX_WAKES_WITHOUT_PROGRESS   = 1000000;
+        static constexpr size_t CORE_STACK_SIZE                = 1024 * 1024;
+
+        static Core sCores[NUM_CORES];
+        static int sCurrentCore;
+        static bool sInEvent;
+        static uint64_t sNowUS;
+        static uint64_t sEndUS;
+        static uint64_t sSwitchCount;
+        static uint64_t sLastProgressUS;
+        static uint32_t sWakesWithoutProgress;
+        static const char* sStopReason;
+};
+
+#endif      // _VIRTUAL_CLOCK_H_
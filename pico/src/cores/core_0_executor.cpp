@@ -1,22 +1,35 @@
 #include "core_0_executor.h"
 #include "util/debug_io.h"
+#include "messaging/cbor_writer.h"
+#include "util/fnv_hash.h"
+#include "util/copy_stats.h"
+#include "util/boot_timeline.h"
 
 #include "hardware/watchdog.h"
 #include "pico/multicore.h"
+#include "pico/stdio.h"
 #include <malloc.h>
 #include <cstring>
+#include <cstdio>
 
 Core0Executor* Core0Executor::sExecutor = nullptr;
 
-Core0Executor::Core0Executor(MulticoreMailbox& mailbox, vector<SensorGroup>& sensorGroups, WiFiIndicator* wifiIndicator) :
+Core0Executor::Core0Executor(MulticoreMailbox& mailbox, WorkExecutor& workExecutor, vector<SensorGroup>& sensorGroups, WiFiIndicator* wifiIndicator) :
     mMailbox{mailbox},
+    mWorkExecutor{workExecutor},
     mMQTTController{mailbox},
     mSensorGroups{sensorGroups},
-    mWifiIndicator{wifiIndicator}
+    mEncodeBatch{WorkExecutor::BATCH_PAYLOAD_ENCODE},
+    mEncodeFrame{nullptr},
+    mEncodeFormat{UserData::PAYLOAD_JSON},
+    mNextI2CTelemetryTime{nil_time},
+    mNextI2CClockSaveTime{nil_time},
+    mQueuedBatchGroups{0},
+    mWifiIndicator{wifiIndicator},
+    mRuntimeStats{}
 {}
 
-void Core0Executor::initialize() {
-    // Grab user data
+void Core0Executor::loadUserData() {
     if(mUserData.readFromFlash()) {
         DEBUG_PRINT(0, "Flash contents:");
         DEBUG_PRINT(0, "  +- SSID: %s", mUserData.getSSID().c_str());
@@ -31,6 +44,7 @@ void Core0Executor::initialize() {
                 mUserData.getSensorGroupLocation(i).c_str()
             );
 
+            mSensorGroups[i].setShortKeys(mUserData.getShortKeys());
             mSensorGroups[i].setName(mUserData.getSensorGroupName(i).c_str());
             mSensorGroups[i].setLocation(mUserData.getSensorGroupLocation(i).c_str());
         }
@@ -38,7 +52,67 @@ void Core0Executor::initialize() {
         DEBUG_PRINT(0, "Could not read user data from flash memory")
     }
 
+    // Start each I2C bus at the fastest rate it managed last time, rather than working back up to it
+    for(int i = 0; i < I2CInterface::getInterfaceCount(); ++i) {
+        I2CInterface& interface = I2CInterface::getInterface(i);
+        uint8_t bus = interface.getArbiter().getBusIndex();
+        if((bus < UserData::MAX_I2C_BUSES) && mUserData.getI2CBaudRate(bus)) {
+            interface.restoreBaudRate(mUserData.getI2CBaudRate(bus));
+        }
+    }
+}
+
+void Core0Executor::initialize() {
     mOutgoingMQTTMessageBuffer.resize(mSensorGroups.size());
+    mLastPayloadHashes.resize(mSensorGroups.size(), 0);
+    mFrameSequences.resize(mSensorGroups.size(), 0);
+    uint16_t dataOffset = 0;
+    for(auto& group : mSensorGroups) {
+        mGroupDataOffsets.push_back(dataOffset);
+        dataOffset += group.getRawDataSize();
+    }
+    mNetworkController.setWiFiParameters(
+        mUserData.getSSID().c_str(),
+        mUserData.getPSK().c_str(),
+        mUserData.getHostName().c_str()
+    );
+    mBrokerRequest.initialize(mUserData.getBrokerAddress().c_str());
+
+    // Try whatever worked last time first, it saves a scan, DHCP and DNS on the way to the first publish
+    if(mUserData.hasStaticIP()) {
+        const UserData::StaticIPConfig& staticIP = mUserData.getStaticIP();
+        mNetworkController.setInitialAddress(staticIP.mIPAddress, staticIP.mNetmask, staticIP.mGateway, true);
+    }
+    if(mUserData.hasNetworkCache()) {
+        const UserData::NetworkCache& cache = mUserData.getNetworkCache();
+        mNetworkController.setCachedAccessPoint(cache.mBSSID, cache.mChannel);
+        if(!mUserData.hasStaticIP()) {
+            mNetworkController.setInitialAddress(cache.mIPAddress, cache.mNetmask, cache.mGateway, false);
+        }
+        mBrokerRequest.setCachedAddress(cache.mBrokerAddress);
+    }
+
+    // Control topics are (re)subscribed by the MQTT controller each time it connects
+    for(auto& s : mSensorGroups) {
+        if(s.hasTopics()) {
+            mMQTTController.addSubscriptionTopic(s.getControlTopic());
+        }
+    }
+
+    mRuntimeStats.mMinFreeMemory = getFreeMemory();
+
+    async_context_poll_init_with_defaults(&mContext);
+    addWorker(WORKER_NETWORK, "network", &Core0Executor::runNetworkWorker);
+    addWorker(WORKER_PUBLISH, "publish", &Core0Executor::runPublishWorker);
+    addWorker(WORKER_SERIAL, "serial", &Core0Executor::runSerialWorker);
+    addWorker(WORKER_DIAGNOSTICS, "diagnostics", &Core0Executor::runDiagnosticsWorker);
+    addWorker(WORKER_SENSOR_WORK, "sensor work", &Core0Executor::runSensorWorkWorker);
+
+    // What wakes each worker early
+    mNetworkController.setEventCallback(wakeWorker, &mWorkers[WORKER_NETWORK]);
+    mMQTTController.setEventCallback(wakeWorker, &mWorkers[WORKER_NETWORK]);
+    stdio_set_chars_available_callback(wakeWorker, &mWorkers[WORKER_SERIAL]);
+    mWorkExecutor.setWakeFunction(0, wakeWorker, &mWorkers[WORKER_SENSOR_WORK]);
 }
 
 void Core0Executor::loop() {
@@ -54,52 +128,129 @@ void Core0Executor::setExecutor(Core0Executor& executor) {
 }
 
 void Core0Executor::doLoop() {
-    NetworkController::DNSRequest brokerRequest;
-    absolute_time_t pingTimeout = nil_time;
-    absolute_time_t mqttUpdateTimeout = nil_time;
-    char controlTopic[MQTTMessage::MQTT_MAX_TOPIC_LENGTH];
-
     while(1) {
-        absolute_time_t now = get_absolute_time();
+        // Runs every worker which is due or has been woken
+        async_context_poll(&mContext.core);
 
-        // Periodically send an update through the serial port just to show core0 is still functioning
-        if(is_nil_time(pingTimeout) || absolute_time_diff_us(now, pingTimeout) <= 0) {
-            DEBUG_PRINT(0, "Memory status: %d bytes free", getFreeMemory());
-            pingTimeout = make_timeout_time_ms(STDIO_PING_TIMEOUT);
-        }
+        // Sleep until the next one is due, or something wakes one
+        async_context_wait_for_work_until(&mContext.core, at_the_end_of_time);
+    }
+}
 
-        // Process any incoming serial data
-        if(mSerialController.updateUserData(mUserData)) {
-            // If user data has changed it's probably best to just reboot the board
-            stopCore1AndWriteUserData();
-            softwareReset();
-        }
+void Core0Executor::addWorker(WorkerType type, const char* name, WorkerFunction function) {
+    Worker& worker = mWorkers[type];
+    worker.mExecutor = this;
+    worker.mFunction = function;
+    worker.mName = name;
+    worker.mStats = {};
+
+    worker.mTimeout.do_work = onWorkerTimeout;
+    worker.mTimeout.user_data = &worker;
+    worker.mWake.do_work = onWorkerWake;
+    worker.mWake.user_data = &worker;
+    worker.mWake.work_pending = false;
+
+    // Everything runs once at startup, then as it asks to
+    async_context_add_when_pending_worker(&mContext.core, &worker.mWake);
+    async_context_add_at_time_worker_in_ms(&mContext.core, &worker.mTimeout, 0);
+}
 
-        // Check to see if we need to (re)connect to the network
-        checkNetworkConnection();
+void Core0Executor::runWorker(Worker& worker) {
+    // If we were woken before the timeout, the timeout starts again from now
+    async_context_remove_at_time_worker(&mContext.core, &worker.mTimeout);
 
-        if(mNetworkController.isConnected()) {
-            if(mWifiIndicator) mWifiIndicator->ledOn();
+    absolute_time_t now = get_absolute_time();
+    uint32_t nextRunMS = (this->*worker.mFunction)(now);
 
-            // We may need to trigger a new MQTT connection, so check for that now
-            if(createMQTTConnection()) {
-                mqttUpdateTimeout = make_timeout_time_ms(MQTT_UPDATE_CHECK_PERIOD_MS);
-            }
+    uint32_t runTime = absolute_time_diff_us(now, get_absolute_time());
+    ++worker.mStats.mRuns;
+    worker.mStats.mTotalUS += runTime;
+    if(runTime > worker.mStats.mMaxUS) {
+        worker.mStats.mMaxUS = runTime;
+    }
 
-            // If we are connected and it's time to publish sensor data, do so.
-            if(
-                mMQTTController.isConnected() &&
-                (is_nil_time(mqttUpdateTimeout) || absolute_time_diff_us(now, mqttUpdateTimeout) <= 0)
-            ) {
-                transmitData();
-                mqttUpdateTimeout = make_timeout_time_ms(MQTT_UPDATE_CHECK_PERIOD_MS);
-            }
-        } else {
-            if(mWifiIndicator) mWifiIndicator->ledOff();
-        }
+    if(nextRunMS != WAKE_ONLY) {
+        async_context_add_at_time_worker_in_ms(&mContext.core, &worker.mTimeout, nextRunMS);
+    }
+}
+
+void Core0Executor::onWorkerTimeout(async_context_t* context, async_at_time_worker_t* timeout) {
+    Worker* worker = static_cast<Worker*>(timeout->user_data);
+    worker->mExecutor->runWorker(*worker);
+}
+
+void Core0Executor::onWorkerWake(async_context_t* context, async_when_pending_worker_t* wake) {
+    Worker* worker = static_cast<Worker*>(wake->user_data);
+    worker->mExecutor->runWorker(*worker);
+}
+
+void Core0Executor::wakeWorker(void* worker) {
+    // Called from lwIP and stdio interrupts, and from core1, all of which the poll context allows
+    Worker* w = static_cast<Worker*>(worker);
+    async_context_set_work_pending(&w->mExecutor->mContext.core, &w->mWake);
+}
 
-        sleep_ms(1);
+uint32_t Core0Executor::runNetworkWorker(absolute_time_t now) {
+    // Check to see if we need to (re)connect to the network
+    checkNetworkConnection(now);
+
+    if(mNetworkController.isConnected()) {
+        if(mWifiIndicator) mWifiIndicator->ledOn();
+
+        // We may need to trigger a new MQTT connection, so check for that now. This also sends
+        // anything which has been queued
+        createMQTTConnection(now);
+    } else {
+        if(mWifiIndicator) mWifiIndicator->ledOff();
     }
+
+    if(!mRuntimeStats.mFirstPublishTimeMS && mMQTTController.getPublishStats().mPublished) {
+        BootTimeline::mark(BOOT_FIRST_PUBLISH);
+        mRuntimeStats.mFirstPublishTimeMS = BootTimeline::getTimeMS(BOOT_FIRST_PUBLISH);
+        printBootTimeline();
+    }
+
+    return NETWORK_POLL_PERIOD_MS;
+}
+
+uint32_t Core0Executor::runPublishWorker(absolute_time_t now) {
+    // If we are connected and it's time to publish sensor data, do so
+    if(mNetworkController.isConnected() && mMQTTController.isConnected()) {
+        transmitData();
+
+        // Get it on its way now, rather than at the next network poll
+        wakeWorker(&mWorkers[WORKER_NETWORK]);
+    }
+
+    return MQTT_UPDATE_CHECK_PERIOD_MS;
+}
+
+uint32_t Core0Executor::runSerialWorker(absolute_time_t now) {
+    // Process any incoming serial data
+    if(mSerialController.updateUserData(mUserData)) {
+        // If user data has changed it's probably best to just reboot the board
+        mUserData.clearNetworkCache();
+        stopCore1AndWriteUserData();
+        softwareReset();
+    }
+
+    return SERIAL_POLL_PERIOD_MS;
+}
+
+uint32_t Core0Executor::runDiagnosticsWorker(absolute_time_t now) {
+    // Periodically send an update through the serial port just to show core0 is still functioning
+    printRuntimeStats(now);
+    updateI2CClockRates(now);
+    publishI2CTelemetry(now);
+
+    return STDIO_PING_TIMEOUT;
+}
+
+uint32_t Core0Executor::runSensorWorkWorker(absolute_time_t now) {
+    // Help out with any sensor work core1 has queued
+    while(mWorkExecutor.runNext());
+
+    return WAKE_ONLY;
 }
 
 void Core0Executor::softwareReset() {
@@ -113,72 +264,110 @@ void Core0Executor::stopCore1AndWriteUserData() {
     multicore_lockout_end_blocking();
 }
 
-void Core0Executor::checkNetworkConnection() {
-    if(mUserData.hasNetworkUserData() && !mNetworkController.isConnected()) {
-        if(mWifiIndicator) mWifiIndicator->ledOff();
-        
-        DEBUG_PRINT(0, "Network is not connected, connecting....");
-        int connectResponse = mNetworkController.connectToWiFi(
-            mUserData.getSSID().c_str(),
-            mUserData.getPSK().c_str(),
-            mUserData.getHostName().c_str()
-        );
-        DEBUG_PRINT(0, "...connect %s (%d)", 
-            connectResponse ? "failed" : "succeeded",
-            connectResponse
-        );
+void Core0Executor::checkNetworkConnection(absolute_time_t now) {
+    if(!mUserData.hasNetworkUserData()) {
+        return;
+    }
 
-        if(!connectResponse) {
-            if(mWifiIndicator) mWifiIndicator->ledOn();
-            mMQTTController.initMQTTClient();
-        }
+    // Returns true each time the connection comes (back) up
+    if(mNetworkController.update(now)) {
+        ++mRuntimeStats.mWiFiConnectCount;
+        BootTimeline::mark(BOOT_WIFI_CONNECTED);
+        if(mWifiIndicator) mWifiIndicator->ledOn();
+        mMQTTController.initMQTTClient();
     }
 }
 
-bool Core0Executor::createMQTTConnection() {
-    // If we aren't connected to the broker yet, connect and subscribe
-    if(!mMQTTController.isConnected() && mUserData.hasMQTTUserData()) {
-        DEBUG_PRINT(0, "Not connected to MQTT broker, opening connection...");
-
-        // Lookup the broker's IP
-        NetworkController::DNSRequest brokerRequest;
-        brokerRequest.mResolvedAddress.addr = 0;
-        brokerRequest.mHost = mUserData.getBrokerAddress().c_str();
-        mNetworkController.resolveHost(brokerRequest);
+bool Core0Executor::createMQTTConnection(absolute_time_t now) {
+    // If we aren't connected to the broker yet (and aren't backing off), start a new connection
+    if(mUserData.hasMQTTUserData() && mMQTTController.readyToConnect(now)) {
+        // Lookup the broker's IP. This won't block, so we may have to come back for it
+        NetworkController::DNSResult result = mNetworkController.resolveHost(mBrokerRequest, now);
 
         // If we have the broker's address, proceed with the connection
-        if(brokerRequest.mResolvedAddress.addr) {
+        if(result == NetworkController::DNS_RESOLVED) {
             char ipString[16];
-            NetworkController::ipAddressToString(ipString, &brokerRequest.mResolvedAddress);
-            DEBUG_PRINT(0, "Broker resolved (IP: %s). Connecting to broker...", ipString);
+            NetworkController::ipAddressToString(ipString, &mBrokerRequest.mResolvedAddress);
+            DEBUG_PRINT(0, "Not connected to MQTT broker, connecting (IP: %s)...", ipString);
 
             mMQTTController.setBrokerParameters(
-                brokerRequest.mResolvedAddress,
+                mBrokerRequest.mResolvedAddress,
                 MQTT_PORT
             );
             mMQTTController.setClientParameters(
                 mUserData.getHostName().c_str()
             );
-
-            if(!mMQTTController.connectToBrokerBlocking(2000)) {
-                DEBUG_PRINT(0, "Broker connection failed");
-            } else {
-                DEBUG_PRINT(0, "Broker connection succeeded. Subscribing to control topics")
-                for(auto& s : mSensorGroups) {
-                    if(s.hasTopics()) {
-                        mMQTTController.subscribeToTopic(s.getControlTopic());
-                    }
-                }
-                DEBUG_PRINT(0, "MQTT broker subscription complete");
-                return true;
-            }
-        } else {
+            mMQTTController.startConnection(now);
+        } else if(result == NetworkController::DNS_FAILED) {
             DEBUG_PRINT(0, "Broker IP resolution failed");
+            mMQTTController.connectionFailed(now);
         }
     }
+
+    // Returns true once the connection and all control topic subscriptions have completed
+    if(mMQTTController.update(now)) {
+        ++mRuntimeStats.mBrokerConnectCount;
+        BootTimeline::mark(BOOT_BROKER_CONNECTED);
+        updateNetworkCache();
+        if(mUserData.getPayloadFormat() == UserData::PAYLOAD_RAW) {
+            publishSchemas();
+        }
+        return true;
+    }
+
     return false;
 }
 
+void Core0Executor::updateNetworkCache() {
+    UserData::NetworkCache cache = {};
+    if(!mNetworkController.getConnectionDetails(cache.mBSSID, cache.mChannel, cache.mIPAddress, cache.mNetmask, cache.mGateway)) {
+        return;
+    }
+    cache.mBrokerAddress = mBrokerRequest.mResolvedAddress.addr;
+
+    // Only touch flash when something has actually changed
+    if(mUserData.hasNetworkCache() && (cache == mUserData.getNetworkCache())) {
+        return;
+    }
+
+    DEBUG_PRINT(0, "Saving connection details for fast reconnect");
+    mUserData.setNetworkCache(cache);
+    stopCore1AndWriteUserData();
+}
+
+void Core0Executor::updateI2CClockRates(absolute_time_t now) {
+    bool changed = false;
+
+    // Each save is a flash erase, so a bus which keeps changing its mind waits its turn
+    if(!is_nil_time(mNextI2CClockSaveTime) && (absolute_time_diff_us(mNextI2CClockSaveTime, now) < 0)) {
+        return;
+    }
+
+    for(int i = 0; i < I2CInterface::getInterfaceCount(); ++i) {
+        I2CInterface& interface = I2CInterface::getInterface(i);
+        uint8_t bus = interface.getArbiter().getBusIndex();
+        const I2CClockTuner& tuner = interface.getClockTuner();
+
+        // Only once it has settled, so we don't write every step of the way up, and not while it's
+        // retrying a rate which failed before
+        if(!tuner.isTuning() || !tuner.hasRateToSave() || (bus >= UserData::MAX_I2C_BUSES)) {
+            continue;
+        }
+
+        uint32_t baud = interface.getBaudRate();
+        if(baud != mUserData.getI2CBaudRate(bus)) {
+            DEBUG_PRINT(0, "Saving I2C%d clock rate of %dkHz", bus, baud / 1000);
+            mUserData.setI2CBaudRate(bus, baud);
+            changed = true;
+        }
+    }
+
+    if(changed) {
+        stopCore1AndWriteUserData();
+        mNextI2CClockSaveTime = delayed_by_ms(now, I2C_CLOCK_SAVE_PERIOD_MS);
+    }
+}
+
 void Core0Executor::transmitData() {
     transmitSensorData();
 }
@@ -188,16 +377,277 @@ void Core0Executor::transmitSensorData() {
         return;
     }
 
-    if(mMailbox.latestSensorDataToJSON(mSensorGroups, mOutgoingMQTTMessageBuffer)) {
-        for(auto& msg : mOutgoingMQTTMessageBuffer) {
-            if(msg.mReadyToSend) {
-                DEBUG_PRINT(0, "Publishing MQTT message *");
-                mMQTTController.publishMessage(msg);
+    if(encodeSensorFrame()) {
+        UserData::PublishMode publishMode = mUserData.getPublishMode();
+        uint32_t changedGroups = 0;
+
+        for(int i = 0; i < mOutgoingMQTTMessageBuffer.size(); ++i) {
+            MQTTMessage& msg = mOutgoingMQTTMessageBuffer[i];
+            if(!msg.mReadyToSend) {
+                continue;
+            }
+
+            // Only groups whose data has changed go in the batch
+            uint32_t payloadHash = (publishMode != UserData::PUBLISH_PER_GROUP) ? fnv1aHash((const uint8_t*) msg.mPayload, msg.mPayloadLength) : 0;
+            if(payloadHash != mLastPayloadHashes[i]) {
+                mLastPayloadHashes[i] = payloadHash;
+                changedGroups |= (1 << i);
+            }
+
+            // Sequence numbers go in after the hash so they don't count as a change. They let the
+            // receiving end spot lost frames
+            if(mUserData.getPayloadFormat() == UserData::PAYLOAD_RAW) {
+                SensorGroup::setFrameSequence((uint8_t*) msg.mPayload, ++mFrameSequences[i]);
+            }
+
+            if(publishMode != UserData::PUBLISH_BATCH_ONLY) {
+                DEBUG_PRINT_VERBOSE(0, "Publishing MQTT message *");
+                mMQTTController.queueMessage(msg);
             }
         }
+
+        if(publishMode != UserData::PUBLISH_PER_GROUP) {
+            transmitBatch(changedGroups, (publishMode == UserData::PUBLISH_BATCH_ONLY));
+        }
     }
 }
 
+bool Core0Executor::encodeSensorFrame() {
+    SensorDataMessage* frame = mMailbox.receiveSensorFrame();
+    if(!frame) {
+        return false;
+    }
+
+    // Each group's payload is a separate piece of work, so core1 can take some if it's idle
+    mEncodeFrame = frame;
+    mEncodeFormat = mUserData.getPayloadFormat();
+    for(int i = 0; i < mSensorGroups.size(); ++i) {
+        mWorkExecutor.submit(encodeSensorGroup, this, i, WorkExecutor::ANY_CORE, mEncodeBatch);
+    }
+    mWorkExecutor.runUntilComplete(mEncodeBatch);
+
+    frame->release();
+    mEncodeFrame = nullptr;
+
+    return true;
+}
+
+void Core0Executor::encodeSensorGroup(void* context, uint32_t groupIndex) {
+    Core0Executor* executor = static_cast<Core0Executor*>(context);
+
+    executor->mEncodeFrame->groupToMQTT(
+        groupIndex,
+        executor->mGroupDataOffsets[groupIndex],
+        executor->mSensorGroups[groupIndex],
+        executor->mOutgoingMQTTMessageBuffer[groupIndex],
+        executor->mEncodeFormat
+    );
+}
+
+void Core0Executor::transmitBatch(uint32_t changedGroups, bool batchOnly) {
+    // Groups in a batch which is still queued haven't gone out yet, so they go in this one too.
+    // The new batch replaces the queued one.
+    if(!mMQTTController.getPublishQueue().contains(BATCH_COALESCE_KEY)) {
+        mQueuedBatchGroups = 0;
+    }
+    uint32_t batchGroups = changedGroups | mQueuedBatchGroups;
+    if(!batchGroups) {
+        return;
+    }
+
+    mMQTTController.initializeMessage(mBatchMessage);
+    snprintf(mBatchMessage.mTopic, MQTTMessage::MQTT_MAX_TOPIC_LENGTH, "%s/%s/batch",
+        MQTTMessage::AUTOBLOOMER_TOPIC_NAME,
+        mUserData.getHostName().c_str()
+    );
+
+    // JSON and CBOR payloads are keyed by each group's "<location>/<name>". Raw frames carry their
+    // group index instead, which matches the "group" in the schemas
+    const int keyOffset = strlen(MQTTMessage::AUTOBLOOMER_TOPIC_NAME) + 1;
+    const UserData::PayloadFormat format = mUserData.getPayloadFormat();
+
+    // Work out what fits first, a CBOR map needs its size up front. Anything that doesn't fit
+    // will have to go out on its own topic
+    int batchSize = (format == UserData::PAYLOAD_CBOR) ? CBOR_MAP_HEADER_SIZE : (format == UserData::PAYLOAD_RAW) ? 0 : 2;
+    int groupCount = 0;
+    for(int i = 0; i < mOutgoingMQTTMessageBuffer.size(); ++i) {
+        if(!(batchGroups & (1 << i))) {
+            continue;
+        }
+
+        const MQTTMessage& msg = mOutgoingMQTTMessageBuffer[i];
+        int needed = msg.mPayloadLength;
+        switch(format) {
+            case UserData::PAYLOAD_CBOR:    needed += strlen(msg.mTopic + keyOffset) + CBOR_TEXT_HEADER_SIZE;   break;
+            case UserData::PAYLOAD_RAW:     needed += RAW_BATCH_ENTRY_HEADER_SIZE;                              break;
+            default:                        needed += strlen(msg.mTopic + keyOffset) + 6;                       break;  // Quotes and separators
+        }
+
+        if(((batchSize + needed) >= MQTTMessage::MQTT_MAX_PAYLOAD_LENGTH) || (msg.mPayloadLength > UINT8_MAX)) {
+            if(batchOnly) {
+                mMQTTController.queueMessage(msg);
+            }
+            batchGroups &= ~(1 << i);
+            continue;
+        }
+
+        batchSize += needed;
+        ++groupCount;
+    }
+
+    if(!batchGroups) {
+        return;
+    }
+
+    CborWriter writer((uint8_t*) mBatchMessage.mPayload, MQTTMessage::MQTT_MAX_PAYLOAD_LENGTH);
+    char* payload = mBatchMessage.mPayload;
+    int written = 0;
+    if(format == UserData::PAYLOAD_CBOR) {
+        writer.writeMapHeader(groupCount);
+    } else if(format == UserData::PAYLOAD_JSON) {
+        payload[written++] = '{';
+    }
+
+    for(int i = 0; i < mOutgoingMQTTMessageBuffer.size(); ++i) {
+        if(!(batchGroups & (1 << i))) {
+            continue;
+        }
+
+        // Group payloads are already encoded, so they go in as they are
+        const MQTTMessage& msg = mOutgoingMQTTMessageBuffer[i];
+        const char* key = msg.mTopic + keyOffset;
+        switch(format) {
+            case UserData::PAYLOAD_CBOR:
+                writer.writeText(key);
+                writer.writeEncoded((const uint8_t*) msg.mPayload, msg.mPayloadLength);
+                break;
+
+            case UserData::PAYLOAD_RAW:
+                // [group index][frame length][frame]
+                payload[written++] = i;
+                payload[written++] = msg.mPayloadLength;
+                memcpy(payload + written, msg.mPayload, msg.mPayloadLength);
+                written += msg.mPayloadLength;
+                break;
+
+            default:
+                written += snprintf(payload + written, MQTTMessage::MQTT_MAX_PAYLOAD_LENGTH - written, "%s\"%s\": %s",
+                    (written > 1) ? ", " : "",
+                    key,
+                    msg.mPayload
+                );
+                break;
+        }
+
+        if(msg.mQoS > mBatchMessage.mQoS) {
+            mBatchMessage.mQoS = msg.mQoS;
+        }
+        ++mRuntimeStats.mBatchedGroupCount;
+    }
+
+    if(format == UserData::PAYLOAD_CBOR) {
+        written = writer.getLength();
+    } else if(format == UserData::PAYLOAD_JSON) {
+        payload[written++] = '}';
+        payload[written] = 0;
+    }
+    mBatchMessage.mPayloadLength = written;
+    COUNT_COPIED_BYTES(COPY_ENCODE, written);
+
+    mBatchMessage.mCoalesceKey = BATCH_COALESCE_KEY;
+    mMQTTController.queueMessage(mBatchMessage);
+    mQueuedBatchGroups = batchGroups;
+    ++mRuntimeStats.mBatchCount;
+}
+
+void Core0Executor::publishSchemas() {
+    // Retained, so anything subscribing later can still decode the raw frames
+    for(int i = 0; i < mSensorGroups.size(); ++i) {
+        const SensorGroup& group = mSensorGroups[i];
+        if(!group.hasTopics()) {
+            continue;
+        }
+
+        mMQTTController.initializeMessage(mSchemaMessage);
+        strncpy(mSchemaMessage.mTopic, group.getSchemaTopic(), MQTTMessage::MQTT_MAX_TOPIC_LENGTH - 1);
+        mSchemaMessage.mPayloadLength = group.writeSchema(mSchemaMessage.mPayload, MQTTMessage::MQTT_MAX_PAYLOAD_LENGTH, i);
+        if(!mSchemaMessage.mPayloadLength) {
+            DEBUG_PRINT(0, "Schema for group %d doesn't fit in a message", i);
+            continue;
+        }
+
+        mSchemaMessage.mQoS = SCHEMA_QOS;
+        mSchemaMessage.mRetain = true;
+        mMQTTController.queueMessage(mSchemaMessage);
+    }
+}
+
+void Core0Executor::publishI2CTelemetry(absolute_time_t now) {
+    if(!mUserData.hasMQTTUserData() || !I2CRetryPolicy::getPolicyCount()) {
+        return;
+    }
+
+    if(!is_nil_time(mNextI2CTelemetryTime) && (absolute_time_diff_us(mNextI2CTelemetryTime, now) < 0)) {
+        return;
+    }
+    mNextI2CTelemetryTime = delayed_by_ms(now, I2C_TELEMETRY_PERIOD_MS);
+
+    mMQTTController.initializeMessage(mI2CTelemetryMessage);
+    snprintf(mI2CTelemetryMessage.mTopic, MQTTMessage::MQTT_MAX_TOPIC_LENGTH, "%s/%s/i2c",
+        MQTTMessage::AUTOBLOOMER_TOPIC_NAME,
+        mUserData.getHostName().c_str()
+    );
+
+    // Keyed by "<bus>/<address>", or "<bus>.<channel>/<address>" behind a multiplexer. Always JSON,
+    // whatever the sensor data goes out as
+    char* payload = mI2CTelemetryMessage.mPayload;
+    const int payloadSize = MQTTMessage::MQTT_MAX_PAYLOAD_LENGTH - 1;
+    int written = 1;
+    payload[0] = '{';
+    for(int i = 0; i < I2CRetryPolicy::getPolicyCount(); ++i) {
+        const I2CRetryPolicy& policy = I2CRetryPolicy::getPolicy(i);
+        const I2CRetryPolicy::Stats& stats = policy.getStats();
+        uint16_t route = policy.getInterface()->getRoute();
+        int bus = (route >> 8) - 1;
+        int channel = (route & 0xFF) - 1;
+
+        char key[16];
+        if(channel < 0) {
+            snprintf(key, sizeof(key), "%d/0x%02x", bus, policy.getAddress());
+        } else {
+            snprintf(key, sizeof(key), "%d.%d/0x%02x", bus, channel, policy.getAddress());
+        }
+
+        int entry = snprintf(payload + written, payloadSize - written,
+            "%s\"%s\":{\"ops\":%u,\"att\":%u,\"ok\":%u,\"retry\":%u,\"fail\":%u,\"avg_us\":%u,\"max_us\":%u,\"bus_rst\":%u,\"sen_rst\":%u}",
+            (written > 1) ? "," : "",
+            key,
+            stats.mOperations,
+            stats.mAttempts,
+            stats.mSucceeded,
+            stats.mRecovered,
+            stats.mFailed,
+            stats.mOperations ? (stats.mTotalLatencyUS / stats.mOperations) : 0,
+            stats.mMaxLatencyUS,
+            stats.mBusResets,
+            stats.mSensorResets
+        );
+
+        // Leave out whatever doesn't fit rather than sending a broken object
+        if((entry < 0) || ((written + entry) >= (payloadSize - 1))) {
+            DEBUG_PRINT(0, "I2C telemetry only has room for %d of %d devices", i, I2CRetryPolicy::getPolicyCount());
+            break;
+        }
+        written += entry;
+    }
+    payload[written++] = '}';
+    payload[written] = 0;
+
+    mI2CTelemetryMessage.mPayloadLength = written;
+    mI2CTelemetryMessage.mCoalesceKey = I2C_TELEMETRY_COALESCE_KEY;
+    mMQTTController.queueMessage(mI2CTelemetryMessage);
+}
+
 uint32_t Core0Executor::getFreeMemory() {
    struct mallinfo m = mallinfo();
 
@@ -209,3 +659,279 @@ uint32_t Core0Executor::getHeapSize() {
    
    return &__StackLimit  - &__bss_end__;
 }
+
+void Core0Executor::printBootTimeline() {
+    DEBUG_PRINT(0, "First publish %dms after boot (%s connect)",
+        mRuntimeStats.mFirstPublishTimeMS,
+        mNetworkController.usedFastConnect() ? "fast" : "full"
+    );
+
+    // Events which haven't happened yet (sensors still initializing, say) are left out
+    for(int i = 0; i < NUM_BOOT_EVENTS; ++i) {
+        BootEvent event = (BootEvent) i;
+        if(BootTimeline::hasHappened(event)) {
+            DEBUG_PRINT(0, "  +- %s: %dms", BootTimeline::getEventName(event), BootTimeline::getTimeMS(event));
+        }
+    }
+
+    // Read while core1 may still be initializing them, which is fine for a report
+    for(auto& group : mSensorGroups) {
+        for(int i = 0; i < group.getSensorCount(); ++i) {
+            const Sensor& sensor = group.getSensor(i);
+            DEBUG_PRINT(0, "  +- %s: %s, %dms (%d attempts)",
+                sensor.getDataLayout().mSensorName,
+                Sensor::getInitStageName(sensor.getInitStage()),
+                sensor.getInitCompleteTimeMS(),
+                sensor.getInitAttempts()
+            );
+        }
+    }
+}
+
+void Core0Executor::printRuntimeStats(absolute_time_t now) {
+    uint32_t freeMemory = getFreeMemory();
+    if(freeMemory < mRuntimeStats.mMinFreeMemory) {
+        mRuntimeStats.mMinFreeMemory = freeMemory;
+    }
+
+    DEBUG_PRINT(0, "Uptime: %llus. Memory: %d bytes free (lowest %d)",
+        to_us_since_boot(now) / 1000000,
+        freeMemory,
+        mRuntimeStats.mMinFreeMemory
+    );
+    // Publish rate since the last report
+    const MQTTController::PublishStats& publishStats = mMQTTController.getPublishStats();
+    uint32_t publishRate = 0;
+    absolute_time_t lastReportTime = mRuntimeStats.mLastReportTime;
+    int64_t reportPeriodUS = absolute_time_diff_us(lastReportTime, now);
+    if(!is_nil_time(lastReportTime) && (reportPeriodUS > 0)) {
+        publishRate = ((uint64_t) (publishStats.mPublished - mRuntimeStats.mLastReportPublishCount) * 1000000) / reportPeriodUS;
+    }
+    mRuntimeStats.mLastReportPublishCount = publishStats.mPublished;
+    mRuntimeStats.mLastReportTime = now;
+
+    DEBUG_PRINT(0, "  +- Publishes: %d (%d failed, %d/s), WiFi connects: %d, broker connects: %d",
+        publishStats.mPublished,
+        publishStats.mPublishErrors,
+        publishRate,
+        mRuntimeStats.mWiFiConnectCount,
+        mRuntimeStats.mBrokerConnectCount
+    );
+    DEBUG_PRINT(0, "  +- MQTT completed: %d, timed out: %d, retried: %d, dropped: %d, window full: %d, max latency: %dus",
+        publishStats.mCompleted,
+        publishStats.mTimedOut,
+        publishStats.mRetried,
+        publishStats.mDropped,
+        publishStats.mWindowFull,
+        publishStats.mMaxLatencyUS
+    );
+    const PublishQueue& publishQueue = mMQTTController.getPublishQueue();
+    DEBUG_PRINT(0, "  +- Publish queue depth: %d (max %d), coalesced: %d, dropped: %d",
+        publishQueue.getDepth(),
+        publishQueue.getStats().mMaxDepth,
+        publishQueue.getStats().mCoalesced,
+        publishQueue.getStats().mDropped
+    );
+    if(mUserData.getPublishMode() != UserData::PUBLISH_PER_GROUP) {
+        DEBUG_PRINT(0, "  +- Batches: %d, group updates batched: %d",
+            mRuntimeStats.mBatchCount,
+            mRuntimeStats.mBatchedGroupCount
+        );
+    }
+    DEBUG_PRINT(0, "  +- First publish: %dms, dropped control messages: %d, sensor frames exhausted: %d",
+        mRuntimeStats.mFirstPublishTimeMS,
+        mMailbox.getDroppedSensorControlMessageCount(),
+        mMailbox.getSensorFrameExhaustedCount()
+    );
+    printWorkerStats(is_nil_time(lastReportTime) ? 0 : reportPeriodUS);
+    printWorkStats();
+    printI2CStats(is_nil_time(lastReportTime) ? 0 : reportPeriodUS);
+#if COPY_STATS
+    if(publishStats.mPublished) {
+        uint32_t stageBytes[NUM_COPY_STAGES];
+        uint32_t totalBytes = 0;
+        for(int i = 0; i < NUM_COPY_STAGES; ++i) {
+            stageBytes[i] = CopyStats::getCopiedBytes((CopyStage) i) / publishStats.mPublished;
+            totalBytes += stageBytes[i];
+        }
+
+        DEBUG_PRINT(0, "  +- Bytes copied per publish: %d (cache %d, mailbox %d, encode %d, queue %d, in flight %d, lwIP %d)",
+            totalBytes,
+            stageBytes[COPY_SENSOR_CACHE],
+            stageBytes[COPY_MAILBOX],
+            stageBytes[COPY_ENCODE],
+            stageBytes[COPY_PUBLISH_QUEUE],
+            stageBytes[COPY_IN_FLIGHT],
+            stageBytes[COPY_LWIP]
+        );
+    }
+#endif
+}
+
+void Core0Executor::printWorkerStats(uint32_t reportPeriodUS) {
+    uint32_t busyUS = 0;
+    for(auto& worker : mWorkers) {
+        DEBUG_PRINT(0, "  +- Worker %s: %d runs, avg %dus, max %dus",
+            worker.mName,
+            worker.mStats.mRuns,
+            worker.mStats.mRuns ? (worker.mStats.mTotalUS / worker.mStats.mRuns) : 0,
+            worker.mStats.mMaxUS
+        );
+        busyUS += worker.mStats.mTotalUS;
+    }
+
+    // Whatever the workers didn't use, core0 spent asleep (or in interrupts)
+    uint32_t busyPercent = 0;
+    if(reportPeriodUS) {
+        busyPercent = ((uint64_t) (busyUS - mRuntimeStats.mLastReportBusyUS) * 100) / reportPeriodUS;
+    }
+    mRuntimeStats.mLastReportBusyUS = busyUS;
+
+    DEBUG_PRINT(0, "  +- Core 0 busy: %d%%", busyPercent);
+}
+
+void Core0Executor::printI2CStats(uint32_t reportPeriodUS) {
+    for(int i = 0; i < I2CInterface::getInterfaceCount(); ++i) {
+        I2CInterface& interface = I2CInterface::getInterface(i);
+        const I2CBusArbiter& bus = interface.getArbiter();
+        const I2CBusArbiter::Stats& stats = bus.getStats();
+
+        // Busy is from grant to release, so it includes the gaps inside batched transactions
+        uint32_t busyPercent = 0;
+        uint32_t transactionRate = 0;
+        if(reportPeriodUS) {
+            busyPercent = ((stats.mBusyUS - mRuntimeStats.mLastReportI2CBusyUS[i]) * 100) / reportPeriodUS;
+            transactionRate = ((uint64_t) (stats.mTransactions - mRuntimeStats.mLastReportI2CTransactions[i]) * 1000000) / reportPeriodUS;
+        }
+        mRuntimeStats.mLastReportI2CBusyUS[i] = stats.mBusyUS;
+        mRuntimeStats.mLastReportI2CTransactions[i] = stats.mTransactions;
+
+        DEBUG_PRINT(0, "  +- I2C%d: %d transactions (%d/s) in %d grants, busy %d%%, wait avg %dus, max %dus (%d contended, %d late)",
+            bus.getBusIndex(),
+            stats.mTransactions,
+            transactionRate,
+            stats.mGrants,
+            busyPercent,
+            stats.mGrants ? (stats.mTotalWaitUS / stats.mGrants) : 0,
+            stats.mMaxWaitUS,
+            stats.mContended,
+            stats.mDeadlinesMissed
+        );
+        DEBUG_PRINT(0, "  +- I2C%d errors: %d (%d timeouts), bus inits: %d (%d skipped), resets: %d",
+            bus.getBusIndex(),
+            stats.mErrors,
+            stats.mTimeouts,
+            stats.mBusInits,
+            stats.mBusInitsSkipped,
+            stats.mBusResets
+        );
+        DEBUG_PRINT(0, "  +- I2C%d stuck: %d (%d recovered), recovery last %dus, max %dus",
+            bus.getBusIndex(),
+            stats.mStuckBus,
+            stats.mStuckBusRecovered,
+            stats.mLastRecoveryUS,
+            stats.mMaxRecoveryUS
+        );
+
+        const I2CClockTuner& tuner = interface.getClockTuner();
+        DEBUG_PRINT(0, "  +- I2C%d clock: %dkHz (%s), stepped up %d, fell back %d",
+            bus.getBusIndex(),
+            interface.getBaudRate() / 1000,
+            !tuner.isTuning() ? "fixed" : (tuner.isSettled() ? "settled" : "probing"),
+            tuner.getStats().mStepsUp,
+            tuner.getStats().mFallbacks
+        );
+        for(int d = 0; d < tuner.getDeviceCount(); ++d) {
+            const I2CClockTuner::DeviceStats& device = tuner.getDeviceStats(d);
+            DEBUG_PRINT(0, "    [0x%02x] %d transactions, NACKs: %d, timeouts: %d, CRC errors: %d",
+                device.mAddress,
+                device.mTransactions,
+                device.mNacks,
+                device.mTimeouts,
+                device.mCRCErrors
+            );
+        }
+
+        const I2CMultiplexer* mux = interface.getMultiplexer();
+        if(!mux) {
+            continue;
+        }
+
+        const I2CMultiplexer::Stats& muxStats = mux->getStats();
+        DEBUG_PRINT(0, "  +- I2C%d mux 0x%02x: %d selects, %d switches (%d%% cached), %d failed",
+            bus.getBusIndex(),
+            mux->getAddress(),
+            muxStats.mSelects,
+            muxStats.mSwitches,
+            muxStats.mSelects ? (((muxStats.mSelects - muxStats.mSwitches) * 100) / muxStats.mSelects) : 0,
+            muxStats.mSwitchFailures
+        );
+        for(uint8_t c = 0; c < I2CMultiplexer::NUM_CHANNELS; ++c) {
+            const I2CMultiplexer::ChannelStats& channel = mux->getChannelStats(c);
+            if(!channel.mInterfaces) {
+                continue;
+            }
+
+            uint32_t channelRate = 0;
+            if(reportPeriodUS) {
+                channelRate = ((uint64_t) (channel.mTransactions - mRuntimeStats.mLastReportMuxTransactions[i][c]) * 1000000) / reportPeriodUS;
+            }
+            mRuntimeStats.mLastReportMuxTransactions[i][c] = channel.mTransactions;
+
+            DEBUG_PRINT(0, "    [ch%d] %d interfaces, %d transactions (%d/s)",
+                c,
+                channel.mInterfaces,
+                channel.mTransactions,
+                channelRate
+            );
+        }
+    }
+
+    for(int i = 0; i < I2CRetryPolicy::getPolicyCount(); ++i) {
+        const I2CRetryPolicy& policy = I2CRetryPolicy::getPolicy(i);
+        const I2CRetryPolicy::Stats& stats = policy.getStats();
+        DEBUG_PRINT(0, "  +- I2C device 0x%02x: %d ops in %d attempts (%d retried ok, %d failed), avg %dus, max %dus, bus resets %d, sensor resets %d",
+            policy.getAddress(),
+            stats.mOperations,
+            stats.mAttempts,
+            stats.mRecovered,
+            stats.mFailed,
+            stats.mOperations ? (stats.mTotalLatencyUS / stats.mOperations) : 0,
+            stats.mMaxLatencyUS,
+            stats.mBusResets,
+            stats.mSensorResets
+        );
+    }
+}
+
+void Core0Executor::printWorkStats() {
+#if FIXED_CORE_SPLIT
+    const char* mode = "fixed split";
+#else
+    const char* mode = "work stealing";
+#endif
+
+    for(int core = 0; core < WorkExecutor::NUM_CORES; ++core) {
+        const WorkExecutor::CoreStats& stats = mWorkExecutor.getCoreStats(core);
+        DEBUG_PRINT(0, "  +- Core %d work: %d run (%d stolen), busy %llums, queue latency avg %dus, max %dus",
+            core,
+            stats.mExecuted,
+            stats.mStolen,
+            stats.mBusyUS / 1000,
+            stats.mExecuted ? (uint32_t) (stats.mTotalQueueLatencyUS / stats.mExecuted) : 0,
+            stats.mMaxQueueLatencyUS
+        );
+    }
+
+    const WorkExecutor::BatchStats& updateStats = mWorkExecutor.getBatchStats(WorkExecutor::BATCH_SENSOR_UPDATE);
+    const WorkExecutor::BatchStats& encodeStats = mWorkExecutor.getBatchStats(WorkExecutor::BATCH_PAYLOAD_ENCODE);
+    DEBUG_PRINT(0, "  +- Sensor updates: %d, avg %dus, max %dus. Encodes: %d, avg %dus, max %dus (%s)",
+        updateStats.mCount,
+        updateStats.mCount ? (uint32_t) (updateStats.mTotalTimeUS / updateStats.mCount) : 0,
+        updateStats.mMaxTimeUS,
+        encodeStats.mCount,
+        encodeStats.mCount ? (uint32_t) (encodeStats.mTotalTimeUS / encodeStats.mCount) : 0,
+        encodeStats.mMaxTimeUS,
+        mode
+    );
+}
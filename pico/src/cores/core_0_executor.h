@@ -8,47 +8,158 @@
 #include "network/network_controller.h"
 #include "network/mqtt_controller.h"
 #include "board_hardware/wifi_indicator.h"
+#include "cores/work_executor.h"
+#include "sensors/hardware_interfaces/sensor_i2c_interface.h"
+#include "sensors/hardware_interfaces/i2c_retry_policy.h"
+
+#include "pico/async_context_poll.h"
 
 
 
 class Core0Executor {
     public:
-        Core0Executor(MulticoreMailbox& mailbox, vector<SensorGroup>& sensorGroups, WiFiIndicator* wifiIndicator);
+        Core0Executor(MulticoreMailbox& mailbox, WorkExecutor& workExecutor, vector<SensorGroup>& sensorGroups, WiFiIndicator* wifiIndicator);
 
+        // Sets up the sensor groups and I2C buses from flash, so it has to be done before core1 is
+        // launched and starts using them
+        void loadUserData();
         void initialize();
         
         static void loop();
         static void setExecutor(Core0Executor& executor);
 
     private:
+        // Core0's work is split into workers on an async_context. Each runs when it's due or when
+        // something wakes it, and says how long until it next needs to run
+        enum WorkerType {
+            WORKER_NETWORK,             // Wi-Fi and broker (re)connection, MQTT housekeeping
+            WORKER_PUBLISH,             // Encoding and queuing sensor data
+            WORKER_SERIAL,              // Serial configuration commands
+            WORKER_DIAGNOSTICS,         // Runtime stats
+            WORKER_SENSOR_WORK,         // Sensor work core1 has queued, which this core can take
+
+            NUM_WORKER_TYPES
+        };
+
+        struct WorkerStats {
+            uint32_t mRuns;
+            uint32_t mTotalUS;
+            uint32_t mMaxUS;
+        };
+
+        typedef uint32_t (Core0Executor::*WorkerFunction)(absolute_time_t now);
+
+        struct Worker {
+            async_at_time_worker_t mTimeout;
+            async_when_pending_worker_t mWake;
+            Core0Executor* mExecutor;
+            WorkerFunction mFunction;
+            const char* mName;
+            WorkerStats mStats;
+        };
+
         void doLoop();
 
+        void addWorker(WorkerType type, const char* name, WorkerFunction function);
+        void runWorker(Worker& worker);
+        static void onWorkerTimeout(async_context_t* context, async_at_time_worker_t* timeout);
+        static void onWorkerWake(async_context_t* context, async_when_pending_worker_t* wake);
+        static void wakeWorker(void* worker);
+
+        uint32_t runNetworkWorker(absolute_time_t now);
+        uint32_t runPublishWorker(absolute_time_t now);
+        uint32_t runSerialWorker(absolute_time_t now);
+        uint32_t runDiagnosticsWorker(absolute_time_t now);
+        uint32_t runSensorWorkWorker(absolute_time_t now);
+
         void softwareReset();
         void stopCore1AndWriteUserData();
         
-        void checkNetworkConnection();
-        bool createMQTTConnection();
+        void checkNetworkConnection(absolute_time_t now);
+        bool createMQTTConnection(absolute_time_t now);
+        void updateNetworkCache();
+        void updateI2CClockRates(absolute_time_t now);
 
         void transmitData();
         void transmitSensorData();
+        bool encodeSensorFrame();
+        static void encodeSensorGroup(void* context, uint32_t groupIndex);
+        void transmitBatch(uint32_t changedGroups, bool batchOnly);
+        void publishSchemas();
+        void publishI2CTelemetry(absolute_time_t now);
 
         uint32_t getFreeMemory();
         uint32_t getHeapSize();
+        void printBootTimeline();
+        void printRuntimeStats(absolute_time_t now);
+        void printWorkStats();
+        void printWorkerStats(uint32_t reportPeriodUS);
+        void printI2CStats(uint32_t reportPeriodUS);
 
         constexpr static int STDIO_PING_TIMEOUT                 = 2000;
+        constexpr static uint32_t NETWORK_POLL_PERIOD_MS        = 10;       // For timeouts, lwIP events wake it sooner
+        constexpr static uint32_t SERIAL_POLL_PERIOD_MS         = 100;      // In case stdio can't tell us about input
+        constexpr static uint32_t WAKE_ONLY                     = UINT32_MAX;
+#if SYNTHETIC_LOAD_MODE
+        constexpr static uint16_t MQTT_UPDATE_CHECK_PERIOD_MS   = 1;        // Publish whenever core1 has new data
+#else
         constexpr static uint16_t MQTT_UPDATE_CHECK_PERIOD_MS   = 750;
+#endif
         constexpr static int JSON_BUFFER_SIZE                   = 256;
+        constexpr static int8_t BATCH_COALESCE_KEY              = INT8_MAX;     // Group indices are used for the rest
+        constexpr static int CBOR_MAP_HEADER_SIZE               = 1;            // Fewer than 24 groups
+        constexpr static int CBOR_TEXT_HEADER_SIZE              = 2;            // Keys are shorter than 256 bytes
+        constexpr static int RAW_BATCH_ENTRY_HEADER_SIZE        = 2;            // Group index and frame length
+        constexpr static uint8_t SCHEMA_QOS                     = 1;
+        constexpr static uint32_t I2C_TELEMETRY_PERIOD_MS       = (60 * 1000);
+        constexpr static int8_t I2C_TELEMETRY_COALESCE_KEY      = INT8_MAX - 1;
+        constexpr static uint32_t I2C_CLOCK_SAVE_PERIOD_MS      = (60 * 60 * 1000);     // At most one flash write an hour for clock rates
 
         static Core0Executor* sExecutor;
 
         MulticoreMailbox& mMailbox;
+        WorkExecutor& mWorkExecutor;
+        async_context_poll_t mContext;
+        Worker mWorkers[NUM_WORKER_TYPES];
         UserData mUserData;
         SerialController mSerialController;
         NetworkController mNetworkController;
         MQTTController mMQTTController;
+        NetworkController::DNSRequest mBrokerRequest;
         vector<SensorGroup>& mSensorGroups;
         vector<MQTTMessage> mOutgoingMQTTMessageBuffer;
+        vector<uint32_t> mLastPayloadHashes;
+        vector<uint16_t> mFrameSequences;
+        vector<uint16_t> mGroupDataOffsets;
+
+        // State shared with the group encodes, which may be running on either core
+        WorkExecutor::WorkBatch mEncodeBatch;
+        SensorDataMessage* mEncodeFrame;
+        UserData::PayloadFormat mEncodeFormat;
+
+        MQTTMessage mBatchMessage;
+        MQTTMessage mSchemaMessage;
+        MQTTMessage mI2CTelemetryMessage;
+        absolute_time_t mNextI2CTelemetryTime;
+        absolute_time_t mNextI2CClockSaveTime;
+        uint32_t mQueuedBatchGroups;                // Bit per group in the batch currently queued
         WiFiIndicator* mWifiIndicator;
+
+        // Long-running health statistics, reported along with the periodic serial ping
+        struct RuntimeStats {
+            uint32_t mMinFreeMemory;
+            uint32_t mBrokerConnectCount;
+            uint32_t mWiFiConnectCount;
+            uint32_t mFirstPublishTimeMS;
+            uint32_t mBatchCount;
+            uint32_t mBatchedGroupCount;
+            uint32_t mLastReportPublishCount;
+            uint32_t mLastReportBusyUS;
+            uint64_t mLastReportI2CBusyUS[I2CInterface::MAX_INTERFACES];
+            uint32_t mLastReportI2CTransactions[I2CInterface::MAX_INTERFACES];
+            uint32_t mLastReportMuxTransactions[I2CInterface::MAX_INTERFACES][I2CMultiplexer::NUM_CHANNELS];
+            absolute_time_t mLastReportTime;
+        } mRuntimeStats;
 };
 
 #endif      // _CORE_0_EXECUTOR_H_
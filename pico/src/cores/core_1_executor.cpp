@@ -1,5 +1,6 @@
 #include "core_1_executor.h"
 #include "util/debug_io.h"
+#include "util/boot_timeline.h"
 
 #include "pico/multicore.h"
 #include <cstdlib>
@@ -9,16 +10,27 @@ Core1Executor* Core1Executor::sExecutor = nullptr;
 
 Core1Executor::Core1Executor(
     MulticoreMailbox& mailbox,
+    WorkExecutor& workExecutor,
     vector<SensorGroup>& sensors
 ) :
     mMailbox(mailbox),
-    mSensorGroups(sensors)
+    mWorkExecutor(workExecutor),
+    mSensorGroups(sensors),
+    mUpdateBatch(WorkExecutor::BATCH_SENSOR_UPDATE),
+    mUpdateFrame(nullptr),
+    mUpdateTime(nil_time)
 {}
 
 void Core1Executor::initialize() {
-    for(auto i = mSensorGroups.begin(); i != mSensorGroups.end(); ++i) {
-        i->initializeSensors();
+    mMailbox.initializeSensorFrames(mSensorGroups);
+
+    // Each group writes to its own part of the frame, so they can be updated side by side
+    uint16_t dataOffset = 0;
+    for(auto& group : mSensorGroups) {
+        mGroupDataOffsets.push_back(dataOffset);
+        dataOffset += group.getRawDataSize();
     }
+    mGroupFreshData.resize(mSensorGroups.size(), false);
 }
 
 void Core1Executor::loop() {
@@ -36,33 +48,114 @@ void Core1Executor::setExecutor(Core1Executor& executor) {
 void Core1Executor::doLoop() {
     multicore_lockout_victim_init();
 
+    // Sensor initialization runs as tasks, which only start once core1 is running the scheduler
+    TaskScheduler::setCurrent(mScheduler);
+
+    // Sensors are brought up from here rather than before launch, so they start while core0 is
+    // still bringing up the network
+    BootTimeline::mark(BOOT_CORE1_STARTED);
+    for(auto& group : mSensorGroups) {
+        group.initializeSensors();
+    }
+
+    absolute_time_t nextSensorUpdate = get_absolute_time();
     while(1) {
-        absolute_time_t currentTime = get_absolute_time();
+        // Resume any sensor tasks which have finished waiting
+        mScheduler.run(get_absolute_time());
 
-        // Check for sensor control messages
-        DEBUG_PRINT(1, "Stage 1: Processing control commands");
-        processSensorControlCommands();
+        if(absolute_time_diff_us(nextSensorUpdate, get_absolute_time()) >= 0) {
+            updateSensors();
+            nextSensorUpdate = make_timeout_time_ms(UPDATE_PERIOD_MS);
+        }
+
+        // Help out with anything core0 has queued, such as encoding
+        while(mWorkExecutor.runNext());
 
-        // Perform sensor hardware updates
-        DEBUG_PRINT(1, "Stage 2: Updating sensors");
-        for(auto i = mSensorGroups.begin(); i != mSensorGroups.end(); ++i) {
-            i->update(currentTime);
+        // Sleep until either a task or the next update is due, or there's work to take
+        absolute_time_t wakeTime = mScheduler.getNextWakeTime();
+        if(absolute_time_diff_us(nextSensorUpdate, wakeTime) > 0) {
+            wakeTime = nextSensorUpdate;
         }
+        mWorkExecutor.waitForWork(wakeTime);
+    }
+}
+
+void Core1Executor::updateSensors() {
+    // Check for sensor control messages
+    DEBUG_PRINT_VERBOSE(1, "Stage 1: Processing control commands");
+    processSensorControlCommands();
+
+    // Perform sensor hardware updates. Sensors write straight into the frame which goes to core0.
+    // Each group is a separate piece of work, which core0 can take if it isn't pinned to this core
+    DEBUG_PRINT_VERBOSE(1, "Stage 2: Updating sensors");
+    SensorDataMessage* frame = mMailbox.acquireSensorFrame();
+    if(!frame) {
+        // The pool has room for every holder of a frame, so this shouldn't happen
+        DEBUG_PRINT(1, "No free sensor frames");
+        return;
+    }
 
-        // Package sensor data to core0
-        DEBUG_PRINT(1, "Stage 3: Updating Core 0");
-        DEBUG_PRINT(1, "");
-        mMailbox.sendSensorDataToCore0(mSensorGroups);
+    mUpdateFrame = frame;
+    mUpdateTime = get_absolute_time();
+    for(int i = 0; i < mSensorGroups.size(); ++i) {
+        mWorkExecutor.submit(
+            updateSensorGroup,
+            this,
+            i,
+            (WorkExecutor::Affinity) mSensorGroups[i].getCoreAffinity(),
+            mUpdateBatch
+        );
+    }
+    mWorkExecutor.runUntilComplete(mUpdateBatch);
 
-        sleep_ms(500);
+    bool freshData = false;
+    for(auto fresh : mGroupFreshData) {
+        freshData |= fresh;
     }
+
+    // Hand the frame over to core0
+    DEBUG_PRINT_VERBOSE(1, "Stage 3: Updating Core 0");
+    DEBUG_PRINT_VERBOSE(1, "");
+    if(freshData || !SEND_FRESH_DATA_ONLY) {
+        mMailbox.sendSensorFrameToCore0(frame);
+        BootTimeline::mark(BOOT_FIRST_SENSOR_FRAME);
+    } else {
+        frame->release();
+    }
+
+    if(!BootTimeline::hasHappened(BOOT_SENSORS_SETTLED) && sensorsSettled()) {
+        BootTimeline::mark(BOOT_SENSORS_SETTLED);
+    }
+}
+
+bool Core1Executor::sensorsSettled() const {
+    for(auto& group : mSensorGroups) {
+        for(int i = 0; i < group.getSensorCount(); ++i) {
+            if(!group.getSensor(i).isInitSettled()) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+void Core1Executor::updateSensorGroup(void* context, uint32_t groupIndex) {
+    Core1Executor* executor = static_cast<Core1Executor*>(context);
+
+    executor->mGroupFreshData[groupIndex] = executor->mSensorGroups[groupIndex].update(
+        executor->mUpdateTime,
+        executor->mUpdateFrame,
+        executor->mUpdateFrame->mData + executor->mGroupDataOffsets[groupIndex]
+    );
 }
 
 void Core1Executor::processSensorControlCommands() {
     optional<SensorControlMessage> msgOpt;
 
     do {
-        if(msgOpt = mMailbox.getWaitingSensorControlMessage()) {
+        msgOpt = mMailbox.getWaitingSensorControlMessage();
+        if(msgOpt) {
             bool messageHandled = false;
             for(auto& group : mSensorGroups) {
                 if(group.handleSensorControlCommand(*msgOpt)) {
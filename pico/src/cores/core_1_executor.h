@@ -6,6 +6,8 @@
 #include <vector>
 #include "messaging/multicore_mailbox.h"
 #include "sensors/sensor_group.h"
+#include "util/task_scheduler.h"
+#include "cores/work_executor.h"
 
 
 using std::optional;
@@ -16,6 +18,7 @@ class Core1Executor {
     public:
         Core1Executor(
             MulticoreMailbox& mailbox,
+            WorkExecutor& workExecutor,
             vector<SensorGroup>& sensors
         );
 
@@ -26,13 +29,35 @@ class Core1Executor {
 
     private:
         void doLoop(); 
+        void updateSensors();
+        bool sensorsSettled() const;
         void processSensorControlCommands();
 
+        static void updateSensorGroup(void* context, uint32_t groupIndex);
+
+
+#if SYNTHETIC_LOAD_MODE
+        // Run flat out and only pass on new readings, so the publish rate is set by the sensors themselves
+        constexpr static uint32_t UPDATE_PERIOD_MS      = 1;
+        constexpr static bool SEND_FRESH_DATA_ONLY      = true;
+#else
+        constexpr static uint32_t UPDATE_PERIOD_MS      = 500;
+        constexpr static bool SEND_FRESH_DATA_ONLY      = false;
+#endif
 
         static Core1Executor* sExecutor;
 
         MulticoreMailbox& mMailbox;
+        WorkExecutor& mWorkExecutor;
         vector<SensorGroup>& mSensorGroups;
+        TaskScheduler mScheduler;
+
+        // State shared with the group updates, which may be running on either core
+        WorkExecutor::WorkBatch mUpdateBatch;
+        vector<uint16_t> mGroupDataOffsets;
+        vector<uint8_t> mGroupFreshData;            // Not vector<bool>, each group's flag is written from its own update
+        SensorDataMessage* mUpdateFrame;
+        absolute_time_t mUpdateTime;
 
         // SensorPod mSensorPod;
 };
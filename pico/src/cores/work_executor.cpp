@@ -0,0 +1,180 @@
+#include "work_executor.h"
+
+#include "pico/time.h"
+#include <cstring>
+
+
+WorkExecutor::WorkExecutor() :
+    mDeques{},
+    mCoreStats{},
+    mBatchStats{},
+    mWakers{}
+{
+    mutex_init(&mMutex);
+}
+
+bool WorkExecutor::submit(WorkFunction function, void* context, uint32_t argument, Affinity affinity, WorkBatch& batch) {
+    int core = get_core_num();
+
+#if FIXED_CORE_SPLIT
+    if(affinity == ANY_CORE) {
+        affinity = (Affinity) core;
+    }
+#endif
+
+    WorkDeque& deque = mDeques[(affinity == ANY_CORE) ? core : affinity];
+
+    mutex_enter_blocking(&mMutex);
+
+    if(deque.mCount == MAX_QUEUED_WORK) {
+        mutex_exit(&mMutex);
+
+        // No room, so do it now rather than drop it
+        function(context, argument);
+        return false;
+    }
+
+    if(!batch.mPending) {
+        batch.mStartTime = get_absolute_time();
+    }
+    batch.mPending = batch.mPending + 1;
+
+    deque.mItems[deque.mCount++] = {function, context, argument, affinity, &batch, get_absolute_time()};
+
+    mutex_exit(&mMutex);
+
+    // Wake the other core in case it's idle and can take this
+    __sev();
+
+    int otherCore = core ^ 1;
+    if((affinity != core) && mWakers[otherCore].mFunction) {
+        mWakers[otherCore].mFunction(mWakers[otherCore].mContext);
+    }
+
+    return true;
+}
+
+bool WorkExecutor::runNext() {
+    int core = get_core_num();
+    WorkItem item;
+    bool stolen;
+
+    if(!takeWork(core, item, stolen)) {
+        return false;
+    }
+
+    runWork(core, item, stolen);
+    return true;
+}
+
+void WorkExecutor::runUntilComplete(WorkBatch& batch) {
+    // Anything left in the batch has either been stolen and is running on the other core, or is
+    // still queued. Either way we may as well be running something
+    while(batch.mPending) {
+        if(!runNext()) {
+            tight_loop_contents();
+        }
+    }
+
+    if(is_nil_time(batch.mStartTime)) {
+        return;
+    }
+
+    uint32_t batchTime = absolute_time_diff_us(batch.mStartTime, get_absolute_time());
+    batch.mStartTime = nil_time;
+
+    mutex_enter_blocking(&mMutex);
+    BatchStats& stats = mBatchStats[batch.mType];
+    ++stats.mCount;
+    stats.mTotalTimeUS += batchTime;
+    if(batchTime > stats.mMaxTimeUS) {
+        stats.mMaxTimeUS = batchTime;
+    }
+    mutex_exit(&mMutex);
+}
+
+void WorkExecutor::waitForWork(absolute_time_t timeout) {
+    // Submitting work sends an event, so this wakes as soon as there's something to take
+    if(!hasWorkFor(get_core_num())) {
+        best_effort_wfe_or_timeout(timeout);
+    }
+}
+
+void WorkExecutor::setWakeFunction(int core, WakeFunction function, void* context) {
+    mWakers[core].mContext = context;
+    mWakers[core].mFunction = function;
+}
+
+bool WorkExecutor::takeWork(int core, WorkItem& item, bool& stolen) {
+    bool found = false;
+
+    mutex_enter_blocking(&mMutex);
+
+    // Our own newest work first, which is usually the batch we are waiting on
+    WorkDeque& ownDeque = mDeques[core];
+    if(ownDeque.mCount) {
+        item = ownDeque.mItems[--ownDeque.mCount];
+        stolen = false;
+        found = true;
+    } else {
+        // Otherwise the other core's oldest work which isn't pinned to it
+        WorkDeque& victim = mDeques[core ^ 1];
+        for(int i = 0; i < victim.mCount; ++i) {
+            if(victim.mItems[i].mAffinity == ANY_CORE) {
+                item = victim.mItems[i];
+                memmove(&victim.mItems[i], &victim.mItems[i + 1], (victim.mCount - i - 1) * sizeof(WorkItem));
+                --victim.mCount;
+                stolen = true;
+                found = true;
+                break;
+            }
+        }
+    }
+
+    mutex_exit(&mMutex);
+
+    return found;
+}
+
+void WorkExecutor::runWork(int core, const WorkItem& item, bool stolen) {
+    absolute_time_t startTime = get_absolute_time();
+    uint32_t queueLatency = absolute_time_diff_us(item.mQueuedTime, startTime);
+
+    item.mFunction(item.mContext, item.mArgument);
+
+    uint32_t busyTime = absolute_time_diff_us(startTime, get_absolute_time());
+
+    mutex_enter_blocking(&mMutex);
+
+    CoreStats& stats = mCoreStats[core];
+    ++stats.mExecuted;
+    stats.mStolen += stolen ? 1 : 0;
+    stats.mBusyUS += busyTime;
+    stats.mTotalQueueLatencyUS += queueLatency;
+    if(queueLatency > stats.mMaxQueueLatencyUS) {
+        stats.mMaxQueueLatencyUS = queueLatency;
+    }
+
+    item.mBatch->mPending = item.mBatch->mPending - 1;
+
+    mutex_exit(&mMutex);
+}
+
+bool WorkExecutor::hasWorkFor(int core) {
+    bool hasWork = false;
+
+    mutex_enter_blocking(&mMutex);
+
+    if(mDeques[core].mCount) {
+        hasWork = true;
+    } else {
+        const WorkDeque& other = mDeques[core ^ 1];
+        for(int i = 0; !hasWork && (i < other.mCount); ++i) {
+            hasWork = (other.mItems[i].mAffinity == ANY_CORE);
+        }
+    }
+
+    mutex_exit(&mMutex);
+
+    return hasWork;
+}
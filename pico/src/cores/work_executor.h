@@ -0,0 +1,113 @@
+#ifndef _WORK_EXECUTOR_H_
+#define _WORK_EXECUTOR_H_
+
+#include "pico/sync.h"
+#include "pico/types.h"
+
+
+// Short run-to-completion work items shared between the cores. Each core has its own deque - it
+// takes its own work newest first, and when that's empty steals the oldest work from the other core.
+// Work pinned to a core (because that core owns the hardware involved) is never stolen.
+//
+// Configuring with -DFIXED_CORE_SPLIT=ON pins all work to the core which submitted it, for comparing
+// against the old fixed split of sensors on core1 and encoding on core0
+class WorkExecutor {
+    public:
+        typedef void (*WorkFunction)(void* context, uint32_t argument);
+        typedef void (*WakeFunction)(void* context);
+
+        enum Affinity : int8_t {
+            ANY_CORE    = -1,
+            CORE_0      = 0,
+            CORE_1      = 1
+        };
+
+        // Timings are kept per type of batch
+        enum BatchType {
+            BATCH_SENSOR_UPDATE,
+            BATCH_PAYLOAD_ENCODE,
+
+            NUM_BATCH_TYPES
+        };
+
+        // A set of work items the submitting core waits on
+        struct WorkBatch {
+            WorkBatch(BatchType type) : mType(type), mPending(0), mStartTime(nil_time) {}
+
+            const BatchType mType;
+            volatile uint16_t mPending;
+            absolute_time_t mStartTime;
+        };
+
+        struct CoreStats {
+            uint32_t mExecuted;
+            uint32_t mStolen;                   // Executed work which was taken from the other core
+            uint64_t mBusyUS;                   // Wide enough not to wrap over a long uptime
+            uint64_t mTotalQueueLatencyUS;      // From submission to starting
+            uint32_t mMaxQueueLatencyUS;
+        };
+
+        struct BatchStats {
+            uint32_t mCount;
+            uint64_t mTotalTimeUS;
+            uint32_t mMaxTimeUS;
+        };
+
+        WorkExecutor();
+
+        // Returns false if the deque is full, in which case the work is run there and then
+        bool submit(WorkFunction function, void* context, uint32_t argument, Affinity affinity, WorkBatch& batch);
+
+        // Runs one item of work on the calling core, stealing if it has none of its own. Returns false
+        // if there was nothing to run
+        bool runNext();
+
+        // Runs work (any work, not just the batch's) until everything in the batch has finished
+        void runUntilComplete(WorkBatch& batch);
+
+        // Sleeps until the timeout, or until there's work for this core
+        void waitForWork(absolute_time_t timeout);
+
+        // For a core which sleeps somewhere other than waitForWork(). Called from the submitting
+        // core whenever there's new work the given core could take
+        void setWakeFunction(int core, WakeFunction function, void* context);
+
+        const CoreStats& getCoreStats(int core) const { return mCoreStats[core]; }
+        const BatchStats& getBatchStats(BatchType type) const { return mBatchStats[type]; }
+
+        static constexpr uint8_t MAX_QUEUED_WORK    = 16;       // Per core
+        static constexpr int NUM_CORES              = 2;
+
+    private:
+        struct WorkItem {
+            WorkFunction mFunction;
+            void* mContext;
+            uint32_t mArgument;
+            Affinity mAffinity;
+            WorkBatch* mBatch;
+            absolute_time_t mQueuedTime;
+        };
+
+        // Deque per core, index 0 is the oldest work
+        struct WorkDeque {
+            WorkItem mItems[MAX_QUEUED_WORK];
+            uint8_t mCount;
+        };
+
+        struct Waker {
+            WakeFunction mFunction;
+            void* mContext;
+        };
+
+        bool takeWork(int core, WorkItem& item, bool& stolen);
+        void runWork(int core, const WorkItem& item, bool stolen);
+        bool hasWorkFor(int core);
+
+        mutex_t mMutex;                 // Guards the deques, batch counts and stats
+        WorkDeque mDeques[NUM_CORES];
+        CoreStats mCoreStats[NUM_CORES];
+        BatchStats mBatchStats[NUM_BATCH_TYPES];
+        Waker mWakers[NUM_CORES];
+};
+
+#endif      // _WORK_EXECUTOR_H_
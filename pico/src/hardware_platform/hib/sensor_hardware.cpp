@@ -23,6 +23,8 @@ constexpr int SONAR_SENSOR_R1_TX_PIN                = 28;
 constexpr int SONAR_SENSOR_R2_RX_PIN                = 21;
 constexpr int SONAR_SENSOR_R2_TX_PIN                = 22;
 constexpr int SONAR_SENSOR_BAUDRATE                 = 9600;
+constexpr uint8_t SONAR_GROUP_QOS                   = 1;        // Feed levels need at-least-once delivery
+constexpr int8_t SONAR_GROUP_CORE                   = 1;        // Sonars share the connection shift registers
 
 constexpr int HARDWARE_CONNECT_SR_LATCH_PIN         = 20;
 constexpr int HARDWARE_CONNECT_SR_CLOCK_PIN         = 14;
@@ -113,12 +115,18 @@ vector<SensorGroup> _SENSOR_GROUPS = {
     SensorGroup(
         {
             &_sonarSensorL1
-        }
+        },
+        SONAR_GROUP_QOS,
+        SensorGroup::PUBLISH_LATEST,
+        SONAR_GROUP_CORE
     ),
     SensorGroup(
         {
             &_sonarSensorR1
-        }
+        },
+        SONAR_GROUP_QOS,
+        SensorGroup::PUBLISH_LATEST,
+        SONAR_GROUP_CORE
     )
 };
 
@@ -12,19 +12,23 @@ using std::vector;
 extern const uint8_t SCD30_I2C_SDA_PIN      = 4;
 extern const uint8_t SCD30_I2C_SCL_PIN      = 5;
 static const uint8_t SCD30_POWER_CTL_PIN    = 6;
+static const int SCD30_READY_PIN            = SCD30Sensor::NO_READY_PIN;       // Set to the RDY GPIO on boards which wire it
 extern const uint SCD30_I2C_BAUDRATE        = (25 * 1000);
+static const uint SCD30_I2C_MAX_BAUDRATE    = (100 * 1000);     // The SCD30's limit, the bus tunes up to it
 
 #define STEMMA_I2C_PORT                     (i2c1)
 static const uint8_t STEMMA_I2C_SDA_PIN     = 2;
 static const uint8_t STEMMA_I2C_SCL_PIN     = 3;
 static const uint STEMMA_I2C_BAUDRATE       = (25 * 1000);
+static const uint STEMMA_I2C_MAX_BAUDRATE   = (400 * 1000);
 
 I2CInterface _scd30Interface = I2CInterface(
     SCD30_I2C_PORT,
     SCD30_I2C_BAUDRATE,
     SCD30_I2C_SDA_PIN,
     SCD30_I2C_SCL_PIN,
-    true
+    true,
+    SCD30_I2C_MAX_BAUDRATE
 );
 
 I2CInterface _stemmaInterface = I2CInterface(
@@ -32,12 +36,14 @@ I2CInterface _stemmaInterface = I2CInterface(
     STEMMA_I2C_BAUDRATE,
     STEMMA_I2C_SDA_PIN,
     STEMMA_I2C_SCL_PIN,
-    true
+    true,
+    STEMMA_I2C_MAX_BAUDRATE
 );
 
 SCD30Sensor _scd30Sensor(
     _scd30Interface,
-    SCD30_POWER_CTL_PIN
+    SCD30_POWER_CTL_PIN,
+    SCD30_READY_PIN
 );
 
 StemmaSoilSensor _stemmaSensor(
@@ -2,6 +2,7 @@
 #include "messaging/multicore_mailbox.h"
 #include "cores/core_0_executor.h"
 #include "cores/core_1_executor.h"
+#include "cores/work_executor.h"
 #include "board_hardware/wifi_indicator.h"
 
 #include "pico/multicore.h"
@@ -10,16 +11,19 @@
 extern WiFiIndicator* _wifiIndicator;
 extern vector<SensorGroup> _SENSOR_GROUPS;
 MulticoreMailbox multicoreMailbox;
+WorkExecutor workExecutor;
 
 // Core data wrappers
 Core0Executor dataCore0(
     multicoreMailbox,
+    workExecutor,
     _SENSOR_GROUPS,
     _wifiIndicator
 );
 
 Core1Executor dataCore1(
     multicoreMailbox,
+    workExecutor,
     _SENSOR_GROUPS
 );
 
@@ -28,15 +32,14 @@ int main() {
     // Setup stdio
     DEBUG_PRINT_INIT()
 
-    // Initialize cores
-    dataCore0.initialize();
-    Core0Executor::setExecutor(dataCore0);
-
+    // Core1 goes first, so sensor bring-up runs alongside core0 getting the network up
+    dataCore0.loadUserData();
     dataCore1.initialize();
     Core1Executor::setExecutor(dataCore1);
-
-    // Run our separate cores
     multicore_launch_core1(Core1Executor::loop);
+
+    dataCore0.initialize();
+    Core0Executor::setExecutor(dataCore0);
     Core0Executor::loop();
 
     return 1;
@@ -0,0 +1,180 @@
+#include "cbor_writer.h"
+#include <cstring>
+#include <cassert>
+
+
+// Major types (RFC 8949 section 3.1)
+constexpr uint8_t CBOR_UNSIGNED             = 0;
+constexpr uint8_t CBOR_NEGATIVE             = 1;
+constexpr uint8_t CBOR_BYTES                = 2;
+constexpr uint8_t CBOR_TEXT                 = 3;
+constexpr uint8_t CBOR_ARRAY                = 4;
+constexpr uint8_t CBOR_MAP                  = 5;
+
+constexpr uint8_t CBOR_HALF_FLOAT           = 0xF9;
+constexpr uint8_t CBOR_SINGLE_FLOAT         = 0xFA;
+constexpr uint16_t CBOR_HALF_NAN            = 0x7E00;
+
+
+CborWriter::CborWriter(uint8_t* buffer, int bufferSize) :
+    mBuffer(buffer),
+    mBufferSize(bufferSize),
+    mLength(0),
+    mOverflowed(false)
+{}
+
+void CborWriter::writeUnsigned(uint32_t value) {
+    writeHead(CBOR_UNSIGNED, value);
+}
+
+void CborWriter::writeInt(int32_t value) {
+    if(value < 0) {
+        // Negative integers are stored as -1 - n
+        writeHead(CBOR_NEGATIVE, (uint32_t) (-1 - value));
+    } else {
+        writeHead(CBOR_UNSIGNED, (uint32_t) value);
+    }
+}
+
+void CborWriter::writeFloat(float value) {
+    // Use a half float whenever it holds the value exactly
+    uint16_t half;
+    if(floatToHalf(value, half)) {
+        writeByte(CBOR_HALF_FLOAT);
+        writeByte(half >> 8);
+        writeByte(half & 0xFF);
+        return;
+    }
+
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(float));
+
+    writeByte(CBOR_SINGLE_FLOAT);
+    writeByte(bits >> 24);
+    writeByte((bits >> 16) & 0xFF);
+    writeByte((bits >> 8) & 0xFF);
+    writeByte(bits & 0xFF);
+}
+
+void CborWriter::writeText(const char* text) {
+    int length = strlen(text);
+    writeHead(CBOR_TEXT, length);
+    writeRaw((const uint8_t*) text, length);
+}
+
+void CborWriter::writeBytes(const uint8_t* data, int length) {
+    writeHead(CBOR_BYTES, length);
+    writeRaw(data, length);
+}
+
+void CborWriter::writeArrayHeader(uint32_t count) {
+    writeHead(CBOR_ARRAY, count);
+}
+
+void CborWriter::writeMapHeader(uint32_t count) {
+    writeHead(CBOR_MAP, count);
+}
+
+void CborWriter::writeEncoded(const uint8_t* data, int length) {
+    writeRaw(data, length);
+}
+
+int CborWriter::beginMap() {
+    int mapStart = mLength;
+    writeByte(CBOR_MAP << 5);
+    return mapStart;
+}
+
+void CborWriter::endMap(int mapStart, uint8_t pairCount) {
+    assert(pairCount <= MAX_SMALL_MAP_PAIRS);
+
+    if(mapStart < mBufferSize) {
+        mBuffer[mapStart] = (CBOR_MAP << 5) | pairCount;
+    }
+}
+
+void CborWriter::writeHead(uint8_t majorType, uint32_t value) {
+    // Shortest form of the argument
+    majorType <<= 5;
+    if(value < 24) {
+        writeByte(majorType | value);
+    } else if(value <= 0xFF) {
+        writeByte(majorType | 24);
+        writeByte(value);
+    } else if(value <= 0xFFFF) {
+        writeByte(majorType | 25);
+        writeByte(value >> 8);
+        writeByte(value & 0xFF);
+    } else {
+        writeByte(majorType | 26);
+        writeByte(value >> 24);
+        writeByte((value >> 16) & 0xFF);
+        writeByte((value >> 8) & 0xFF);
+        writeByte(value & 0xFF);
+    }
+}
+
+void CborWriter::writeByte(uint8_t value) {
+    if(mLength >= mBufferSize) {
+        mOverflowed = true;
+        return;
+    }
+
+    mBuffer[mLength++] = value;
+}
+
+void CborWriter::writeRaw(const uint8_t* data, int length) {
+    if((mLength + length) > mBufferSize) {
+        mOverflowed = true;
+        return;
+    }
+
+    memcpy(mBuffer + mLength, data, length);
+    mLength += length;
+}
+
+bool CborWriter::floatToHalf(float value, uint16_t& half) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(float));
+
+    uint16_t sign = (bits >> 16) & 0x8000;
+    int32_t exponent = (int32_t) ((bits >> 23) & 0xFF);
+    uint32_t mantissa = bits & 0x7FFFFF;
+
+    // Zero, infinity and NaN all have exact half forms
+    if(!exponent && !mantissa) {
+        half = sign;
+        return true;
+    }
+    if(exponent == 0xFF) {
+        half = mantissa ? CBOR_HALF_NAN : (sign | 0x7C00);
+        return true;
+    }
+    if(!exponent) {
+        // Single precision subnormals are far too small for a half
+        return false;
+    }
+
+    exponent -= 127;
+    if((exponent >= -14) && (exponent <= 15)) {
+        // Normal half, as long as we don't lose any mantissa bits
+        if(mantissa & 0x1FFF) {
+            return false;
+        }
+        half = sign | ((exponent + 15) << 10) | (mantissa >> 13);
+        return true;
+    }
+
+    if((exponent >= -24) && (exponent < -14)) {
+        // Subnormal half, the implicit leading bit becomes part of the mantissa
+        uint32_t fullMantissa = mantissa | 0x800000;
+        int shift = -1 - exponent;
+        if(fullMantissa & ((1u << shift) - 1)) {
+            return false;
+        }
+        half = sign | (fullMantissa >> shift);
+        return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,49 @@
+#ifndef _CBOR_WRITER_H_
+#define _CBOR_WRITER_H_
+
+#include <cstdint>
+
+// Minimal CBOR (RFC 8949) encoder for sensor payloads.
+//
+// Output is deterministic - definite lengths only, integers and floats in their shortest form
+// and keys written in a fixed order by each serializer - so the same reading always encodes to
+// the same bytes. Writes past the end of the buffer are dropped and flagged as an overflow.
+class CborWriter {
+    public:
+        CborWriter(uint8_t* buffer, int bufferSize);
+
+        void writeUnsigned(uint32_t value);
+        void writeInt(int32_t value);
+        void writeFloat(float value);
+        void writeText(const char* text);
+        void writeBytes(const uint8_t* data, int length);
+        void writeArrayHeader(uint32_t count);
+        void writeMapHeader(uint32_t count);
+
+        // Copies in an item which has already been encoded
+        void writeEncoded(const uint8_t* data, int length);
+
+        // For maps whose size isn't known up front. Reserves a one byte header which endMap()
+        // fills in, so these can hold at most 23 pairs
+        int beginMap();
+        void endMap(int mapStart, uint8_t pairCount);
+
+        int getLength() const { return mLength; }
+        bool hasOverflowed() const { return mOverflowed; }
+
+        static constexpr uint8_t MAX_SMALL_MAP_PAIRS    = 23;
+
+    private:
+        void writeHead(uint8_t majorType, uint32_t value);
+        void writeByte(uint8_t value);
+        void writeRaw(const uint8_t* data, int length);
+
+        static bool floatToHalf(float value, uint16_t& half);
+
+        uint8_t* mBuffer;
+        int mBufferSize;
+        int mLength;
+        bool mOverflowed;
+};
+
+#endif      // _CBOR_WRITER_H_
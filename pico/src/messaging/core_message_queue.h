@@ -11,7 +11,8 @@ class CoreMessageQueue {
         CoreMessageQueue(int numMessages) :
             mQueueSize{numMessages},
             mFront{-1},
-            mRear{-1}
+            mRear{-1},
+            mDroppedCount{0}
         {
             mQueueEntries = new T[numMessages];
             mutex_init(&mQueueMutex);
@@ -21,9 +22,26 @@ class CoreMessageQueue {
             delete[] mQueueEntries;
         }
 
-        bool addToQueue(const T& message) {
+        // Returns false if the oldest entry had to be dropped to make room, copying it to dropped
+        // (if supplied) so that anything it holds can be released
+        bool addToQueue(const T& message, T* dropped = nullptr) {
+            bool added = true;
+
             mutex_enter_blocking(&mQueueMutex);
 
+            // If the queue is full we drop the oldest entry to make room, so the newest always gets in
+            if(queueFull()) {
+                if(dropped) {
+                    memcpy(dropped, &mQueueEntries[mFront], sizeof(T));
+                }
+                added = false;
+
+                if(++mFront == mQueueSize) {
+                    mFront = 0;
+                }
+                ++mDroppedCount;
+            }
+
             if(++mRear == mQueueSize) {
                 mRear = 0;
             }
@@ -35,7 +53,7 @@ class CoreMessageQueue {
 
             mutex_exit(&mQueueMutex);
 
-            return true;
+            return added;
         }
 
         bool readFromQueue(T& destination) {
@@ -69,21 +87,32 @@ class CoreMessageQueue {
             bool full = false;
             mutex_enter_blocking(&mQueueMutex);
 
-            full = (
-                (mRear == (mQueueSize - 1) && mFront == 0) || 
-                (mRear == (mFront - 1))
-            );
+            full = queueFull();
 
             mutex_exit(&mQueueMutex);
 
             return full;
         }
 
+        // Number of entries which have been discarded because the queue was full when adding
+        uint32_t getDroppedCount() const {
+            return mDroppedCount;
+        }
+
     private:
+        // Must be called with the queue mutex held
+        bool queueFull() const {
+            return (
+                (mRear == (mQueueSize - 1) && mFront == 0) || 
+                (mFront != -1 && mRear == (mFront - 1))
+            );
+        }
+
         T*  mQueueEntries;
         const int mQueueSize;
         int mFront;
         int mRear;
+        uint32_t mDroppedCount;
         mutex_t mQueueMutex;
 };
 
@@ -26,6 +26,28 @@ optional<MQTTMessage> MQTTMessage::createTestMQTTMessage(
     int messageLength = strlen(message);
     memcpy(mqttMsg.mPayload, message, messageLength);
     mqttMsg.mPayload[messageLength] = 0;
+    mqttMsg.mPayloadLength = messageLength;
+    mqttMsg.mQoS = 0;
+    mqttMsg.mRetain = false;
+    mqttMsg.mCoalesceKey = -1;
 
     return mqttMsg;
 }
+
+int MQTTMessage::copyFrom(const MQTTMessage& other) {
+    mReadyToSend = other.mReadyToSend;
+    mQoS = other.mQoS;
+    mRetain = other.mRetain;
+    mCoalesceKey = other.mCoalesceKey;
+    mPayloadLength = other.mPayloadLength;
+
+    int topicLength = strnlen(other.mTopic, MQTT_MAX_TOPIC_LENGTH - 1);
+    memcpy(mTopic, other.mTopic, topicLength);
+    mTopic[topicLength] = 0;
+
+    // JSON payloads are also used as strings, so their terminator comes along too
+    int payloadLength = (other.mPayloadLength < MQTT_MAX_PAYLOAD_LENGTH) ? (other.mPayloadLength + 1) : MQTT_MAX_PAYLOAD_LENGTH;
+    memcpy(mPayload, other.mPayload, payloadLength);
+
+    return (topicLength + 1 + payloadLength);
+}
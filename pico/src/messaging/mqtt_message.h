@@ -2,19 +2,28 @@
 #define _MQTT_MESSAGE_H_
 
 #include <optional>
+#include <cstdint>
 
 using std::optional;
 
 // Outgoing MQTT message
 struct MQTTMessage {
     static constexpr int MQTT_MAX_TOPIC_LENGTH              = 128;
-    static constexpr int MQTT_MAX_PAYLOAD_LENGTH            = 256;
+    static constexpr int MQTT_MAX_PAYLOAD_LENGTH            = 768;      // Room for a batch of several groups, or a group's schema
     static constexpr const char* AUTOBLOOMER_TOPIC_NAME     = "AutoBloomer";
 
     // Creates a basic test message with the supplied message as payload contents
     static optional<MQTTMessage> createTestMQTTMessage(const char *sensorName, const char *sensorLocation, const char *message);
 
+    // Copies only the used parts of another message's topic and payload rather than the whole
+    // buffers, returning the number of bytes copied
+    int copyFrom(const MQTTMessage& other);
+
     bool mReadyToSend;
+    uint8_t mQoS;
+    bool mRetain;
+    int8_t mCoalesceKey;        // Queued messages with the same key replace each other, -1 keeps them all
+    uint16_t mPayloadLength;    // Payloads may be binary, so this is the length that gets published
     char mTopic[MQTT_MAX_TOPIC_LENGTH];
     char mPayload[MQTT_MAX_PAYLOAD_LENGTH];
 };
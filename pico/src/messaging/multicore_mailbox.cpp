@@ -1,4 +1,5 @@
 #include "multicore_mailbox.h"
+#include "util/copy_stats.h"
 
 
 using std::nullopt;
@@ -9,18 +10,38 @@ MulticoreMailbox::MulticoreMailbox() :
     mSensorControlQueue2{NUM_SENSOR_CONTROL_MESSAGES}
 {}
 
-void MulticoreMailbox::sendSensorDataToCore0(const vector<SensorGroup>& sensorGroups) {
-    // Fill our temporary message and push it to the queue
-    mSensorUpdateWriteScratch.fillFromSensors(sensorGroups);
-    mSensorUpdateQueue2.addToQueue(mSensorUpdateWriteScratch);
+void MulticoreMailbox::initializeSensorFrames(const vector<SensorGroup>& sensorGroups) {
+    int sensorCount = 0;
+    for(auto& group : sensorGroups) {
+        sensorCount += group.getSensorCount();
+    }
+
+    mSensorFramePool.initialize(sensorCount, NUM_SENSOR_UPDATE_MESSAGES);
+}
+
+SensorDataMessage* MulticoreMailbox::acquireSensorFrame() {
+    return mSensorFramePool.acquire();
 }
 
-bool MulticoreMailbox::latestSensorDataToJSON(const vector<SensorGroup>& sensorGroups, vector<MQTTMessage>& outgoingMessages) {
-    bool gotMessage = mSensorUpdateQueue2.readFromQueue(mSensorUpdateReadScratch);
-    if(gotMessage) {
-        mSensorUpdateReadScratch.toMQTT(sensorGroups, outgoingMessages);
+void MulticoreMailbox::sendSensorFrameToCore0(SensorDataMessage* frame) {
+    // Only the pointer goes through the queue. If core0 hasn't kept up, the oldest frame is dropped
+    SensorDataMessage* droppedFrame = nullptr;
+    mSensorUpdateQueue2.addToQueue(frame, &droppedFrame);
+    COUNT_COPIED_BYTES(COPY_MAILBOX, sizeof(SensorDataMessage*));
+
+    if(droppedFrame) {
+        droppedFrame->release();
     }
-    return gotMessage;
+}
+
+SensorDataMessage* MulticoreMailbox::receiveSensorFrame() {
+    SensorDataMessage* frame;
+    if(!mSensorUpdateQueue2.readFromQueue(frame)) {
+        return nullptr;
+    }
+
+    COUNT_COPIED_BYTES(COPY_MAILBOX, sizeof(SensorDataMessage*));
+    return frame;
 }
 
 void MulticoreMailbox::sendSensorControlMessageToCore1(MQTTMessage& mqttMessage) {
@@ -39,3 +60,11 @@ optional<SensorControlMessage> MulticoreMailbox::getWaitingSensorControlMessage(
         return nullopt;
     }
 }
+
+uint32_t MulticoreMailbox::getDroppedSensorControlMessageCount() const {
+    return mSensorControlQueue2.getDroppedCount();
+}
+
+uint32_t MulticoreMailbox::getSensorFrameExhaustedCount() const {
+    return mSensorFramePool.getExhaustedCount();
+}
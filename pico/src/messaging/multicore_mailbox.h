@@ -5,6 +5,7 @@
 #include "messaging/sensor_control_message.h"
 #include "messaging/mqtt_message.h"
 #include "messaging/sensor_data_message.h"
+#include "messaging/sensor_frame_pool.h"
 #include "sensors/sensor_group.h"
 #include <optional>
 
@@ -14,23 +15,32 @@ class MulticoreMailbox {
     public:
         MulticoreMailbox();
 
-        // core1 -> core0 functions
-        void sendSensorDataToCore0(const vector<SensorGroup>& sensorGroups);
-        bool latestSensorDataToJSON(const vector<SensorGroup>& sensorGroups, vector<MQTTMessage>& outgoingMessages);
+        // Must be called before either core starts using sensor frames
+        void initializeSensorFrames(const vector<SensorGroup>& sensorGroups);
+
+        // core1 -> core0 functions. The mailbox takes over core1's reference to the frame
+        SensorDataMessage* acquireSensorFrame();
+        void sendSensorFrameToCore0(SensorDataMessage* frame);
+
+        // Latest frame from core1, or nullptr if there isn't a new one. The caller takes over the
+        // mailbox's reference and releases it once it's done encoding
+        SensorDataMessage* receiveSensorFrame();
 
         // core0 -> core1 functions
         void sendSensorControlMessageToCore1(MQTTMessage& mqttMessage);
         optional<SensorControlMessage> getWaitingSensorControlMessage();
 
+        // Diagnostics
+        uint32_t getDroppedSensorControlMessageCount() const;
+        uint32_t getSensorFrameExhaustedCount() const;
+
     private:
         constexpr static int NUM_SENSOR_UPDATE_MESSAGES     = 2;    // We only really need double-buffering
         constexpr static int NUM_SENSOR_CONTROL_MESSAGES    = 4;    // We possibly may have a few of these coming in at once
 
-        CoreMessageQueue<SensorDataMessage> mSensorUpdateQueue2;        // Queue used for sending sensor updates from core1 to core0
+        SensorFramePool mSensorFramePool;
+        CoreMessageQueue<SensorDataMessage*> mSensorUpdateQueue2;       // Queue used for sending sensor updates from core1 to core0
         CoreMessageQueue<SensorControlMessage> mSensorControlQueue2;    // Queue used for sending sensor control commands from core0 to core1
-
-        SensorDataMessage mSensorUpdateReadScratch;
-        SensorDataMessage mSensorUpdateWriteScratch;
 };
 
 #endif      // _MULTICORE_MAILBOX_H_
@@ -0,0 +1,82 @@
+#include "publish_queue.h"
+#include "util/copy_stats.h"
+#include <cstring>
+
+
+PublishQueue::PublishQueue() :
+    mDepth(0),
+    mStats{}
+{
+    for(int i = 0; i < QUEUE_SIZE; ++i) {
+        mOrder[i] = i;
+    }
+}
+
+bool PublishQueue::push(const MQTTMessage& message) {
+    // Latest wins - just overwrite the queued message in place
+    if(message.mCoalesceKey != NO_COALESCE_KEY) {
+        for(int i = 0; i < mDepth; ++i) {
+            MQTTMessage& queued = mEntries[mOrder[i]];
+            if(queued.mCoalesceKey == message.mCoalesceKey) {
+                COUNT_COPIED_BYTES(COPY_PUBLISH_QUEUE, queued.copyFrom(message));
+                ++mStats.mCoalesced;
+                return true;
+            }
+        }
+    }
+
+    if(mDepth == QUEUE_SIZE) {
+        // Make room by throwing away the oldest telemetry, events are never evicted
+        int evict = -1;
+        for(int i = 0; i < mDepth; ++i) {
+            if(mEntries[mOrder[i]].mCoalesceKey != NO_COALESCE_KEY) {
+                evict = i;
+                break;
+            }
+        }
+
+        ++mStats.mDropped;
+        if(evict < 0) {
+            return false;
+        }
+        removeAt(evict);
+    }
+
+    COUNT_COPIED_BYTES(COPY_PUBLISH_QUEUE, mEntries[mOrder[mDepth]].copyFrom(message));
+    ++mDepth;
+    ++mStats.mQueued;
+
+    if(mDepth > mStats.mMaxDepth) {
+        mStats.mMaxDepth = mDepth;
+    }
+
+    return true;
+}
+
+MQTTMessage* PublishQueue::at(int position) {
+    return (position < mDepth) ? &mEntries[mOrder[position]] : nullptr;
+}
+
+bool PublishQueue::contains(int8_t coalesceKey) const {
+    for(int i = 0; i < mDepth; ++i) {
+        if(mEntries[mOrder[i]].mCoalesceKey == coalesceKey) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void PublishQueue::pop() {
+    if(mDepth) {
+        removeAt(0);
+    }
+}
+
+void PublishQueue::removeAt(int position) {
+    // Move the freed entry index to the back so it gets reused
+    uint8_t entry = mOrder[position];
+    memmove(&mOrder[position], &mOrder[position + 1], (mDepth - position - 1));
+    mOrder[mDepth - 1] = entry;
+    --mDepth;
+}
@@ -0,0 +1,46 @@
+#ifndef _PUBLISH_QUEUE_H_
+#define _PUBLISH_QUEUE_H_
+
+#include "mqtt_message.h"
+#include <cstdint>
+
+// Bounded queue of outgoing MQTT messages, only used from core0 so there's no locking.
+//
+// Messages with a coalesce key (telemetry) replace any queued message with the same key, so
+// only the latest reading is sent. Messages without one (events) are kept in order. When the
+// queue is full the oldest telemetry message makes room, and if there isn't one the new
+// message is dropped.
+class PublishQueue {
+    public:
+        static constexpr int8_t NO_COALESCE_KEY         = -1;
+
+        struct QueueStats {
+            uint32_t mQueued;
+            uint32_t mCoalesced;
+            uint32_t mDropped;
+            uint8_t mMaxDepth;
+        };
+
+        PublishQueue();
+
+        bool push(const MQTTMessage& message);
+        MQTTMessage* front() { return at(0); }
+        MQTTMessage* at(int position);         // Oldest first, nullptr past the end
+        bool contains(int8_t coalesceKey) const;
+        void pop();
+        void removeAt(int position);
+
+        bool isEmpty() const { return !mDepth; }
+        uint8_t getDepth() const { return mDepth; }
+        const QueueStats& getStats() const { return mStats; }
+
+        static constexpr int QUEUE_SIZE                 = 8;
+
+    private:
+        MQTTMessage mEntries[QUEUE_SIZE];
+        uint8_t mOrder[QUEUE_SIZE];         // Entry indices, oldest first
+        uint8_t mDepth;
+        QueueStats mStats;
+};
+
+#endif      // _PUBLISH_QUEUE_H_
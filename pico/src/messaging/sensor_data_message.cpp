@@ -1,45 +1,143 @@
 #include "sensor_data_message.h"
+#include "sensor_frame_pool.h"
 #include "util/debug_io.h"
+#include "util/copy_stats.h"
 #include <cstring>
 
+#if PAYLOAD_BENCHMARK
+#include "hardware/structs/systick.h"
+#endif
+
 
 extern const int NUM_SENSOR_GROUPS;
 
-SensorDataMessage::SensorDataMessage() {}
+#if PAYLOAD_BENCHMARK
+constexpr int BENCHMARK_ITERATIONS                  = 100;
+constexpr uint32_t SYSTICK_MAX                      = 0xFFFFFF;
+constexpr int MAX_BENCHMARKED_GROUPS                = 32;
+
+// Encodes the group's data in each format, reporting the payload size and the average cycles
+// taken. SysTick counts processor clock cycles down from SYSTICK_MAX, and each core has its own
+static void benchmarkPayloadFormats(const SensorGroup& group, uint8_t* rawData) {
+    char scratch[MQTTMessage::MQTT_MAX_PAYLOAD_LENGTH];
+    uint32_t formattedCycles = 0;
+    uint32_t jsonCycles = 0;
+    uint32_t cborCycles = 0;
+    uint32_t rawCycles = 0;
+    int formattedSize = 0;
+    int jsonSize = 0;
+    int cborSize = 0;
+    int rawSize = 0;
+
+    systick_hw->rvr = SYSTICK_MAX;
+    systick_hw->csr = 0x5;      // Enabled, processor clock, no interrupt
 
-void SensorDataMessage::fillFromSensors(const vector<SensorGroup>& sensorGroups) {
-    uint8_t *writePtr = mData;
-    uint16_t bufferSize = TOTAL_RAW_DATA_SIZE;
+    for(int i = 0; i < BENCHMARK_ITERATIONS; ++i) {
+        systick_hw->cvr = 0;
+        uint32_t start = systick_hw->cvr;
+        group.formatSensorDataToJSON(rawData, group.getRawDataSize(), scratch, MQTTMessage::MQTT_MAX_PAYLOAD_LENGTH);
+        formattedCycles += (start - systick_hw->cvr) & SYSTICK_MAX;
+        formattedSize = strlen(scratch);
 
-    for(auto& sensorGroup : sensorGroups) {
-        sensorGroup.packSensorData(writePtr, bufferSize);
-        writePtr += sensorGroup.getRawDataSize();
-        bufferSize -= sensorGroup.getRawDataSize();
+        systick_hw->cvr = 0;
+        start = systick_hw->cvr;
+        group.unpackSensorDataToJSON(rawData, group.getRawDataSize(), scratch, MQTTMessage::MQTT_MAX_PAYLOAD_LENGTH);
+        jsonCycles += (start - systick_hw->cvr) & SYSTICK_MAX;
+        jsonSize = strlen(scratch);
+
+        systick_hw->cvr = 0;
+        start = systick_hw->cvr;
+        cborSize = group.unpackSensorDataToCBOR(rawData, group.getRawDataSize(), (uint8_t*) scratch, MQTTMessage::MQTT_MAX_PAYLOAD_LENGTH);
+        cborCycles += (start - systick_hw->cvr) & SYSTICK_MAX;
+
+        systick_hw->cvr = 0;
+        start = systick_hw->cvr;
+        rawSize = group.packRawFrame(rawData, group.getRawDataSize(), (uint8_t*) scratch, MQTTMessage::MQTT_MAX_PAYLOAD_LENGTH);
+        rawCycles += (start - systick_hw->cvr) & SYSTICK_MAX;
     }
+
+    DEBUG_PRINT(0, "Payload benchmark (%s):", group.getTopic());
+    DEBUG_PRINT(0, "  +- JSON (printf) %d bytes, %d cycles", formattedSize, formattedCycles / BENCHMARK_ITERATIONS);
+    DEBUG_PRINT(0, "  +- JSON (template) %d bytes, %d cycles", jsonSize, jsonCycles / BENCHMARK_ITERATIONS);
+    DEBUG_PRINT(0, "  +- CBOR %d bytes, %d cycles", cborSize, cborCycles / BENCHMARK_ITERATIONS);
+    DEBUG_PRINT(0, "  +- Raw %d bytes, %d cycles", rawSize, rawCycles / BENCHMARK_ITERATIONS);
 }
 
-void SensorDataMessage::toMQTT(const vector<SensorGroup>& sensorGroups,vector<MQTTMessage>& outboundMessages) {
-    assert(sensorGroups.size() == outboundMessages.size());
-
-    uint8_t* readPtr = mData; 
-
-    for(int i = 0; i < sensorGroups.size(); ++i) {
-        auto& group = sensorGroups[i];
-        auto& mqttMsg = outboundMessages[i];
-
-        if(group.hasTopics()) {
-            strncpy(mqttMsg.mTopic, group.getTopic(), MQTTMessage::MQTT_MAX_TOPIC_LENGTH);
-            group.unpackSensorDataToJSON(
-                readPtr,
-                group.getRawDataSize(),
-                mqttMsg.mPayload,
-                MQTTMessage::MQTT_MAX_PAYLOAD_LENGTH
-            );
-            mqttMsg.mReadyToSend = true;
-        } else {
-            mqttMsg.mReadyToSend = false;
+// Only benchmark groups once every sensor in them has data
+static bool groupHasAllData(const SensorGroup& group, uint8_t* rawData) {
+    const uint8_t* end = rawData + group.getRawDataSize();
+    for(int i = 0; i < group.getSensorCount(); ++i) {
+        if((rawData >= end) || (rawData[0] != Sensor::SENSOR_OK) || !rawData[1]) {
+            return false;
         }
+        rawData += group.getSensorRawDataSize(i) + 2;
+    }
+
+    return true;
+}
+#endif
 
-        readPtr += group.getRawDataSize();
+SensorDataMessage::SensorDataMessage() :
+    mRefCount(0),
+    mPool(nullptr)
+{}
+
+void SensorDataMessage::retain() {
+    mPool->retain(this);
+}
+
+void SensorDataMessage::release() {
+    mPool->release(this);
+}
+
+void SensorDataMessage::groupToMQTT(int groupIndex, int dataOffset, const SensorGroup& group, MQTTMessage& mqttMsg, UserData::PayloadFormat format) {
+    uint8_t* readPtr = mData + dataOffset;
+
+    if(!group.hasTopics()) {
+        mqttMsg.mReadyToSend = false;
+        return;
+    }
+
+#if PAYLOAD_BENCHMARK
+    // One flag per group, since groups can be encoded on both cores at once
+    static bool benchmarkedGroups[MAX_BENCHMARKED_GROUPS] = {};
+    if((groupIndex < MAX_BENCHMARKED_GROUPS) && !benchmarkedGroups[groupIndex] && groupHasAllData(group, readPtr)) {
+        benchmarkPayloadFormats(group, readPtr);
+        benchmarkedGroups[groupIndex] = true;
+    }
+#endif
+
+    // Group topics only change across a reboot, so only the first message needs them copying
+    if(!mqttMsg.mTopic[0]) {
+        strncpy(mqttMsg.mTopic, group.getTopic(), MQTTMessage::MQTT_MAX_TOPIC_LENGTH);
     }
+    if(format == UserData::PAYLOAD_RAW) {
+        mqttMsg.mPayloadLength = group.packRawFrame(
+            readPtr,
+            group.getRawDataSize(),
+            (uint8_t*) mqttMsg.mPayload,
+            MQTTMessage::MQTT_MAX_PAYLOAD_LENGTH
+        );
+    } else if(format == UserData::PAYLOAD_CBOR) {
+        mqttMsg.mPayloadLength = group.unpackSensorDataToCBOR(
+            readPtr,
+            group.getRawDataSize(),
+            (uint8_t*) mqttMsg.mPayload,
+            MQTTMessage::MQTT_MAX_PAYLOAD_LENGTH
+        );
+    } else {
+        group.unpackSensorDataToJSON(
+            readPtr,
+            group.getRawDataSize(),
+            mqttMsg.mPayload,
+            MQTTMessage::MQTT_MAX_PAYLOAD_LENGTH
+        );
+        mqttMsg.mPayloadLength = strlen(mqttMsg.mPayload);
+    }
+    COUNT_COPIED_BYTES(COPY_ENCODE, mqttMsg.mPayloadLength);
+
+    mqttMsg.mQoS = group.getQoS();
+    mqttMsg.mRetain = false;
+    mqttMsg.mCoalesceKey = (group.getPublishPolicy() == SensorGroup::PUBLISH_LATEST) ? groupIndex : -1;
+    mqttMsg.mReadyToSend = (mqttMsg.mPayloadLength > 0);
 }
@@ -7,14 +7,24 @@
 
 using std::vector;
 
-// Raw sensor data holder for passing between cores
+class SensorFramePool;
+
+// Raw sensor data for every group, passed between the cores by pointer. Core1's sensors write their
+// readings straight into a frame and core0 encodes straight out of it, so the data itself is never
+// copied. Frames come from a SensorFramePool and are reference counted
 struct SensorDataMessage {
     SensorDataMessage();
 
-    void fillFromSensors(const vector<SensorGroup>& sensorGroups);
-    void toMQTT(const vector<SensorGroup>& sensorGroups, vector<MQTTMessage>& outboundMessages);
+    void retain();
+    void release();
+
+    // Encodes one group's data, which starts dataOffset bytes into the frame. Groups are encoded
+    // independently, so they can be spread across both cores
+    void groupToMQTT(int groupIndex, int dataOffset, const SensorGroup& group, MQTTMessage& mqttMsg, UserData::PayloadFormat format);
     
     uint8_t mData[TOTAL_RAW_DATA_SIZE];
+    uint8_t mRefCount;
+    SensorFramePool* mPool;
 };
 
 #endif      // _SENSOR_DATA_MESSAGE_H_
@@ -0,0 +1,60 @@
+#include "sensor_frame_pool.h"
+#include <cassert>
+
+
+SensorFramePool::SensorFramePool() :
+    mFrames(nullptr),
+    mFrameCount(0),
+    mExhaustedCount(0)
+{
+    mutex_init(&mPoolMutex);
+}
+
+SensorFramePool::~SensorFramePool() {
+    delete[] mFrames;
+}
+
+void SensorFramePool::initialize(int sensorCount, int queuedFrameCount) {
+    assert(!mFrames);
+
+    mFrameCount = sensorCount + queuedFrameCount + IN_USE_FRAME_COUNT;
+    mFrames = new SensorDataMessage[mFrameCount];
+    for(int i = 0; i < mFrameCount; ++i) {
+        mFrames[i].mPool = this;
+    }
+}
+
+SensorDataMessage* SensorFramePool::acquire() {
+    SensorDataMessage* frame = nullptr;
+
+    mutex_enter_blocking(&mPoolMutex);
+
+    for(int i = 0; i < mFrameCount; ++i) {
+        if(!mFrames[i].mRefCount) {
+            frame = &mFrames[i];
+            frame->mRefCount = 1;
+            break;
+        }
+    }
+
+    if(!frame) {
+        ++mExhaustedCount;
+    }
+
+    mutex_exit(&mPoolMutex);
+
+    return frame;
+}
+
+void SensorFramePool::retain(SensorDataMessage* frame) {
+    mutex_enter_blocking(&mPoolMutex);
+    ++frame->mRefCount;
+    mutex_exit(&mPoolMutex);
+}
+
+void SensorFramePool::release(SensorDataMessage* frame) {
+    mutex_enter_blocking(&mPoolMutex);
+    assert(frame->mRefCount);
+    --frame->mRefCount;
+    mutex_exit(&mPoolMutex);
+}
@@ -0,0 +1,35 @@
+#ifndef _SENSOR_FRAME_POOL_H_
+#define _SENSOR_FRAME_POOL_H_
+
+#include "messaging/sensor_data_message.h"
+#include "pico/sync.h"
+
+// Fixed set of reference counted sensor frames, shared by both cores.
+//
+// A frame is held by core1 while its sensors write into it, by the mailbox queue until core0 reads
+// it, by core0 while it is being encoded, and by any sensor whose cached reading lives in it. The
+// pool is sized so that even with every one of those holding a different frame there's one free.
+class SensorFramePool {
+    public:
+        SensorFramePool();
+        ~SensorFramePool();
+
+        void initialize(int sensorCount, int queuedFrameCount);
+
+        // Returns a frame with a single reference, or nullptr if there are none free
+        SensorDataMessage* acquire();
+        void retain(SensorDataMessage* frame);
+        void release(SensorDataMessage* frame);
+
+        uint32_t getExhaustedCount() const { return mExhaustedCount; }
+
+    private:
+        static constexpr int IN_USE_FRAME_COUNT     = 2;        // One being written by core1, one being encoded by core0
+
+        SensorDataMessage* mFrames;
+        int mFrameCount;
+        uint32_t mExhaustedCount;
+        mutex_t mPoolMutex;
+};
+
+#endif      // _SENSOR_FRAME_POOL_H_
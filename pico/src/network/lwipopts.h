@@ -20,7 +20,7 @@
 #define MEM_LIBC_MALLOC             0
 #endif
 #define MEM_ALIGNMENT               4
-#define MEM_SIZE                    4000
+#define MEM_SIZE                    8000
 #define MEMP_NUM_TCP_SEG            32
 #define MEMP_NUM_ARP_QUEUE          10
 #define PBUF_POOL_SIZE              24
@@ -90,5 +90,7 @@
 
 #define MEMP_NUM_SYS_TIMEOUT        LWIP_NUM_SYS_TIMEOUT_INTERNAL + 1
 #define MQTT_REQ_MAX_IN_FLIGHT  (5) /* maximum of subscribe requests */
+#define MQTT_REQ_TIMEOUT        (10) /* seconds before an unacknowledged request times out */
+#define MQTT_OUTPUT_RINGBUF_SIZE (1024) /* default of 256 can't hold a full size message */
 
 #endif /* __LWIPOPTS_H__ */
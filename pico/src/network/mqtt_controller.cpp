@@ -2,15 +2,12 @@
 
 #include <cstring>
 #include "pico/cyw43_arch.h"
+#include "pico/rand.h"
 
 #include "util/debug_io.h"
+#include "util/copy_stats.h"
 
 // MQTT callback functions /////////////////////////////////////////////////////////////
-struct ConnectionMonitor {
-    mqtt_connection_status_t mStatus;
-    bool mConnectionCompleted;
-};
-
 void mqtt_connection_callback(mqtt_client_t *client, void *arg, mqtt_connection_status_t status);
 void mqtt_publish_start_callback(void *arg, const char *topic, u32_t tot_len);
 void mqtt_publish_data_callback(void *arg, const u8_t *data, u16_t len, u8_t flags);
@@ -20,14 +17,15 @@ void mqtt_publish_request_callback(void *arg, err_t err);
 
 
 void MQTTController::MQTTMessageBuffer::initialize(uint32_t payloadSize) {
-    memset(mMessage.mTopic, 0, 128);
-    memset(mMessage.mPayload, 0, 128);
+    memset(mMessage.mTopic, 0, MQTTMessage::MQTT_MAX_TOPIC_LENGTH);
+    memset(mMessage.mPayload, 0, MQTTMessage::MQTT_MAX_PAYLOAD_LENGTH);
+    mMessage.mPayloadLength = payloadSize;
     mPayloadSize = payloadSize;
     mBufferIndex = 0;
 }
 
 void MQTTController::MQTTMessageBuffer::setMessageTopic(const char *topic) {
-    memcpy(mMessage.mTopic, topic, strlen(topic));
+    strncpy(mMessage.mTopic, topic, MQTTMessage::MQTT_MAX_TOPIC_LENGTH - 1);
 }
 
 
@@ -35,53 +33,183 @@ MQTTController::MQTTController(MulticoreMailbox& mailbox) :
     mMQTTClient(nullptr),
     mBrokerPort(0),
     mClientName(nullptr),
-    mCoreMailbox(mailbox)
-{}
+    mKeepAliveSeconds(DEFAULT_KEEP_ALIVE_SECONDS),
+    mCoreMailbox(mailbox),
+    mEventCallback(nullptr),
+    mEventContext(nullptr),
+    mConnectionState(MQTT_STATE_DISCONNECTED),
+    mStateTimeout(nil_time),
+    mCurrentBackoffMS(0),
+    mNextSubscription(0),
+    mPublishStats{},
+    mConnectionCompleted(false),
+    mConnectionStatus(MQTT_CONNECT_DISCONNECTED),
+    mPendingSubscriptions(0)
+{
+    for(auto& p : mInFlightPublishes) {
+        p.mController = this;
+        p.mActive = false;
+        p.mRetryPending = false;
+        p.mCompleted = false;
+    }
+}
 
 void MQTTController::initMQTTClient() {
+    // The network stack survives Wi-Fi reconnects, so make sure the old connection is closed first
     if(mMQTTClient) {
+        disconnectFromBroker();
         mqtt_client_free(mMQTTClient);
+        abandonPublishes();
     }
 
     mMQTTClient = mqtt_client_new();
     mIncomingMessageBuffer.initialize(0);
+
+    // Fresh client, so we can connect straight away
+    mConnectionState = MQTT_STATE_DISCONNECTED;
+    mCurrentBackoffMS = 0;
 }
 
-bool MQTTController::connectToBrokerBlocking(uint16_t timeoutMS) {
+bool MQTTController::readyToConnect(absolute_time_t now) {
+    if(!mMQTTClient) {
+        return false;
+    }
+
+    switch(mConnectionState) {
+        case MQTT_STATE_DISCONNECTED:
+            return true;
+
+        case MQTT_STATE_BACKOFF:
+            return (absolute_time_diff_us(now, mStateTimeout) <= 0);
+
+        default:
+            return false;
+    }
+}
+
+bool MQTTController::startConnection(absolute_time_t now) {
     struct mqtt_connect_client_info_t ci;
     err_t err;
-    char controlTopic[MQTTMessage::MQTT_MAX_TOPIC_LENGTH];
 
+    // Note that lwIP's MQTT client always requests a clean session, so control topics are
+    // resubscribed on every connection
     memset(&ci, 0, sizeof(ci));
     ci.client_id    = mClientName;
     ci.client_user  = NULL;
     ci.client_pass  = NULL;
-    ci.keep_alive   = 10;
+    ci.keep_alive   = mKeepAliveSeconds;
     ci.will_topic   = NULL;
     ci.will_msg     = NULL;
     ci.will_retain  = 0;
     ci.will_qos     = 0;
 
-    ConnectionMonitor connectionMonitor;
-    connectionMonitor.mConnectionCompleted = false;
-    absolute_time_t connectTimeout = make_timeout_time_ms(timeoutMS);
+    mConnectionCompleted = false;
 
     cyw43_arch_lwip_begin();
-    mqtt_client_connect(mMQTTClient, &mBrokerAddress, mBrokerPort, mqtt_connection_callback, &connectionMonitor, &ci);
+    err = mqtt_client_connect(mMQTTClient, &mBrokerAddress, mBrokerPort, mqtt_connection_callback, this, &ci);
+
+    // Connecting wipes the client, so the callbacks for incoming published data go on afterwards.
+    // Nothing can come in before the CONNACK, so this isn't too late
+    if(err == ERR_OK) {
+        mqtt_set_inpub_callback(
+            mMQTTClient,
+            mqtt_publish_start_callback,
+            mqtt_publish_data_callback,
+            this
+        );
+    }
     cyw43_arch_lwip_end();
 
-    absolute_time_t now = get_absolute_time();
-    int64_t timeDiff = absolute_time_diff_us(now, connectTimeout);
-    while((timeDiff > 0) && !connectionMonitor.mConnectionCompleted) {
-        sleep_ms(1);
-        now = get_absolute_time();
+    if(err != ERR_OK) {
+        DEBUG_PRINT(0, "Could not start broker connection (err %d)", err);
+        enterBackoff(now);
+        return false;
     }
 
-    if(!connectionMonitor.mConnectionCompleted) {
-        disconnectFromBroker();
+    mConnectionState = MQTT_STATE_CONNECTING;
+    mStateTimeout = delayed_by_ms(now, CONNECT_TIMEOUT_MS);
+    return true;
+}
+
+void MQTTController::connectionFailed(absolute_time_t now) {
+    enterBackoff(now);
+}
+
+bool MQTTController::update(absolute_time_t now) {
+    processCompletedPublishes(now);
+
+    bool timedOut = !is_nil_time(mStateTimeout) && (absolute_time_diff_us(now, mStateTimeout) <= 0);
+
+    switch(mConnectionState) {
+        case MQTT_STATE_CONNECTING:
+            if(mConnectionCompleted) {
+                mConnectionCompleted = false;
+
+                if(mConnectionStatus == MQTT_CONNECT_ACCEPTED) {
+                    DEBUG_PRINT(0, "Broker connection succeeded. Subscribing to control topics");
+                    mNextSubscription = 0;
+                    mPendingSubscriptions = 0;
+                    mConnectionState = MQTT_STATE_SUBSCRIBING;
+                    mStateTimeout = delayed_by_ms(now, SUBSCRIBE_TIMEOUT_MS);
+                } else {
+                    DEBUG_PRINT(0, "Broker connection failed (status %d)", mConnectionStatus);
+                    disconnectFromBroker();
+                    enterBackoff(now);
+                }
+            } else if(timedOut) {
+                DEBUG_PRINT(0, "Broker connection timed out");
+                disconnectFromBroker();
+                enterBackoff(now);
+            }
+            break;
+
+        case MQTT_STATE_SUBSCRIBING:
+            if(!mqtt_client_is_connected(mMQTTClient)) {
+                DEBUG_PRINT(0, "Broker connection lost while subscribing");
+                enterBackoff(now);
+                break;
+            }
+
+            // Issue as many of our subscriptions as lwIP currently has room for
+            while(
+                (mNextSubscription < mSubscriptionTopics.size()) &&
+                subscribeToTopic(mSubscriptionTopics[mNextSubscription])
+            ) {
+                ++mNextSubscription;
+            }
+
+            if((mNextSubscription == mSubscriptionTopics.size()) && !mPendingSubscriptions) {
+                DEBUG_PRINT(0, "MQTT broker subscription complete");
+                mConnectionState = MQTT_STATE_CONNECTED;
+                mStateTimeout = nil_time;
+                mCurrentBackoffMS = 0;
+                return true;
+            } else if(timedOut) {
+                DEBUG_PRINT(0, "MQTT broker subscription timed out");
+                disconnectFromBroker();
+                enterBackoff(now);
+            }
+            break;
+
+        case MQTT_STATE_CONNECTED:
+            if(!mqtt_client_is_connected(mMQTTClient)) {
+                DEBUG_PRINT(0, "Lost connection to MQTT broker");
+                enterBackoff(now);
+            } else {
+                resendPublishes(now);
+                drainPublishQueue();
+            }
+            break;
+
+        default:
+            break;
     }
 
-    return connectionMonitor.mStatus == MQTT_CONNECT_ACCEPTED;
+    return false;
+}
+
+void MQTTController::addSubscriptionTopic(const char* topic) {
+    mSubscriptionTopics.push_back(topic);
 }
 
 bool MQTTController::isConnected() {
@@ -89,35 +217,57 @@ bool MQTTController::isConnected() {
         return false;
     }
 
-    return mqtt_client_is_connected(mMQTTClient);
+    return (mConnectionState == MQTT_STATE_CONNECTED) && mqtt_client_is_connected(mMQTTClient);
 }
 
 void MQTTController::disconnectFromBroker() {
-    if(mqtt_client_is_connected(mMQTTClient)) {
-        cyw43_arch_lwip_begin();
-        mqtt_disconnect(mMQTTClient);
-        cyw43_arch_lwip_end();
+    if(!mMQTTClient) {
+        return;
     }
-}
 
-void MQTTController::subscribeToTopic(const char* topic) {
-    // Set callbacks for incoming published data
-    mqtt_set_inpub_callback(
-        mMQTTClient,
-        mqtt_publish_start_callback,
-        mqtt_publish_data_callback,
-        this
-    );
+    // Also aborts a connection attempt which is still in progress
+    cyw43_arch_lwip_begin();
+    mqtt_disconnect(mMQTTClient);
+    cyw43_arch_lwip_end();
+}
 
-    // Subscribe to supplied topic
-    mqtt_sub_unsub(
+bool MQTTController::subscribeToTopic(const char* topic) {
+    // The pending count is adjusted under the lwIP lock so the completion callback can't beat us to it
+    cyw43_arch_lwip_begin();
+    mPendingSubscriptions = mPendingSubscriptions + 1;
+    err_t err = mqtt_sub_unsub(
         mMQTTClient,
         topic,
         0,
         mqtt_subscribe_request_callback,
-        0,
+        this,
         1
     );
+    if(err != ERR_OK) {
+        mPendingSubscriptions = mPendingSubscriptions - 1;
+    }
+    cyw43_arch_lwip_end();
+
+    // ERR_MEM means there are too many requests in flight, we'll try again on the next update
+    return (err == ERR_OK);
+}
+
+void MQTTController::enterBackoff(absolute_time_t now) {
+    // Exponential backoff with +/- jitter so a roomful of devices don't all hammer the broker at once
+    mCurrentBackoffMS = mCurrentBackoffMS ? (mCurrentBackoffMS * 2) : MIN_BACKOFF_MS;
+    if(mCurrentBackoffMS > MAX_BACKOFF_MS) {
+        mCurrentBackoffMS = MAX_BACKOFF_MS;
+    }
+
+    uint32_t jitterRange = (mCurrentBackoffMS * BACKOFF_JITTER_PERCENT) / 100;
+    uint32_t delay = (mCurrentBackoffMS - jitterRange) + (get_rand_32() % ((jitterRange * 2) + 1));
+
+    // Anything lwIP was still holding is gone now
+    abandonPublishes();
+
+    DEBUG_PRINT(0, "Retrying broker connection in %dms", delay);
+    mConnectionState = MQTT_STATE_BACKOFF;
+    mStateTimeout = delayed_by_ms(now, delay);
 }
 
 void MQTTController::setBrokerParameters(ip_addr_t& address, uint16_t port) {
@@ -129,6 +279,32 @@ void MQTTController::setClientParameters(const char* clientName) {
     mClientName = clientName;
 }
 
+void MQTTController::setKeepAlive(uint16_t keepAliveSeconds) {
+    mKeepAliveSeconds = keepAliveSeconds;
+}
+
+void MQTTController::setEventCallback(EventCallback callback, void* context) {
+    mEventContext = context;
+    mEventCallback = callback;
+}
+
+void MQTTController::onConnectionStatus(mqtt_connection_status_t status) {
+    mConnectionStatus = status;
+    mConnectionCompleted = true;
+    notifyEvent();
+}
+
+void MQTTController::onSubscribeComplete(err_t err) {
+    if(mPendingSubscriptions > 0) {
+        mPendingSubscriptions = mPendingSubscriptions - 1;
+    }
+
+    if(err != ERR_OK) {
+        DEBUG_PRINT(0, "MQTT subscribe failed (err %d)", err);
+    }
+    notifyEvent();
+}
+
 MQTTController::MQTTMessageBuffer& MQTTController::getBuffer() {
     return mIncomingMessageBuffer;
 }
@@ -138,37 +314,239 @@ void MQTTController::handleIncomingControlMessage(MQTTMessage& message) {
 }
 
 void MQTTController::initializeMessage(MQTTMessage& message) {
-    memset(message.mTopic, 0, MQTTMessage::MQTT_MAX_PAYLOAD_LENGTH);
+    memset(message.mTopic, 0, MQTTMessage::MQTT_MAX_TOPIC_LENGTH);
     memset(message.mPayload, 0, MQTTMessage::MQTT_MAX_PAYLOAD_LENGTH);
+    message.mPayloadLength = 0;
+    message.mQoS = 0;
+    message.mRetain = false;
+    message.mCoalesceKey = -1;
 }
 
-err_t MQTTController::publishMessage(MQTTMessage& message) {
+err_t MQTTController::publishMessage(const MQTTMessage& message) {
     err_t err;
-    u8_t qos = 0;
-    u8_t retain = 0;
-  
+    InFlightPublish* publish = allocatePublish(message.mQoS, err);
+    if(!publish) {
+        ++mPublishStats.mWindowFull;
+        return err;
+    }
+
+    // QoS 1 messages are kept until they are acknowledged in case they need resending
+    if(message.mQoS > 0) {
+        COUNT_COPIED_BYTES(COPY_IN_FLIGHT, publish->mMessage.copyFrom(message));
+    }
+
+    err = sendPublish(*publish, message, get_absolute_time());
+    if(err != ERR_OK) {
+        publish->mActive = false;
+    }
+
+    return err;
+}
+
+bool MQTTController::queueMessage(const MQTTMessage& message) {
+    // With nothing queued ahead of it the message can go straight from the caller's buffer, and
+    // only needs copying into the queue if lwIP is full
+    if(mPublishQueue.isEmpty() && isConnected()) {
+        err_t err = publishMessage(message);
+        if((err != ERR_MEM) && (err != ERR_WINDOW_FULL)) {
+            if(err == ERR_OK) {
+                ++mPublishStats.mPublished;
+            } else {
+                ++mPublishStats.mPublishErrors;
+            }
+            return true;
+        }
+    }
+
+    bool queued = mPublishQueue.push(message);
+
+    // Send straight away if there's room
+    if(isConnected()) {
+        drainPublishQueue();
+    }
+
+    return queued;
+}
+
+void MQTTController::drainPublishQueue() {
+    // QoS 1 messages which don't fit in their window stay queued in order, without holding up the
+    // QoS 0 messages behind them
+    bool qos1WindowFull = false;
+    int position = 0;
+
+    while(MQTTMessage* message = mPublishQueue.at(position)) {
+        if(qos1WindowFull && (message->mQoS > 0)) {
+            ++position;
+            continue;
+        }
+
+        err_t err = publishMessage(*message);
+        if(err == ERR_WINDOW_FULL) {
+            qos1WindowFull = true;
+            ++position;
+            continue;
+        }
+
+        if(err == ERR_MEM) {
+            // lwIP is full - leave the rest queued until completions free some space
+            break;
+        }
+
+        if(err == ERR_OK) {
+            ++mPublishStats.mPublished;
+        } else {
+            ++mPublishStats.mPublishErrors;
+        }
+        mPublishQueue.removeAt(position);
+    }
+}
+
+void MQTTController::onPublishComplete(InFlightPublish& publish, err_t err) {
+    publish.mResult = err;
+    publish.mCompleted = true;
+    notifyEvent();
+}
+
+void MQTTController::notifyEvent() {
+    if(mEventCallback) {
+        mEventCallback(mEventContext);
+    }
+}
+
+MQTTController::InFlightPublish* MQTTController::allocatePublish(uint8_t qos, err_t& err) {
+    InFlightPublish* freePublish = nullptr;
+    int qos1InFlight = 0;
+
+    for(auto& p : mInFlightPublishes) {
+        if(!p.mActive) {
+            if(!freePublish) {
+                freePublish = &p;
+            }
+        } else if(p.mMessage.mQoS > 0) {
+            ++qos1InFlight;
+        }
+    }
+
+    if(!freePublish) {
+        err = ERR_MEM;
+        return nullptr;
+    }
+
+    if((qos > 0) && (qos1InFlight >= MAX_QOS1_IN_FLIGHT)) {
+        err = ERR_WINDOW_FULL;
+        return nullptr;
+    }
+
+    freePublish->mActive = true;
+    freePublish->mRetryPending = false;
+    freePublish->mRetries = 0;
+    freePublish->mCompleted = false;
+    freePublish->mMessage.mQoS = qos;
+    return freePublish;
+}
+
+err_t MQTTController::sendPublish(InFlightPublish& publish, const MQTTMessage& message, absolute_time_t now) {
+    err_t err;
+    u8_t retain = message.mRetain ? 1 : 0;
+
+    publish.mCompleted = false;
+    publish.mSentTime = now;
+
     cyw43_arch_lwip_begin();
     err = mqtt_publish(
         mMQTTClient,
         message.mTopic, 
         message.mPayload, 
-        strlen(message.mPayload), 
-        qos, 
+        message.mPayloadLength, 
+        message.mQoS, 
         retain, 
         mqtt_publish_request_callback, 
-        this
+        &publish
     );
     cyw43_arch_lwip_end();
 
-    return err; 
+    // lwIP copies the topic and payload into its output buffer
+    if(err == ERR_OK) {
+        COUNT_COPIED_BYTES(COPY_LWIP, strlen(message.mTopic) + message.mPayloadLength);
+    }
+
+    return err;
+}
+
+void MQTTController::processCompletedPublishes(absolute_time_t now) {
+    for(auto& p : mInFlightPublishes) {
+        if(!p.mActive || !p.mCompleted) {
+            continue;
+        }
+        p.mCompleted = false;
+
+        // For QoS 1 this is the time to the broker's PUBACK, for QoS 0 until TCP has sent the data
+        uint32_t latency = absolute_time_diff_us(p.mSentTime, now);
+        if(latency > mPublishStats.mMaxLatencyUS) {
+            mPublishStats.mMaxLatencyUS = latency;
+        }
+
+        if(p.mResult == ERR_OK) {
+            ++mPublishStats.mCompleted;
+            p.mActive = false;
+            continue;
+        }
+
+        ++mPublishStats.mTimedOut;
+        if((p.mMessage.mQoS > 0) && (p.mRetries < MAX_PUBLISH_RETRIES)) {
+            p.mRetryPending = true;
+        } else {
+            ++mPublishStats.mDropped;
+            p.mActive = false;
+        }
+    }
+}
+
+void MQTTController::resendPublishes(absolute_time_t now) {
+    for(auto& p : mInFlightPublishes) {
+        if(!p.mActive || !p.mRetryPending) {
+            continue;
+        }
+
+        err_t err = sendPublish(p, p.mMessage, now);
+        if(err == ERR_OK) {
+            p.mRetryPending = false;
+            ++p.mRetries;
+            ++mPublishStats.mRetried;
+        } else if(err == ERR_MEM) {
+            // No room in lwIP right now, try again on the next update
+            break;
+        }
+    }
+}
+
+void MQTTController::abandonPublishes() {
+    // lwIP throws away its pending requests without calling back when a connection closes, so
+    // QoS 1 messages get sent again once we reconnect and the rest are forgotten
+    for(auto& p : mInFlightPublishes) {
+        if(!p.mActive || p.mCompleted) {
+            continue;
+        }
+
+        if((p.mMessage.mQoS > 0) && (p.mRetries < MAX_PUBLISH_RETRIES)) {
+            p.mRetryPending = true;
+        } else {
+            if(p.mMessage.mQoS > 0) {
+                ++mPublishStats.mDropped;
+            }
+            p.mActive = false;
+        }
+    }
 }
 
 
 // CALLBACK FUNCTIONS //////
 void mqtt_connection_callback(mqtt_client_t *client, void *arg, mqtt_connection_status_t status) {
-    ConnectionMonitor *monitor = (ConnectionMonitor*) arg;
-    monitor->mStatus = status;
-    monitor->mConnectionCompleted = true;
+    if(!arg) {
+        return;
+    }
+
+    ((MQTTController *) arg)->onConnectionStatus(status);
 }
 
 // Callback when a new publish has started on a subscribed topic
@@ -182,7 +560,7 @@ void mqtt_publish_start_callback(void *arg, const char *topic, u32_t tot_len) {
     MQTTController* controller = (MQTTController *) arg;
     MQTTController::MQTTMessageBuffer& buffer = controller->getBuffer();
 
-    if(tot_len > MQTTMessage::MQTT_MAX_PAYLOAD_LENGTH) {
+    if(tot_len >= MQTTMessage::MQTT_MAX_PAYLOAD_LENGTH) {
         // This is unfortunate - our payload is larger than our buffer
         DEBUG_PRINT(0, "Incoming publish is too large (%d bytes)", tot_len);
         buffer.initialize(0);
@@ -227,9 +605,15 @@ void mqtt_subscribe_request_callback(void *arg, err_t err) {
         return;
     }
 
-    DEBUG_PRINT(0, "MQTT subscribe response (err %d)", err);
+    ((MQTTController *) arg)->onSubscribeComplete(err);
 }
 
-// Called when a local publish to a topic has been completed
-// Currently unused
-void mqtt_publish_request_callback(void *arg, err_t err) {}
+// Called when a local publish to a topic has been completed (acknowledged for QoS 1, sent for QoS 0)
+void mqtt_publish_request_callback(void *arg, err_t err) {
+    if(!arg) {
+        return;
+    }
+
+    MQTTController::InFlightPublish* publish = (MQTTController::InFlightPublish *) arg;
+    publish->mController->onPublishComplete(*publish, err);
+}
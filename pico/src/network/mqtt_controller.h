@@ -2,12 +2,22 @@
 #define _MQTT_CONTROLLER_H_
 
 #include "messaging/mqtt_message.h"
+#include "messaging/publish_queue.h"
 #include "messaging/multicore_mailbox.h"
 
 #include "pico/types.h"
 #include "lwip/ip_addr.h"
 #include "lwip/apps/mqtt.h"
 
+#include <vector>
+
+using std::vector;
+
+// Broker keep-alive, can be overridden at build time
+#ifndef MQTT_KEEP_ALIVE_SECONDS
+#define MQTT_KEEP_ALIVE_SECONDS     10
+#endif
+
 
 class MQTTController {
     public:
@@ -20,30 +30,132 @@ class MQTTController {
             void setMessageTopic(const char *topic);
         };
 
+        // A publish which lwIP is still holding on to. QoS 1 messages are kept so they can be resent
+        struct InFlightPublish {
+            MQTTController* mController;
+            bool mActive;
+            bool mRetryPending;
+            uint8_t mRetries;
+            absolute_time_t mSentTime;
+            MQTTMessage mMessage;
+
+            // Written from the lwIP publish callback
+            volatile bool mCompleted;
+            volatile err_t mResult;
+        };
+
+        struct PublishStats {
+            uint32_t mPublished;
+            uint32_t mPublishErrors;
+            uint32_t mCompleted;
+            uint32_t mTimedOut;
+            uint32_t mRetried;
+            uint32_t mDropped;
+            uint32_t mWindowFull;
+            uint32_t mMaxLatencyUS;
+        };
+
+        // Broker connection states. The controller never blocks - update() advances through these
+        // and falls back to BACKOFF (with an increasing, jittered delay) whenever something fails
+        enum ConnectionState {
+            MQTT_STATE_DISCONNECTED,
+            MQTT_STATE_CONNECTING,
+            MQTT_STATE_SUBSCRIBING,
+            MQTT_STATE_CONNECTED,
+            MQTT_STATE_BACKOFF
+        };
+
+        // Called from lwIP callbacks whenever update() has something new to look at
+        typedef void (*EventCallback)(void* context);
+
         MQTTController(MulticoreMailbox& mailbox);
 
         void initMQTTClient();
-        bool connectToBrokerBlocking(uint16_t timeoutMS);
         bool isConnected();
         void disconnectFromBroker();
-        void subscribeToTopic(const char* topic);
+
+        // Connection state machine
+        bool readyToConnect(absolute_time_t now);
+        bool startConnection(absolute_time_t now);
+        void connectionFailed(absolute_time_t now);
+        bool update(absolute_time_t now);
+        ConnectionState getConnectionState() const { return mConnectionState; }
+
+        void addSubscriptionTopic(const char* topic);
 
         void setBrokerParameters(ip_addr_t& address, uint16_t port);
         void setClientParameters(const char* clientName);
+        void setKeepAlive(uint16_t keepAliveSeconds);
+        void setEventCallback(EventCallback callback, void* context);
 
         MQTTMessageBuffer& getBuffer();
         void handleIncomingControlMessage(MQTTMessage& mMessage);
 
         void initializeMessage(MQTTMessage& message);
-        err_t publishMessage(MQTTMessage& message);
+
+        // Returns ERR_WINDOW_FULL rather than ERR_MEM when only the QoS 1 window is full, since
+        // lwIP can still take QoS 0 messages
+        static constexpr err_t ERR_WINDOW_FULL = ERR_ARG - 1;       // Past the end of lwIP's own codes
+        err_t publishMessage(const MQTTMessage& message);
+        bool queueMessage(const MQTTMessage& message);
+        const PublishQueue& getPublishQueue() const { return mPublishQueue; }
+        const PublishStats& getPublishStats() const { return mPublishStats; }
+
+        // Called from lwIP callbacks
+        void onConnectionStatus(mqtt_connection_status_t status);
+        void onSubscribeComplete(err_t err);
+        void onPublishComplete(InFlightPublish& publish, err_t err);
 
     private:
+        bool subscribeToTopic(const char* topic);
+        void enterBackoff(absolute_time_t now);
+        InFlightPublish* allocatePublish(uint8_t qos, err_t& err);
+        err_t sendPublish(InFlightPublish& publish, const MQTTMessage& message, absolute_time_t now);
+        void processCompletedPublishes(absolute_time_t now);
+        void resendPublishes(absolute_time_t now);
+        void abandonPublishes();
+        void drainPublishQueue();
+        void notifyEvent();
+
+        static constexpr uint16_t DEFAULT_KEEP_ALIVE_SECONDS    = MQTT_KEEP_ALIVE_SECONDS;
+        static constexpr uint32_t CONNECT_TIMEOUT_MS            = 5000;
+        static constexpr uint32_t SUBSCRIBE_TIMEOUT_MS          = 5000;
+        static constexpr uint32_t MIN_BACKOFF_MS                = 1000;
+        static constexpr uint32_t MAX_BACKOFF_MS                = 60000;
+        static constexpr uint32_t BACKOFF_JITTER_PERCENT        = 25;
+
+        // lwIP's request pool is shared by every publish (QoS 0 ones too, until their data has been
+        // sent) and subscription, so our window matches it. QoS 1 can't take the last slot, which
+        // stops unacknowledged publishes from starving everything else
+        static constexpr int PUBLISH_WINDOW_SIZE                = MQTT_REQ_MAX_IN_FLIGHT;
+        static constexpr int MAX_QOS1_IN_FLIGHT                 = PUBLISH_WINDOW_SIZE - 1;
+        static constexpr uint8_t MAX_PUBLISH_RETRIES            = 3;
+
         mqtt_client_t* mMQTTClient;
         ip_addr_t mBrokerAddress;
         uint16_t mBrokerPort;
         const char *mClientName;
+        uint16_t mKeepAliveSeconds;
         MulticoreMailbox& mCoreMailbox;
         MQTTMessageBuffer mIncomingMessageBuffer;
+        EventCallback mEventCallback;
+        void* mEventContext;
+
+        // Connection state machine
+        ConnectionState mConnectionState;
+        absolute_time_t mStateTimeout;
+        uint32_t mCurrentBackoffMS;
+        vector<const char*> mSubscriptionTopics;
+        size_t mNextSubscription;
+
+        InFlightPublish mInFlightPublishes[PUBLISH_WINDOW_SIZE];
+        PublishStats mPublishStats;
+        PublishQueue mPublishQueue;
+
+        // Written from lwIP callbacks, consumed in update()
+        volatile bool mConnectionCompleted;
+        volatile mqtt_connection_status_t mConnectionStatus;
+        volatile int mPendingSubscriptions;
 };
 
 
@@ -1,14 +1,25 @@
 #include "network_controller.h"
 
 #include "lwip/dns.h"
+#include "lwip/dhcp.h"
 #include "pico/cyw43_arch.h"
+#include "pico/rand.h"
+#include "util/debug_io.h"
 
-// DNS resolution callbacl
+#include <cstring>
+
+// The netif callbacks only give us the interface, so this is how they find their way back to us
+static NetworkController* sNetworkController = nullptr;
+
+constexpr uint32_t WIFI_COUNTRY     = CYW43_COUNTRY_CANADA;
+constexpr uint32_t WIFI_AUTH        = CYW43_AUTH_WPA2_MIXED_PSK;
+
+// DNS resolution callback
 void on_resolution_completed(const char *name, const ip_addr_t *ipaddr, void *callback_arg) {
     NetworkController::DNSRequest *r = (NetworkController::DNSRequest *) callback_arg;
 
     if(ipaddr) {
-        r->mResolvedAddress.addr = ipaddr->addr;
+        r->mLookupAddress.addr = ipaddr->addr;
         r->mStatus = ERR_OK;
     } else {
         // Something went wrong - either a failed resolution or a timeout, we don't really know which
@@ -16,36 +27,350 @@ void on_resolution_completed(const char *name, const ip_addr_t *ipaddr, void *ca
     }
 }
 
+// Network interface link/status callback
+void on_netif_changed(struct netif *netif) {
+    if(sNetworkController) {
+        sNetworkController->onNetworkInterfaceChanged();
+    }
+}
+
+NetworkController::NetworkController() :
+    mSSID(nullptr),
+    mPassword(nullptr),
+    mHostname(nullptr),
+    mWiFiState(WIFI_STATE_DISCONNECTED),
+    mChipInitialized(false),
+    mStateTimeout(nil_time),
+    mNextLinkPoll(nil_time),
+    mCurrentBackoffMS(0),
+    mConsecutiveFailures(0),
+    mCachedBSSID{},
+    mCachedChannel(0),
+    mHasCachedAccessPoint(false),
+    mFastConnectActive(false),
+    mInitialIPAddress(0),
+    mInitialNetmask(0),
+    mInitialGateway(0),
+    mStaticAddress(false),
+    mAddressApplied(false),
+    mEventCallback(nullptr),
+    mEventContext(nullptr),
+    mInterfaceChanged(false)
+{}
+
 bool NetworkController::isConnected() {
-    return (
-        (cyw43_wifi_link_status(&cyw43_state, CYW43_ITF_STA) == CYW43_LINK_JOIN) &&
-        (cyw43_tcpip_link_status(&cyw43_state, CYW43_ITF_STA) == CYW43_LINK_UP)
-    );
+    return (mWiFiState == WIFI_STATE_CONNECTED);
 }
 
-void NetworkController::resolveHost(DNSRequest &request) {
+void NetworkController::setWiFiParameters(const char *ssid, const char *password, const char *hostname) {
+    mSSID = ssid;
+    mPassword = password;
+    mHostname = hostname;
+}
+
+void NetworkController::setCachedAccessPoint(const uint8_t *bssid, uint8_t channel) {
+    memcpy(mCachedBSSID, bssid, sizeof(mCachedBSSID));
+    mCachedChannel = channel;
+    mHasCachedAccessPoint = true;
+}
+
+void NetworkController::setInitialAddress(uint32_t ipAddress, uint32_t netmask, uint32_t gateway, bool isStatic) {
+    mInitialIPAddress = ipAddress;
+    mInitialNetmask = netmask;
+    mInitialGateway = gateway;
+    mStaticAddress = isStatic;
+}
+
+bool NetworkController::getConnectionDetails(uint8_t *bssid, uint8_t& channel, uint32_t& ipAddress, uint32_t& netmask, uint32_t& gateway) {
+    if(!isConnected()) {
+        return false;
+    }
+
+    struct netif *staInterface = &cyw43_state.netif[CYW43_ITF_STA];
+    uint32_t channelInfo[3] = {0};      // hw_channel, target_channel, scan_channel
+
     cyw43_arch_lwip_begin();
-    request.mStatus = dns_gethostbyname(request.mHost, &request.mResolvedAddress, on_resolution_completed, &request);
+    int err = cyw43_wifi_get_bssid(&cyw43_state, bssid);
+    if(!err) {
+        err = cyw43_ioctl(&cyw43_state, CYW43_IOCTL_GET_CHANNEL, sizeof(channelInfo), (uint8_t *) channelInfo, CYW43_ITF_STA);
+    }
+    ipAddress = ip4_addr_get_u32(netif_ip4_addr(staInterface));
+    netmask = ip4_addr_get_u32(netif_ip4_netmask(staInterface));
+    gateway = ip4_addr_get_u32(netif_ip4_gw(staInterface));
     cyw43_arch_lwip_end();
 
-    if(request.mStatus == ERR_ARG) {
+    channel = channelInfo[0];
+    return !err;
+}
+
+bool NetworkController::update(absolute_time_t now) {
+    bool interfaceChanged = mInterfaceChanged;
+    mInterfaceChanged = false;
+
+    switch(mWiFiState) {
+        case WIFI_STATE_DISCONNECTED:
+            startConnection(now);
+            break;
+
+        case WIFI_STATE_CONNECTING: {
+            // Join failures don't raise a netif callback, so poll (slowly) for those as well
+            if(!interfaceChanged && (absolute_time_diff_us(now, mNextLinkPoll) > 0)) {
+                break;
+            }
+            mNextLinkPoll = delayed_by_ms(now, WIFI_CONNECT_POLL_PERIOD_MS);
+
+            // As soon as we're associated we can put a known address on the interface
+            if(!mAddressApplied && netif_is_link_up(&cyw43_state.netif[CYW43_ITF_STA])) {
+                applyInitialAddress();
+            }
+
+            int linkStatus = cyw43_tcpip_link_status(&cyw43_state, CYW43_ITF_STA);
+            if(linkStatus == CYW43_LINK_UP) {
+                DEBUG_PRINT(0, "...connect succeeded");
+                mWiFiState = WIFI_STATE_CONNECTED;
+                mCurrentBackoffMS = 0;
+                mConsecutiveFailures = 0;
+                return true;
+            } else if(linkStatus < 0) {
+                DEBUG_PRINT(0, "...connect failed (%d)", linkStatus);
+                connectionFailed(now);
+            } else if(absolute_time_diff_us(now, mStateTimeout) <= 0) {
+                DEBUG_PRINT(0, "...connect timed out (%d)", linkStatus);
+                connectionFailed(now);
+            }
+            break;
+        }
+
+        case WIFI_STATE_CONNECTED:
+            // Only check the link when lwIP tells us something changed
+            if(interfaceChanged && (cyw43_tcpip_link_status(&cyw43_state, CYW43_ITF_STA) != CYW43_LINK_UP)) {
+                DEBUG_PRINT(0, "Network connection lost");
+                mWiFiState = WIFI_STATE_DISCONNECTED;
+            }
+            break;
+
+        case WIFI_STATE_BACKOFF:
+            if(absolute_time_diff_us(now, mStateTimeout) <= 0) {
+                startConnection(now);
+            }
+            break;
+    }
+
+    return false;
+}
+
+void NetworkController::setEventCallback(EventCallback callback, void* context) {
+    mEventContext = context;
+    mEventCallback = callback;
+}
+
+void NetworkController::onNetworkInterfaceChanged() {
+    mInterfaceChanged = true;
+
+    if(mEventCallback) {
+        mEventCallback(mEventContext);
+    }
+}
+
+bool NetworkController::initializeWiFi() {
+    if(cyw43_arch_init_with_country(WIFI_COUNTRY)) {
+        return false;
+    }
+
+    cyw43_arch_enable_sta_mode();
+
+    // The STA interface is (re)created when STA mode is enabled, so the callbacks have to be set each time
+    struct netif *staInterface = &cyw43_state.netif[CYW43_ITF_STA];
+    sNetworkController = this;
+
+    cyw43_arch_lwip_begin();
+    if(mHostname) {
+        netif_set_hostname(staInterface, mHostname);
+    }
+    netif_set_link_callback(staInterface, on_netif_changed);
+    netif_set_status_callback(staInterface, on_netif_changed);
+    cyw43_arch_lwip_end();
+
+    mChipInitialized = true;
+    return true;
+}
+
+void NetworkController::shutdownWiFi() {
+    if(cyw43_arch_async_context()) {
+        cyw43_arch_disable_sta_mode();
+        cyw43_arch_deinit();
+    }
+
+    mChipInitialized = false;
+}
+
+void NetworkController::startConnection(absolute_time_t now) {
+    // A full teardown is slow and drops everything, so only do it when the chip looks wedged
+    if(mChipInitialized && (mConsecutiveFailures >= WIFI_FAILURES_BEFORE_REINIT)) {
+        DEBUG_PRINT(0, "WiFi failed %d times in a row, reinitializing", mConsecutiveFailures);
+        shutdownWiFi();
+        mConsecutiveFailures = 0;
+    }
+
+    if(!mChipInitialized && !initializeWiFi()) {
+        DEBUG_PRINT(0, "WiFi initialization failed");
+        connectionFailed(now);
         return;
     }
 
-    if(request.mStatus == ERR_OK) {
-        // IP was resolved internally (from cache) and stored in request->mResolvedAddress, nothing else required
+    mAddressApplied = false;
+    mFastConnectActive = mHasCachedAccessPoint;
+
+    int err;
+    if(mFastConnectActive) {
+        // Going straight to the access point and channel we used last time skips the scan
+        DEBUG_PRINT(0, "Network is not connected, connecting to last known access point....");
+        err = cyw43_wifi_join(
+            &cyw43_state,
+            strlen(mSSID), (const uint8_t *) mSSID,
+            strlen(mPassword), (const uint8_t *) mPassword,
+            WIFI_AUTH,
+            mCachedBSSID,
+            mCachedChannel
+        );
+    } else {
+        DEBUG_PRINT(0, "Network is not connected, connecting....");
+        err = cyw43_arch_wifi_connect_async(mSSID, mPassword, WIFI_AUTH);
+    }
+
+    if(err) {
+        DEBUG_PRINT(0, "...connect failed to start (%d)", err);
+        connectionFailed(now);
+        return;
+    }
+
+    mWiFiState = WIFI_STATE_CONNECTING;
+    mStateTimeout = delayed_by_ms(now, WIFI_CONNECT_TIMEOUT_MS);
+    mNextLinkPoll = delayed_by_ms(now, WIFI_CONNECT_POLL_PERIOD_MS);
+}
+
+void NetworkController::connectionFailed(absolute_time_t now) {
+    // The access point may have changed, so forget it and go straight to a full connect
+    if(mFastConnectActive) {
+        DEBUG_PRINT(0, "Fast connect failed, falling back to a full connect");
+        cyw43_wifi_leave(&cyw43_state, CYW43_ITF_STA);
+        mHasCachedAccessPoint = false;
+        mFastConnectActive = false;
+        mWiFiState = WIFI_STATE_DISCONNECTED;
+        return;
+    }
+
+    ++mConsecutiveFailures;
+
+    // Exponential backoff with +/- jitter
+    mCurrentBackoffMS = mCurrentBackoffMS ? (mCurrentBackoffMS * 2) : WIFI_MIN_BACKOFF_MS;
+    if(mCurrentBackoffMS > WIFI_MAX_BACKOFF_MS) {
+        mCurrentBackoffMS = WIFI_MAX_BACKOFF_MS;
+    }
+
+    uint32_t jitterRange = (mCurrentBackoffMS * WIFI_BACKOFF_JITTER_PERCENT) / 100;
+    uint32_t delay = (mCurrentBackoffMS - jitterRange) + (get_rand_32() % ((jitterRange * 2) + 1));
+
+    DEBUG_PRINT(0, "Retrying WiFi connection in %dms", delay);
+    mWiFiState = WIFI_STATE_BACKOFF;
+    mStateTimeout = delayed_by_ms(now, delay);
+}
+
+void NetworkController::applyInitialAddress() {
+    mAddressApplied = true;
+
+    // A cached lease is only trusted on the access point it came from
+    if(!mInitialIPAddress || (!mStaticAddress && !mFastConnectActive)) {
         return;
     }
 
-    while((request.mStatus != ERR_OK) && (request.mStatus != ERR_ARG)) {
-        sleep_ms(1);
+    struct netif *staInterface = &cyw43_state.netif[CYW43_ITF_STA];
+    ip4_addr_t ipAddress, netmask, gateway;
+    ip4_addr_set_u32(&ipAddress, mInitialIPAddress);
+    ip4_addr_set_u32(&netmask, mInitialNetmask);
+    ip4_addr_set_u32(&gateway, mInitialGateway);
+
+    // The driver starts DHCP on every link up. With a cached lease we leave it running, it will
+    // normally just confirm the same address, and if not the new one replaces ours
+    cyw43_arch_lwip_begin();
+    if(mStaticAddress) {
+        dhcp_stop(staInterface);
+        dns_setserver(0, &gateway);
+    }
+    netif_set_addr(staInterface, &ipAddress, &netmask, &gateway);
+    cyw43_arch_lwip_end();
+
+    char ipString[16];
+    NetworkController::ipAddressToString(ipString, &ipAddress);
+    DEBUG_PRINT(0, "Using %s address %s", mStaticAddress ? "static" : "cached", ipString);
+}
+
+void NetworkController::DNSRequest::initialize(const char *host) {
+    mHost = host;
+    mHasAddress = false;
+    mStatus = ERR_OK;
+    mTimeout = nil_time;
+    ip_addr_set_zero(&mResolvedAddress);
+    ip_addr_set_zero(&mLookupAddress);
+
+    // Literal IPs don't need a lookup at all
+    mIsLiteral = (host && ipaddr_aton(host, &mResolvedAddress));
+    mHasAddress = mIsLiteral;
+}
+
+void NetworkController::DNSRequest::setCachedAddress(uint32_t address) {
+    if(mIsLiteral || !address) {
+        return;
     }
+
+    mResolvedAddress.addr = address;
+    mHasAddress = true;
 }
 
-int NetworkController::connectToWiFi(const char * const ssid, const char * const password, const char * const hostname) {
-    uint32_t country = CYW43_COUNTRY_CANADA;
-    uint32_t auth = CYW43_AUTH_WPA2_MIXED_PSK;
-    return init_wifi(country, ssid, password, auth, hostname);
+NetworkController::DNSResult NetworkController::resolveHost(DNSRequest &request, absolute_time_t now) {
+    if(request.mIsLiteral) {
+        return DNS_RESOLVED;
+    }
+
+    // A lookup is already in flight
+    if(request.mStatus == ERR_INPROGRESS) {
+        if(absolute_time_diff_us(now, request.mTimeout) > 0) {
+            return request.mHasAddress ? DNS_RESOLVED : DNS_PENDING;
+        }
+
+        // The callback never fired - give up on this lookup
+        DEBUG_PRINT(0, "DNS lookup for %s timed out", request.mHost);
+        request.mStatus = ERR_TIMEOUT;
+    } else if(request.mStatus != ERR_ARG) {
+        // lwIP keeps its own cache which honours the record TTL, so this returns immediately
+        // unless the entry has expired (or was never resolved)
+        cyw43_arch_lwip_begin();
+        request.mStatus = dns_gethostbyname(request.mHost, &request.mLookupAddress, on_resolution_completed, &request);
+        cyw43_arch_lwip_end();
+
+        if(request.mStatus == ERR_INPROGRESS) {
+            request.mTimeout = delayed_by_ms(now, DNS_TIMEOUT_MS);
+
+            // Keep using the old address while the refresh completes in the background
+            return request.mHasAddress ? DNS_RESOLVED : DNS_PENDING;
+        }
+    }
+
+    if(request.mStatus == ERR_OK) {
+        request.mResolvedAddress.addr = request.mLookupAddress.addr;
+        request.mHasAddress = true;
+        return DNS_RESOLVED;
+    }
+
+    // The lookup failed, so the next call will start a fresh one
+    request.mStatus = ERR_OK;
+
+    if(request.mHasAddress) {
+        DEBUG_PRINT(0, "DNS lookup for %s failed, using cached address", request.mHost);
+        return DNS_RESOLVED;
+    }
+
+    return DNS_FAILED;
 }
 
 void NetworkController::ipAddressToString(char *dest, ip_addr_t *address) {
@@ -62,28 +387,3 @@ void NetworkController::ipAddressToString(char *dest, ip_addr_t *address) {
         ((address->addr & 0xFF000000) >> 24)
     );
 }
-
-int NetworkController::init_wifi(
-    uint32_t country, 
-    const char *ssid, 
-    const char *password,
-    uint32_t authType, 
-    const char *hostname
-) {
-    // Clean up any previous connections
-    if(cyw43_arch_async_context()) {
-        cyw43_arch_disable_sta_mode();
-        cyw43_arch_deinit();
-    }
-
-    if(cyw43_arch_init_with_country(country)) {
-        return 1;
-    }
-
-    cyw43_arch_enable_sta_mode();
-    if(hostname != NULL){
-        netif_set_hostname(netif_default, hostname);
-    }
-
-    return cyw43_arch_wifi_connect_timeout_ms(ssid, password, authType, 20000);
-}
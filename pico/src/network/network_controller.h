@@ -3,29 +3,111 @@
 
 #include "lwip/ip_addr.h"
 #include "lwip/err.h"
+#include "pico/types.h"
 
 class NetworkController {
     public:
+        enum DNSResult {
+            DNS_RESOLVED,
+            DNS_PENDING,
+            DNS_FAILED
+        };
+
+        // Lookups complete asynchronously, so requests must outlive the call to resolveHost(). The
+        // last good address is kept so we can still connect while DNS is unavailable
         struct DNSRequest {
             const char *mHost;
-            ip_addr_t mResolvedAddress;
-            err_t mStatus;
+            ip_addr_t mResolvedAddress;         // Last good address
+            bool mHasAddress;
+            bool mIsLiteral;                    // mHost is a dotted IP, so never looked up
+
+            // Lookup state, written from the lwIP callback
+            ip_addr_t mLookupAddress;
+            volatile err_t mStatus;
+            absolute_time_t mTimeout;
+
+            void initialize(const char *host);
+            void setCachedAddress(uint32_t address);
         };
 
+        // Wi-Fi connection states. Nothing here blocks - update() moves between these, with the
+        // netif link/status callbacks telling us when the connection changes
+        enum WiFiState {
+            WIFI_STATE_DISCONNECTED,
+            WIFI_STATE_CONNECTING,
+            WIFI_STATE_CONNECTED,
+            WIFI_STATE_BACKOFF
+        };
+
+        // Called from the netif callbacks whenever update() has something new to look at
+        typedef void (*EventCallback)(void* context);
+
+        NetworkController();
+
         bool isConnected();
-        void resolveHost(DNSRequest &request);
-        int connectToWiFi(const char * const ssid, const char * const password, const char * const hostname);
+        void setWiFiParameters(const char *ssid, const char *password, const char *hostname);
+        bool update(absolute_time_t now);
+        WiFiState getWiFiState() const { return mWiFiState; }
+
+        // Fast reconnect. A cached access point is joined directly (skipping the scan) and, if that
+        // works, the cached lease is used straight away while DHCP confirms it in the background.
+        // A static address replaces DHCP altogether
+        void setCachedAccessPoint(const uint8_t *bssid, uint8_t channel);
+        void setInitialAddress(uint32_t ipAddress, uint32_t netmask, uint32_t gateway, bool isStatic);
+        bool usedFastConnect() const { return mFastConnectActive; }
+        bool getConnectionDetails(uint8_t *bssid, uint8_t& channel, uint32_t& ipAddress, uint32_t& netmask, uint32_t& gateway);
+
+        DNSResult resolveHost(DNSRequest &request, absolute_time_t now);
 
         static void ipAddressToString(char *dest, ip_addr_t *address);
 
+        void setEventCallback(EventCallback callback, void* context);
+
+        // Called from the netif callbacks
+        void onNetworkInterfaceChanged();
+
     private:
-        int init_wifi(
-            uint32_t country, 
-            const char *ssid, 
-            const char *password,
-            uint32_t authType, 
-            const char *hostname
-        );
+        bool initializeWiFi();
+        void shutdownWiFi();
+        void startConnection(absolute_time_t now);
+        void connectionFailed(absolute_time_t now);
+        void applyInitialAddress();
+
+        static constexpr uint32_t DNS_TIMEOUT_MS                    = 5000;
+        static constexpr uint32_t WIFI_CONNECT_TIMEOUT_MS           = 20000;
+        static constexpr uint32_t WIFI_CONNECT_POLL_PERIOD_MS       = 250;
+        static constexpr uint32_t WIFI_MIN_BACKOFF_MS               = 1000;
+        static constexpr uint32_t WIFI_MAX_BACKOFF_MS               = 30000;
+        static constexpr uint32_t WIFI_BACKOFF_JITTER_PERCENT       = 25;
+        static constexpr uint32_t WIFI_FAILURES_BEFORE_REINIT       = 5;        // Consecutive failures before we assume the chip is wedged
+
+        const char *mSSID;
+        const char *mPassword;
+        const char *mHostname;
+
+        WiFiState mWiFiState;
+        bool mChipInitialized;
+        absolute_time_t mStateTimeout;
+        absolute_time_t mNextLinkPoll;
+        uint32_t mCurrentBackoffMS;
+        uint32_t mConsecutiveFailures;
+
+        // Fast reconnect
+        uint8_t mCachedBSSID[6];
+        uint8_t mCachedChannel;
+        bool mHasCachedAccessPoint;
+        bool mFastConnectActive;
+        uint32_t mInitialIPAddress;
+        uint32_t mInitialNetmask;
+        uint32_t mInitialGateway;
+        bool mStaticAddress;
+        bool mAddressApplied;
+
+        EventCallback mEventCallback;
+        void* mEventContext;
+
+        // Set from the netif callbacks, consumed in update()
+        volatile bool mInterfaceChanged;
 };
 
 #endif
@@ -0,0 +1,178 @@
+#include "i2c_bus_arbiter.h"
+
+#include "util/debug_io.h"
+
+
+I2CBusArbiter::I2CBusArbiter() :
+    mOwnerCore(NO_OWNER),
+    mDepth(0),
+    mGrantTime(nil_time),
+    mBusIndex(0),
+    mRequests{},
+    mStats{}
+{
+    mutex_init(&mMutex);
+}
+
+void I2CBusArbiter::acquire(Priority priority, absolute_time_t deadline) {
+    int core = get_core_num();
+    absolute_time_t requestTime = get_absolute_time();
+    Request* request = nullptr;
+
+    while(!request) {
+        mutex_enter_blocking(&mMutex);
+        if(take(core, requestTime, deadline)) {
+            mutex_exit(&mMutex);
+            return;
+        }
+
+        request = addRequest(core, priority, deadline, requestTime);
+        mutex_exit(&mMutex);
+    }
+
+    // The owner hands the bus straight to us when it releases it
+    while(!request->mGranted) {
+        tight_loop_contents();
+    }
+
+    mutex_enter_blocking(&mMutex);
+    request->mInUse = false;
+    mutex_exit(&mMutex);
+}
+
+bool I2CBusArbiter::tryAcquire(AsyncRequest& request) {
+    mutex_enter_blocking(&mMutex);
+
+    // Anyone spinning for the bus is handed it on release, so a free bus means nobody is queued
+    bool taken = take(get_core_num(), request.mRequestTime, request.mDeadline);
+    if(!taken && !request.mWaiting) {
+        request.mWaiting = true;
+        ++mStats.mContended;
+    }
+
+    mutex_exit(&mMutex);
+
+    return taken;
+}
+
+void I2CBusArbiter::release() {
+    mutex_enter_blocking(&mMutex);
+
+    if(!mDepth || (mOwnerCore != (int8_t) get_core_num())) {
+        mutex_exit(&mMutex);
+        DEBUG_PRINT(get_core_num(), "I2C bus %d released by core which doesn't hold it", mBusIndex);
+        return;
+    }
+
+    if(--mDepth) {
+        mutex_exit(&mMutex);
+        return;
+    }
+
+    absolute_time_t now = get_absolute_time();
+    mStats.mBusyUS += absolute_time_diff_us(mGrantTime, now);
+    mOwnerCore = NO_OWNER;
+
+    Request* next = getNextRequest();
+    if(next) {
+        grant(next->mCore, next->mRequestTime, next->mDeadline, now);
+        ++mStats.mContended;
+        next->mGranted = true;
+    }
+
+    mutex_exit(&mMutex);
+}
+
+void I2CBusArbiter::recordTransaction(bool failed, bool timedOut) {
+    ++mStats.mTransactions;
+    mStats.mErrors += failed ? 1 : 0;
+    mStats.mTimeouts += timedOut ? 1 : 0;
+}
+
+void I2CBusArbiter::recordBusInit(bool skipped) {
+    if(skipped) {
+        ++mStats.mBusInitsSkipped;
+    } else {
+        ++mStats.mBusInits;
+    }
+}
+
+void I2CBusArbiter::recordStuckBus(bool recovered, uint32_t recoveryUS) {
+    ++mStats.mStuckBus;
+    if(!recovered) {
+        return;
+    }
+
+    ++mStats.mStuckBusRecovered;
+    mStats.mLastRecoveryUS = recoveryUS;
+    if(recoveryUS > mStats.mMaxRecoveryUS) {
+        mStats.mMaxRecoveryUS = recoveryUS;
+    }
+}
+
+bool I2CBusArbiter::take(int core, absolute_time_t requestTime, absolute_time_t deadline) {
+    if(mOwnerCore == core) {
+        // Already ours, so this just runs on the back of the current grant
+        ++mDepth;
+        return true;
+    }
+
+    if(mOwnerCore != NO_OWNER) {
+        return false;
+    }
+
+    grant(core, requestTime, deadline, get_absolute_time());
+    return true;
+}
+
+void I2CBusArbiter::grant(int core, absolute_time_t requestTime, absolute_time_t deadline, absolute_time_t now) {
+    mOwnerCore = core;
+    mDepth = 1;
+    mGrantTime = now;
+
+    uint32_t waitTime = absolute_time_diff_us(requestTime, now);
+    ++mStats.mGrants;
+    mStats.mTotalWaitUS += waitTime;
+    if(waitTime > mStats.mMaxWaitUS) {
+        mStats.mMaxWaitUS = waitTime;
+    }
+
+    if(!is_nil_time(deadline) && (absolute_time_diff_us(deadline, now) > 0)) {
+        ++mStats.mDeadlinesMissed;
+    }
+}
+
+I2CBusArbiter::Request* I2CBusArbiter::addRequest(int core, Priority priority, absolute_time_t deadline, absolute_time_t requestTime) {
+    for(auto& request : mRequests) {
+        if(!request.mInUse) {
+            request = {(int8_t) core, priority, deadline, requestTime, false, true};
+            return &request;
+        }
+    }
+
+    return nullptr;
+}
+
+I2CBusArbiter::Request* I2CBusArbiter::getNextRequest() {
+    Request* next = nullptr;
+
+    for(auto& request : mRequests) {
+        if(!request.mInUse || request.mGranted) {
+            continue;
+        }
+
+        if(!next || (request.mPriority < next->mPriority)) {
+            next = &request;
+            continue;
+        }
+
+        // Then whichever is due first, treating requests without a deadline as due when they were made
+        absolute_time_t due = is_nil_time(request.mDeadline) ? request.mRequestTime : request.mDeadline;
+        absolute_time_t nextDue = is_nil_time(next->mDeadline) ? next->mRequestTime : next->mDeadline;
+        if((request.mPriority == next->mPriority) && (absolute_time_diff_us(due, nextDue) > 0)) {
+            next = &request;
+        }
+    }
+
+    return next;
+}
@@ -0,0 +1,122 @@
+#ifndef _I2C_BUS_ARBITER_H_
+#define _I2C_BUS_ARBITER_H_
+
+#include "pico/sync.h"
+#include "pico/time.h"
+#include "pico/types.h"
+
+
+// Shares one I2C bus between every sensor on it. Sensor updates can run on either core and sensor
+// tasks on core1, so each transaction first asks the arbiter for the bus. Callers spinning for the
+// bus are granted it highest priority first, then earliest deadline (or earliest request, without
+// one). Tasks don't spin - they try again after a short sleep, so the other tasks keep running.
+//
+// The bus is held per core and is re-entrant, so a caller which already holds it can run several
+// transactions back to back without arbitrating again. It must never be held across a task
+// suspension - anything else on core1 would then be let straight through, and a core waiting on
+// the bus could be waiting on a task which won't run until that core has finished
+class I2CBusArbiter {
+    public:
+        enum Priority : uint8_t {
+            PRIORITY_HIGH,              // Bus resets
+            PRIORITY_NORMAL,
+            PRIORITY_LOW
+        };
+
+        // For tasks, which keep trying until the bus is free
+        struct AsyncRequest {
+            absolute_time_t mRequestTime;
+            absolute_time_t mDeadline;
+            bool mWaiting;
+        };
+
+        struct Stats {
+            uint32_t mGrants;           // Times the bus was handed out
+            uint32_t mTransactions;     // Reads and writes, more than one per grant when batched
+            uint32_t mContended;        // Grants which had to wait for the bus
+            uint32_t mDeadlinesMissed;  // Grants made after the request's deadline
+            uint32_t mTotalWaitUS;
+            uint32_t mMaxWaitUS;
+            uint64_t mBusyUS;
+            uint32_t mErrors;
+            uint32_t mTimeouts;
+            uint32_t mBusInits;
+            uint32_t mBusInitsSkipped;  // Drivers asking for a bus which was already up
+            uint32_t mBusResets;
+            uint32_t mStuckBus;         // Times a device was found holding SDA low
+            uint32_t mStuckBusRecovered;
+            uint32_t mLastRecoveryUS;
+            uint32_t mMaxRecoveryUS;
+        };
+
+        I2CBusArbiter();
+
+        // Spins until the bus is granted to the calling core
+        void acquire(Priority priority = PRIORITY_NORMAL, absolute_time_t deadline = nil_time);
+
+        // Takes the bus if it's free (or already ours), otherwise the caller should sleep for
+        // RETRY_PERIOD_MS and try again
+        static AsyncRequest makeAsyncRequest(absolute_time_t deadline = nil_time) { return {get_absolute_time(), deadline, false}; }
+        bool tryAcquire(AsyncRequest& request);
+
+        void release();
+
+        // Counted by the interface, with the bus held
+        void recordTransaction(bool failed, bool timedOut);
+        void recordBusInit(bool skipped);
+        void recordBusReset() { ++mStats.mBusResets; }
+        void recordStuckBus(bool recovered, uint32_t recoveryUS);
+
+        void setBusIndex(uint8_t index) { mBusIndex = index; }
+        uint8_t getBusIndex() const { return mBusIndex; }
+        const Stats& getStats() const { return mStats; }
+
+        static constexpr uint32_t RETRY_PERIOD_MS       = 1;
+
+    private:
+        struct Request {
+            int8_t mCore;
+            Priority mPriority;
+            absolute_time_t mDeadline;
+            absolute_time_t mRequestTime;
+            volatile bool mGranted;
+            bool mInUse;
+        };
+
+        // All called with the lock held
+        bool take(int core, absolute_time_t requestTime, absolute_time_t deadline);
+        void grant(int core, absolute_time_t requestTime, absolute_time_t deadline, absolute_time_t now);
+        Request* addRequest(int core, Priority priority, absolute_time_t deadline, absolute_time_t requestTime);
+        Request* getNextRequest();
+
+        static constexpr int8_t NO_OWNER                = -1;
+        static constexpr uint8_t MAX_WAITING_REQUESTS   = 2;        // Only a core without the bus can be spinning for it
+
+        mutex_t mMutex;                 // Guards ownership, the requests and the stats
+        volatile int8_t mOwnerCore;
+        uint8_t mDepth;                 // Nested grants held by the owner
+        absolute_time_t mGrantTime;
+        uint8_t mBusIndex;
+        Request mRequests[MAX_WAITING_REQUESTS];
+        Stats mStats;
+};
+
+
+// Holds the bus for the lifetime of the lock. Only for code which doesn't suspend
+class I2CBusLock {
+    public:
+        I2CBusLock(I2CBusArbiter& arbiter, I2CBusArbiter::Priority priority = I2CBusArbiter::PRIORITY_NORMAL) :
+            mArbiter(arbiter)
+        {
+            mArbiter.acquire(priority);
+        }
+        ~I2CBusLock() { mArbiter.release(); }
+
+        I2CBusLock(const I2CBusLock&) = delete;
+        I2CBusLock& operator=(const I2CBusLock&) = delete;
+
+    private:
+        I2CBusArbiter& mArbiter;
+};
+
+#endif      // _I2C_BUS_ARBITER_H_
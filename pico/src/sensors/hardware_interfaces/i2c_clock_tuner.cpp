@@ -0,0 +1,127 @@
+#include "i2c_clock_tuner.h"
+
+
+I2CClockTuner::I2CClockTuner(uint32_t baseBaud, uint32_t maxBaud) :
+    mRates{baseBaud},
+    mRateCount(1),
+    mRateIndex(0),
+    mCeilingIndex(0),
+    mSettled(false),
+    mRetrying(false),
+    mWindowTransactions(0),
+    mWindowErrors(0),
+    mCleanWindows(0),
+    mStableWindows(0),
+    mDevices{},
+    mDeviceCount(0),
+    mStats{}
+{
+    for(uint32_t rate : RATE_STEPS) {
+        if((rate > baseBaud) && (rate <= maxBaud) && (mRateCount < MAX_RATES)) {
+            mRates[mRateCount++] = rate;
+        }
+    }
+
+    mCeilingIndex = mRateCount - 1;
+    mSettled = (mRateCount == 1);
+}
+
+bool I2CClockTuner::recordResult(uint8_t address, ErrorType error) {
+    DeviceStats* device = getDevice(address);
+    if(device) {
+        ++device->mTransactions;
+        device->mNacks += (error == ERROR_NACK) ? 1 : 0;
+        device->mTimeouts += (error == ERROR_TIMEOUT) ? 1 : 0;
+        device->mCRCErrors += (error == ERROR_CRC) ? 1 : 0;
+    }
+
+    if(!isTuning()) {
+        return false;
+    }
+
+    // A CRC error is counted on top of the read it came from, which went through fine
+    mWindowTransactions += (error == ERROR_CRC) ? 0 : 1;
+    mWindowErrors += (error == ERROR_NONE) ? 0 : 1;
+
+    if((mWindowErrors <= MAX_WINDOW_ERRORS) && (mWindowTransactions < WINDOW_TRANSACTIONS)) {
+        return false;
+    }
+
+    uint8_t previousIndex = mRateIndex;
+    endWindow();
+
+    return (mRateIndex != previousIndex);
+}
+
+bool I2CClockTuner::restoreBaud(uint32_t baud) {
+    for(int i = 0; i < mRateCount; ++i) {
+        if(mRates[i] == baud) {
+            // It was the fastest rate which worked, so don't go looking above it straight away
+            mRateIndex = i;
+            mCeilingIndex = i;
+            mSettled = true;
+            mRetrying = false;
+            mCleanWindows = 0;
+            mStableWindows = 0;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+I2CClockTuner::DeviceStats* I2CClockTuner::getDevice(uint8_t address) {
+    for(int i = 0; i < mDeviceCount; ++i) {
+        if(mDevices[i].mAddress == address) {
+            return &mDevices[i];
+        }
+    }
+
+    if(mDeviceCount == MAX_DEVICES) {
+        return nullptr;
+    }
+
+    mDevices[mDeviceCount].mAddress = address;
+    return &mDevices[mDeviceCount++];
+}
+
+void I2CClockTuner::endWindow() {
+    uint8_t previousIndex = mRateIndex;
+
+    if(mWindowErrors > MAX_WINDOW_ERRORS) {
+        // Too many errors, so this rate is no good, at least for now
+        if(mRateIndex) {
+            --mRateIndex;
+            ++mStats.mFallbacks;
+        }
+        mCeilingIndex = mRateIndex;
+        mSettled = true;
+        mRetrying = false;
+        mCleanWindows = 0;
+    } else if(mWindowErrors) {
+        mCleanWindows = 0;
+    } else if(++mCleanWindows >= CLEAN_WINDOWS_TO_STEP_UP) {
+        if((mCeilingIndex < (mRateCount - 1)) && (mCleanWindows >= CLEAN_WINDOWS_TO_RETRY)) {
+            ++mCeilingIndex;
+            mSettled = false;
+            mRetrying = true;
+        }
+
+        if(mRateIndex < mCeilingIndex) {
+            ++mRateIndex;
+            ++mStats.mStepsUp;
+            mCleanWindows = 0;
+        } else {
+            mSettled = true;
+        }
+    }
+
+    if(mRateIndex != previousIndex) {
+        mStableWindows = 0;
+    } else if((++mStableWindows >= WINDOWS_TO_TRUST_RETRY) && mSettled) {
+        mRetrying = false;
+    }
+
+    mWindowTransactions = 0;
+    mWindowErrors = 0;
+}
@@ -0,0 +1,88 @@
+#ifndef _I2C_CLOCK_TUNER_H_
+#define _I2C_CLOCK_TUNER_H_
+
+#include "pico/types.h"
+
+
+// Picks the clock rate for one I2C bus from how its transactions are going. Starting at the rate
+// the board was built with, it steps up a rate after a run of clean windows until either it reaches
+// the bus's maximum or a window has too many errors, in which case it drops back a rate and stays
+// there. A long clean run lets it try the rate above again, in case whatever caused the errors
+// (a long cable, a noisy supply) has gone. A retried rate isn't worth saving until it has held
+// for much longer, as an intermittent fault would otherwise have it saved on every retry.
+//
+// Only counts and decides - the interface applies the rate, with the bus held
+class I2CClockTuner {
+    public:
+        enum ErrorType : uint8_t {
+            ERROR_NONE,
+            ERROR_NACK,
+            ERROR_TIMEOUT,
+            ERROR_CRC
+        };
+
+        struct DeviceStats {
+            uint8_t mAddress;
+            uint32_t mTransactions;
+            uint32_t mNacks;
+            uint32_t mTimeouts;
+            uint32_t mCRCErrors;
+        };
+
+        struct Stats {
+            uint32_t mStepsUp;
+            uint32_t mFallbacks;
+        };
+
+        I2CClockTuner(uint32_t baseBaud, uint32_t maxBaud);
+
+        // Returns true if the rate should change
+        bool recordResult(uint8_t address, ErrorType error);
+
+        // Starts from a rate settled on by a previous run. Anything out of range is ignored
+        bool restoreBaud(uint32_t baud);
+
+        uint32_t getBaud() const { return mRates[mRateIndex]; }
+        bool isSettled() const { return mSettled; }
+        bool isRetrying() const { return mRetrying; }
+
+        // Settled on a rate a later run should start from, rather than one still being retried
+        bool hasRateToSave() const { return mSettled && !mRetrying; }
+        bool isTuning() const { return (mRateCount > 1); }
+
+        const Stats& getStats() const { return mStats; }
+        int getDeviceCount() const { return mDeviceCount; }
+        const DeviceStats& getDeviceStats(int index) const { return mDevices[index]; }
+
+        static constexpr uint8_t MAX_DEVICES                = 8;        // Per bus, later ones aren't broken out
+
+    private:
+        DeviceStats* getDevice(uint8_t address);
+        void endWindow();
+
+        static constexpr uint32_t RATE_STEPS[]              = {50 * 1000, 100 * 1000, 400 * 1000};
+        static constexpr uint8_t MAX_RATES                  = 4;        // The base rate plus the steps
+        static constexpr uint16_t WINDOW_TRANSACTIONS       = 64;
+        static constexpr uint16_t MAX_WINDOW_ERRORS         = 2;        // More than this in a window and we drop a rate
+        static constexpr uint16_t CLEAN_WINDOWS_TO_STEP_UP  = 4;
+        static constexpr uint16_t CLEAN_WINDOWS_TO_RETRY    = 1024;     // Before trying a rate which failed before
+        static constexpr uint32_t WINDOWS_TO_TRUST_RETRY    = 16384;    // At a retried rate before it's worth saving
+
+        uint32_t mRates[MAX_RATES];
+        uint8_t mRateCount;
+        uint8_t mRateIndex;
+        uint8_t mCeilingIndex;          // Highest rate we'll try, lowered when one fails
+        bool mSettled;                  // Either at the ceiling or dropped back from a failed rate
+        bool mRetrying;                 // Above the last rate to fail, which is what a later run should start from
+
+        uint16_t mWindowTransactions;
+        uint16_t mWindowErrors;
+        uint16_t mCleanWindows;
+        uint32_t mStableWindows;        // Since the rate last changed
+
+        DeviceStats mDevices[MAX_DEVICES];
+        uint8_t mDeviceCount;
+        Stats mStats;
+};
+
+#endif      // _I2C_CLOCK_TUNER_H_
@@ -0,0 +1,33 @@
+#include "i2c_multiplexer.h"
+
+#include "sensor_i2c_interface.h"
+
+
+I2CMultiplexer::I2CMultiplexer(I2CInterface& bus, uint8_t address) :
+    mBus(bus),
+    mAddress(address),
+    mSelectedChannel(NO_CHANNEL),
+    mStats{},
+    mChannelStats{}
+{
+    mBus.attachMultiplexer(*this);
+}
+
+bool I2CMultiplexer::selectChannel(uint8_t channel) {
+    ++mStats.mSelects;
+    if(channel == mSelectedChannel) {
+        return true;
+    }
+
+    // One bit per channel, only ever one enabled so devices on different channels can't clash
+    uint8_t channelMask = 1 << channel;
+    ++mStats.mSwitches;
+    if(mBus.writeI2CData(mAddress, &channelMask, 1) != I2C_RESPONSE_OK) {
+        ++mStats.mSwitchFailures;
+        mSelectedChannel = NO_CHANNEL;
+        return false;
+    }
+
+    mSelectedChannel = channel;
+    return true;
+}
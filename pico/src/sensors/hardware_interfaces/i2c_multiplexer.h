@@ -0,0 +1,55 @@
+#ifndef _I2C_MULTIPLEXER_H_
+#define _I2C_MULTIPLEXER_H_
+
+#include "pico/types.h"
+
+class I2CInterface;
+
+
+// TCA9548A I2C multiplexer, splitting one bus into 8 channels so several sensors with the same fixed
+// address (or more Seesaw probes than their address pins allow) can share it. Sensors behind it are
+// given a channel interface (see I2CInterface) which selects their channel before each transaction.
+//
+// The selected channel is cached, so the select is only written when the bus moves to a different
+// channel. Devices on the bus itself stay connected whatever channel is selected, so they mustn't
+// share an address with anything behind the multiplexer
+class I2CMultiplexer {
+    public:
+        struct Stats {
+            uint32_t mSelects;                  // Transactions needing a channel
+            uint32_t mSwitches;                 // Selects which had to be written
+            uint32_t mSwitchFailures;
+        };
+
+        struct ChannelStats {
+            uint32_t mTransactions;
+            uint8_t mInterfaces;                // Channel interfaces created for the channel
+        };
+
+        I2CMultiplexer(I2CInterface& bus, uint8_t address = DEFAULT_ADDRESS);
+
+        // With the bus held
+        bool selectChannel(uint8_t channel);
+        void invalidateChannel() { mSelectedChannel = NO_CHANNEL; }
+        void recordTransaction(uint8_t channel) { ++mChannelStats[channel].mTransactions; }
+
+        void addChannelInterface(uint8_t channel) { ++mChannelStats[channel].mInterfaces; }
+
+        I2CInterface& getBus() { return mBus; }
+        uint8_t getAddress() const { return mAddress; }
+        const Stats& getStats() const { return mStats; }
+        const ChannelStats& getChannelStats(uint8_t channel) const { return mChannelStats[channel]; }
+
+        static constexpr uint8_t DEFAULT_ADDRESS    = 0x70;     // With A0-A2 low, up to 0x77
+        static constexpr uint8_t NUM_CHANNELS       = 8;
+        static constexpr uint8_t NO_CHANNEL         = 0xFF;
+
+    private:
+        I2CInterface& mBus;
+        const uint8_t mAddress;
+        uint8_t mSelectedChannel;               // NO_CHANNEL when unknown, after a reset or failed select
+        Stats mStats;
+        ChannelStats mChannelStats[NUM_CHANNELS];
+};
+
+#endif      // _I2C_MULTIPLEXER_H_
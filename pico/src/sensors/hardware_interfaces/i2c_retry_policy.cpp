@@ -0,0 +1,135 @@
+#include "i2c_retry_policy.h"
+
+#include "sensor_i2c_interface.h"
+#include "util/debug_io.h"
+
+#include <algorithm>
+
+
+I2CRetryPolicy* I2CRetryPolicy::sPolicies[MAX_POLICIES] = {};
+uint8_t I2CRetryPolicy::sPolicyCount = 0;
+
+I2CRetryPolicy::I2CRetryPolicy() :
+    mEscalation{},
+    mI2C(nullptr),
+    mAddress(0),
+    mRetries(nullptr),
+    mStartTime(nil_time),
+    mAttempts(0),
+    mEscalate(false),
+    mSucceeded(false),
+    mFailedInARow(0),
+    mSensorResetRequested(false),
+    mStats{}
+{}
+
+void I2CRetryPolicy::setDevice(I2CInterface& i2c, uint8_t address, Escalation escalation) {
+    bool registered = (mI2C != nullptr);
+
+    mI2C = &i2c;
+    mAddress = address;
+    mEscalation = escalation;
+
+    // Devices are only ever set up at startup, before the second core is running
+    if(!registered && (sPolicyCount < MAX_POLICIES)) {
+        sPolicies[sPolicyCount++] = this;
+    }
+}
+
+void I2CRetryPolicy::begin(const Retries& retries, bool escalate) {
+    mRetries = &retries;
+    mStartTime = get_absolute_time();
+    mAttempts = 0;
+    mEscalate = escalate;
+    mSucceeded = false;
+}
+
+bool I2CRetryPolicy::complete(bool succeeded) {
+    ++mAttempts;
+    ++mStats.mAttempts;
+
+    if(succeeded || (mAttempts >= mRetries->mMaxAttempts)) {
+        finish(succeeded);
+        return true;
+    }
+
+    return false;
+}
+
+uint32_t I2CRetryPolicy::getBackoffMS() const {
+    uint32_t delay = mRetries->mBaseDelayMS;
+
+    // mAttempts is the number which have failed so far
+    switch(mRetries->mBackoff) {
+        case BACKOFF_LINEAR:
+            delay *= mAttempts;
+            break;
+
+        case BACKOFF_EXPONENTIAL: {
+            // Anything which would shift past the maximum is the maximum, so it can't overflow
+            uint32_t shift = std::min<uint32_t>(mAttempts - 1, MAX_BACKOFF_SHIFT);
+            if(delay > (mRetries->mMaxDelayMS >> shift)) {
+                return mRetries->mMaxDelayMS;
+            }
+            delay <<= shift;
+            break;
+        }
+
+        default:
+            break;
+    }
+
+    return (delay > mRetries->mMaxDelayMS) ? mRetries->mMaxDelayMS : delay;
+}
+
+bool I2CRetryPolicy::takeSensorResetRequest() {
+    if(!mSensorResetRequested) {
+        return false;
+    }
+
+    mSensorResetRequested = false;
+    return true;
+}
+
+void I2CRetryPolicy::finish(bool succeeded) {
+    uint32_t latency = absolute_time_diff_us(mStartTime, get_absolute_time());
+
+    mSucceeded = succeeded;
+    ++mStats.mOperations;
+    mStats.mTotalLatencyUS += latency;
+    if(latency > mStats.mMaxLatencyUS) {
+        mStats.mMaxLatencyUS = latency;
+    }
+
+    if(succeeded) {
+        ++mStats.mSucceeded;
+        mStats.mRecovered += (mAttempts > 1) ? 1 : 0;
+        mFailedInARow = 0;
+        return;
+    }
+
+    ++mStats.mFailed;
+    if(mEscalate) {
+        escalate();
+    }
+}
+
+void I2CRetryPolicy::escalate() {
+    ++mFailedInARow;
+
+    // Called between transactions, so the bus isn't held by anyone on this core
+    if(mEscalation.mBusResetAfter && (mFailedInARow == mEscalation.mBusResetAfter) && mI2C) {
+        DEBUG_PRINT(get_core_num(), "I2C device 0x%02x failed %d times in a row, resetting bus", mAddress, mFailedInARow);
+        ++mStats.mBusResets;
+        mI2C->resetSensorBus();
+    }
+
+    // Starts the count again, so a device which stays down gets the bus reset and then the sensor
+    // reset again rather than the sensor reset every time
+    if(mEscalation.mSensorResetAfter && (mFailedInARow >= mEscalation.mSensorResetAfter)) {
+        DEBUG_PRINT(get_core_num(), "I2C device 0x%02x failed %d times in a row, asking for a sensor reset", mAddress, mFailedInARow);
+        ++mStats.mSensorResets;
+        mSensorResetRequested = true;
+        mFailedInARow = 0;
+    }
+}
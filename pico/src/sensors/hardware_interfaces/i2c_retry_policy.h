@@ -0,0 +1,104 @@
+#ifndef _I2C_RETRY_POLICY_H_
+#define _I2C_RETRY_POLICY_H_
+
+#include "pico/time.h"
+#include "pico/types.h"
+
+class I2CInterface;
+
+
+// Retries, backoff and escalation for one I2C device, so every driver handles failures the same
+// way. A driver runs each operation (one or more transactions which succeed or fail together) as:
+//
+//     mPolicy.begin(RETRIES);
+//     while(!mPolicy.complete(attempt())) {
+//         co_await sleepFor(mPolicy.getBackoffMS());
+//     }
+//
+// stopping at the first attempt which succeeds. Operations which run out of attempts escalate -
+// after a run of them the bus is reset, and after a longer run the policy asks for the sensor to be
+// reset, which the driver picks up with takeSensorResetRequest(). A device only ever has one
+// operation in progress, so the policy holds its state rather than the caller.
+//
+// Every operation is counted per device, for the runtime stats and the published telemetry
+class I2CRetryPolicy {
+    public:
+        enum Backoff : uint8_t {
+            BACKOFF_FIXED,
+            BACKOFF_LINEAR,
+            BACKOFF_EXPONENTIAL
+        };
+
+        struct Retries {
+            uint8_t mMaxAttempts;
+            Backoff mBackoff;
+            uint16_t mBaseDelayMS;          // Before the first retry
+            uint16_t mMaxDelayMS;
+        };
+
+        struct Escalation {
+            uint8_t mBusResetAfter;         // Failed operations in a row, 0 for never
+            uint8_t mSensorResetAfter;
+        };
+
+        struct Stats {
+            uint32_t mOperations;
+            uint32_t mAttempts;
+            uint32_t mSucceeded;
+            uint32_t mRecovered;            // Succeeded, but not first time
+            uint32_t mFailed;
+            uint32_t mTotalLatencyUS;       // Start to finish of each operation, including backoff
+            uint32_t mMaxLatencyUS;
+            uint32_t mBusResets;
+            uint32_t mSensorResets;
+        };
+
+        I2CRetryPolicy();
+
+        // Registers the policy for reporting
+        void setDevice(I2CInterface& i2c, uint8_t address, Escalation escalation = {});
+
+        // Operations which don't escalate are for failures which are expected, like probing for a
+        // device which may not be fitted
+        void begin(const Retries& retries, bool escalate = true);
+        bool complete(bool succeeded);      // True once the operation is over, either way
+        uint32_t getBackoffMS() const;
+        bool succeeded() const { return mSucceeded; }
+
+        bool takeSensorResetRequest();
+
+        uint8_t getAddress() const { return mAddress; }
+        const I2CInterface* getInterface() const { return mI2C; }
+        const Stats& getStats() const { return mStats; }
+
+        static int getPolicyCount() { return sPolicyCount; }
+        static const I2CRetryPolicy& getPolicy(int index) { return *sPolicies[index]; }
+
+        static constexpr uint8_t MAX_POLICIES       = 16;
+
+    private:
+        void finish(bool succeeded);
+        void escalate();
+
+        static constexpr uint32_t MAX_BACKOFF_SHIFT = 15;
+
+        static I2CRetryPolicy* sPolicies[MAX_POLICIES];
+        static uint8_t sPolicyCount;
+
+        Escalation mEscalation;
+        I2CInterface* mI2C;
+        uint8_t mAddress;
+
+        // The operation in progress
+        const Retries* mRetries;
+        absolute_time_t mStartTime;
+        uint8_t mAttempts;
+        bool mEscalate;
+        bool mSucceeded;
+
+        uint8_t mFailedInARow;
+        volatile bool mSensorResetRequested;
+        Stats mStats;
+};
+
+#endif      // _I2C_RETRY_POLICY_H_
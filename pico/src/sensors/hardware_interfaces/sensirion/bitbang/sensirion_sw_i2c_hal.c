@@ -39,18 +39,16 @@
 
 #define DELAY_USEC (SENSIRION_I2C_CLOCK_PERIOD_USEC / 2)
 
-I2CInterface* _I2C_INTERFACE = 0;
-
 void sensirion_i2c_hal_sleep_usec(uint32_t useconds) {
     sleep_us(useconds);
 }
 
-static int8_t sensirion_wait_while_clock_stretching(void) {
+static int8_t sensirion_wait_while_clock_stretching(I2CInterface* i2c) {
     /* Maximal timeout of 150ms (SCD30) in sleep polling cycles */
     uint32_t timeout_cycles = 150000 / SENSIRION_I2C_CLOCK_PERIOD_USEC;
 
     while (--timeout_cycles) {
-        if (sensirion_SCL_read(_I2C_INTERFACE))
+        if (sensirion_SCL_read(i2c))
             return NO_ERROR;
         sensirion_sleep_usec(SENSIRION_I2C_CLOCK_PERIOD_USEC);
     }
@@ -58,146 +56,143 @@ static int8_t sensirion_wait_while_clock_stretching(void) {
     return STATUS_FAIL;
 }
 
-static int8_t sensirion_i2c_write_byte(uint8_t data) {
+static int8_t sensirion_i2c_write_byte(I2CInterface* i2c, uint8_t data) {
     int8_t nack, i;
     for (i = 7; i >= 0; i--) {
-        sensirion_SCL_out(_I2C_INTERFACE);
+        sensirion_SCL_out(i2c);
         if ((data >> i) & 0x01)
-            sensirion_SDA_in(_I2C_INTERFACE);
+            sensirion_SDA_in(i2c);
         else
-            sensirion_SDA_out(_I2C_INTERFACE);
+            sensirion_SDA_out(i2c);
         sensirion_sleep_usec(DELAY_USEC);
-        sensirion_SCL_in(_I2C_INTERFACE);
+        sensirion_SCL_in(i2c);
         sensirion_sleep_usec(DELAY_USEC);
-        if (sensirion_wait_while_clock_stretching())
+        if (sensirion_wait_while_clock_stretching(i2c))
             return STATUS_FAIL;
     }
-    sensirion_SCL_out(_I2C_INTERFACE);
-    sensirion_SDA_in(_I2C_INTERFACE);
+    sensirion_SCL_out(i2c);
+    sensirion_SDA_in(i2c);
     sensirion_sleep_usec(DELAY_USEC);
-    sensirion_SCL_in(_I2C_INTERFACE);
-    if (sensirion_wait_while_clock_stretching())
+    sensirion_SCL_in(i2c);
+    if (sensirion_wait_while_clock_stretching(i2c))
         return STATUS_FAIL;
-    nack = (sensirion_SDA_read(_I2C_INTERFACE) != 0);
-    sensirion_SCL_out(_I2C_INTERFACE);
+    nack = (sensirion_SDA_read(i2c) != 0);
+    sensirion_SCL_out(i2c);
 
     return nack;
 }
 
-static uint8_t sensirion_i2c_read_byte(uint8_t ack) {
+static uint8_t sensirion_i2c_read_byte(I2CInterface* i2c, uint8_t ack) {
     int8_t i;
     uint8_t data = 0;
-    sensirion_SDA_in(_I2C_INTERFACE);
+    sensirion_SDA_in(i2c);
     for (i = 7; i >= 0; i--) {
         sensirion_sleep_usec(DELAY_USEC);
-        sensirion_SCL_in(_I2C_INTERFACE);
-        if (sensirion_wait_while_clock_stretching())
+        sensirion_SCL_in(i2c);
+        if (sensirion_wait_while_clock_stretching(i2c))
             return 0xFF;  // return 0xFF on error
-        data |= (sensirion_SDA_read(_I2C_INTERFACE) != 0) << i;
-        sensirion_SCL_out(_I2C_INTERFACE);
+        data |= (sensirion_SDA_read(i2c) != 0) << i;
+        sensirion_SCL_out(i2c);
     }
     if (ack)
-        sensirion_SDA_out(_I2C_INTERFACE);
+        sensirion_SDA_out(i2c);
     else
-        sensirion_SDA_in(_I2C_INTERFACE);
+        sensirion_SDA_in(i2c);
     sensirion_sleep_usec(DELAY_USEC);
-    sensirion_SCL_in(_I2C_INTERFACE);
+    sensirion_SCL_in(i2c);
     sensirion_sleep_usec(DELAY_USEC);
-    if (sensirion_wait_while_clock_stretching())
+    if (sensirion_wait_while_clock_stretching(i2c))
         return 0xFF;  // return 0xFF on error
-    sensirion_SCL_out(_I2C_INTERFACE);
-    sensirion_SDA_in(_I2C_INTERFACE);
+    sensirion_SCL_out(i2c);
+    sensirion_SDA_in(i2c);
 
     return data;
 }
 
-static int8_t sensirion_i2c_start(void) {
-    sensirion_SCL_in(_I2C_INTERFACE);
-    if (sensirion_wait_while_clock_stretching())
+static int8_t sensirion_i2c_start(I2CInterface* i2c) {
+    sensirion_SCL_in(i2c);
+    if (sensirion_wait_while_clock_stretching(i2c))
         return STATUS_FAIL;
 
-    sensirion_SDA_out(_I2C_INTERFACE);
+    sensirion_SDA_out(i2c);
     sensirion_sleep_usec(DELAY_USEC);
-    sensirion_SCL_out(_I2C_INTERFACE);
+    sensirion_SCL_out(i2c);
     sensirion_sleep_usec(DELAY_USEC);
     return NO_ERROR;
 }
 
-static void sensirion_i2c_stop(void) {
-    sensirion_SDA_out(_I2C_INTERFACE);
+static void sensirion_i2c_stop(I2CInterface* i2c) {
+    sensirion_SDA_out(i2c);
     sensirion_sleep_usec(DELAY_USEC);
-    sensirion_SCL_in(_I2C_INTERFACE);
+    sensirion_SCL_in(i2c);
     sensirion_sleep_usec(DELAY_USEC);
-    sensirion_SDA_in(_I2C_INTERFACE);
+    sensirion_SDA_in(i2c);
     sensirion_sleep_usec(DELAY_USEC);
 }
 
-int8_t sensirion_i2c_hal_write(uint8_t address, const uint8_t* data,
-                           uint16_t count) {
+int8_t sensirion_i2c_hal_write(I2CInterface* i2c, uint8_t address,
+                               const uint8_t* data, uint16_t count) {
     int8_t ret;
     uint16_t i;
 
-    ret = sensirion_i2c_start();
+    ret = sensirion_i2c_start(i2c);
     if (ret != NO_ERROR)
         return ret;
 
-    ret = sensirion_i2c_write_byte(address << 1);
+    ret = sensirion_i2c_write_byte(i2c, address << 1);
     if (ret != NO_ERROR) {
-        sensirion_i2c_stop();
+        sensirion_i2c_stop(i2c);
         return ret;
     }
 
     for (i = 0; i < count; i++) {
-        ret = sensirion_i2c_write_byte(data[i]);
+        ret = sensirion_i2c_write_byte(i2c, data[i]);
         if (ret != NO_ERROR) {
-            sensirion_i2c_stop();
+            sensirion_i2c_stop(i2c);
             break;
         }
     }
-    sensirion_i2c_stop();
+    sensirion_i2c_stop(i2c);
     return ret;
 }
 
-int8_t sensirion_i2c_hal_read(uint8_t address, uint8_t* data, uint16_t count) {
+int8_t sensirion_i2c_hal_read(I2CInterface* i2c, uint8_t address, uint8_t* data,
+                              uint16_t count) {
     int8_t ret;
     uint8_t send_ack;
     uint16_t i;
 
-    ret = sensirion_i2c_start();
+    ret = sensirion_i2c_start(i2c);
     if (ret != NO_ERROR)
         return ret;
 
-    ret = sensirion_i2c_write_byte((address << 1) | 1);
+    ret = sensirion_i2c_write_byte(i2c, (address << 1) | 1);
     if (ret != NO_ERROR) {
-        sensirion_i2c_stop();
+        sensirion_i2c_stop(i2c);
         return ret;
     }
 
     for (i = 0; i < count; i++) {
         send_ack = i < (count - 1); /* last byte must be NACK'ed */
-        data[i] = sensirion_i2c_read_byte(send_ack);
+        data[i] = sensirion_i2c_read_byte(i2c, send_ack);
     }
 
-    sensirion_i2c_stop();
+    sensirion_i2c_stop(i2c);
     return NO_ERROR;
 }
 
 void sensirion_i2c_hal_init(I2CInterface* i2c) {
     assert(i2c);
 
-    _I2C_INTERFACE = i2c;
-
-    sensirion_init_pins(_I2C_INTERFACE);
-    sensirion_SCL_in(_I2C_INTERFACE);
-    sensirion_SDA_in(_I2C_INTERFACE);
+    sensirion_init_pins(i2c);
+    sensirion_SCL_in(i2c);
+    sensirion_SDA_in(i2c);
 }
 
-void sensirion_i2c_hal_free(void) {
-    assert(_I2C_INTERFACE);
-
-    sensirion_SCL_in(_I2C_INTERFACE);
-    sensirion_SDA_in(_I2C_INTERFACE);
-    sensirion_release_pins(_I2C_INTERFACE);
+void sensirion_i2c_hal_free(I2CInterface* i2c) {
+    assert(i2c);
 
-    _I2C_INTERFACE = 0;
+    sensirion_SCL_in(i2c);
+    sensirion_SDA_in(i2c);
+    sensirion_release_pins(i2c);
 }
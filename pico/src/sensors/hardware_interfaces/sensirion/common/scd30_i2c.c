@@ -43,22 +43,23 @@
 
 #define sensirion_hal_sleep_us sensirion_i2c_hal_sleep_usec
 
-static uint8_t _i2c_address;
-
-void init_driver(uint8_t i2c_address) {
-    _i2c_address = i2c_address;
+void scd30_init_device(sensirion_i2c_device_t* device, I2CInterface* i2c,
+                       uint8_t i2c_address) {
+    device->i2c = i2c;
+    device->i2c_address = i2c_address;
+    device->command_delay_us = SCD30_COMMAND_DELAY_USEC;
 }
 
-int16_t scd30_await_data_ready() {
+int16_t scd30_await_data_ready(const sensirion_i2c_device_t* device) {
     uint16_t data_ready = 0;
     int16_t local_error = 0;
-    local_error = scd30_get_data_ready(&data_ready);
+    local_error = scd30_get_data_ready(device, &data_ready);
     if (local_error != NO_ERROR) {
         return local_error;
     }
     while (data_ready == 0) {
         sensirion_hal_sleep_us(100000);
-        local_error = scd30_get_data_ready(&data_ready);
+        local_error = scd30_get_data_ready(device, &data_ready);
         if (local_error != NO_ERROR) {
             return local_error;
         }
@@ -66,20 +67,21 @@ int16_t scd30_await_data_ready() {
     return local_error;
 }
 
-int16_t scd30_blocking_read_measurement_data(float* co2_concentration,
-                                             float* temperature,
-                                             float* humidity) {
+int16_t scd30_blocking_read_measurement_data(
+    const sensirion_i2c_device_t* device, float* co2_concentration,
+    float* temperature, float* humidity) {
     int16_t local_error = 0;
-    local_error = scd30_await_data_ready();
+    local_error = scd30_await_data_ready(device);
     if (local_error != NO_ERROR) {
         return local_error;
     }
-    local_error =
-        scd30_read_measurement_data(co2_concentration, temperature, humidity);
+    local_error = scd30_read_measurement_data(device, co2_concentration,
+                                              temperature, humidity);
     return local_error;
 }
 
-int16_t scd30_start_periodic_measurement(uint16_t ambient_pressure) {
+int16_t scd30_start_periodic_measurement(const sensirion_i2c_device_t* device,
+                                         uint16_t ambient_pressure) {
     int16_t local_error = NO_ERROR;
     uint8_t local_buffer[5] = {0};
     uint16_t local_offset = 0;
@@ -87,30 +89,31 @@ int16_t scd30_start_periodic_measurement(uint16_t ambient_pressure) {
         sensirion_i2c_add_command_to_buffer(local_buffer, local_offset, 0x10);
     local_offset = sensirion_i2c_add_uint16_t_to_buffer(
         local_buffer, local_offset, ambient_pressure);
-    local_error =
-        sensirion_i2c_write_data(_i2c_address, local_buffer, local_offset);
+    local_error = sensirion_i2c_write_data(device->i2c, device->i2c_address,
+                                           local_buffer, local_offset);
     if (local_error != NO_ERROR) {
         return local_error;
     }
     return local_error;
 }
 
-int16_t scd30_stop_periodic_measurement() {
+int16_t scd30_stop_periodic_measurement(const sensirion_i2c_device_t* device) {
     int16_t local_error = NO_ERROR;
     uint8_t local_buffer[2] = {0};
     uint16_t local_offset = 0;
     local_offset =
         sensirion_i2c_add_command_to_buffer(local_buffer, local_offset, 0x104);
-    local_error =
-        sensirion_i2c_write_data(_i2c_address, local_buffer, local_offset);
+    local_error = sensirion_i2c_write_data(device->i2c, device->i2c_address,
+                                           local_buffer, local_offset);
     if (local_error != NO_ERROR) {
         return local_error;
     }
-    sensirion_i2c_hal_sleep_usec(10 * 1000);
+    sensirion_i2c_hal_sleep_usec(device->command_delay_us);
     return local_error;
 }
 
-int16_t scd30_set_measurement_interval(uint16_t interval) {
+int16_t scd30_set_measurement_interval(const sensirion_i2c_device_t* device,
+                                       uint16_t interval) {
     int16_t local_error = NO_ERROR;
     uint8_t local_buffer[5] = {0};
     uint16_t local_offset = 0;
@@ -118,29 +121,30 @@ int16_t scd30_set_measurement_interval(uint16_t interval) {
         sensirion_i2c_add_command_to_buffer(local_buffer, local_offset, 0x4600);
     local_offset = sensirion_i2c_add_uint16_t_to_buffer(local_buffer,
                                                         local_offset, interval);
-    local_error =
-        sensirion_i2c_write_data(_i2c_address, local_buffer, local_offset);
+    local_error = sensirion_i2c_write_data(device->i2c, device->i2c_address,
+                                           local_buffer, local_offset);
     if (local_error != NO_ERROR) {
         return local_error;
     }
-    sensirion_i2c_hal_sleep_usec(10 * 1000);
+    sensirion_i2c_hal_sleep_usec(device->command_delay_us);
     return local_error;
 }
 
-int16_t scd30_get_measurement_interval(uint16_t* interval) {
+int16_t scd30_get_measurement_interval(const sensirion_i2c_device_t* device,
+                                       uint16_t* interval) {
     int16_t local_error = NO_ERROR;
     uint8_t local_buffer[3] = {0};
     uint16_t local_offset = 0;
     local_offset =
         sensirion_i2c_add_command_to_buffer(local_buffer, local_offset, 0x4600);
-    local_error =
-        sensirion_i2c_write_data(_i2c_address, local_buffer, local_offset);
+    local_error = sensirion_i2c_write_data(device->i2c, device->i2c_address,
+                                           local_buffer, local_offset);
     if (local_error != NO_ERROR) {
         return local_error;
     }
-    sensirion_i2c_hal_sleep_usec(10 * 1000);
-    local_error =
-        sensirion_i2c_read_data_inplace(_i2c_address, local_buffer, 2);
+    sensirion_i2c_hal_sleep_usec(device->command_delay_us);
+    local_error = sensirion_i2c_read_data_inplace(
+        device->i2c, device->i2c_address, local_buffer, 2);
     if (local_error != NO_ERROR) {
         return local_error;
     }
@@ -148,20 +152,21 @@ int16_t scd30_get_measurement_interval(uint16_t* interval) {
     return local_error;
 }
 
-int16_t scd30_get_data_ready(uint16_t* data_ready_flag) {
+int16_t scd30_get_data_ready(const sensirion_i2c_device_t* device,
+                             uint16_t* data_ready_flag) {
     int16_t local_error = NO_ERROR;
     uint8_t local_buffer[3] = {0};
     uint16_t local_offset = 0;
     local_offset =
         sensirion_i2c_add_command_to_buffer(local_buffer, local_offset, 0x202);
-    local_error =
-        sensirion_i2c_write_data(_i2c_address, local_buffer, local_offset);
+    local_error = sensirion_i2c_write_data(device->i2c, device->i2c_address,
+                                           local_buffer, local_offset);
     if (local_error != NO_ERROR) {
         return local_error;
     }
-    sensirion_i2c_hal_sleep_usec(10 * 1000);
-    local_error =
-        sensirion_i2c_read_data_inplace(_i2c_address, local_buffer, 2);
+    sensirion_i2c_hal_sleep_usec(device->command_delay_us);
+    local_error = sensirion_i2c_read_data_inplace(
+        device->i2c, device->i2c_address, local_buffer, 2);
     if (local_error != NO_ERROR) {
         return local_error;
     }
@@ -169,21 +174,22 @@ int16_t scd30_get_data_ready(uint16_t* data_ready_flag) {
     return local_error;
 }
 
-int16_t scd30_read_measurement_data(float* co2_concentration,
+int16_t scd30_read_measurement_data(const sensirion_i2c_device_t* device,
+                                    float* co2_concentration,
                                     float* temperature, float* humidity) {
     int16_t local_error = NO_ERROR;
     uint8_t local_buffer[18] = {0};
     uint16_t local_offset = 0;
     local_offset =
         sensirion_i2c_add_command_to_buffer(local_buffer, local_offset, 0x300);
-    local_error =
-        sensirion_i2c_write_data(_i2c_address, local_buffer, local_offset);
+    local_error = sensirion_i2c_write_data(device->i2c, device->i2c_address,
+                                           local_buffer, local_offset);
     if (local_error != NO_ERROR) {
         return local_error;
     }
-    sensirion_i2c_hal_sleep_usec(10 * 1000);
-    local_error =
-        sensirion_i2c_read_data_inplace(_i2c_address, local_buffer, 12);
+    sensirion_i2c_hal_sleep_usec(device->command_delay_us);
+    local_error = sensirion_i2c_read_data_inplace(
+        device->i2c, device->i2c_address, local_buffer, 12);
     if (local_error != NO_ERROR) {
         return local_error;
     }
@@ -193,7 +199,8 @@ int16_t scd30_read_measurement_data(float* co2_concentration,
     return local_error;
 }
 
-int16_t scd30_activate_auto_calibration(uint16_t do_activate) {
+int16_t scd30_activate_auto_calibration(const sensirion_i2c_device_t* device,
+                                        uint16_t do_activate) {
     int16_t local_error = NO_ERROR;
     uint8_t local_buffer[5] = {0};
     uint16_t local_offset = 0;
@@ -201,29 +208,30 @@ int16_t scd30_activate_auto_calibration(uint16_t do_activate) {
         sensirion_i2c_add_command_to_buffer(local_buffer, local_offset, 0x5306);
     local_offset = sensirion_i2c_add_uint16_t_to_buffer(
         local_buffer, local_offset, do_activate);
-    local_error =
-        sensirion_i2c_write_data(_i2c_address, local_buffer, local_offset);
+    local_error = sensirion_i2c_write_data(device->i2c, device->i2c_address,
+                                           local_buffer, local_offset);
     if (local_error != NO_ERROR) {
         return local_error;
     }
-    sensirion_i2c_hal_sleep_usec(10 * 1000);
+    sensirion_i2c_hal_sleep_usec(device->command_delay_us);
     return local_error;
 }
 
-int16_t scd30_get_auto_calibration_status(uint16_t* is_active) {
+int16_t scd30_get_auto_calibration_status(const sensirion_i2c_device_t* device,
+                                          uint16_t* is_active) {
     int16_t local_error = NO_ERROR;
     uint8_t local_buffer[3] = {0};
     uint16_t local_offset = 0;
     local_offset =
         sensirion_i2c_add_command_to_buffer(local_buffer, local_offset, 0x5306);
-    local_error =
-        sensirion_i2c_write_data(_i2c_address, local_buffer, local_offset);
+    local_error = sensirion_i2c_write_data(device->i2c, device->i2c_address,
+                                           local_buffer, local_offset);
     if (local_error != NO_ERROR) {
         return local_error;
     }
-    sensirion_i2c_hal_sleep_usec(10 * 1000);
-    local_error =
-        sensirion_i2c_read_data_inplace(_i2c_address, local_buffer, 2);
+    sensirion_i2c_hal_sleep_usec(device->command_delay_us);
+    local_error = sensirion_i2c_read_data_inplace(
+        device->i2c, device->i2c_address, local_buffer, 2);
     if (local_error != NO_ERROR) {
         return local_error;
     }
@@ -231,7 +239,8 @@ int16_t scd30_get_auto_calibration_status(uint16_t* is_active) {
     return local_error;
 }
 
-int16_t scd30_force_recalibration(uint16_t co2_ref_concentration) {
+int16_t scd30_force_recalibration(const sensirion_i2c_device_t* device,
+                                  uint16_t co2_ref_concentration) {
     int16_t local_error = NO_ERROR;
     uint8_t local_buffer[5] = {0};
     uint16_t local_offset = 0;
@@ -239,29 +248,30 @@ int16_t scd30_force_recalibration(uint16_t co2_ref_concentration) {
         sensirion_i2c_add_command_to_buffer(local_buffer, local_offset, 0x5204);
     local_offset = sensirion_i2c_add_uint16_t_to_buffer(
         local_buffer, local_offset, co2_ref_concentration);
-    local_error =
-        sensirion_i2c_write_data(_i2c_address, local_buffer, local_offset);
+    local_error = sensirion_i2c_write_data(device->i2c, device->i2c_address,
+                                           local_buffer, local_offset);
     if (local_error != NO_ERROR) {
         return local_error;
     }
-    sensirion_i2c_hal_sleep_usec(10 * 1000);
+    sensirion_i2c_hal_sleep_usec(device->command_delay_us);
     return local_error;
 }
 
-int16_t scd30_get_force_recalibration_status(uint16_t* co2_ref_concentration) {
+int16_t scd30_get_force_recalibration_status(
+    const sensirion_i2c_device_t* device, uint16_t* co2_ref_concentration) {
     int16_t local_error = NO_ERROR;
     uint8_t local_buffer[3] = {0};
     uint16_t local_offset = 0;
     local_offset =
         sensirion_i2c_add_command_to_buffer(local_buffer, local_offset, 0x5204);
-    local_error =
-        sensirion_i2c_write_data(_i2c_address, local_buffer, local_offset);
+    local_error = sensirion_i2c_write_data(device->i2c, device->i2c_address,
+                                           local_buffer, local_offset);
     if (local_error != NO_ERROR) {
         return local_error;
     }
-    sensirion_i2c_hal_sleep_usec(10 * 1000);
-    local_error =
-        sensirion_i2c_read_data_inplace(_i2c_address, local_buffer, 2);
+    sensirion_i2c_hal_sleep_usec(device->command_delay_us);
+    local_error = sensirion_i2c_read_data_inplace(
+        device->i2c, device->i2c_address, local_buffer, 2);
     if (local_error != NO_ERROR) {
         return local_error;
     }
@@ -270,7 +280,8 @@ int16_t scd30_get_force_recalibration_status(uint16_t* co2_ref_concentration) {
     return local_error;
 }
 
-int16_t scd30_set_temperature_offset(uint16_t temperature_offset) {
+int16_t scd30_set_temperature_offset(const sensirion_i2c_device_t* device,
+                                     uint16_t temperature_offset) {
     int16_t local_error = NO_ERROR;
     uint8_t local_buffer[5] = {0};
     uint16_t local_offset = 0;
@@ -278,29 +289,30 @@ int16_t scd30_set_temperature_offset(uint16_t temperature_offset) {
         sensirion_i2c_add_command_to_buffer(local_buffer, local_offset, 0x5403);
     local_offset = sensirion_i2c_add_uint16_t_to_buffer(
         local_buffer, local_offset, temperature_offset);
-    local_error =
-        sensirion_i2c_write_data(_i2c_address, local_buffer, local_offset);
+    local_error = sensirion_i2c_write_data(device->i2c, device->i2c_address,
+                                           local_buffer, local_offset);
     if (local_error != NO_ERROR) {
         return local_error;
     }
-    sensirion_i2c_hal_sleep_usec(10 * 1000);
+    sensirion_i2c_hal_sleep_usec(device->command_delay_us);
     return local_error;
 }
 
-int16_t scd30_get_temperature_offset(uint16_t* temperature_offset) {
+int16_t scd30_get_temperature_offset(const sensirion_i2c_device_t* device,
+                                     uint16_t* temperature_offset) {
     int16_t local_error = NO_ERROR;
     uint8_t local_buffer[3] = {0};
     uint16_t local_offset = 0;
     local_offset =
         sensirion_i2c_add_command_to_buffer(local_buffer, local_offset, 0x5403);
-    local_error =
-        sensirion_i2c_write_data(_i2c_address, local_buffer, local_offset);
+    local_error = sensirion_i2c_write_data(device->i2c, device->i2c_address,
+                                           local_buffer, local_offset);
     if (local_error != NO_ERROR) {
         return local_error;
     }
-    sensirion_i2c_hal_sleep_usec(10 * 1000);
-    local_error =
-        sensirion_i2c_read_data_inplace(_i2c_address, local_buffer, 2);
+    sensirion_i2c_hal_sleep_usec(device->command_delay_us);
+    local_error = sensirion_i2c_read_data_inplace(
+        device->i2c, device->i2c_address, local_buffer, 2);
     if (local_error != NO_ERROR) {
         return local_error;
     }
@@ -308,20 +320,21 @@ int16_t scd30_get_temperature_offset(uint16_t* temperature_offset) {
     return local_error;
 }
 
-int16_t scd30_get_altitude_compensation(uint16_t* altitude) {
+int16_t scd30_get_altitude_compensation(const sensirion_i2c_device_t* device,
+                                        uint16_t* altitude) {
     int16_t local_error = NO_ERROR;
     uint8_t local_buffer[3] = {0};
     uint16_t local_offset = 0;
     local_offset =
         sensirion_i2c_add_command_to_buffer(local_buffer, local_offset, 0x5102);
-    local_error =
-        sensirion_i2c_write_data(_i2c_address, local_buffer, local_offset);
+    local_error = sensirion_i2c_write_data(device->i2c, device->i2c_address,
+                                           local_buffer, local_offset);
     if (local_error != NO_ERROR) {
         return local_error;
     }
-    sensirion_i2c_hal_sleep_usec(10 * 1000);
-    local_error =
-        sensirion_i2c_read_data_inplace(_i2c_address, local_buffer, 2);
+    sensirion_i2c_hal_sleep_usec(device->command_delay_us);
+    local_error = sensirion_i2c_read_data_inplace(
+        device->i2c, device->i2c_address, local_buffer, 2);
     if (local_error != NO_ERROR) {
         return local_error;
     }
@@ -329,7 +342,8 @@ int16_t scd30_get_altitude_compensation(uint16_t* altitude) {
     return local_error;
 }
 
-int16_t scd30_set_altitude_compensation(uint16_t altitude) {
+int16_t scd30_set_altitude_compensation(const sensirion_i2c_device_t* device,
+                                        uint16_t altitude) {
     int16_t local_error = NO_ERROR;
     uint8_t local_buffer[5] = {0};
     uint16_t local_offset = 0;
@@ -337,29 +351,30 @@ int16_t scd30_set_altitude_compensation(uint16_t altitude) {
         sensirion_i2c_add_command_to_buffer(local_buffer, local_offset, 0x5102);
     local_offset = sensirion_i2c_add_uint16_t_to_buffer(local_buffer,
                                                         local_offset, altitude);
-    local_error =
-        sensirion_i2c_write_data(_i2c_address, local_buffer, local_offset);
+    local_error = sensirion_i2c_write_data(device->i2c, device->i2c_address,
+                                           local_buffer, local_offset);
     if (local_error != NO_ERROR) {
         return local_error;
     }
-    sensirion_i2c_hal_sleep_usec(10 * 1000);
+    sensirion_i2c_hal_sleep_usec(device->command_delay_us);
     return local_error;
 }
 
-int16_t scd30_read_firmware_version(uint8_t* major, uint8_t* minor) {
+int16_t scd30_read_firmware_version(const sensirion_i2c_device_t* device,
+                                    uint8_t* major, uint8_t* minor) {
     int16_t local_error = NO_ERROR;
     uint8_t local_buffer[3] = {0};
     uint16_t local_offset = 0;
     local_offset =
         sensirion_i2c_add_command_to_buffer(local_buffer, local_offset, 0xd100);
-    local_error =
-        sensirion_i2c_write_data(_i2c_address, local_buffer, local_offset);
+    local_error = sensirion_i2c_write_data(device->i2c, device->i2c_address,
+                                           local_buffer, local_offset);
     if (local_error != NO_ERROR) {
         return local_error;
     }
-    sensirion_i2c_hal_sleep_usec(10 * 1000);
-    local_error =
-        sensirion_i2c_read_data_inplace(_i2c_address, local_buffer, 2);
+    sensirion_i2c_hal_sleep_usec(device->command_delay_us);
+    local_error = sensirion_i2c_read_data_inplace(
+        device->i2c, device->i2c_address, local_buffer, 2);
     if (local_error != NO_ERROR) {
         return local_error;
     }
@@ -368,14 +383,14 @@ int16_t scd30_read_firmware_version(uint8_t* major, uint8_t* minor) {
     return local_error;
 }
 
-int16_t scd30_soft_reset() {
+int16_t scd30_soft_reset(const sensirion_i2c_device_t* device) {
     int16_t local_error = NO_ERROR;
     uint8_t local_buffer[2] = {0};
     uint16_t local_offset = 0;
     local_offset =
         sensirion_i2c_add_command_to_buffer(local_buffer, local_offset, 0xd304);
-    local_error =
-        sensirion_i2c_write_data(_i2c_address, local_buffer, local_offset);
+    local_error = sensirion_i2c_write_data(device->i2c, device->i2c_address,
+                                           local_buffer, local_offset);
     if (local_error != NO_ERROR) {
         return local_error;
     }
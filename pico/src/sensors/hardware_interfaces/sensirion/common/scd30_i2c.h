@@ -44,7 +44,9 @@ extern "C" {
 #endif
 
 #include "sensirion_config.h"
+#include "sensirion_i2c.h"
 #define SCD30_I2C_ADDR_61 0x61
+#define SCD30_COMMAND_DELAY_USEC (10 * 1000)
 
 typedef enum {
     START_PERIODIC_MEASUREMENT_CMD_ID = 0x10,
@@ -66,12 +68,16 @@ typedef enum {
 } cmd_id_t;
 
 /**
- * @brief Initialize i2c address of driver
+ * @brief Set up the context for one SCD30. Every other call takes it, so
+ * several SCD30s can be driven on different buses
  *
+ * @param[out] device Context to fill in
+ * @param[in] i2c Bus the sensor is on
  * @param[in] i2c_address Used i2c address
  *
  */
-void init_driver(uint8_t i2c_address);
+void scd30_init_device(sensirion_i2c_device_t* device, I2CInterface* i2c,
+                       uint8_t i2c_address);
 
 /**
  * @brief Poll the data ready flag.
@@ -82,7 +88,7 @@ void init_driver(uint8_t i2c_address);
  *
  * @return error_code 0 on success, an error code otherwise.
  */
-int16_t scd30_await_data_ready();
+int16_t scd30_await_data_ready(const sensirion_i2c_device_t* device);
 
 /**
  * @brief Block until data is available and return measurement results.
@@ -97,9 +103,9 @@ int16_t scd30_await_data_ready();
  *
  * @return error_code 0 on success, an error code otherwise.
  */
-int16_t scd30_blocking_read_measurement_data(float* co2_concentration,
-                                             float* temperature,
-                                             float* humidity);
+int16_t scd30_blocking_read_measurement_data(
+    const sensirion_i2c_device_t* device, float* co2_concentration,
+    float* temperature, float* humidity);
 
 /**
  * @brief Start continuous measurement of CO2, relative humidity and
@@ -119,7 +125,8 @@ int16_t scd30_blocking_read_measurement_data(float* co2_concentration,
  *
  * @return error_code 0 on success, an error code otherwise.
  */
-int16_t scd30_start_periodic_measurement(uint16_t ambient_pressure);
+int16_t scd30_start_periodic_measurement(const sensirion_i2c_device_t* device,
+                                         uint16_t ambient_pressure);
 
 /**
  * @brief Stops continuous measurements of the sensor.
@@ -128,7 +135,7 @@ int16_t scd30_start_periodic_measurement(uint16_t ambient_pressure);
  *
  * @return error_code 0 on success, an error code otherwise.
  */
-int16_t scd30_stop_periodic_measurement();
+int16_t scd30_stop_periodic_measurement(const sensirion_i2c_device_t* device);
 
 /**
  * @brief Sets the interval used to measure in continuous measurement.
@@ -142,7 +149,8 @@ int16_t scd30_stop_periodic_measurement();
  *
  * @return error_code 0 on success, an error code otherwise.
  */
-int16_t scd30_set_measurement_interval(uint16_t interval);
+int16_t scd30_set_measurement_interval(const sensirion_i2c_device_t* device,
+                                       uint16_t interval);
 
 /**
  * @brief Read the configured measurement interval.
@@ -153,7 +161,8 @@ int16_t scd30_set_measurement_interval(uint16_t interval);
  *
  * @return error_code 0 on success, an error code otherwise.
  */
-int16_t scd30_get_measurement_interval(uint16_t* interval);
+int16_t scd30_get_measurement_interval(const sensirion_i2c_device_t* device,
+                                       uint16_t* interval);
 
 /**
  * @brief Query if data is ready for readout.
@@ -167,7 +176,8 @@ int16_t scd30_get_measurement_interval(uint16_t* interval);
  *
  * @return error_code 0 on success, an error code otherwise.
  */
-int16_t scd30_get_data_ready(uint16_t* data_ready_flag);
+int16_t scd30_get_data_ready(const sensirion_i2c_device_t* device,
+                             uint16_t* data_ready_flag);
 
 /**
  * @brief Read out the measurement values
@@ -180,7 +190,8 @@ int16_t scd30_get_data_ready(uint16_t* data_ready_flag);
  *
  * @return error_code 0 on success, an error code otherwise.
  */
-int16_t scd30_read_measurement_data(float* co2_concentration,
+int16_t scd30_read_measurement_data(const sensirion_i2c_device_t* device,
+                                    float* co2_concentration,
                                     float* temperature, float* humidity);
 
 /**
@@ -200,7 +211,8 @@ int16_t scd30_read_measurement_data(float* co2_concentration,
  *
  * @return error_code 0 on success, an error code otherwise.
  */
-int16_t scd30_activate_auto_calibration(uint16_t do_activate);
+int16_t scd30_activate_auto_calibration(const sensirion_i2c_device_t* device,
+                                        uint16_t do_activate);
 
 /**
  * @brief scd30_get_auto_calibration_status
@@ -211,7 +223,8 @@ int16_t scd30_activate_auto_calibration(uint16_t do_activate);
  *
  * @return error_code 0 on success, an error code otherwise.
  */
-int16_t scd30_get_auto_calibration_status(uint16_t* is_active);
+int16_t scd30_get_auto_calibration_status(const sensirion_i2c_device_t* device,
+                                          uint16_t* is_active);
 
 /**
  * @brief Forces recalibration with a new value for the CO2 concentration.
@@ -234,7 +247,8 @@ int16_t scd30_get_auto_calibration_status(uint16_t* is_active);
  *
  * @return error_code 0 on success, an error code otherwise.
  */
-int16_t scd30_force_recalibration(uint16_t co2_ref_concentration);
+int16_t scd30_force_recalibration(const sensirion_i2c_device_t* device,
+                                  uint16_t co2_ref_concentration);
 
 /**
  * @brief scd30_get_force_recalibration_status
@@ -245,7 +259,8 @@ int16_t scd30_force_recalibration(uint16_t co2_ref_concentration);
  *
  * @return error_code 0 on success, an error code otherwise.
  */
-int16_t scd30_get_force_recalibration_status(uint16_t* co2_ref_concentration);
+int16_t scd30_get_force_recalibration_status(
+    const sensirion_i2c_device_t* device, uint16_t* co2_ref_concentration);
 
 /**
  * @brief Set the temperature offset. Unit C * 100
@@ -263,7 +278,8 @@ int16_t scd30_get_force_recalibration_status(uint16_t* co2_ref_concentration);
  *
  * @return error_code 0 on success, an error code otherwise.
  */
-int16_t scd30_set_temperature_offset(uint16_t temperature_offset);
+int16_t scd30_set_temperature_offset(const sensirion_i2c_device_t* device,
+                                     uint16_t temperature_offset);
 
 /**
  * @brief Get the temperature offset. Unit ℃ * 100.
@@ -275,7 +291,8 @@ int16_t scd30_set_temperature_offset(uint16_t temperature_offset);
  *
  * @return error_code 0 on success, an error code otherwise.
  */
-int16_t scd30_get_temperature_offset(uint16_t* temperature_offset);
+int16_t scd30_get_temperature_offset(const sensirion_i2c_device_t* device,
+                                     uint16_t* temperature_offset);
 
 /**
  * @brief Get the configured altitude (height over sea level in m).
@@ -286,7 +303,8 @@ int16_t scd30_get_temperature_offset(uint16_t* temperature_offset);
  *
  * @return error_code 0 on success, an error code otherwise.
  */
-int16_t scd30_get_altitude_compensation(uint16_t* altitude);
+int16_t scd30_get_altitude_compensation(const sensirion_i2c_device_t* device,
+                                        uint16_t* altitude);
 
 /**
  * @brief Set a new value for altitude.
@@ -302,7 +320,8 @@ int16_t scd30_get_altitude_compensation(uint16_t* altitude);
  *
  * @return error_code 0 on success, an error code otherwise.
  */
-int16_t scd30_set_altitude_compensation(uint16_t altitude);
+int16_t scd30_set_altitude_compensation(const sensirion_i2c_device_t* device,
+                                        uint16_t altitude);
 
 /**
  * @brief Read the version of the current firmware.
@@ -314,7 +333,8 @@ int16_t scd30_set_altitude_compensation(uint16_t altitude);
  *
  * @return error_code 0 on success, an error code otherwise.
  */
-int16_t scd30_read_firmware_version(uint8_t* major, uint8_t* minor);
+int16_t scd30_read_firmware_version(const sensirion_i2c_device_t* device,
+                                    uint8_t* major, uint8_t* minor);
 
 /**
  * @brief scd30_soft_reset
@@ -330,7 +350,7 @@ int16_t scd30_read_firmware_version(uint8_t* major, uint8_t* minor);
  *
  * @return error_code 0 on success, an error code otherwise.
  */
-int16_t scd30_soft_reset();
+int16_t scd30_soft_reset(const sensirion_i2c_device_t* device);
 
 #ifdef __cplusplus
 }
@@ -33,6 +33,7 @@
 #define SENSIRION_I2C_H
 
 #include "sensirion_config.h"
+#include "sensors/hardware_interfaces/sensor_i2c_interface.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -52,6 +53,17 @@ extern "C" {
 #define SENSIRION_NUM_WORDS(x) (sizeof(x) / SENSIRION_WORD_SIZE)
 #define SENSIRION_MAX_BUFFER_WORDS 32
 
+/**
+ * Everything a driver needs to talk to one device. Drivers take one of these
+ * rather than keeping the bus and address in globals, so several of the same
+ * sensor can run side by side on different buses.
+ */
+typedef struct {
+    I2CInterface* i2c;
+    uint8_t i2c_address;
+    uint32_t command_delay_us; /* Between a command and reading its response */
+} sensirion_i2c_device_t;
+
 uint8_t sensirion_i2c_generate_crc(const uint8_t* data, uint16_t count);
 
 int8_t sensirion_i2c_check_crc(const uint8_t* data, uint16_t count,
@@ -65,7 +77,7 @@ int8_t sensirion_i2c_check_crc(const uint8_t* data, uint16_t count,
  *
  * @return  NO_ERROR on success, an error code otherwise
  */
-int16_t sensirion_i2c_general_call_reset(void);
+int16_t sensirion_i2c_general_call_reset(I2CInterface* i2c);
 
 /**
  * sensirion_i2c_fill_cmd_send_buf() - create the i2c send buffer for a command
@@ -87,6 +99,7 @@ uint16_t sensirion_i2c_fill_cmd_send_buf(uint8_t* buf, uint16_t cmd,
 /**
  * sensirion_i2c_read_words() - read data words from sensor
  *
+ * @i2c:        Bus the sensor is on
  * @address:    Sensor i2c address
  * @data_words: Allocated buffer to store the read words.
  *              The buffer may also have been modified in case of an error.
@@ -94,8 +107,8 @@ uint16_t sensirion_i2c_fill_cmd_send_buf(uint8_t* buf, uint16_t cmd,
  *
  * @return      NO_ERROR on success, an error code otherwise
  */
-int16_t sensirion_i2c_read_words(uint8_t address, uint16_t* data_words,
-                                 uint16_t num_words);
+int16_t sensirion_i2c_read_words(I2CInterface* i2c, uint8_t address,
+                                 uint16_t* data_words, uint16_t num_words);
 
 /**
  * sensirion_i2c_read_words_as_bytes() - read data words as byte-stream from
@@ -103,6 +116,7 @@ int16_t sensirion_i2c_read_words(uint8_t address, uint16_t* data_words,
  *
  * Read bytes without adjusting values to the uP's word-order.
  *
+ * @i2c:        Bus the sensor is on
  * @address:    Sensor i2c address
  * @data:       Allocated buffer to store the read bytes.
  *              The buffer may also have been modified in case of an error.
@@ -113,21 +127,24 @@ int16_t sensirion_i2c_read_words(uint8_t address, uint16_t* data_words,
  *
  * @return      NO_ERROR on success, an error code otherwise
  */
-int16_t sensirion_i2c_read_words_as_bytes(uint8_t address, uint8_t* data,
-                                          uint16_t num_words);
+int16_t sensirion_i2c_read_words_as_bytes(I2CInterface* i2c, uint8_t address,
+                                          uint8_t* data, uint16_t num_words);
 
 /**
  * sensirion_i2c_write_cmd() - writes a command to the sensor
+ * @i2c:        Bus the sensor is on
  * @address:    Sensor i2c address
  * @command:    Sensor command
  *
  * @return      NO_ERROR on success, an error code otherwise
  */
-int16_t sensirion_i2c_write_cmd(uint8_t address, uint16_t command);
+int16_t sensirion_i2c_write_cmd(I2CInterface* i2c, uint8_t address,
+                                uint16_t command);
 
 /**
  * sensirion_i2c_write_cmd_with_args() - writes a command with arguments to the
  *                                       sensor
+ * @i2c:        Bus the sensor is on
  * @address:    Sensor i2c address
  * @command:    Sensor command
  * @data:       Argument buffer with words to send
@@ -135,13 +152,15 @@ int16_t sensirion_i2c_write_cmd(uint8_t address, uint16_t command);
  *
  * @return      NO_ERROR on success, an error code otherwise
  */
-int16_t sensirion_i2c_write_cmd_with_args(uint8_t address, uint16_t command,
+int16_t sensirion_i2c_write_cmd_with_args(I2CInterface* i2c, uint8_t address,
+                                          uint16_t command,
                                           const uint16_t* data_words,
                                           uint16_t num_words);
 
 /**
  * sensirion_i2c_delayed_read_cmd() - send a command, wait for the sensor to
  *                                    process and read data back
+ * @i2c:        Bus the sensor is on
  * @address:    Sensor i2c address
  * @cmd:        Command
  * @delay:      Time in microseconds to delay sending the read request
@@ -150,12 +169,14 @@ int16_t sensirion_i2c_write_cmd_with_args(uint8_t address, uint16_t command,
  *
  * @return      NO_ERROR on success, an error code otherwise
  */
-int16_t sensirion_i2c_delayed_read_cmd(uint8_t address, uint16_t cmd,
-                                       uint32_t delay_us, uint16_t* data_words,
+int16_t sensirion_i2c_delayed_read_cmd(I2CInterface* i2c, uint8_t address,
+                                       uint16_t cmd, uint32_t delay_us,
+                                       uint16_t* data_words,
                                        uint16_t num_words);
 /**
  * sensirion_i2c_read_cmd() - reads data words from the sensor after a command
  *                            is issued
+ * @i2c:        Bus the sensor is on
  * @address:    Sensor i2c address
  * @cmd:        Command
  * @data_words: Allocated buffer to store the read data
@@ -163,7 +184,7 @@ int16_t sensirion_i2c_delayed_read_cmd(uint8_t address, uint16_t cmd,
  *
  * @return      NO_ERROR on success, an error code otherwise
  */
-int16_t sensirion_i2c_read_cmd(uint8_t address, uint16_t cmd,
+int16_t sensirion_i2c_read_cmd(I2CInterface* i2c, uint8_t address, uint16_t cmd,
                                uint16_t* data_words, uint16_t num_words);
 
 /**
@@ -283,18 +304,20 @@ uint16_t sensirion_i2c_add_bytes_to_buffer(uint8_t* buffer, uint16_t offset,
  * @note This is just a wrapper for sensirion_i2c_hal_write() to
  *       not need to include the HAL in the drivers.
  *
+ * @param i2c         Bus the sensor is on.
  * @param address     I2C address to write to.
  * @param data        Pointer to the buffer containing the data to write.
  * @param data_length Number of bytes to send to the Sensor.
  *
  * @return        NO_ERROR on success, error code otherwise
  */
-int16_t sensirion_i2c_write_data(uint8_t address, const uint8_t* data,
-                                 uint16_t data_length);
+int16_t sensirion_i2c_write_data(I2CInterface* i2c, uint8_t address,
+                                 const uint8_t* data, uint16_t data_length);
 
 /**
  * sensirion_i2c_read_data_inplace() - Reads data from the Sensor.
  *
+ * @param i2c                  Bus the sensor is on
  * @param address              Sensor I2C address
  * @param buffer               Allocated buffer to store data as bytes. Needs
  *                             to be big enough to store the data including
@@ -306,7 +329,8 @@ int16_t sensirion_i2c_write_data(uint8_t address, const uint8_t* data,
  *
  * @return            NO_ERROR on success, an error code otherwise
  */
-int16_t sensirion_i2c_read_data_inplace(uint8_t address, uint8_t* buffer,
+int16_t sensirion_i2c_read_data_inplace(I2CInterface* i2c, uint8_t address,
+                                        uint8_t* buffer,
                                         uint16_t expected_data_length);
 #ifdef __cplusplus
 }
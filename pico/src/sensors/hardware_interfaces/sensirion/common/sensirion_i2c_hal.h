@@ -53,27 +53,29 @@ extern "C" {
 int16_t sensirion_i2c_hal_select_bus(uint8_t bus_idx);
 
 /**
- * Initialize all hard- and software components that are needed for the I2C
- * communication.
+ * Initialize all hard- and software components that are needed for I2C
+ * communication on the given bus.
  */
 void sensirion_i2c_hal_init(I2CInterface* i2c);
 
 /**
  * Release all resources initialized by sensirion_i2c_hal_init().
  */
-void sensirion_i2c_hal_free();
+void sensirion_i2c_hal_free(I2CInterface* i2c);
 
 /**
  * Execute one read transaction on the I2C bus, reading a given number of bytes.
  * If the device does not acknowledge the read command, an error shall be
  * returned.
  *
+ * @param i2c     bus to read from
  * @param address 7-bit I2C address to read from
  * @param data    pointer to the buffer where the data is to be stored
  * @param count   number of bytes to read from I2C and store in the buffer
  * @returns 0 on success, error code otherwise
  */
-int8_t sensirion_i2c_hal_read(uint8_t address, uint8_t* data, uint16_t count);
+int8_t sensirion_i2c_hal_read(I2CInterface* i2c, uint8_t address, uint8_t* data,
+                              uint16_t count);
 
 /**
  * Execute one write transaction on the I2C bus, sending a given number of
@@ -81,13 +83,14 @@ int8_t sensirion_i2c_hal_read(uint8_t address, uint8_t* data, uint16_t count);
  * the slave device does not acknowledge any of the bytes, an error shall be
  * returned.
  *
+ * @param i2c     bus to write to
  * @param address 7-bit I2C address to write to
  * @param data    pointer to the buffer containing the data to write
  * @param count   number of bytes to read from the buffer and send over I2C
  * @returns 0 on success, error code otherwise
  */
-int8_t sensirion_i2c_hal_write(uint8_t address, const uint8_t* data,
-                               uint16_t count);
+int8_t sensirion_i2c_hal_write(I2CInterface* i2c, uint8_t address,
+                               const uint8_t* data, uint16_t count);
 
 /**
  * Sleep for a given number of microseconds. The function should delay the
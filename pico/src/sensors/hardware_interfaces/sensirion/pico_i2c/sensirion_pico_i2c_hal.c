@@ -42,8 +42,6 @@
  */
 
 
-I2CInterface* _I2C_INTERFACE = 0;
-
 /**
  * Select the current i2c bus by index.
  * All following i2c operations will be directed at that bus.
@@ -62,24 +60,22 @@ int16_t sensirion_i2c_hal_select_bus(uint8_t bus_idx) {
 }
 
 /**
- * Initialize all hard- and software components that are needed for the I2C
- * communication.
+ * Initialize all hard- and software components that are needed for I2C
+ * communication on the given bus.
  */
 void sensirion_i2c_hal_init(I2CInterface* i2c) {
     assert(i2c);
 
-    _I2C_INTERFACE = i2c;
-    init_sensor_bus(_I2C_INTERFACE);
+    init_sensor_bus(i2c);
 }
 
 /**
  * Release all resources initialized by sensirion_i2c_hal_init().
  */
-void sensirion_i2c_hal_free() {
-    assert(_I2C_INTERFACE);
+void sensirion_i2c_hal_free(I2CInterface* i2c) {
+    assert(i2c);
 
-    reset_sensor_bus(_I2C_INTERFACE);
-    _I2C_INTERFACE = 0;
+    reset_sensor_bus(i2c);
 }
 
 /**
@@ -87,15 +83,17 @@ void sensirion_i2c_hal_free() {
  * If the device does not acknowledge the read command, an error shall be
  * returned.
  *
+ * @param i2c     bus to read from
  * @param address 7-bit I2C address to read from
  * @param data    pointer to the buffer where the data is to be stored
  * @param count   number of bytes to read from I2C and store in the buffer
  * @returns 0 on success, error code otherwise
  */
-int8_t sensirion_i2c_hal_read(uint8_t address, uint8_t* data, uint16_t count) {
-    assert(_I2C_INTERFACE);
+int8_t sensirion_i2c_hal_read(I2CInterface* i2c, uint8_t address, uint8_t* data,
+                              uint16_t count) {
+    assert(i2c);
 
-    I2CResponse response = read_from_i2c(_I2C_INTERFACE, address, data, count);
+    I2CResponse response = read_from_i2c(i2c, address, data, count);
     return (response == I2C_RESPONSE_OK) ? 0 : -1;
 }
 
@@ -105,16 +103,17 @@ int8_t sensirion_i2c_hal_read(uint8_t address, uint8_t* data, uint16_t count) {
  * the slave device does not acknowledge any of the bytes, an error shall be
  * returned.
  *
+ * @param i2c     bus to write to
  * @param address 7-bit I2C address to write to
  * @param data    pointer to the buffer containing the data to write
  * @param count   number of bytes to read from the buffer and send over I2C
  * @returns 0 on success, error code otherwise
  */
-int8_t sensirion_i2c_hal_write(uint8_t address, const uint8_t* data,
-                               uint16_t count) {
-    assert(_I2C_INTERFACE);
+int8_t sensirion_i2c_hal_write(I2CInterface* i2c, uint8_t address,
+                               const uint8_t* data, uint16_t count) {
+    assert(i2c);
 
-    I2CResponse response = write_i2c_data(_I2C_INTERFACE, address, data, count);
+    I2CResponse response = write_i2c_data(i2c, address, data, count);
     return (response == I2C_RESPONSE_OK) ? 0 : -1;
 }
 
@@ -1,26 +1,75 @@
 #include "sensor_i2c_interface.h"
 
 #include "util/debug_io.h"
+#include "util/task_scheduler.h"
 #include "hardware/gpio.h"
 
 
+I2CInterface* I2CInterface::sInterfaces[MAX_INTERFACES] = {};
+uint8_t I2CInterface::sInterfaceCount = 0;
+
 I2CInterface::I2CInterface(
     i2c_inst_t *i2c,
     int baud,
     int sdaPin,
     int sclPin,
-    bool sendStopAfterTransactions
+    bool sendStopAfterTransactions,
+    int maxBaud
 ) : 
     mI2C(i2c),
     mBaud(baud),
     mSDA(sdaPin),
     mSCL(sclPin),
     mSendStopAfterTransactions(sendStopAfterTransactions),
-    mInterfaceResetTimeout(nil_time)
-{}
+    mInterfaceResetTimeout(nil_time),
+    mBus(this),
+    mMux(nullptr),
+    mMuxChannel(I2CMultiplexer::NO_CHANNEL),
+    mClockTuner(baud, (maxBaud > baud) ? maxBaud : baud),
+    mBusInitialized(false)
+{
+    mArbiter.setBusIndex(i2c_hw_index(i2c));
+
+    // Interfaces are only ever created at startup, before the second core is running
+    if(sInterfaceCount < MAX_INTERFACES) {
+        sInterfaces[sInterfaceCount++] = this;
+    }
+}
+
+I2CInterface::I2CInterface(I2CMultiplexer& mux, uint8_t channel) :
+    mI2C(mux.getBus().mI2C),
+    mBaud(mux.getBus().mBaud),
+    mSDA(mux.getBus().mSDA),
+    mSCL(mux.getBus().mSCL),
+    mSendStopAfterTransactions(mux.getBus().mSendStopAfterTransactions),
+    mInterfaceResetTimeout(nil_time),
+    mBus(&mux.getBus()),
+    mMux(&mux),
+    mMuxChannel(channel),
+    mClockTuner(mBaud, mBaud),
+    mBusInitialized(false)
+{
+    // Reported with the multiplexer rather than registered as a bus of its own
+    mux.addChannelInterface(channel);
+}
 
 void I2CInterface::initSensorBus() {
-    i2c_init(mI2C, mBaud);
+    if(mBus != this) {
+        mInterfaceResetTimeout = make_timeout_time_ms(I2C_WATCHDOG_TIMEOUT_MS);
+        mBus->initSensorBus();
+        return;
+    }
+
+    I2CBusLock lock(mArbiter, I2CBusArbiter::PRIORITY_HIGH);
+
+    // Drivers sharing the bus each ask for it, but restarting it under another driver would
+    // break whatever it was in the middle of
+    if(mBusInitialized) {
+        mArbiter.recordBusInit(true);
+        return;
+    }
+
+    i2c_init(mI2C, mClockTuner.getBaud());
     gpio_set_function(mSDA, GPIO_FUNC_I2C);
     gpio_set_function(mSCL, GPIO_FUNC_I2C);
 
@@ -28,18 +77,143 @@ void I2CInterface::initSensorBus() {
     gpio_pull_up(mSCL);
 
     mInterfaceResetTimeout = make_timeout_time_ms(I2C_WATCHDOG_TIMEOUT_MS);
+    mBusInitialized = true;
+    mArbiter.recordBusInit(false);
+
+    // Whatever glitch led to the bus being brought up again may have reset the multiplexer too
+    if(mMux) {
+        mMux->invalidateChannel();
+    }
 }
 
 void I2CInterface::shutdownSensorBus() {
-    i2c_deinit(mI2C);
+    if(mBus != this) {
+        mBus->shutdownSensorBus();
+        return;
+    }
+
+    I2CBusLock lock(mArbiter, I2CBusArbiter::PRIORITY_HIGH);
+
+    if(mBusInitialized) {
+        i2c_deinit(mI2C);
+        mBusInitialized = false;
+    }
 }
 
 void I2CInterface::resetSensorBus() {
+    if(mBus != this) {
+        mInterfaceResetTimeout = make_timeout_time_ms(I2C_WATCHDOG_TIMEOUT_MS);
+        mBus->resetSensorBus();
+        return;
+    }
+
+    I2CBusLock lock(mArbiter, I2CBusArbiter::PRIORITY_HIGH);
+
+    // Restarting the controller does nothing for a device holding the bus, so that goes first
+    mArbiter.recordBusReset();
+    recoverStuckBus();
     shutdownSensorBus();
     initSensorBus();
 }
 
+I2CInterface::BusRecovery I2CInterface::recoverStuckBus() {
+    if(mBus != this) {
+        return mBus->recoverStuckBus();
+    }
+
+    I2CBusLock lock(mArbiter, I2CBusArbiter::PRIORITY_HIGH);
+
+    if(!mBusInitialized || !isSDAHeldLow()) {
+        return BUS_NOT_STUCK;
+    }
+
+    absolute_time_t startTime = get_absolute_time();
+    bool recovered = clockOutStuckBus();
+    uint32_t recoveryUS = absolute_time_diff_us(startTime, get_absolute_time());
+
+    mArbiter.recordStuckBus(recovered, recoveryUS);
+    DEBUG_PRINT(get_core_num(), "I2C%d stuck with SDA held low, %s after %dus",
+        mArbiter.getBusIndex(),
+        recovered ? "recovered" : "still stuck",
+        recoveryUS
+    );
+
+    // The controller was part way through whatever left the bus stuck, so it starts again too
+    i2c_deinit(mI2C);
+    i2c_init(mI2C, mClockTuner.getBaud());
+    gpio_set_function(mSDA, GPIO_FUNC_I2C);
+    gpio_set_function(mSCL, GPIO_FUNC_I2C);
+    if(mMux) {
+        mMux->invalidateChannel();
+    }
+
+    return recovered ? BUS_RECOVERED : BUS_STUCK;
+}
+
+bool I2CInterface::isSDAHeldLow() {
+    // A device stuck part way through a byte holds SDA low with the clock released. SCL low is
+    // someone mid transfer or stretching the clock (including our own controller between
+    // transactions, when it keeps the bus), and SDA going high at any point is a transfer moving on
+    absolute_time_t confirmTime = make_timeout_time_us(STUCK_SDA_CONFIRM_US);
+    do {
+        if(gpio_get(mSDA) || !gpio_get(mSCL)) {
+            return false;
+        }
+    } while(absolute_time_diff_us(confirmTime, get_absolute_time()) < 0);
+
+    return true;
+}
+
+bool I2CInterface::clockOutStuckBus() {
+    // Lines are driven open drain through GPIO - an output low pulls the line down, an input lets
+    // the pull-ups take it high
+    gpio_put(mSDA, 0);
+    gpio_put(mSCL, 0);
+    gpio_set_dir(mSDA, GPIO_IN);
+    gpio_set_dir(mSCL, GPIO_IN);
+    gpio_set_function(mSDA, GPIO_FUNC_SIO);
+    gpio_set_function(mSCL, GPIO_FUNC_SIO);
+
+    // Nothing we can do for a device holding the clock, other than give it a chance to let go
+    absolute_time_t sclTimeout = make_timeout_time_us(STUCK_SCL_TIMEOUT_US);
+    while(!gpio_get(mSCL)) {
+        if(absolute_time_diff_us(sclTimeout, get_absolute_time()) > 0) {
+            return false;
+        }
+    }
+
+    // The device holding SDA is waiting to send the rest of a byte. Clock it through until it lets
+    // go, which is never more than the byte and its ACK
+    for(int i = 0; (i < BUS_RECOVERY_CLOCKS) && !gpio_get(mSDA); ++i) {
+        gpio_set_dir(mSCL, GPIO_OUT);
+        busy_wait_us_32(BUS_RECOVERY_HALF_CLOCK_US);
+        gpio_set_dir(mSCL, GPIO_IN);
+        busy_wait_us_32(BUS_RECOVERY_HALF_CLOCK_US);
+    }
+
+    if(!gpio_get(mSDA)) {
+        return false;
+    }
+
+    // STOP (SDA rising while SCL is high) so every device goes back to waiting for a START
+    gpio_set_dir(mSCL, GPIO_OUT);
+    busy_wait_us_32(BUS_RECOVERY_HALF_CLOCK_US);
+    gpio_set_dir(mSDA, GPIO_OUT);
+    busy_wait_us_32(BUS_RECOVERY_HALF_CLOCK_US);
+    gpio_set_dir(mSCL, GPIO_IN);
+    busy_wait_us_32(BUS_RECOVERY_HALF_CLOCK_US);
+    gpio_set_dir(mSDA, GPIO_IN);
+    busy_wait_us_32(BUS_RECOVERY_HALF_CLOCK_US);
+
+    return gpio_get(mSDA) && gpio_get(mSCL);
+}
+
 I2CResponse I2CInterface::checkI2CAddress(const uint8_t address) {
+    I2CBusLock lock(mBus->mArbiter);
+    if(!selectChannel()) {
+        return I2C_RESPONSE_ERROR;
+    }
+
     absolute_time_t timeout = make_timeout_time_ms(DEFAULT_I2C_TIMEOUT_MS);
 
     int response = i2c_write_blocking_until(
@@ -51,6 +225,10 @@ I2CResponse I2CInterface::checkI2CAddress(const uint8_t address) {
         timeout
     );
 
+    // Probing for a device which isn't there is expected to fail, so this doesn't count towards
+    // the clock rate
+    mBus->mArbiter.recordTransaction(response < 0, response == PICO_ERROR_TIMEOUT);
+
     switch(response) {
         case PICO_ERROR_GENERIC:
             return I2C_RESPONSE_ERROR;
@@ -63,6 +241,25 @@ I2CResponse I2CInterface::checkI2CAddress(const uint8_t address) {
     }
 }
 
+void I2CInterface::recordCRCError(const uint8_t address) {
+    I2CBusLock lock(mBus->mArbiter);
+
+    mBus->recordResult(address, I2CClockTuner::ERROR_CRC);
+}
+
+void I2CInterface::restoreBaudRate(uint32_t baud) {
+    if(mBus != this) {
+        mBus->restoreBaudRate(baud);
+        return;
+    }
+
+    I2CBusLock lock(mArbiter);
+
+    if(mClockTuner.restoreBaud(baud) && mBusInitialized) {
+        i2c_set_baudrate(mI2C, baud);
+    }
+}
+
 void I2CInterface::resetInterfaceWatchdog() {
     mInterfaceResetTimeout = make_timeout_time_ms(I2C_WATCHDOG_TIMEOUT_MS);
 }
@@ -79,6 +276,11 @@ I2CResponse I2CInterface::writeI2CData(
     const uint8_t *buffer, 
     size_t bufferLen 
 ) {
+    I2CBusLock lock(mBus->mArbiter);
+    if(!selectChannel()) {
+        return I2C_RESPONSE_ERROR;
+    }
+
     absolute_time_t timeout = make_timeout_time_ms(DEFAULT_I2C_TIMEOUT_MS);
 
     // Write the data itself, if we have any
@@ -94,13 +296,13 @@ I2CResponse I2CInterface::writeI2CData(
 
         switch(response) {
             case PICO_ERROR_GENERIC:
-                return I2C_RESPONSE_ERROR;
+                return recordResponse(address, I2C_RESPONSE_ERROR);
 
             case PICO_ERROR_TIMEOUT:
-                return I2C_RESPONSE_TIMEOUT;
+                return recordResponse(address, I2C_RESPONSE_TIMEOUT);
 
             default:
-                return (response == bufferLen) ? I2C_RESPONSE_OK : I2C_RESPONSE_INCOMPLETE;
+                return recordResponse(address, (response == bufferLen) ? I2C_RESPONSE_OK : I2C_RESPONSE_INCOMPLETE);
         }
     }
 
@@ -114,6 +316,12 @@ I2CResponse I2CInterface::writePrefixedI2CData(
     const uint8_t *buffer, 
     size_t bufferLen 
 ) {
+    // Held across both writes, so nothing can get in between the prefix and the data
+    I2CBusLock lock(mBus->mArbiter);
+    if(!selectChannel()) {
+        return I2C_RESPONSE_ERROR;
+    }
+
     // Write the prefix data (usually an address)
     if ((prefixLen != 0) && (prefixBuffer != NULL)) {
         absolute_time_t timeout = make_timeout_time_ms(DEFAULT_I2C_TIMEOUT_MS);
@@ -128,13 +336,14 @@ I2CResponse I2CInterface::writePrefixedI2CData(
 
         switch(response) {
             case PICO_ERROR_GENERIC:
-                return I2C_RESPONSE_ERROR;
+                return recordResponse(address, I2C_RESPONSE_ERROR);
 
             case PICO_ERROR_TIMEOUT:
-                return I2C_RESPONSE_TIMEOUT;
+                return recordResponse(address, I2C_RESPONSE_TIMEOUT);
 
             default:
-                if(response != prefixLen) return I2C_RESPONSE_INCOMPLETE;
+                if(response != prefixLen) return recordResponse(address, I2C_RESPONSE_INCOMPLETE);
+                recordResponse(address, I2C_RESPONSE_OK);
         }
     }
 
@@ -165,6 +374,11 @@ I2CResponse I2CInterface::readFromI2C(
     uint8_t *buffer, 
     const uint8_t amountToRead
 ) {
+    I2CBusLock lock(mBus->mArbiter);
+    if(!selectChannel()) {
+        return I2C_RESPONSE_ERROR;
+    }
+
     absolute_time_t timeout = make_timeout_time_ms(DEFAULT_I2C_TIMEOUT_MS);
     int response = i2c_read_blocking_until(
         mI2C,
@@ -177,13 +391,13 @@ I2CResponse I2CInterface::readFromI2C(
 
     switch(response) {
         case PICO_ERROR_GENERIC:
-            return I2C_RESPONSE_ERROR;
+            return recordResponse(address, I2C_RESPONSE_ERROR);
 
         case PICO_ERROR_TIMEOUT:
-            return I2C_RESPONSE_TIMEOUT;
+            return recordResponse(address, I2C_RESPONSE_TIMEOUT);
 
         default:
-            return I2C_RESPONSE_OK;
+            return recordResponse(address, I2C_RESPONSE_OK);
     }
 }
 
@@ -197,7 +411,8 @@ I2CResponse I2CInterface::readFromI2CRegister(
 ) {
     uint8_t pos = 0;
 
-    // Write register/command data
+    // Write register/command data. The bus is free for others while the device gets its response
+    // ready
     I2CResponse registerResponse = writeToI2CRegister(address, regHigh, regLow, 0, 0);
     if(registerResponse != I2C_RESPONSE_OK) {
         return registerResponse;
@@ -210,21 +425,94 @@ I2CResponse I2CInterface::readFromI2CRegister(
     return readFromI2C(address, buffer, amountToRead);
 }
 
+Task<I2CResponse> I2CInterface::readFromI2CRegisterAsync(
+    const uint8_t address,
+    const uint8_t regHigh, 
+    const uint8_t regLow,
+    uint8_t *buffer, 
+    const uint8_t amountToRead, 
+    const uint16_t readDelay
+) {
+    // Write register/command data, sleeping rather than spinning while the bus is busy
+    I2CBusArbiter& arbiter = getArbiter();
+    I2CBusArbiter::AsyncRequest request = I2CBusArbiter::makeAsyncRequest();
+    while(!arbiter.tryAcquire(request)) {
+        co_await sleepFor(I2CBusArbiter::RETRY_PERIOD_MS);
+    }
 
+    I2CResponse registerResponse = writeToI2CRegister(address, regHigh, regLow, 0, 0);
+    arbiter.release();
 
+    if(registerResponse != I2C_RESPONSE_OK) {
+        co_return registerResponse;
+    }
 
+    // Wait for response
+    co_await sleepFor(readDelay);
 
-EXPORT_C void init_sensor_bus(I2CInterface* i2c) {
-    assert(i2c);
+    // Read response, which is due now
+    request = I2CBusArbiter::makeAsyncRequest(get_absolute_time());
+    while(!arbiter.tryAcquire(request)) {
+        co_await sleepFor(I2CBusArbiter::RETRY_PERIOD_MS);
+    }
 
-    i2c_init(i2c->mI2C, i2c->mBaud);
-    gpio_set_function(i2c->mSDA, GPIO_FUNC_I2C);
-    gpio_set_function(i2c->mSCL, GPIO_FUNC_I2C);
+    I2CResponse response = readFromI2C(address, buffer, amountToRead);
+    arbiter.release();
 
-    gpio_pull_up(i2c->mSDA);
-    gpio_pull_up(i2c->mSCL);
+    co_return response;
+}
 
-    i2c->mInterfaceResetTimeout = make_timeout_time_ms(I2C_WATCHDOG_TIMEOUT_MS);
+bool I2CInterface::selectChannel() {
+    // Called with the bus held. A no-op for devices on the bus itself, or when the multiplexer is
+    // already on our channel
+    if(mMuxChannel == I2CMultiplexer::NO_CHANNEL) {
+        return true;
+    }
+
+    return mMux->selectChannel(mMuxChannel);
+}
+
+I2CResponse I2CInterface::recordResponse(const uint8_t address, I2CResponse response) {
+    mBus->mArbiter.recordTransaction(response != I2C_RESPONSE_OK, response == I2C_RESPONSE_TIMEOUT);
+
+    if(mMuxChannel != I2CMultiplexer::NO_CHANNEL) {
+        mMux->recordTransaction(mMuxChannel);
+    }
+
+    switch(response) {
+        case I2C_RESPONSE_OK:
+            mBus->recordResult(address, I2CClockTuner::ERROR_NONE);
+            break;
+
+        case I2C_RESPONSE_TIMEOUT:
+            mBus->recordResult(address, I2CClockTuner::ERROR_TIMEOUT);
+            break;
+
+        default:
+            // Errors and short transfers are both the device NACKing
+            mBus->recordResult(address, I2CClockTuner::ERROR_NACK);
+            break;
+    }
+
+    return response;
+}
+
+void I2CInterface::recordResult(const uint8_t address, I2CClockTuner::ErrorType error) {
+    // Called with the bus held, so the new rate applies from the next transaction
+    if(mClockTuner.recordResult(address, error) && mBusInitialized) {
+        DEBUG_PRINT(get_core_num(), "I2C%d clock now %dkHz", mArbiter.getBusIndex(), mClockTuner.getBaud() / 1000);
+        i2c_set_baudrate(mI2C, mClockTuner.getBaud());
+    }
+}
+
+
+
+
+
+EXPORT_C void init_sensor_bus(I2CInterface* i2c) {
+    assert(i2c);
+
+    i2c->initSensorBus();
 }
 
 EXPORT_C void shutdown_sensor_bus(I2CInterface* i2c) {
@@ -258,6 +546,12 @@ EXPORT_C void check_interface_watchdog(I2CInterface* i2c) {
     i2c->checkInterfaceWatchdog();
 }
 
+EXPORT_C void record_i2c_crc_error(I2CInterface* i2c, const uint8_t address) {
+    assert(i2c);
+
+    i2c->recordCRCError(address);
+}
+
 EXPORT_C I2CResponse write_i2c_data(
     I2CInterface* i2c,
     const uint8_t address, 
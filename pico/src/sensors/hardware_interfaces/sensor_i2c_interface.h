@@ -22,6 +22,11 @@ typedef enum {
 
 #ifdef __cplusplus // only actually define the class if this is C++
 
+#include "util/task.h"
+#include "sensors/hardware_interfaces/i2c_bus_arbiter.h"
+#include "sensors/hardware_interfaces/i2c_clock_tuner.h"
+#include "sensors/hardware_interfaces/i2c_multiplexer.h"
+
 class I2CInterface {
     public:
 
@@ -30,9 +35,15 @@ class I2CInterface {
             int baud,
             int sdaPin,
             int sclPin,
-            bool sendStopAfterTransactions
+            bool sendStopAfterTransactions,
+            int maxBaud = 0                         // Fastest rate to try, if the bus should tune its clock
         );
 
+        // One channel of a multiplexer. Transactions select the channel first, and otherwise go
+        // through the multiplexer's bus - sharing its arbiter, clock rate and initialization
+        I2CInterface(I2CMultiplexer& mux, uint8_t channel);
+
+        // Only the first call brings the bus up, so every driver on it can call this
         void initSensorBus();
         void shutdownSensorBus();
         void resetSensorBus();
@@ -73,6 +84,52 @@ class I2CInterface {
             const uint16_t readDelay
         );
 
+        // As readFromI2CRegister(), but the calling task is suspended rather than blocking while
+        // the device prepares its response
+        Task<I2CResponse> readFromI2CRegisterAsync(
+            const uint8_t address,
+            const uint8_t regHigh, 
+            const uint8_t regLow,
+            uint8_t *buffer, 
+            const uint8_t amountToRead, 
+            const uint16_t readDelay
+        );
+
+        // Frees a device left holding SDA low part way through a byte, by clocking the rest of the
+        // byte out through GPIO and then sending a STOP. Tried before every bus reset, which the
+        // retry policy escalates to after a run of failures, and only once SDA has stayed low with
+        // SCL released for longer than a byte takes
+        enum BusRecovery {
+            BUS_NOT_STUCK,
+            BUS_RECOVERED,
+            BUS_STUCK                               // Still held low, it needs a reset or power cycle
+        };
+        BusRecovery recoverStuckBus();
+
+        // For drivers which check their own data, so bad reads count against the clock rate
+        void recordCRCError(const uint8_t address);
+
+        // Starts from the rate a previous run settled on
+        void restoreBaudRate(uint32_t baud);
+        uint32_t getBaudRate() const { return mBus->mClockTuner.getBaud(); }
+
+        // Every transaction holds the bus through this, callers can hold it around several
+        I2CBusArbiter& getArbiter() { return mBus->mArbiter; }
+        const I2CClockTuner& getClockTuner() const { return mBus->mClockTuner; }
+
+        // Called by the multiplexer, so the bus can forget the selected channel when it's reset
+        void attachMultiplexer(I2CMultiplexer& mux) { mMux = &mux; }
+        I2CMultiplexer* getMultiplexer() const { return mMux; }
+
+        // Bus and multiplexer channel, for grouping transactions which don't need a channel switch
+        uint16_t getRoute() const { return ((mBus->mArbiter.getBusIndex() + 1) << 8) | (uint8_t) (mMuxChannel + 1); }
+
+        // Every interface registers itself, for reporting and saving clock rates
+        static int getInterfaceCount() { return sInterfaceCount; }
+        static I2CInterface& getInterface(int index) { return *sInterfaces[index]; }
+
+        static constexpr uint8_t MAX_INTERFACES = 4;
+
 
         i2c_inst_t *mI2C;                           // The underlying I2C access struct
         const int mBaud;                            // I2C baud rate
@@ -80,6 +137,30 @@ class I2CInterface {
         const int mSCL;                             // I2C SCL pin
         const bool mSendStopAfterTransactions;      // If we relinquish the bus after transactions (for multi-master)
         absolute_time_t mInterfaceResetTimeout;     // Watchdog timer for multiplexer/interface
+
+    private:
+        bool selectChannel();
+        bool isSDAHeldLow();
+        bool clockOutStuckBus();
+        I2CResponse recordResponse(const uint8_t address, I2CResponse response);
+        void recordResult(const uint8_t address, I2CClockTuner::ErrorType error);
+
+        static constexpr int BUS_RECOVERY_CLOCKS            = 9;        // Enough to finish any byte, plus the ACK
+        static constexpr uint32_t BUS_RECOVERY_HALF_CLOCK_US = 5;       // 100kHz, which every device handles
+        static constexpr uint32_t STUCK_SCL_TIMEOUT_US      = 1000;     // Longer than any clock stretch we'd expect
+        static constexpr uint32_t STUCK_SDA_CONFIRM_US      = 200;      // Longer than a byte and its ACK at 50kHz, the slowest rate
+
+        static I2CInterface* sInterfaces[MAX_INTERFACES];
+        static uint8_t sInterfaceCount;
+
+        // Not in the C struct, so these have to stay after the members which are. C code reads those
+        // through the struct, so they need to be at the same offsets in both
+        I2CInterface* const mBus;                   // This, unless the interface is a multiplexer channel
+        I2CMultiplexer* mMux;
+        const uint8_t mMuxChannel;
+        I2CBusArbiter mArbiter;                     // These three are only used on the bus's own interface
+        I2CClockTuner mClockTuner;
+        bool mBusInitialized;
 };
 
 #else
@@ -110,6 +191,7 @@ EXPORT_C void reset_sensor_bus(I2CInterface* i2c);
 EXPORT_C I2CResponse check_i2c_address(I2CInterface* i2c, const uint8_t address);
 EXPORT_C void reset_interface_watchdog(I2CInterface* i2c);
 EXPORT_C void check_interface_watchdog(I2CInterface* i2c);
+EXPORT_C void record_i2c_crc_error(I2CInterface* i2c, const uint8_t address);
 EXPORT_C I2CResponse write_i2c_data(
     I2CInterface* i2c,
     const uint8_t address, 
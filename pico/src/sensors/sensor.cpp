@@ -1,5 +1,9 @@
 #include "sensor.h"
 
+#include "messaging/sensor_data_message.h"
+#include "util/debug_io.h"
+#include "util/copy_stats.h"
+#include "util/task_scheduler.h"
 #include "pico/time.h"
 #include <string.h>
 
@@ -7,75 +11,169 @@
 using std::tie;
 
 map<int, Sensor::JsonSerializer> Sensor::sJSONSerializerMap;
+map<int, Sensor::CborSerializer> Sensor::sCBORSerializerMap;
 
 
 Sensor::SensorDataBuffer::SensorDataBuffer() :
+    mStatus{SENSOR_INACTIVE},
+    mFrame{nullptr},
     mDataBytes{nullptr},
-    mDataLen{0}
+    mDataLen{0},
+    mDataExpiryTime{nil_time}
 {}
 
-Sensor::SensorDataBuffer::~SensorDataBuffer() {
-    if(mDataBytes) {
-       delete[] mDataBytes;
-       mDataBytes = nullptr;
+void Sensor::SensorDataBuffer::clear() {
+    if(mFrame) {
+        mFrame->release();
+        mFrame = nullptr;
     }
+    mDataBytes = nullptr;
     mDataLen = 0;
 }
 
-void Sensor::SensorDataBuffer::initializeBuffer(uint32_t bufferSize) {
-    if(!mDataBytes) {
-        mDataBytes = new uint8_t[bufferSize];
-    }
-    mDataLen = 0;
-}
-
-Sensor::Sensor(uint8_t sensorType, JsonSerializer serializer) :
+Sensor::Sensor(uint8_t sensorType, JsonSerializer serializer, CborSerializer cborSerializer) :
     mSensorType(sensorType),
-    mUpdateWatchdogTimeout(nil_time)
+    mUpdateWatchdogTimeout(nil_time),
+    mNextInitializationTime(nil_time),
+    mResetCount(0),
+    mResetRequested(false),
+    mInitializing(false),
+    mInitStage(INIT_NOT_STARTED),
+    mInitCompleteTimeMS(0),
+    mInitAttempts(0)
 {
     sJSONSerializerMap[mSensorType] = serializer;
+    sCBORSerializerMap[mSensorType] = cborSerializer;
 }
 
 void Sensor::initialize() {
-    mCachedData.initializeBuffer(getRawDataSize());
+    startInitialization(initializationTask());
+}
 
+Task<> Sensor::initializationTask() {
     doInitialization();
+    co_return;
+}
+
+void Sensor::startInitialization(Task<> task) {
+    // Start the watchdog from here, otherwise a sensor which malfunctions before ever giving us data
+    // is compared against a nil timeout and gets reset immediately
+    resetUpdateWatchdogTimer(get_absolute_time());
+
+    if(!task.isValid()) {
+        DEBUG_PRINT(1, "Sensor (type %d) couldn't start initializing", mSensorType);
+        setInitStage(INIT_FAILED);
+        return;
+    }
+
+    if(mInitAttempts < UINT8_MAX) {
+        ++mInitAttempts;
+    }
+
+    // Cleared by runInitialization(), which may already have finished by the time startTask() returns
+    mInitializing = true;
+    setInitStage(INIT_STARTING);
+    if(!startTask(runInitialization(std::move(task)))) {
+        DEBUG_PRINT(1, "Sensor (type %d) couldn't start initializing", mSensorType);
+        setInitStage(INIT_FAILED);
+        mInitializing = false;
+    }
+}
+
+void Sensor::setInitStage(InitStage stage) {
+    if((stage == INIT_COMPLETE) && !mInitCompleteTimeMS) {
+        mInitCompleteTimeMS = to_ms_since_boot(get_absolute_time());
+    }
+
+    mInitStage = stage;
+}
+
+const char* Sensor::getInitStageName(InitStage stage) {
+    switch(stage) {
+        case INIT_NOT_STARTED:  return "not started";
+        case INIT_STARTING:     return "starting";
+        case INIT_CONNECTING:   return "connecting";
+        case INIT_CONFIGURING:  return "configuring";
+        case INIT_COMPLETE:     return "complete";
+        case INIT_FAILED:       return "failed";
+    }
+
+    return "unknown";
 }
 
+bool Sensor::startTask(Task<> task) {
+    if(!task.isValid()) {
+        return false;
+    }
 
-void Sensor::update(absolute_time_t currentTime) {
-    uint8_t sensorData[getRawDataSize()];
-    uint8_t dataSize;
+    // Always core1's, even when core0 has taken this group's update, so the task's waits and I2C
+    // happen on core1 rather than blocking core0's workers
+    TaskScheduler* scheduler = TaskScheduler::forCore(1);
+    if(!scheduler) {
+        // Without a scheduler every wait blocks, so the task runs to completion right here
+        task.getHandle().resume();
+        return true;
+    }
 
-    tie(mCachedData.mStatus, dataSize) = doUpdate(currentTime, sensorData, getRawDataSize());
+    return scheduler->spawn(std::move(task));
+}
+
+Task<> Sensor::runInitialization(Task<> task) {
+    co_await task;
+
+    if(mInitStage != INIT_FAILED) {
+        setInitStage(INIT_COMPLETE);
+    }
+
+    mInitializing = false;
+    resetUpdateWatchdogTimer(get_absolute_time());
+}
+
+
+bool Sensor::update(absolute_time_t currentTime, SensorDataMessage* frame, uint8_t* blockPtr) {
+    uint8_t* sensorData = blockPtr + 2;
+    uint8_t dataSize = 0;
+
+    if(mInitializing) {
+        // Hardware isn't ready yet
+        mCachedData.mStatus = SENSOR_INACTIVE;
+    } else {
+        tie(mCachedData.mStatus, dataSize) = doUpdate(currentTime, sensorData, getRawDataSize());
+    }
 
     switch(mCachedData.mStatus) {
         case SENSOR_OK:
-            // We got fresh data, everything is good. Cache the data.
-            memcpy(mCachedData.mDataBytes, sensorData, dataSize);
+            // We got fresh data, everything is good. The frame becomes our cache
+            mCachedData.clear();
+            frame->retain();
+            mCachedData.mFrame = frame;
+            mCachedData.mDataBytes = sensorData;
             mCachedData.mDataLen = dataSize;
-            mCachedData.mDataExpiryTime = make_timeout_time_ms(getDataCacheTimeout());
-            resetUpdateWatchdogTimer();
+            mCachedData.mDataExpiryTime = delayed_by_ms(currentTime, getDataCacheTimeout());
+            resetUpdateWatchdogTimer(currentTime);
             break;
 
         case SENSOR_OK_NO_DATA:
             // No new data, but that's ok. We will continue transmitting the cached
             // data until it becomes stale
-            if(absolute_time_diff_us(mCachedData.mDataExpiryTime, currentTime) > 0) {
-                mCachedData.mDataLen = 0;
+            if(!is_nil_time(mCachedData.mDataExpiryTime) && absolute_time_diff_us(mCachedData.mDataExpiryTime, currentTime) > 0) {
+                mCachedData.clear();
                 mCachedData.mDataExpiryTime = nil_time;
             }
-            resetUpdateWatchdogTimer();
+            resetUpdateWatchdogTimer(currentTime);
             break;
         
         case SENSOR_MALFUNCTIONING:
             // We are getting errors from the underlying sensor. If we have been getting it for too long,
-            // we will try bouncing the sensor
-            if(absolute_time_diff_us(mUpdateWatchdogTimeout, currentTime) > 0) {
+            // or the driver has already given up on it, we will try bouncing the sensor
+            if(mResetRequested || (absolute_time_diff_us(mUpdateWatchdogTimeout, currentTime) > 0)) {
+                mResetRequested = false;
+                ++mResetCount;
+                DEBUG_PRINT(1, "Sensor (type %d) unresponsive, resetting (reset #%d)", mSensorType, mResetCount);
                 reset();
-                resetUpdateWatchdogTimer();
+                resetUpdateWatchdogTimer(get_absolute_time());
             }
-            mCachedData.mDataLen = 0;
+            mCachedData.clear();
             break;
 
         case SENSOR_NOT_CONNECTED:
@@ -84,10 +182,29 @@ void Sensor::update(absolute_time_t currentTime) {
         case SENSOR_INACTIVE:
             // Not a lot we can do here, either we weren't initialized or the init failed or the sensor
             // physically hasn't been connected yet. Either way there's no data. We can try re-initializing
-            initialize();
-            mCachedData.mDataLen = 0;
+            // once any initialization in progress has finished, but not every cycle
+            if(!mInitializing &&
+               (is_nil_time(mNextInitializationTime) || absolute_time_diff_us(mNextInitializationTime, currentTime) > 0)) {
+                initialize();
+                mNextInitializationTime = make_timeout_time_ms(REINITIALIZATION_PERIOD_MS);
+            }
+            mCachedData.clear();
             break;
     }
+
+    // A cached reading from an earlier frame is the only thing which gets copied
+    if(mCachedData.mDataLen && (mCachedData.mFrame != frame)) {
+        memcpy(sensorData, mCachedData.mDataBytes, mCachedData.mDataLen);
+        COUNT_COPIED_BYTES(COPY_SENSOR_CACHE, mCachedData.mDataLen);
+    }
+
+    // Fixed stride, the unpack functions find each sensor's block by its raw data size. The unused
+    // tail is cleared so raw frames only change when the data does
+    blockPtr[0] = (uint8_t) mCachedData.mStatus;
+    blockPtr[1] = mCachedData.mDataLen;
+    memset(sensorData + mCachedData.mDataLen, 0, getRawDataSize() - mCachedData.mDataLen);
+
+    return (mCachedData.mStatus == SENSOR_OK);
 }
 
 int Sensor::getDataAsJSON(uint8_t sensorTypeID, uint8_t* data, uint8_t dataLength, char* jsonBuffer, int jsonBufferSize) {
@@ -102,6 +219,26 @@ void Sensor::registerJSONSerializer(int sensorTypeID, Sensor::JsonSerializer ser
     sJSONSerializerMap[sensorTypeID] = serializer;
 }
 
-void Sensor::resetUpdateWatchdogTimer() {
-    mUpdateWatchdogTimeout = make_timeout_time_ms(UPDATE_WATCHDOG_TIMEOUT_MS);
+int Sensor::getDataAsCBOR(uint8_t sensorTypeID, uint8_t* data, uint8_t dataLength, CborWriter& writer) {
+    if(auto serializer = sCBORSerializerMap.find(sensorTypeID); serializer != sCBORSerializerMap.end()) {
+        return serializer->second(data, dataLength, writer);
+    }
+
+    return 0;
+}
+
+const char* Sensor::getFieldTypeName(FieldType type) {
+    switch(type) {
+        case FIELD_UINT8:       return "u8";
+        case FIELD_UINT16:      return "u16";
+        case FIELD_INT32:       return "i32";
+        case FIELD_FLOAT:       return "f32";
+        case FIELD_BYTES:       return "bytes";
+    }
+
+    return "unknown";
+}
+
+void Sensor::resetUpdateWatchdogTimer(absolute_time_t currentTime) {
+    mUpdateWatchdogTimeout = delayed_by_ms(currentTime, UPDATE_WATCHDOG_TIMEOUT_MS);
 }
@@ -2,6 +2,8 @@
 #define _SENSOR_H_
 
 #include "messaging/sensor_control_message.h"
+#include "messaging/cbor_writer.h"
+#include "util/task.h"
 #include "pico/types.h"
 
 #include <map>
@@ -11,6 +13,8 @@
 using std::map;
 using std::tuple;
 
+struct SensorDataMessage;
+
 class Sensor {
     public:
         enum SensorType {
@@ -30,28 +34,72 @@ class Sensor {
             SENSOR_MALFUNCTIONING
         };
 
+        // Initialization runs as a task on core1 alongside the network coming up on core0. Tasks
+        // report how far they have got, so a slow or missing sensor can be told apart from one which
+        // is still being set up. A failed initialization is retried every REINITIALIZATION_PERIOD_MS
+        enum InitStage : uint8_t {
+            INIT_NOT_STARTED,
+            INIT_STARTING,              // Task started, hardware not touched yet
+            INIT_CONNECTING,            // Waiting for the hardware to answer
+            INIT_CONFIGURING,           // Found it, setting it up
+            INIT_COMPLETE,
+            INIT_FAILED
+        };
+
+        // The latest reading lives in the frame it was written into, which is held on to while the
+        // reading is cached
         struct SensorDataBuffer {
             SensorDataBuffer();
-            ~SensorDataBuffer();
-            void initializeBuffer(uint32_t bufferSize);
+            void clear();
 
             SensorStatus mStatus;
-            uint8_t* mDataBytes;
+            SensorDataMessage* mFrame;
+            uint8_t* mDataBytes;            // Points into mFrame
             uint8_t mDataLen;
             absolute_time_t mDataExpiryTime;
         };
 
         typedef int (*JsonSerializer)(uint8_t*, uint8_t, char*, int);
 
+        // Writes the sensor's data as key/value pairs into an open map, returning the number of pairs
+        typedef int (*CborSerializer)(uint8_t*, uint8_t, CborWriter&);
+
+        // Describes the layout of a sensor's raw data, for publishing schemas alongside raw frames.
+        // Raw data is little-endian
+        enum FieldType : uint8_t {
+            FIELD_UINT8,
+            FIELD_UINT16,
+            FIELD_INT32,
+            FIELD_FLOAT,
+            FIELD_BYTES         // Whatever is left of the data after the preceding fields
+        };
+
+        struct FieldDescriptor {
+            const char* mName;
+            const char* mShortName;     // Used instead of mName in short key payloads
+            FieldType mType;
+            const char* mUnit;          // nullptr if there isn't one
+            uint8_t mOffset;            // From the start of the sensor's data
+            int8_t mCountField;         // For arrays, index of the field holding the element count. Otherwise -1
+        };
+
+        struct DataLayout {
+            const char* mSensorName;
+            const FieldDescriptor* mFields;
+            uint8_t mFieldCount;
+        };
 
-        Sensor(uint8_t sensorType, JsonSerializer serializer);
+
+        Sensor(uint8_t sensorType, JsonSerializer serializer, CborSerializer cborSerializer);
 
         // Must be unique per-sensor type
         uint8_t getSensorTypeID() const { return mSensorType; };      
 
         void initialize();
 
-        void update(absolute_time_t currentTime);
+        // Writes the sensor's [status][data length][data] block into the frame at blockPtr, reading
+        // straight into it. Returns true if the sensor produced fresh data during this update
+        bool update(absolute_time_t currentTime, SensorDataMessage* frame, uint8_t* blockPtr);
 
         // Fully reset the sensor hardware (will be used if sensor stops responding for a period of time)
         virtual void reset() = 0;
@@ -67,30 +115,80 @@ class Sensor {
 
         virtual uint32_t getDataCacheTimeout() const { return SENSOR_DATA_CACHE_TIME_MS; }
 
+        // Bus and multiplexer channel the sensor talks over (see I2CInterface::getRoute()), so groups
+        // can update sensors on the same channel together. 0 for sensors which don't use I2C
+        virtual uint16_t getBusRoute() const { return 0; }
+
+        // Layout of the raw data produced by doUpdate()
+        virtual DataLayout getDataLayout() const = 0;
+
+        static const char* getFieldTypeName(FieldType type);
+
         const SensorDataBuffer& getCachedData() const { return mCachedData; }
 
+        // Number of times the update watchdog has had to reset this sensor
+        uint32_t getResetCount() const { return mResetCount; }
+
+        InitStage getInitStage() const { return mInitStage; }
+        bool isInitSettled() const { return (mInitStage == INIT_COMPLETE) || (mInitStage == INIT_FAILED); }
+        static const char* getInitStageName(InitStage stage);
+
+        // Time after reset at which the sensor first finished initializing, 0 if it hasn't yet
+        uint32_t getInitCompleteTimeMS() const { return mInitCompleteTimeMS; }
+        uint8_t getInitAttempts() const { return mInitAttempts; }
+
         static int getDataAsJSON(uint8_t sensorTypeID, uint8_t* data, uint8_t dataLength, char* jsonBuffer, int jsonBufferSize);
         static void registerJSONSerializer(int sensorTypeID, JsonSerializer serializer);
+        static int getDataAsCBOR(uint8_t sensorTypeID, uint8_t* data, uint8_t dataLength, CborWriter& writer);
 
     protected:
         typedef tuple<SensorStatus, uint8_t> SensorUpdateResponse;
 
         // Perform all required hardware-specific initialization
-        virtual void doInitialization() = 0;
+        virtual void doInitialization() {}
+
+        // Initialization as a task, for sensors which have to wait on their hardware while starting up.
+        // By default this just runs doInitialization()
+        virtual Task<> initializationTask();
+
+        // Runs an initialization task (the sensor reports itself as inactive until it finishes)
+        void startInitialization(Task<> task);
+
+        // Called by initialization tasks as they go. A task which finishes without reporting
+        // INIT_FAILED is taken to have completed
+        void setInitStage(InitStage stage);
+
+        // Hands a task to core1's scheduler, or runs it to completion there and then if there isn't
+        // one. Returns false if the task couldn't be started
+        bool startTask(Task<> task);
 
         // Update the underlying sensor hardware, serializing any current data into the supplied buffer
         virtual SensorUpdateResponse doUpdate(absolute_time_t currentTime, uint8_t *dataStorageBuffer, size_t bufferSize) = 0;
 
+        // Resets the sensor on its next malfunctioning update, without waiting out the update
+        // watchdog. For drivers whose retry policy has given up on the hardware
+        void requestReset() { mResetRequested = true; }
+
     private:
-        inline void resetUpdateWatchdogTimer();
+        inline void resetUpdateWatchdogTimer(absolute_time_t currentTime);
+        Task<> runInitialization(Task<> task);
 
         static constexpr uint32_t UPDATE_WATCHDOG_TIMEOUT_MS    = (15 * 1000);      // Reset sensor if it hasn't responded in 15s
         static constexpr uint32_t SENSOR_DATA_CACHE_TIME_MS     = (5 * 1000);       // Keep old sensor data around for 5s
+        static constexpr uint32_t REINITIALIZATION_PERIOD_MS    = (5 * 1000);       // Retry inactive sensors every 5s
 
         static map<int, JsonSerializer> sJSONSerializerMap;
+        static map<int, CborSerializer> sCBORSerializerMap;
 
         const uint8_t mSensorType;
         absolute_time_t mUpdateWatchdogTimeout;
+        absolute_time_t mNextInitializationTime;
+        uint32_t mResetCount;
+        bool mResetRequested;
+        volatile bool mInitializing;        // Cleared by the task on core1, read by whichever core updates
+        volatile InitStage mInitStage;      // Written by the task on core1, read by core0 for the boot timeline
+        uint32_t mInitCompleteTimeMS;
+        uint8_t mInitAttempts;
         SensorDataBuffer mCachedData;
 };
 
@@ -1,16 +1,125 @@
 #include "sensor_group.h"
 #include <cstring>
 #include <cstdio>
+#include <cmath>
+#include <algorithm>
 #include "util/debug_io.h"
+#include "util/fnv_hash.h"
 
 
-SensorGroup::SensorGroup(initializer_list<Sensor*> sensors) :
-    mSensors(sensors)
+constexpr const char* SENSOR_TYPE_KEY               = "type";
+constexpr const char* SENSOR_STATUS_KEY             = "status";
+constexpr const char* SENSOR_TYPE_SHORT_KEY         = "t";
+constexpr const char* SENSOR_STATUS_SHORT_KEY       = "s";
+
+
+static char* formatUnsigned(char* out, uint32_t value) {
+    char digits[10];
+    int count = 0;
+    do {
+        digits[count++] = '0' + (value % 10);
+        value /= 10;
+    } while(value);
+
+    while(count) {
+        *out++ = digits[--count];
+    }
+
+    return out;
+}
+
+static char* formatInt(char* out, int32_t value) {
+    if(value < 0) {
+        *out++ = '-';
+        return formatUnsigned(out, -(uint32_t) value);
+    }
+
+    return formatUnsigned(out, value);
+}
+
+// Same output as %.2f (including rounding and negative zero), without going through printf
+static char* formatFixed2(char* out, float value) {
+    if(!std::isfinite(value)) {
+        memcpy(out, "null", 4);
+        return out + 4;
+    }
+
+    if(std::signbit(value)) {
+        *out++ = '-';
+    }
+
+    double scaled = fabs((double) value) * 100.0;
+    if(scaled >= 4.0e9) {
+        return out + sprintf(out, "%.2f", fabs(value));
+    }
+
+    uint32_t fixed = (uint32_t) llrint(scaled);
+    out = formatUnsigned(out, fixed / 100);
+    *out++ = '.';
+    *out++ = '0' + ((fixed / 10) % 10);
+    *out++ = '0' + (fixed % 10);
+
+    return out;
+}
+
+static char* formatField(char* out, Sensor::FieldType type, const uint8_t* data) {
+    switch(type) {
+        case Sensor::FIELD_UINT8:
+            return formatUnsigned(out, *data);
+
+        case Sensor::FIELD_UINT16: {
+            uint16_t value;
+            memcpy(&value, data, sizeof(uint16_t));
+            return formatUnsigned(out, value);
+        }
+
+        case Sensor::FIELD_INT32: {
+            int32_t value;
+            memcpy(&value, data, sizeof(int32_t));
+            return formatInt(out, value);
+        }
+
+        case Sensor::FIELD_FLOAT: {
+            float value;
+            memcpy(&value, data, sizeof(float));
+            return formatFixed2(out, value);
+        }
+
+        default:
+            return out;
+    }
+}
+
+SensorGroup::SensorGroup(initializer_list<Sensor*> sensors, uint8_t qos, PublishPolicy policy, int8_t coreAffinity) :
+    mSensors(sensors),
+    mQoS(qos),
+    mPublishPolicy(policy),
+    mCoreAffinity(coreAffinity),
+    mShortKeys(false)
 {
     memset(mName, 0, UserData::MAX_HOST_NAME_LENGTH + 1);
     memset(mLocation, 0, UserData::MAX_GROUP_LOCATION_LENGTH + 1);
     memset(mTopic, 0,MQTTMessage::MQTT_MAX_TOPIC_LENGTH);
     memset(mControlTopic, 0,MQTTMessage::MQTT_MAX_TOPIC_LENGTH);
+    memset(mSchemaTopic, 0,MQTTMessage::MQTT_MAX_TOPIC_LENGTH);
+
+    // The layout is fixed once the group is built, so its ID only needs working out once
+    char layout[MQTTMessage::MQTT_MAX_PAYLOAD_LENGTH];
+    uint32_t layoutHash = fnv1aHash((const uint8_t*) layout, writeSensorLayout(layout, sizeof(layout)));
+    mSchemaID = (layoutHash >> 16) ^ (layoutHash & 0xFFFF);
+
+    // Data stays in the order the sensors were given, but they're updated one channel at a time so
+    // a multiplexer only has to switch once per channel each round
+    uint16_t dataOffset = 0;
+    for(int i = 0; i < mSensors.size(); ++i) {
+        mUpdateOrder.push_back(i);
+        mDataOffsets.push_back(dataOffset);
+        dataOffset += mSensors[i]->getRawDataSize() + 2;
+    }
+
+    std::stable_sort(mUpdateOrder.begin(), mUpdateOrder.end(), [this](uint8_t a, uint8_t b) {
+        return mSensors[a]->getBusRoute() < mSensors[b]->getBusRoute();
+    });
 }
 
 void SensorGroup::initializeSensors() {
@@ -25,14 +134,18 @@ void SensorGroup::shutdown() {
     }
 }
 
-void SensorGroup::update(absolute_time_t currentTime) {
-    DEBUG_PRINT(1, "     <<<<< Updating sensor group: %s >>>>>", mName);
+bool SensorGroup::update(absolute_time_t currentTime, SensorDataMessage* frame, uint8_t* sensorDataBuffer) {
+    bool freshData = false;
 
-    for(auto& s : mSensors) {
-        s->update(currentTime);
+    DEBUG_PRINT_VERBOSE(1, "     <<<<< Updating sensor group: %s >>>>>", mName);
+
+    for(uint8_t i : mUpdateOrder) {
+        freshData |= mSensors[i]->update(currentTime, frame, sensorDataBuffer + mDataOffsets[i]);
     }
 
-    DEBUG_PRINT(1, "     <<<<< %s update complete >>>>>", mName);
+    DEBUG_PRINT_VERBOSE(1, "     <<<<< %s update complete >>>>>", mName);
+
+    return freshData;
 }
 
 uint32_t SensorGroup::getRawDataSize() const {
@@ -45,26 +158,20 @@ uint32_t SensorGroup::getRawDataSize() const {
     return dataSize;
 }
 
-void SensorGroup::packSensorData(uint8_t* sensorDataBuffer, uint16_t bufferSize) const {
-    assert(sensorDataBuffer);
-    assert(bufferSize >= getRawDataSize());
-
-    uint8_t *writePtr = sensorDataBuffer;
-    for(auto& s : mSensors) {
-        const Sensor::SensorDataBuffer& cachedData = s->getCachedData();
-        *writePtr++ = (uint8_t) cachedData.mStatus;
-        *writePtr++ = cachedData.mDataLen;
-
-        memcpy(writePtr, cachedData.mDataBytes, cachedData.mDataLen);
-        writePtr += cachedData.mDataLen;
+int SensorGroup::unpackSensorDataToJSON(uint8_t* sensorDataBuffer, int bufferSize, char* jsonBuffer, int jsonBufferSize) const {
+    if(mTemplateSlots.empty()) {
+        return formatSensorDataToJSON(sensorDataBuffer, bufferSize, jsonBuffer, jsonBufferSize);
     }
+
+    return renderTemplate(sensorDataBuffer, jsonBuffer, jsonBufferSize);
 }
 
-int SensorGroup::unpackSensorDataToJSON(uint8_t* sensorDataBuffer, int bufferSize, char* jsonBuffer, int jsonBufferSize) const {
+int SensorGroup::formatSensorDataToJSON(uint8_t* sensorDataBuffer, int bufferSize, char* jsonBuffer, int jsonBufferSize) const {
+    const char* bufferEnd = jsonBuffer + jsonBufferSize - 2;       // Room for the closing bracket and terminator
     char* writePtr = jsonBuffer;
     uint8_t* readPtr = sensorDataBuffer;
+    bool overflowed = false;
     *writePtr++ = '[';
-    --jsonBufferSize;
 
     for(auto& s : mSensors) {
         // First byte is status
@@ -75,44 +182,135 @@ int SensorGroup::unpackSensorDataToJSON(uint8_t* sensorDataBuffer, int bufferSiz
 
         uint8_t sensorType = s->getSensorTypeID();
 
-        // Regardless of whether there is data or not, we write the sensor's type and status
-        uint8_t pfxBytesWritten = sprintf(writePtr, "{\"type\": %d, \"status\": %d", sensorType, status);
-        writePtr += pfxBytesWritten;
-        jsonBufferSize -= pfxBytesWritten;
+        // Regardless of whether there is data or not, we write the sensor's type and status. Every
+        // write is checked against what's left, as a sensor's data can be longer than the buffer
+        int available = bufferEnd - writePtr;
+        int written = snprintf(writePtr, available, "{\"%s\": %d, \"%s\": %d", SENSOR_TYPE_KEY, sensorType, SENSOR_STATUS_KEY, status);
+        if(overflowed = (written >= available)) {
+            break;
+        }
+        writePtr += written;
 
-        // If there is data, add that to the JSON block too        
+        // If there is data, add that to the JSON block too, after a separator
         if(dataLength) {
-            // JSON separator
-            uint8_t separatorBytesWritten = sprintf(writePtr, ", ");
-            writePtr += separatorBytesWritten;
-            jsonBufferSize -= separatorBytesWritten;
-
-            // Data
-            uint8_t dataBytesWritten = Sensor::getDataAsJSON(sensorType, readPtr, dataLength, writePtr, jsonBufferSize);
-            writePtr += dataBytesWritten;
-            jsonBufferSize -= dataBytesWritten;
+            available = bufferEnd - writePtr;
+            written = snprintf(writePtr, available, ", ");
+            if(overflowed = (written >= available)) {
+                break;
+            }
+            writePtr += written;
+
+            available = bufferEnd - writePtr;
+            written = Sensor::getDataAsJSON(sensorType, readPtr, dataLength, writePtr, available);
+            if(overflowed = (written >= available)) {
+                break;
+            }
+            writePtr += written;
         }
 
-        // Close out JSON block
-        *writePtr++ = '}';
-        --jsonBufferSize;
-
-        // If there are more sensors, add a separator for the next JSON block
-        if(s != mSensors.back()) {
-            *writePtr++ = ',';
-            --jsonBufferSize;
+        // Close out JSON block, and if there are more sensors add a separator for the next one
+        available = bufferEnd - writePtr;
+        written = snprintf(writePtr, available, (s != mSensors.back()) ? "}," : "}");
+        if(overflowed = (written >= available)) {
+            break;
         }
+        writePtr += written;
 
         readPtr += s->getRawDataSize();
     }
 
+    if(overflowed) {
+        DEBUG_PRINT(0, "JSON payload for %s overflows buffer", mName);
+        jsonBuffer[0] = 0;
+        return 0;
+    }
+
     *writePtr++ = ']';
     *writePtr++ = 0;
-    jsonBufferSize -= 2;
 
     return (writePtr - jsonBuffer);
 }
 
+int SensorGroup::unpackSensorDataToCBOR(uint8_t* sensorDataBuffer, int bufferSize, uint8_t* cborBuffer, int cborBufferSize) const {
+    CborWriter writer(cborBuffer, cborBufferSize);
+    uint8_t* readPtr = sensorDataBuffer;
+
+    // Same shape as the JSON, an array holding a map per sensor
+    writer.writeArrayHeader(mSensors.size());
+
+    for(auto& s : mSensors) {
+        Sensor::SensorStatus status = (Sensor::SensorStatus) *readPtr++;
+        uint8_t dataLength = *readPtr++;
+        uint8_t sensorType = s->getSensorTypeID();
+
+        int mapStart = writer.beginMap();
+        writer.writeText(SENSOR_TYPE_KEY);
+        writer.writeUnsigned(sensorType);
+        writer.writeText(SENSOR_STATUS_KEY);
+        writer.writeUnsigned(status);
+
+        int pairCount = 2;
+        if(dataLength) {
+            pairCount += Sensor::getDataAsCBOR(sensorType, readPtr, dataLength, writer);
+        }
+        writer.endMap(mapStart, pairCount);
+
+        readPtr += s->getRawDataSize();
+    }
+
+    if(writer.hasOverflowed()) {
+        DEBUG_PRINT(0, "CBOR payload for %s overflows buffer", mName);
+        return 0;
+    }
+
+    return writer.getLength();
+}
+
+int SensorGroup::packRawFrame(uint8_t* sensorDataBuffer, int bufferSize, uint8_t* frameBuffer, int frameBufferSize) const {
+    int frameSize = RAW_FRAME_HEADER_SIZE + getRawDataSize();
+    if(frameSize > frameBufferSize) {
+        DEBUG_PRINT(0, "Raw frame for %s overflows buffer", mName);
+        return 0;
+    }
+
+    // Sequence number is filled in when the frame is published
+    setFrameSequence(frameBuffer, 0);
+    frameBuffer[2] = mSchemaID & 0xFF;
+    frameBuffer[3] = mSchemaID >> 8;
+    memcpy(frameBuffer + RAW_FRAME_HEADER_SIZE, sensorDataBuffer, getRawDataSize());
+
+    return frameSize;
+}
+
+int SensorGroup::writeSchema(char* buffer, int bufferSize, int groupIndex) const {
+    int written = snprintf(buffer, bufferSize,
+        "{\"version\":%d,\"id\":%d,\"group\":%d,\"endian\":\"little\",\"header\":%d,\"sensors\":",
+        RAW_FRAME_VERSION,
+        mSchemaID,
+        groupIndex,
+        RAW_FRAME_HEADER_SIZE
+    );
+    if(written >= bufferSize) {
+        return 0;
+    }
+
+    int layoutSize = writeSensorLayout(buffer + written, bufferSize - written);
+    written += layoutSize;
+    if(!layoutSize || (written + 2) > bufferSize) {
+        return 0;
+    }
+
+    buffer[written++] = '}';
+    buffer[written] = 0;
+
+    return written;
+}
+
+void SensorGroup::setFrameSequence(uint8_t* frame, uint16_t sequence) {
+    frame[0] = sequence & 0xFF;
+    frame[1] = sequence >> 8;
+}
+
 bool SensorGroup::handleSensorControlCommand(SensorControlMessage& message) {
     if(strncmp(
         message.mControlTopic,
@@ -143,6 +341,11 @@ void SensorGroup::setLocation(const char* location) {
     createTopics();
 }
 
+void SensorGroup::setShortKeys(bool shortKeys) {
+    mShortKeys = shortKeys;
+    compileTemplate();
+}
+
 bool SensorGroup::hasTopics() const {
     return (strlen(mTopic) && strlen(mControlTopic));
 }
@@ -155,7 +358,21 @@ const char* SensorGroup::getControlTopic() const {
     return mControlTopic;
 }
 
+const char* SensorGroup::getSchemaTopic() const {
+    return mSchemaTopic;
+}
+
+uint8_t SensorGroup::getQoS() const {
+    return mQoS;
+}
+
+SensorGroup::PublishPolicy SensorGroup::getPublishPolicy() const {
+    return mPublishPolicy;
+}
+
 void SensorGroup::createTopics() {
+    compileTemplate();
+
     memset(mTopic, 0, MQTTMessage::MQTT_MAX_TOPIC_LENGTH);
 
     if(!strlen(mName) || !strlen(mLocation)) {
@@ -171,4 +388,179 @@ void SensorGroup::createTopics() {
     snprintf(mControlTopic, MQTTMessage::MQTT_MAX_TOPIC_LENGTH, "%s/control",
         mTopic
     );
+
+    snprintf(mSchemaTopic, MQTTMessage::MQTT_MAX_TOPIC_LENGTH, "%s/schema",
+        mTopic
+    );
+}
+
+int SensorGroup::writeSensorLayout(char* buffer, int bufferSize) const {
+    // Each sensor's block is [status][data length][data], at a fixed offset in the frame. Field
+    // offsets are from the start of the sensor's data
+    int offset = RAW_FRAME_HEADER_SIZE;
+    int written = 0;
+
+    auto append = [&](const char* format, auto... args) {
+        if(written < bufferSize) {
+            written += snprintf(buffer + written, bufferSize - written, format, args...);
+        }
+    };
+
+    append("[");
+    for(int i = 0; i < mSensors.size(); ++i) {
+        const Sensor* s = mSensors[i];
+        Sensor::DataLayout layout = s->getDataLayout();
+
+        append("%s{\"type\":%d,\"name\":\"%s\",\"offset\":%d,\"size\":%d,\"fields\":[",
+            i ? "," : "",
+            s->getSensorTypeID(),
+            layout.mSensorName,
+            offset,
+            s->getRawDataSize()
+        );
+
+        for(int f = 0; f < layout.mFieldCount; ++f) {
+            const Sensor::FieldDescriptor& field = layout.mFields[f];
+            append("%s{\"name\":\"%s\",\"type\":\"%s\"",
+                f ? "," : "",
+                field.mName,
+                Sensor::getFieldTypeName(field.mType)
+            );
+            if(field.mType != Sensor::FIELD_BYTES) {
+                append(",\"offset\":%d", field.mOffset);
+            }
+            if(field.mUnit) {
+                append(",\"unit\":\"%s\"", field.mUnit);
+            }
+            if(field.mCountField >= 0) {
+                append(",\"count\":\"%s\"", layout.mFields[field.mCountField].mName);
+            }
+            append("}");
+        }
+        append("]}");
+
+        offset += s->getRawDataSize() + 2;
+    }
+    append("]");
+
+    return (written < bufferSize) ? written : 0;
+}
+
+void SensorGroup::compileTemplate() {
+    mTemplateText.clear();
+    mTemplateSlots.clear();
+
+    const char* typeKey = mShortKeys ? SENSOR_TYPE_SHORT_KEY : SENSOR_TYPE_KEY;
+    const char* statusKey = mShortKeys ? SENSOR_STATUS_SHORT_KEY : SENSOR_STATUS_KEY;
+    const char* separator = mShortKeys ? "," : ", ";
+    char text[64];
+
+    for(int i = 0; i < mSensors.size(); ++i) {
+        const Sensor* s = mSensors[i];
+        Sensor::DataLayout layout = s->getDataLayout();
+
+        // The sensor's type never changes, so it's part of the static text
+        snprintf(text, sizeof(text), mShortKeys ? "%s{\"%s\":%d,\"%s\":" : "%s{\"%s\": %d, \"%s\": ",
+            i ? "," : "[",
+            typeKey,
+            s->getSensorTypeID(),
+            statusKey
+        );
+        addTemplateSlot(text, SLOT_STATUS);
+
+        // Arrays and trailing bytes depend on the data itself, so those sensors are left to
+        // their serializers
+        bool fixedLayout = (layout.mFieldCount > 0);
+        for(int f = 0; f < layout.mFieldCount; ++f) {
+            if((layout.mFields[f].mCountField >= 0) || (layout.mFields[f].mType == Sensor::FIELD_BYTES)) {
+                fixedLayout = false;
+            }
+        }
+
+        if(fixedLayout) {
+            for(int f = 0; f < layout.mFieldCount; ++f) {
+                const Sensor::FieldDescriptor& field = layout.mFields[f];
+                snprintf(text, sizeof(text), mShortKeys ? "%s\"%s\":" : "%s\"%s\": ",
+                    separator,
+                    mShortKeys ? field.mShortName : field.mName
+                );
+                addTemplateSlot(text, SLOT_FIELD, field.mType, field.mOffset);
+            }
+        } else {
+            addTemplateSlot(separator, SLOT_SERIALIZER);
+        }
+
+        addTemplateSlot("}", SLOT_SENSOR_END);
+    }
+}
+
+void SensorGroup::addTemplateSlot(const char* text, TemplateSlotType type, Sensor::FieldType fieldType, uint8_t dataOffset) {
+    TemplateSlot slot;
+    slot.mTextOffset = mTemplateText.size();
+    slot.mTextLength = strlen(text);
+    slot.mType = type;
+    slot.mFieldType = fieldType;
+    slot.mDataOffset = dataOffset;
+
+    mTemplateText.append(text);
+    mTemplateSlots.push_back(slot);
+}
+
+int SensorGroup::renderTemplate(uint8_t* sensorDataBuffer, char* jsonBuffer, int jsonBufferSize) const {
+    const char* templateText = mTemplateText.c_str();
+    const char* bufferEnd = jsonBuffer + jsonBufferSize - 2;       // Room for the closing bracket and terminator
+    char* writePtr = jsonBuffer;
+    uint8_t* blockPtr = sensorDataBuffer;
+    int sensorIndex = 0;
+    uint8_t dataLength = 0;
+
+    for(auto& slot : mTemplateSlots) {
+        // Sensors without data only get their type and status
+        if(((slot.mType == SLOT_FIELD) || (slot.mType == SLOT_SERIALIZER)) && !dataLength) {
+            continue;
+        }
+
+        if((writePtr + slot.mTextLength + MAX_FORMATTED_NUMBER_LENGTH) > bufferEnd) {
+            DEBUG_PRINT(0, "JSON payload for %s overflows buffer", mName);
+            jsonBuffer[0] = 0;
+            return 0;
+        }
+
+        memcpy(writePtr, templateText + slot.mTextOffset, slot.mTextLength);
+        writePtr += slot.mTextLength;
+
+        // Each sensor's block is [status][data length][data]
+        switch(slot.mType) {
+            case SLOT_STATUS:
+                dataLength = blockPtr[1];
+                writePtr = formatUnsigned(writePtr, blockPtr[0]);
+                break;
+
+            case SLOT_FIELD:
+                writePtr = formatField(writePtr, slot.mFieldType, blockPtr + 2 + slot.mDataOffset);
+                break;
+
+            case SLOT_SERIALIZER: {
+                int available = bufferEnd - writePtr;
+                int written = Sensor::getDataAsJSON(mSensors[sensorIndex]->getSensorTypeID(), blockPtr + 2, dataLength, writePtr, available);
+                if(written >= available) {
+                    DEBUG_PRINT(0, "JSON payload for %s overflows buffer", mName);
+                    jsonBuffer[0] = 0;
+                    return 0;
+                }
+                writePtr += written;
+                break;
+            }
+
+            case SLOT_SENSOR_END:
+                blockPtr += mSensors[sensorIndex]->getRawDataSize() + 2;
+                ++sensorIndex;
+                break;
+        }
+    }
+
+    *writePtr++ = ']';
+    *writePtr++ = 0;
+
+    return (writePtr - jsonBuffer);
 }
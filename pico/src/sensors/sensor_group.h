@@ -17,31 +17,97 @@ using std::initializer_list;
 
 class SensorGroup {
     public:
-        SensorGroup(initializer_list<Sensor*> sensors);
+        // How queued messages from this group are handled when the broker can't keep up
+        enum PublishPolicy {
+            PUBLISH_LATEST,         // Telemetry - only the newest reading matters
+            PUBLISH_ALL             // Events - every message is sent, in order
+        };
+
+        // Compiled JSON payload. The static text - brackets, keys and sensor types - is built once by
+        // compileTemplate(), so rendering a payload only has to format the numbers
+        enum TemplateSlotType : uint8_t {
+            SLOT_STATUS,            // Starts a sensor's block
+            SLOT_FIELD,             // One of the sensor's data fields, skipped when it has no data
+            SLOT_SERIALIZER,        // Data the template can't describe, written by the sensor's JSON serializer
+            SLOT_SENSOR_END         // Closes the sensor's block
+        };
+
+        struct TemplateSlot {
+            uint16_t mTextOffset;           // Static text written before the slot's value
+            uint8_t mTextLength;
+            TemplateSlotType mType;
+            Sensor::FieldType mFieldType;
+            uint8_t mDataOffset;
+        };
+
+        SensorGroup(initializer_list<Sensor*> sensors, uint8_t qos = 0, PublishPolicy policy = PUBLISH_LATEST, int8_t coreAffinity = ANY_CORE);
 
         void initializeSensors();
         void shutdown();
-        void update(absolute_time_t currentTime);
+
+        // Updates each sensor, which write their data blocks straight into the frame at sensorDataBuffer
+        bool update(absolute_time_t currentTime, SensorDataMessage* frame, uint8_t* sensorDataBuffer);
 
         uint32_t getRawDataSize() const;
-        void packSensorData(uint8_t* sensorDataBuffer, uint16_t bufferSize) const;
+        int getSensorCount() const { return mSensors.size(); }
+        uint16_t getSensorRawDataSize(int index) const { return mSensors[index]->getRawDataSize(); }
+        const Sensor& getSensor(int index) const { return *mSensors[index]; }
         int unpackSensorDataToJSON(uint8_t* sensorDataBuffer, int bufferSize, char* jsonBuffer, int jsonBufferSize) const;
+
+        // Builds the JSON with printf rather than the template. Used until the template is compiled
+        int formatSensorDataToJSON(uint8_t* sensorDataBuffer, int bufferSize, char* jsonBuffer, int jsonBufferSize) const;
+        int unpackSensorDataToCBOR(uint8_t* sensorDataBuffer, int bufferSize, uint8_t* cborBuffer, int cborBufferSize) const;
+
+        // Raw frames are the packed sensor data behind a small header (sequence number and schema ID),
+        // described by the group's schema
+        int packRawFrame(uint8_t* sensorDataBuffer, int bufferSize, uint8_t* frameBuffer, int frameBufferSize) const;
+        int writeSchema(char* buffer, int bufferSize, int groupIndex) const;
+        uint16_t getSchemaID() const { return mSchemaID; }
+        static void setFrameSequence(uint8_t* frame, uint16_t sequence);
         bool handleSensorControlCommand(SensorControlMessage& message);
 
         void setName(const char* name);
         void setLocation(const char* location);
+        void setShortKeys(bool shortKeys);
         bool hasTopics() const;
         const char* getTopic() const;
         const char* getControlTopic() const;
+        const char* getSchemaTopic() const;
+        uint8_t getQoS() const;
+        PublishPolicy getPublishPolicy() const;
+
+        // Core the group's updates have to run on, for sensors sharing hardware with something else
+        // on that core. ANY_CORE if they can run on either
+        int8_t getCoreAffinity() const { return mCoreAffinity; }
+
+        static constexpr int8_t ANY_CORE                = -1;
+        static constexpr int RAW_FRAME_HEADER_SIZE      = 4;
+        static constexpr int RAW_FRAME_VERSION          = 1;
 
     private:
         void createTopics();
+        int writeSensorLayout(char* buffer, int bufferSize) const;
+        void compileTemplate();
+        void addTemplateSlot(const char* text, TemplateSlotType type, Sensor::FieldType fieldType = Sensor::FIELD_UINT8, uint8_t dataOffset = 0);
+        int renderTemplate(uint8_t* sensorDataBuffer, char* jsonBuffer, int jsonBufferSize) const;
+
+        static constexpr int MAX_FORMATTED_NUMBER_LENGTH    = 48;       // Enough for any float with two decimal places
 
         char mName[UserData::MAX_HOST_NAME_LENGTH + 1];
         char mLocation[UserData::MAX_GROUP_LOCATION_LENGTH + 1];
         char mTopic[MQTTMessage::MQTT_MAX_TOPIC_LENGTH];
         char mControlTopic[MQTTMessage::MQTT_MAX_TOPIC_LENGTH];
+        char mSchemaTopic[MQTTMessage::MQTT_MAX_TOPIC_LENGTH];
         vector<Sensor*> mSensors;
+        vector<uint8_t> mUpdateOrder;       // Sensors sorted by bus route, to keep multiplexer channel switches down
+        vector<uint16_t> mDataOffsets;      // Of each sensor's block in the raw data
+        uint8_t mQoS;           // MQTT QoS used when publishing this group's data
+        PublishPolicy mPublishPolicy;
+        int8_t mCoreAffinity;
+        uint16_t mSchemaID;     // Changes whenever the layout of the group's raw data does
+        bool mShortKeys;
+        string mTemplateText;
+        vector<TemplateSlot> mTemplateSlots;
 };
 
 #endif
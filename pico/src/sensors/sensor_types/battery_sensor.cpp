@@ -18,9 +18,13 @@ const uint BATTERY_CHARGE_PERIOD_MS = 20;                   // Time for capacito
 
 constexpr const char* VOLTAGE_JSON_KEY               = "voltage";
 
+constexpr Sensor::FieldDescriptor BATTERY_DATA_FIELDS[] = {
+    {VOLTAGE_JSON_KEY,         "v",     Sensor::FIELD_FLOAT,    "V",        0,                      -1}
+};
+
 
 BatteryVoltageSensor::BatteryVoltageSensor(int enablePin, int measurePin, int adcInput) :
-    Sensor(BATTERY_SENSOR, &BatteryVoltageSensor::serializeDataToJSON),
+    Sensor(BATTERY_SENSOR, &BatteryVoltageSensor::serializeDataToJSON, &BatteryVoltageSensor::serializeDataToCBOR),
     mEnableSensePin(enablePin),
     mBatteryMeasurePin(measurePin),
     mADCInput(adcInput)
@@ -62,6 +66,20 @@ int BatteryVoltageSensor::serializeDataToJSON(uint8_t* data, uint8_t dataSize, c
     );
 }
 
+int BatteryVoltageSensor::serializeDataToCBOR(uint8_t* data, uint8_t dataSize, CborWriter& writer) {
+    float voltage;
+    memcpy(&voltage, data, sizeof(float));
+
+    writer.writeText(VOLTAGE_JSON_KEY);
+    writer.writeFloat(voltage);
+
+    return 1;
+}
+
+Sensor::DataLayout BatteryVoltageSensor::getDataLayout() const {
+    return {"Battery", BATTERY_DATA_FIELDS, (sizeof(BATTERY_DATA_FIELDS) / sizeof(FieldDescriptor))};
+}
+
 Sensor::SensorUpdateResponse BatteryVoltageSensor::doUpdate(absolute_time_t currentTime, uint8_t *dataStorageBuffer, size_t bufferSize) {
     volatile uint adc_data = 0;
     float voltage = 0.f;
@@ -13,6 +13,8 @@ class BatteryVoltageSensor : public Sensor {
         virtual void shutdown();
 
         static int serializeDataToJSON(uint8_t* data, uint8_t dataSize, char* jsonBuffer, int jsonBufferSize);
+        static int serializeDataToCBOR(uint8_t* data, uint8_t dataSize, CborWriter& writer);
+        virtual DataLayout getDataLayout() const;
         virtual constexpr uint16_t getRawDataSize() const { return RAW_DATA_SIZE; }
         virtual uint32_t getDataCacheTimeout() const { return BATTERY_DATA_CACHE_TIME_MS; }
 
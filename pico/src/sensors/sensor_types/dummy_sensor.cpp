@@ -5,42 +5,187 @@
 #include "util/debug_io.h"
 
 #include <cstring>
+#include <cstdio>
+#include <cstdlib>
 
 using std::make_tuple;
 
 
 constexpr const char* DUMMY_INT_JSON_KEY               = "dummyInt";
 constexpr const char* DUMMY_FLOAT_JSON_KEY             = "dummyFloat";
+constexpr const char* DUMMY_PADDING_JSON_KEY           = "padding";
+constexpr const char* DUMMY_COUNT_FIELD_NAME           = "virtualSensors";
+
+// The float array's size is held in the virtual sensor count
+constexpr Sensor::FieldDescriptor DUMMY_DATA_FIELDS[] = {
+    {DUMMY_INT_JSON_KEY,       "di",    Sensor::FIELD_INT32,    nullptr,    0,                                  -1},
+    {DUMMY_COUNT_FIELD_NAME,   "vs",    Sensor::FIELD_UINT8,    nullptr,    sizeof(int),                        -1},
+    {DUMMY_FLOAT_JSON_KEY,     "df",    Sensor::FIELD_FLOAT,    nullptr,    (sizeof(int) + sizeof(uint8_t)),    1},
+    {DUMMY_PADDING_JSON_KEY,   "p",     Sensor::FIELD_BYTES,    nullptr,    0,                                  -1}
+};
+
+constexpr const char* WAVEFORM_NAMES[] = {
+    "CONST",
+    "RAMP",
+    "NOISE",
+    "STEP"
+};
 
 DummySensor::DummySensor() :
-    Sensor(DUMMY_SENSOR, &DummySensor::serializeDataToJSON),
+    Sensor(DUMMY_SENSOR, &DummySensor::serializeDataToJSON, &DummySensor::serializeDataToCBOR),
     mDummyInt(0),
-    mDummyFloat(0.f),
-    mNextUpdateTime(nil_time)
+    mNextUpdateTime(nil_time),
+    mUpdatePeriodMS(UPDATE_TIME_MS),
+    mPaddingSize(0),
+    mNumVirtualSensors(1),
+    mWaveform(WAVEFORM_NOISE)
 {}
 
 int DummySensor::serializeDataToJSON(uint8_t* data, uint8_t dataSize, char* jsonBuffer, int jsonBufferSize) {
     int intValue;
-    float floatValue;
+    uint8_t numVirtualSensors;
+    int written = 0;
 
     memcpy(&intValue, data, sizeof(int));
     data += sizeof(int);
-    memcpy(&floatValue, data, sizeof(float));
+    numVirtualSensors = *data++;
 
-    return sprintf(jsonBuffer,
-        "\"%s\": %d, \"%s\": %.2f",
-        DUMMY_INT_JSON_KEY, intValue,
-        DUMMY_FLOAT_JSON_KEY, floatValue
+    written += snprintf(jsonBuffer + written, jsonBufferSize - written,
+        "\"%s\": %d",
+        DUMMY_INT_JSON_KEY, intValue
     );
+
+    // First virtual sensor keeps the original key, any others get their index appended
+    for(int i = 0; (i < numVirtualSensors) && (written < jsonBufferSize); ++i) {
+        float floatValue;
+        memcpy(&floatValue, data, sizeof(float));
+        data += sizeof(float);
+
+        if(i == 0) {
+            written += snprintf(jsonBuffer + written, jsonBufferSize - written,
+                ", \"%s\": %.2f", DUMMY_FLOAT_JSON_KEY, floatValue
+            );
+        } else {
+            written += snprintf(jsonBuffer + written, jsonBufferSize - written,
+                ", \"%s%d\": %.2f", DUMMY_FLOAT_JSON_KEY, i, floatValue
+            );
+        }
+    }
+
+    // Whatever is left is padding, which we write out as hex
+    int paddingSize = dataSize - (sizeof(int) + sizeof(uint8_t) + (sizeof(float) * numVirtualSensors));
+    if((paddingSize > 0) && (written < jsonBufferSize)) {
+        written += snprintf(jsonBuffer + written, jsonBufferSize - written, ", \"%s\": \"", DUMMY_PADDING_JSON_KEY);
+        for(int i = 0; (i < paddingSize) && (written < jsonBufferSize); ++i) {
+            written += snprintf(jsonBuffer + written, jsonBufferSize - written, "%02X", data[i]);
+        }
+        if(written < jsonBufferSize) {
+            written += snprintf(jsonBuffer + written, jsonBufferSize - written, "\"");
+        }
+    }
+
+    return (written < jsonBufferSize) ? written : (jsonBufferSize - 1);
+}
+
+int DummySensor::serializeDataToCBOR(uint8_t* data, uint8_t dataSize, CborWriter& writer) {
+    int intValue;
+    uint8_t numVirtualSensors;
+    int pairs = 0;
+
+    memcpy(&intValue, data, sizeof(int));
+    data += sizeof(int);
+    numVirtualSensors = *data++;
+
+    writer.writeText(DUMMY_INT_JSON_KEY);
+    writer.writeInt(intValue);
+    ++pairs;
+
+    // Same keys as the JSON
+    for(int i = 0; i < numVirtualSensors; ++i) {
+        float floatValue;
+        memcpy(&floatValue, data, sizeof(float));
+        data += sizeof(float);
+
+        if(i == 0) {
+            writer.writeText(DUMMY_FLOAT_JSON_KEY);
+        } else {
+            char key[16];
+            snprintf(key, sizeof(key), "%s%d", DUMMY_FLOAT_JSON_KEY, i);
+            writer.writeText(key);
+        }
+        writer.writeFloat(floatValue);
+        ++pairs;
+    }
+
+    // Padding goes in as raw bytes rather than hex
+    int paddingSize = dataSize - (sizeof(int) + sizeof(uint8_t) + (sizeof(float) * numVirtualSensors));
+    if(paddingSize > 0) {
+        writer.writeText(DUMMY_PADDING_JSON_KEY);
+        writer.writeBytes(data, paddingSize);
+        ++pairs;
+    }
+
+    return pairs;
+}
+
+Sensor::DataLayout DummySensor::getDataLayout() const {
+    return {"Dummy", DUMMY_DATA_FIELDS, (sizeof(DUMMY_DATA_FIELDS) / sizeof(FieldDescriptor))};
 }
 
 bool DummySensor::handleSensorControlCommand(SensorControlMessage& message) {
-    if(message.mCommand == 0x44434241) {        // "ABCD"
-        DEBUG_PRINT(1, "+-------------------------+");
-        DEBUG_PRINT(1, "|      DUMMY SENSOR       |");
-        DEBUG_PRINT(1, "|     COMMAND HANDLED     |");
-        DEBUG_PRINT(1, "+-------------------------+");
-        return true;
+    // Command parameters aren't guaranteed to be terminated
+    char param[sizeof(message.mCommandParams) + 1];
+    memcpy(param, message.mCommandParams, sizeof(message.mCommandParams));
+    param[sizeof(message.mCommandParams)] = 0;
+
+    long value = strtol(param, nullptr, 10);
+
+    switch(message.mCommand) {
+        case DUMMY_TEST_COMMAND:
+            DEBUG_PRINT(1, "+-------------------------+");
+            DEBUG_PRINT(1, "|      DUMMY SENSOR       |");
+            DEBUG_PRINT(1, "|     COMMAND HANDLED     |");
+            DEBUG_PRINT(1, "+-------------------------+");
+            return true;
+
+        case DUMMY_SET_RATE:
+            if(value < 1) {
+                DEBUG_PRINT(1, "DUMMY SENSOR - Invalid update period (%s)", param);
+                return true;
+            }
+            mUpdatePeriodMS = value;
+            mNextUpdateTime = nil_time;
+            DEBUG_PRINT(1, "DUMMY SENSOR - Update period set to %dms", mUpdatePeriodMS);
+            return true;
+
+        case DUMMY_SET_PAYLOAD_SIZE:
+            if(value < 0 || value > MAX_PADDING_SIZE) {
+                DEBUG_PRINT(1, "DUMMY SENSOR - Invalid payload size (%s, max %d)", param, MAX_PADDING_SIZE);
+                return true;
+            }
+            mPaddingSize = value;
+            DEBUG_PRINT(1, "DUMMY SENSOR - Payload padding set to %d bytes", mPaddingSize);
+            return true;
+
+        case DUMMY_SET_WAVEFORM:
+            if(!parseWaveform(param, mWaveform)) {
+                DEBUG_PRINT(1, "DUMMY SENSOR - Unknown waveform (%s)", param);
+                return true;
+            }
+            DEBUG_PRINT(1, "DUMMY SENSOR - Waveform set to %s", WAVEFORM_NAMES[mWaveform]);
+            return true;
+
+        case DUMMY_SET_VIRTUAL_SENSORS:
+            if(value < 1 || value > MAX_VIRTUAL_SENSORS) {
+                DEBUG_PRINT(1, "DUMMY SENSOR - Invalid virtual sensor count (%s, max %d)", param, MAX_VIRTUAL_SENSORS);
+                return true;
+            }
+            mNumVirtualSensors = value;
+            DEBUG_PRINT(1, "DUMMY SENSOR - Virtual sensor count set to %d", mNumVirtualSensors);
+            return true;
+
+        default:
+            break;
     }
 
     return false;
@@ -48,25 +193,79 @@ bool DummySensor::handleSensorControlCommand(SensorControlMessage& message) {
 
 Sensor::SensorUpdateResponse DummySensor::doUpdate(absolute_time_t currentTime, uint8_t *dataStorageBuffer, size_t bufferSize) {
     if(is_nil_time(mNextUpdateTime) || absolute_time_diff_us(currentTime, mNextUpdateTime) <= 0) {
-
-        float randValue = static_cast<float>(get_rand_32()) / 0xFFFFFFFF; 
         mDummyInt++;
-        mDummyFloat += randValue;
 
-        memcpy(dataStorageBuffer, &mDummyInt, sizeof(int));
-        dataStorageBuffer += sizeof(int);
-        memcpy(dataStorageBuffer, &mDummyFloat, sizeof(float));
+        uint8_t* writePtr = dataStorageBuffer;
+        memcpy(writePtr, &mDummyInt, sizeof(int));
+        writePtr += sizeof(int);
+        *writePtr++ = mNumVirtualSensors;
 
-        int dataSize = (sizeof(int) + sizeof(float));
+        for(int i = 0; i < mNumVirtualSensors; ++i) {
+            float value = generateValue(i);
+            memcpy(writePtr, &value, sizeof(float));
+            writePtr += sizeof(float);
+        }
 
-        DEBUG_PRINT(1, "+---------------------+");
-        DEBUG_PRINT(1, "|     DUMMY VALUES    |");
-        DEBUG_PRINT(1, "|   INT: 0x%08X   |", mDummyInt);
-        DEBUG_PRINT(1, "| FLOAT: %12.2f |", mDummyFloat);
-        DEBUG_PRINT(1, "+---------------------+");
-        mNextUpdateTime = make_timeout_time_ms(UPDATE_TIME_MS);
+        for(int i = 0; i < mPaddingSize; ++i) {
+            *writePtr++ = (uint8_t) (mDummyInt + i);
+        }
+
+        int dataSize = (writePtr - dataStorageBuffer);
+
+        DEBUG_PRINT_VERBOSE(1, "+---------------------+");
+        DEBUG_PRINT_VERBOSE(1, "|     DUMMY VALUES    |");
+        DEBUG_PRINT_VERBOSE(1, "|   INT: 0x%08X   |", mDummyInt);
+        DEBUG_PRINT_VERBOSE(1, "| SIZE: %3d bytes     |", dataSize);
+        DEBUG_PRINT_VERBOSE(1, "+---------------------+");
+
+        // Schedule from the previous deadline so high rates don't drift, unless we have fallen
+        // more than a whole period behind
+        if(is_nil_time(mNextUpdateTime) || absolute_time_diff_us(mNextUpdateTime, currentTime) > (mUpdatePeriodMS * 1000)) {
+            mNextUpdateTime = delayed_by_ms(currentTime, mUpdatePeriodMS);
+        } else {
+            mNextUpdateTime = delayed_by_ms(mNextUpdateTime, mUpdatePeriodMS);
+        }
 
         return make_tuple(SENSOR_OK, dataSize);
     }
     return make_tuple(SENSOR_OK_NO_DATA, 0);
 }
+
+float DummySensor::generateValue(int virtualSensorIndex) {
+    // Offset each virtual sensor so they are distinguishable
+    float base = 10.f * (virtualSensorIndex + 1);
+
+    switch(mWaveform) {
+        case WAVEFORM_CONSTANT:
+            return base;
+
+        case WAVEFORM_RAMP:
+            return base + (mDummyInt % RAMP_LENGTH);
+
+        case WAVEFORM_STEP:
+            return ((mDummyInt / STEP_LENGTH) % 2) ? (base * 2) : base;
+
+        case WAVEFORM_NOISE:
+        default:
+            return base + (static_cast<float>(get_rand_32()) / 0xFFFFFFFF);
+    }
+}
+
+bool DummySensor::parseWaveform(const char* param, Waveform& waveform) {
+    for(int i = 0; i < (sizeof(WAVEFORM_NAMES) / sizeof(WAVEFORM_NAMES[0])); ++i) {
+        if(!strcmp(param, WAVEFORM_NAMES[i])) {
+            waveform = (Waveform) i;
+            return true;
+        }
+    }
+
+    // Also accept the numeric waveform value
+    char* end;
+    long value = strtol(param, &end, 10);
+    if((end != param) && (value >= WAVEFORM_CONSTANT) && (value <= WAVEFORM_STEP)) {
+        waveform = (Waveform) value;
+        return true;
+    }
+
+    return false;
+}
@@ -3,31 +3,71 @@
 
 #include "sensors/sensor.h"
 
+// Synthetic data source. By default this produces a counter and a random value every UPDATE_TIME_MS,
+// but the update rate, payload size, waveform and number of virtual sensors can all be changed through
+// sensor control commands so the firmware can be used as a load generator (see SYNTHETIC_LOAD in CMakeLists.txt)
 class DummySensor : public Sensor {
     public:
+        enum Waveform {
+            WAVEFORM_CONSTANT   = 0,
+            WAVEFORM_RAMP       = 1,
+            WAVEFORM_NOISE      = 2,
+            WAVEFORM_STEP       = 3
+        };
+
         DummySensor();
 
         virtual void reset() {}
         virtual void shutdown() {}
 
-        virtual constexpr uint16_t getRawDataSize() const { 
-            return sizeof(int) + sizeof(float);
+        virtual constexpr uint16_t getRawDataSize() const {
+            return RAW_DATA_SIZE;
         }
 
         static int serializeDataToJSON(uint8_t* data, uint8_t dataSize, char* jsonBuffer, int jsonBufferSize);
+        static int serializeDataToCBOR(uint8_t* data, uint8_t dataSize, CborWriter& writer);
+        virtual DataLayout getDataLayout() const;
         virtual bool handleSensorControlCommand(SensorControlMessage& message);
 
-        static const uint32_t RAW_DATA_SIZE = (sizeof(int) + sizeof(float));
+        static constexpr int MAX_VIRTUAL_SENSORS    = 8;
+        static constexpr int MAX_PADDING_SIZE       = 48;
+
+        // Counter, virtual sensor count, virtual sensor values and padding
+        static const uint32_t RAW_DATA_SIZE = (
+            sizeof(int) +
+            sizeof(uint8_t) +
+            (sizeof(float) * MAX_VIRTUAL_SENSORS) +
+            MAX_PADDING_SIZE
+        );
+
     protected:
         virtual void doInitialization() {}
         Sensor::SensorUpdateResponse doUpdate(absolute_time_t currentTime, uint8_t *dataStorageBuffer, size_t bufferSize);
 
     private:
-        static constexpr int UPDATE_TIME_MS     = 2000;
+        // Types of incoming control commands this sensor handles
+        enum DummyCommandType {
+            DUMMY_TEST_COMMAND          = 0x44434241,       // "ABCD"
+            DUMMY_SET_RATE              = 0x45544152,       // "RATE" - Update period in ms
+            DUMMY_SET_PAYLOAD_SIZE      = 0x455A4953,       // "SIZE" - Number of padding bytes
+            DUMMY_SET_WAVEFORM          = 0x45564157,       // "WAVE" - CONST, RAMP, NOISE or STEP
+            DUMMY_SET_VIRTUAL_SENSORS   = 0x534E5356        // "VSNS" - Number of virtual sensors
+        };
+
+        float generateValue(int virtualSensorIndex);
+        static bool parseWaveform(const char* param, Waveform& waveform);
+
+        static constexpr int UPDATE_TIME_MS         = 2000;
+        static constexpr int RAMP_LENGTH            = 100;      // Samples before the ramp wraps
+        static constexpr int STEP_LENGTH            = 20;       // Samples spent at each step level
 
         int mDummyInt;
-        float mDummyFloat;
         absolute_time_t mNextUpdateTime;
+
+        uint32_t mUpdatePeriodMS;
+        uint8_t mPaddingSize;
+        uint8_t mNumVirtualSensors;
+        Waveform mWaveform;
 };
 
 #endif      // _DUMMY_SENSOR_H_
@@ -3,7 +3,10 @@
 #include "sensors/hardware_interfaces/sensirion/common/sensirion_i2c.h"
 #include "sensors/hardware_interfaces/sensirion/common/sensirion_i2c_hal.h"
 #include "util/debug_io.h"
+#include "util/task_scheduler.h"
 
+#include "hardware/gpio.h"
+#include "hardware/irq.h"
 #include <cstring>
 
 using std::make_tuple;
@@ -12,6 +15,12 @@ constexpr const char* CO2_LEVEL_JSON_KEY               = "CO2";
 constexpr const char* TEMPERATURE_JSON_KEY             = "Temperature";
 constexpr const char* HUMIDITY_JSON_KEY                = "Humidity";
 
+constexpr Sensor::FieldDescriptor SCD30_DATA_FIELDS[] = {
+    {CO2_LEVEL_JSON_KEY,       "co2",   Sensor::FIELD_FLOAT,    "ppm",      0,                      -1},
+    {TEMPERATURE_JSON_KEY,     "tmp",   Sensor::FIELD_FLOAT,    "C",        sizeof(float),          -1},
+    {HUMIDITY_JSON_KEY,        "hum",   Sensor::FIELD_FLOAT,    "%RH",      (sizeof(float) * 2),    -1}
+};
+
 // Sensirion SCD30 variables
 extern i2c_inst_t *sensirion_i2c_inst;
 extern int sensirion_i2c_baud;
@@ -20,59 +29,113 @@ extern int sensirion_scl_pin;
 
 #define SCD30_WAIT_SLEEP()    (busy_wait_us_32(10))
 
-SCD30Sensor::SCD30Sensor(I2CInterface& i2c, uint8_t powerPin) :
-    Sensor{SCD30_SENSOR, &SCD30Sensor::serializeDataToJSON},
+// The sensor may not be fitted, so not finding it doesn't escalate
+constexpr I2CRetryPolicy::Retries SCD30_CONNECT_RETRIES     = {5,   I2CRetryPolicy::BACKOFF_FIXED,  1000,   1000};
+
+// Updates can't wait, so a failed read is tried again straight away and after that it's down to the
+// next update. A run of failed updates resets the bus, then bounces the sensor's power
+constexpr I2CRetryPolicy::Retries SCD30_READ_RETRIES        = {2,   I2CRetryPolicy::BACKOFF_FIXED,  0,      0};
+constexpr I2CRetryPolicy::Escalation SCD30_ESCALATION       = {3, 6};
+
+SCD30Sensor* SCD30Sensor::sReadySensors[MAX_READY_SENSORS] = {};
+
+SCD30Sensor::SCD30Sensor(I2CInterface& i2c, uint8_t powerPin, int readyPin) :
+    Sensor{SCD30_SENSOR, &SCD30Sensor::serializeDataToJSON, &SCD30Sensor::serializeDataToCBOR},
     mI2C(i2c),
     mPowerControlPin{powerPin},
-    mActive{false}
-{}
+    mReadyPin{readyPin},
+    mActive{false},
+    mReadyInterruptEnabled{false},
+    mDataReady{false},
+    mLastReadyTime{nil_time},
+    mBusTransactions{0},
+    mReadings{0}
+{
+    scd30_init_device(&mDevice, &mI2C, SCD30_I2C_ADDR_61);
+    mPolicy.setDevice(mI2C, SCD30_I2C_ADDR_61, SCD30_ESCALATION);
+}
 
-void SCD30Sensor::doInitialization() {
-    char serial[33];
+Task<> SCD30Sensor::initializationTask() {
     uint8_t firmwareMajor, firmwareMinor;
 
+    mActive = false;
+
     // Setup our power control pin
     gpio_init(mPowerControlPin);
     gpio_set_dir(mPowerControlPin, GPIO_OUT);
     gpio_pull_up(mPowerControlPin);
 
-    sleep_ms(2);
+    co_await sleepFor(2);
 
     gpio_put(mPowerControlPin, 0);
 
     // Initialize I2C lib
-    init_driver(SCD30_I2C_ADDR_61);
-    sensirion_i2c_hal_init(&mI2C);
-
-    // See if we can get access
-    while (scd30_await_data_ready()) {
-        sensirion_i2c_hal_sleep_usec(1000000u);
+    sensirion_i2c_hal_init(mDevice.i2c);
+
+    // See if we can get access, waiting a while for the sensor's first measurement. If it doesn't
+    // answer we give up and leave it inactive, and initialization is tried again later
+    setInitStage(INIT_CONNECTING);
+    mPolicy.begin(SCD30_CONNECT_RETRIES, false);
+    absolute_time_t dataReadyTimeout = make_timeout_time_ms(SCD30_DATA_READY_TIMEOUT_MS);
+    while(true) {
+        uint16_t dataReady = 0;
+        if(scd30_get_data_ready(&mDevice, &dataReady)) {
+            if(mPolicy.complete(false)) {
+                DEBUG_PRINT(1, "SCD30 not responding");
+                setInitStage(INIT_FAILED);
+                co_return;
+            }
+            co_await sleepFor(mPolicy.getBackoffMS());
+        } else if(!dataReady && (absolute_time_diff_us(dataReadyTimeout, get_absolute_time()) < 0)) {
+            co_await sleepFor(SCD30_DATA_READY_POLL_PERIOD_MS);
+        } else {
+            // Either it has a measurement, or it isn't measuring yet and startReadings() will fix that
+            mPolicy.complete(true);
+            break;
+        }
     }
 
     // Validate we can communicate with the SCD30
-    mActive = !scd30_read_firmware_version(&firmwareMajor, &firmwareMinor);
+    setInitStage(INIT_CONFIGURING);
+    mActive = !scd30_read_firmware_version(&mDevice, &firmwareMajor, &firmwareMinor);
     DEBUG_PRINT(1, "SCD30 firmware: 0x%0X-0x%0X", firmwareMajor, firmwareMinor);
 
-    startReadings();
+    co_await startReadings();
+
+    if(!mActive) {
+        setInitStage(INIT_FAILED);
+    } else if(mReadyPin != NO_READY_PIN) {
+        enableReadyInterrupt();
+    }
 }
 
 void SCD30Sensor::reset() {
+    // A sensor which had the bus stuck is fine again once it's been clocked free, so it only needs
+    // starting again rather than its power bouncing
+    if(mI2C.recoverStuckBus() == I2CInterface::BUS_RECOVERED) {
+        startInitialization(initializationTask());
+        return;
+    }
+
     shutdown();
+    startInitialization(powerCycle());
+}
 
+Task<> SCD30Sensor::powerCycle() {
     // Bounce the power to the sensor
-    sleep_ms(2);
+    co_await sleepFor(2);
     gpio_put(mPowerControlPin, 1);
-    sleep_ms(2);
+    co_await sleepFor(2);
     gpio_put(mPowerControlPin, 0);
-    sleep_ms(2);
+    co_await sleepFor(2);
 
-    initialize();
+    co_await initializationTask();
 }
 
 void SCD30Sensor::shutdown() {
-    scd30_stop_periodic_measurement();
+    scd30_stop_periodic_measurement(&mDevice);
     SCD30_WAIT_SLEEP();
-    sensirion_i2c_hal_free();
+    sensirion_i2c_hal_free(mDevice.i2c);
 }           
 
 bool SCD30Sensor::handleSensorControlCommand(SensorControlMessage& message) {
@@ -105,14 +168,14 @@ void SCD30Sensor::setTemperatureOffset(double offset) {
     uint16_t offsetInt = (uint16_t) (offset * 100);
 
     // Pause readings while we set the offset (not sure if we need to do this but it seems like a good idea)
-    scd30_stop_periodic_measurement();
+    scd30_stop_periodic_measurement(&mDevice);
 
     DEBUG_PRINT(1, " -- Setting temperature offset to: %d", offsetInt);
-    scd30_set_temperature_offset(offsetInt);
+    scd30_set_temperature_offset(&mDevice, offsetInt);
 
     // Restart readings
-    scd30_set_measurement_interval(SCD30_MEASUREMENT_INTERVAL_SECONDS);
-    scd30_start_periodic_measurement(0);
+    scd30_set_measurement_interval(&mDevice, SCD30_MEASUREMENT_INTERVAL_SECONDS);
+    scd30_start_periodic_measurement(&mDevice, 0);
 }
 
 void SCD30Sensor::setForcedRecalibrationValue(uint16_t frc) {
@@ -122,14 +185,14 @@ void SCD30Sensor::setForcedRecalibrationValue(uint16_t frc) {
     }
 
     // Pause readings while we set the offset (not sure if we need to do this but it seems like a good idea)
-    scd30_stop_periodic_measurement();
+    scd30_stop_periodic_measurement(&mDevice);
 
     DEBUG_PRINT(1, " -- Setting FRC to: %d", frc);
-    scd30_force_recalibration(frc);
+    scd30_force_recalibration(&mDevice, frc);
 
     // Restart readings
-    scd30_set_measurement_interval(SCD30_MEASUREMENT_INTERVAL_SECONDS);
-    scd30_start_periodic_measurement(0);
+    scd30_set_measurement_interval(&mDevice, SCD30_MEASUREMENT_INTERVAL_SECONDS);
+    scd30_start_periodic_measurement(&mDevice, 0);
 }
 
 int SCD30Sensor::serializeDataToJSON(uint8_t* data, uint8_t dataSize, char* jsonBuffer, int jsonBufferSize) {
@@ -148,6 +211,28 @@ int SCD30Sensor::serializeDataToJSON(uint8_t* data, uint8_t dataSize, char* json
     );
 }
 
+int SCD30Sensor::serializeDataToCBOR(uint8_t* data, uint8_t dataSize, CborWriter& writer) {
+    float co2, temp, humidity;
+    memcpy(&co2, data, sizeof(float));
+    data += sizeof(float);
+    memcpy(&temp, data, sizeof(float));
+    data += sizeof(float);
+    memcpy(&humidity, data, sizeof(float));
+
+    writer.writeText(CO2_LEVEL_JSON_KEY);
+    writer.writeFloat(co2);
+    writer.writeText(TEMPERATURE_JSON_KEY);
+    writer.writeFloat(temp);
+    writer.writeText(HUMIDITY_JSON_KEY);
+    writer.writeFloat(humidity);
+
+    return 3;
+}
+
+Sensor::DataLayout SCD30Sensor::getDataLayout() const {
+    return {"SCD30", SCD30_DATA_FIELDS, (sizeof(SCD30_DATA_FIELDS) / sizeof(FieldDescriptor))};
+}
+
 Sensor::SensorUpdateResponse SCD30Sensor::doUpdate(absolute_time_t currentTime, uint8_t *dataStorageBuffer, size_t bufferSize) {
     Sensor::SensorUpdateResponse response = make_tuple(SENSOR_INACTIVE, 0);
 
@@ -157,18 +242,48 @@ Sensor::SensorUpdateResponse SCD30Sensor::doUpdate(absolute_time_t currentTime,
 
     get<0>(response) = SENSOR_INACTIVE;
 
+    // With RDY wired there's nothing to ask the sensor until it has a measurement for us
+    ReadyState readyState = getReadyState(currentTime);
+    if(readyState == READY_NO) {
+        get<0>(response) = SENSOR_OK_NO_DATA;
+        return response;
+    }
+
     uint16_t dataReady;
-    if(!scd30_get_data_ready(&dataReady)) {
-        if(dataReady) {
-            float co2Reading;
-            float temperatureReading;
-            float humidityReading;
+    bool readyCheckFailed;
+    bool readFailed;
+    float co2Reading;
+    float temperatureReading;
+    float humidityReading;
+
+    mPolicy.begin(SCD30_READ_RETRIES);
+    do {
+        dataReady = 1;
+        readyCheckFailed = false;
+        if(readyState == READY_UNKNOWN) {
+            ++mBusTransactions;
+            readyCheckFailed = scd30_get_data_ready(&mDevice, &dataReady);
+        }
 
-            if(!scd30_read_measurement_data(
+        readFailed = false;
+        if(!readyCheckFailed && dataReady) {
+            ++mBusTransactions;
+            readFailed = scd30_read_measurement_data(
+                &mDevice,
                 &co2Reading,
                 &temperatureReading,
                 &humidityReading
-            )) {
+            );
+        }
+    } while(!mPolicy.complete(!readyCheckFailed && !readFailed));
+
+    if(mPolicy.takeSensorResetRequest()) {
+        requestReset();
+    }
+
+    if(!readyCheckFailed) {
+        if(dataReady) {
+            if(!readFailed) {
                 // Good data, copy it into the output buffer
                 float* writePtr = reinterpret_cast<float*>(dataStorageBuffer);
                 *writePtr = co2Reading;
@@ -179,12 +294,14 @@ Sensor::SensorUpdateResponse SCD30Sensor::doUpdate(absolute_time_t currentTime,
 
                 get<0>(response) = SENSOR_OK;
                 get<1>(response) = sizeof(float) * 3;
+                ++mReadings;
 
                 DEBUG_PRINT(1, "+--------------------------------+");
                 DEBUG_PRINT(1, "|             SCD30              |");
                 DEBUG_PRINT(1, "|         SCD30 CO2: %7.2f PPM |", co2Reading);
                 DEBUG_PRINT(1, "| SCD30 Temperature: %5.2f °C    |", temperatureReading);
                 DEBUG_PRINT(1, "|    SCD30 Humidity: %5.2f%%      |", humidityReading);
+                DEBUG_PRINT(1, "|   I2C commands/reading: %4.2f   |", (float) mBusTransactions / mReadings);
                 DEBUG_PRINT(1, "+--------------------------------+");
             } else {
                 // No data when we were told there was data available. This may indiciate a sensor issue
@@ -215,11 +332,73 @@ Sensor::SensorUpdateResponse SCD30Sensor::doUpdate(absolute_time_t currentTime,
     return response;
 }
 
-void SCD30Sensor::startReadings() {
+void SCD30Sensor::enableReadyInterrupt() {
+    // Only set up the first time, resets just pick up where it is now
+    if(!mReadyInterruptEnabled) {
+        int slot = 0;
+        while((slot < MAX_READY_SENSORS) && sReadySensors[slot]) {
+            ++slot;
+        }
+        if(slot == MAX_READY_SENSORS) {
+            DEBUG_PRINT(1, "SCD30 - no room for another RDY interrupt, polling instead");
+            return;
+        }
+
+        sReadySensors[slot] = this;
+        mReadyInterruptEnabled = true;
+
+        gpio_init(mReadyPin);
+        gpio_set_dir(mReadyPin, GPIO_IN);
+        gpio_pull_down(mReadyPin);
+        gpio_add_raw_irq_handler(mReadyPin, onReadyInterrupt);
+        gpio_set_irq_enabled(mReadyPin, GPIO_IRQ_EDGE_RISE, true);
+        irq_set_enabled(IO_IRQ_BANK0, true);
+    }
+
+    // A measurement may already be waiting, in which case there won't be an edge for it
+    mLastReadyTime = get_absolute_time();
+    mDataReady = gpio_get(mReadyPin);
+}
+
+SCD30Sensor::ReadyState SCD30Sensor::getReadyState(absolute_time_t currentTime) {
+    if(!mReadyInterruptEnabled) {
+        return READY_UNKNOWN;
+    }
+
+    if(mDataReady) {
+        mDataReady = false;
+        mLastReadyTime = currentTime;
+        return READY_YES;
+    }
+
+    // An edge may have been missed (RDY stays high until the data is read), so ask now and again
+    if(absolute_time_diff_us(mLastReadyTime, currentTime) > (SCD30_DATA_READY_TIMEOUT_MS * 1000)) {
+        mLastReadyTime = currentTime;
+        return READY_UNKNOWN;
+    }
+
+    return READY_NO;
+}
+
+void SCD30Sensor::onReadyInterrupt() {
+    for(SCD30Sensor* sensor : sReadySensors) {
+        if(!sensor) {
+            break;
+        }
+
+        uint pin = sensor->mReadyPin;
+        if(gpio_get_irq_event_mask(pin) & GPIO_IRQ_EDGE_RISE) {
+            gpio_acknowledge_irq(pin, GPIO_IRQ_EDGE_RISE);
+            sensor->mDataReady = true;
+        }
+    }
+}
+
+Task<> SCD30Sensor::startReadings() {
     if(mActive) {
-        scd30_set_measurement_interval(SCD30_MEASUREMENT_INTERVAL_SECONDS);
-        sensirion_i2c_hal_sleep_usec(20000u);
-        scd30_start_periodic_measurement(0);
+        scd30_set_measurement_interval(&mDevice, SCD30_MEASUREMENT_INTERVAL_SECONDS);
+        co_await sleepFor(20);
+        scd30_start_periodic_measurement(&mDevice, 0);
     }
 }
 
@@ -3,10 +3,15 @@
 
 #include "sensors/sensor.h"
 #include "sensors/hardware_interfaces/sensor_i2c_interface.h"
+#include "sensors/hardware_interfaces/i2c_retry_policy.h"
+#include "sensors/hardware_interfaces/sensirion/common/sensirion_i2c.h"
 
 class SCD30Sensor : public Sensor {
     public:
-        SCD30Sensor(I2CInterface& i2c, uint8_t powerPin);
+        // With the RDY pin wired, measurements are only read once the sensor says it has one.
+        // Without it we have to ask over I2C every update. Each sensor keeps its own driver context,
+        // so there can be several on different buses
+        SCD30Sensor(I2CInterface& i2c, uint8_t powerPin, int readyPin = NO_READY_PIN);
 
         virtual void reset();
         virtual void shutdown();                
@@ -17,11 +22,15 @@ class SCD30Sensor : public Sensor {
         void setForcedRecalibrationValue(uint16_t frc);
 
         static int serializeDataToJSON(uint8_t* data, uint8_t dataSize, char* jsonBuffer, int jsonBufferSize);
+        static int serializeDataToCBOR(uint8_t* data, uint8_t dataSize, CborWriter& writer);
+        virtual DataLayout getDataLayout() const;
         virtual constexpr uint16_t getRawDataSize() const { return RAW_DATA_SIZE; }
+        virtual uint16_t getBusRoute() const { return mI2C.getRoute(); }
         
         static const uint32_t RAW_DATA_SIZE = (sizeof(float) * 3);
+        static constexpr int NO_READY_PIN   = -1;
     protected:
-        virtual void doInitialization();
+        virtual Task<> initializationTask();
         virtual Sensor::SensorUpdateResponse doUpdate(absolute_time_t currentTime, uint8_t *dataStorageBuffer, size_t bufferSize);
 
     private:
@@ -31,16 +40,40 @@ class SCD30Sensor : public Sensor {
             SCD30_SET_FRC               = 0x00435246        // "FRC"
         };
 
-        void startReadings();
+        Task<> startReadings();
+        Task<> powerCycle();
+        // Whether the RDY pin says there's a measurement waiting. UNKNOWN means we have to ask
+        enum ReadyState {
+            READY_NO,
+            READY_YES,
+            READY_UNKNOWN
+        };
+
+        void enableReadyInterrupt();
+        ReadyState getReadyState(absolute_time_t currentTime);
+        static void onReadyInterrupt();
         void handleSetTemperatureOffsetCommand(const char *commandParam);
         void handleSetFRCCommand(const char *commandParam);
         
 
         static constexpr int SCD30_MEASUREMENT_INTERVAL_SECONDS      = 2;
+        static constexpr uint32_t SCD30_DATA_READY_POLL_PERIOD_MS    = 100;
+        static constexpr uint32_t SCD30_DATA_READY_TIMEOUT_MS        = SCD30_MEASUREMENT_INTERVAL_SECONDS * 1000 * 2;
+        static constexpr int MAX_READY_SENSORS                       = 4;
+
+        static SCD30Sensor* sReadySensors[MAX_READY_SENSORS];      // The RDY interrupt has no context of its own
 
         I2CInterface& mI2C;
+        sensirion_i2c_device_t mDevice;
+        I2CRetryPolicy mPolicy;
         uint8_t mPowerControlPin;
+        int mReadyPin;
         bool mActive;
+        bool mReadyInterruptEnabled;
+        volatile bool mDataReady;                   // Set from the RDY interrupt
+        absolute_time_t mLastReadyTime;
+        uint32_t mBusTransactions;                  // Commands sent while updating, for comparing with/without RDY
+        uint32_t mReadings;
 };
 
 #endif      // _SCD30_SENSOR_H_
@@ -1,6 +1,7 @@
 #include "sonar_sensor.h"
 #include "uart_rx.pio.h"
 #include "util/debug_io.h"
+#include "util/task_scheduler.h"
 #include "pico/time.h"
 
 #include <tuple>
@@ -15,10 +16,14 @@ using std::get;
 constexpr const char* DISTANCE_JSON_KEY     = "distance";
 constexpr const char PACKET_HEADER          = 0xFF;
 
+constexpr Sensor::FieldDescriptor SONAR_DATA_FIELDS[] = {
+    {DISTANCE_JSON_KEY,        "d",     Sensor::FIELD_UINT16,   "mm",       0,                      -1}
+};
+
 
 SonarSensor::SonarSensor(
     PIOWrapper &pioWrapper, int stateMachineID, int txPin, int rxPin, int baud, ConnectionIO& connectionIO) :
-    Sensor(Sensor::SONAR_SENSOR, &SonarSensor::serializeDataToJSON),
+    Sensor(Sensor::SONAR_SENSOR, &SonarSensor::serializeDataToJSON, &SonarSensor::serializeDataToCBOR),
     mPIOWrapper(pioWrapper),
     mStateMachineID(stateMachineID),
     mTXPin(txPin),
@@ -56,12 +61,16 @@ void SonarSensor::doInitialization() {
 
 void SonarSensor::reset() {
     // Not much we can do here
-    gpio_put(mTXPin, 0);
-
     mCurrentBufferPos = 0;
 
-    sleep_ms(1);
+    if(!startTask(restartTransmitting())) {
+        DEBUG_PRINT(1, "Couldn't reset sonar");
+    }
+}
 
+Task<> SonarSensor::restartTransmitting() {
+    gpio_put(mTXPin, 0);
+    co_await sleepFor(1);
     gpio_put(mTXPin, 1);
 }
 
@@ -81,6 +90,20 @@ int SonarSensor::serializeDataToJSON(uint8_t* data, uint8_t dataSize, char* json
     );
 }
 
+int SonarSensor::serializeDataToCBOR(uint8_t* data, uint8_t dataSize, CborWriter& writer) {
+    uint16_t distance;
+    memcpy(&distance, data, sizeof(uint16_t));
+
+    writer.writeText(DISTANCE_JSON_KEY);
+    writer.writeUnsigned(distance);
+
+    return 1;
+}
+
+Sensor::DataLayout SonarSensor::getDataLayout() const {
+    return {"Sonar", SONAR_DATA_FIELDS, (sizeof(SONAR_DATA_FIELDS) / sizeof(FieldDescriptor))};
+}
+
 Sensor::SensorUpdateResponse SonarSensor::doUpdate(absolute_time_t currentTime, uint8_t *dataStorageBuffer, size_t bufferSize) {
     mConnectionIO.update();
 
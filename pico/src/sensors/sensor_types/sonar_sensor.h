@@ -23,6 +23,8 @@ class SonarSensor : public Sensor {
         virtual constexpr uint16_t getRawDataSize() const { return RAW_DATA_SIZE; }
         
         static int serializeDataToJSON(uint8_t* data, uint8_t dataSize, char* jsonBuffer, int jsonBufferSize);
+        static int serializeDataToCBOR(uint8_t* data, uint8_t dataSize, CborWriter& writer);
+        virtual DataLayout getDataLayout() const;
 
         static const uint32_t RAW_DATA_SIZE = sizeof(uint16_t);
 
@@ -32,6 +34,7 @@ class SonarSensor : public Sensor {
 
     private:
         static void initializeSonarPIO(PIOWrapper& pioWrapper);
+        Task<> restartTransmitting();
 
         static constexpr int SONAR_SENSOR_PACKET_SIZE   = 4;
 
@@ -1,6 +1,7 @@
 #include "stemma_soil_sensor.h"
 
 #include "util/debug_io.h"
+#include "util/task_scheduler.h"
 
 #include <tuple>
 #include <cstring>
@@ -14,77 +15,125 @@ const uint8_t SEESAW_STATUS_HW_ID               = 0x01;
 const uint8_t SEESAW_STATUS_SWRST               = 0x7F;
 const uint8_t SEESAW_HW_ID_CODE                 = 0x55;
 const uint8_t SEESAW_STATUS_VERSION             = 0x02;
+const uint8_t SEESAW_STATUS_TEMP                = 0x04;
 const uint8_t SEESAW_TOUCH_BASE                 = 0x0F;
 const uint8_t SEESAW_TOUCH_CHANNEL_OFFSET       = 0x10;
 
+constexpr const char* PROBE_COUNT_FIELD_NAME    = "ProbeCount";
 constexpr const char* SOIL_MOISTURE_JSON_KEY    = "SoilMoisture";
+constexpr const char* SOIL_TEMPERATURE_JSON_KEY = "SoilTemperature";
+
+constexpr int MOISTURE_DATA_OFFSET              = sizeof(uint8_t);
+constexpr int TEMPERATURE_DATA_OFFSET           = MOISTURE_DATA_OFFSET + (sizeof(uint16_t) * StemmaSoilSensor::MAX_PROBES);
+
+constexpr Sensor::FieldDescriptor STEMMA_DATA_FIELDS[] = {
+    {PROBE_COUNT_FIELD_NAME,    "pc",   Sensor::FIELD_UINT8,    nullptr,    0,                          -1},
+    {SOIL_MOISTURE_JSON_KEY,    "sm",   Sensor::FIELD_UINT16,   "%",        MOISTURE_DATA_OFFSET,       0},
+    {SOIL_TEMPERATURE_JSON_KEY, "st",   Sensor::FIELD_FLOAT,    "C",        TEMPERATURE_DATA_OFFSET,    0}
+};
+
+// Touch is the moisture reading. Temperature comes back as 16.16 fixed point
+enum SweepIndex {
+    SWEEP_MOISTURE,
+    SWEEP_TEMPERATURE,
+
+    NUM_SWEEPS
+};
+
+// Probes which aren't fitted just won't answer, so looking for them doesn't escalate
+constexpr I2CRetryPolicy::Retries PROBE_SCAN_RETRIES    = {10,  I2CRetryPolicy::BACKOFF_FIXED,  2,  2};
+constexpr I2CRetryPolicy::Retries PROBE_ID_RETRIES      = {10,  I2CRetryPolicy::BACKOFF_FIXED,  0,  0};
+
+// Only probes which didn't answer are swept again
+constexpr I2CRetryPolicy::Retries SWEEP_RETRIES         = {3,   I2CRetryPolicy::BACKOFF_LINEAR, 2,  10};
+
+// Each failed measurement counts once. A probe can't be power cycled, so its reset is a software one
+constexpr I2CRetryPolicy::Escalation PROBE_ESCALATION   = {3, 6};
 
 
 StemmaSoilSensor::StemmaSoilSensor(I2CInterface& i2cInterface, uint8_t address) :
-    Sensor(Sensor::STEMMA_SOIL_SENSOR, &StemmaSoilSensor::serializeDataToJSON),
-    mI2CInterface(i2cInterface),
-    mAddress(address),
-    mActive(false)
+    StemmaSoilSensor(i2cInterface, {address})
 {}
 
-void StemmaSoilSensor::doInitialization() {
+StemmaSoilSensor::StemmaSoilSensor(I2CInterface& i2cInterface, initializer_list<uint8_t> addresses) :
+    Sensor(Sensor::STEMMA_SOIL_SENSOR, &StemmaSoilSensor::serializeDataToJSON, &StemmaSoilSensor::serializeDataToCBOR),
+    mI2CInterface(i2cInterface),
+    mProbes{},
+    mProbeCount(0),
+    mActive(false),
+    mMeasuring(false),
+    mMeasurementTaken(false),
+    mSweepTimeUS(0),
+    mReadings{}
+{
+    for(uint8_t address : addresses) {
+        if(mProbeCount < MAX_PROBES) {
+            Probe& probe = mProbes[mProbeCount++];
+            probe.mAddress = address;
+            probe.mMoisture = STEMMA_SOIL_SENSOR_INVALID_READING;
+            probe.mPolicy.setDevice(mI2CInterface, address, PROBE_ESCALATION);
+        }
+    }
+}
+
+Task<> StemmaSoilSensor::initializationTask() {
     mI2CInterface.initSensorBus();
 
-    uint8_t response = 0x33;
     mActive = false;
+    mMeasurementTaken = false;
 
-    // Scan bus for device at given address
-    bool found = false;
-    for (int retries = 0; retries < 10; retries++) {
-        if(mI2CInterface.checkI2CAddress(mAddress) == I2C_RESPONSE_OK) {
-            found = true;
-            break;
-        }
-        sleep_ms(2);
+    // Probes which don't answer are left out of the measurements until the sensor is next reset
+    setInitStage(INIT_CONNECTING);
+    for(int i = 0; i < mProbeCount; ++i) {
+        mProbes[i].mActive = co_await initializeProbe(mProbes[i]);
+        mActive = mActive || mProbes[i].mActive;
     }
 
-    if (!found) {
-        return;
+    if(!mActive) {
+        setInitStage(INIT_FAILED);
     }
+}
 
-    // Reset device
-    found = false;
-    for (int retries = 0; retries < 10; retries++) {
-        if(mI2CInterface.checkI2CAddress(mAddress) == I2C_RESPONSE_OK) {
-            found = true;
-            break;
-        }
-        sleep_ms(2);
+Task<bool> StemmaSoilSensor::initializeProbe(Probe& probe) {
+    uint8_t response = 0x33;
+
+    // Scan bus for device at given address
+    probe.mPolicy.begin(PROBE_SCAN_RETRIES, false);
+    while(!probe.mPolicy.complete(mI2CInterface.checkI2CAddress(probe.mAddress) == I2C_RESPONSE_OK)) {
+        co_await sleepFor(probe.mPolicy.getBackoffMS());
     }
 
-    if (!found) {
-        return;
-    } else {
-        reset();
+    if(!probe.mPolicy.succeeded()) {
+        co_return false;
     }
 
-    sleep_ms(2);
+    // Reset device
+    resetProbe(probe.mAddress);
 
-    // Get hardware ID from device
-    found = false;
-    for (int retries = 0; !found && retries < 10; retries++) {
-        mI2CInterface.readFromI2CRegister(mAddress,  SEESAW_STATUS_BASE, SEESAW_STATUS_HW_ID, &response, 1, 4);
+    co_await sleepFor(2);
+    setInitStage(INIT_CONFIGURING);
 
-        if(response == SEESAW_HW_ID_CODE) {
-            found = true;
-            break;
-        }
-    }
+    // Get hardware ID from device. The version check below decides whether it's usable
+    probe.mPolicy.begin(PROBE_ID_RETRIES, false);
+    do {
+        co_await mI2CInterface.readFromI2CRegisterAsync(probe.mAddress,  SEESAW_STATUS_BASE, SEESAW_STATUS_HW_ID, &response, 1, 4);
+    } while(!probe.mPolicy.complete(response == SEESAW_HW_ID_CODE));
 
-    mActive = (getVersion() != STEMMA_SOIL_SENSOR_INVALID_READING);
+    co_return ((co_await getVersion(probe.mAddress)) != STEMMA_SOIL_SENSOR_INVALID_READING);
 }
 
 void StemmaSoilSensor::reset() {
+    for(int i = 0; i < mProbeCount; ++i) {
+        resetProbe(mProbes[i].mAddress);
+    }
+}
+
+void StemmaSoilSensor::resetProbe(uint8_t address) {
     const uint8_t resetBuffer[] = {
         0xFF
     };
 
-    mI2CInterface.writeToI2CRegister(mAddress, SEESAW_STATUS_BASE, SEESAW_STATUS_SWRST, resetBuffer, 1);
+    mI2CInterface.writeToI2CRegister(address, SEESAW_STATUS_BASE, SEESAW_STATUS_SWRST, resetBuffer, 1);
 }
 
 void StemmaSoilSensor::shutdown() {
@@ -92,13 +141,69 @@ void StemmaSoilSensor::shutdown() {
 }
 
 int StemmaSoilSensor::serializeDataToJSON(uint8_t* data, uint8_t dataSize, char* jsonBuffer, int jsonBufferSize) {
-    uint16_t moisture;
-    memcpy(&moisture, data, sizeof(uint16_t));
+    uint8_t probeCount = data[0];
+    int written = 0;
+
+    // As with other arrays the first probe keeps the plain keys and the others get their index
+    // appended. Probes which didn't give a reading are left out
+    for(int i = 0; (i < probeCount) && (written < jsonBufferSize); ++i) {
+        uint16_t moisture;
+        float temperature;
+        memcpy(&moisture, data + MOISTURE_DATA_OFFSET + (i * sizeof(uint16_t)), sizeof(uint16_t));
+        memcpy(&temperature, data + TEMPERATURE_DATA_OFFSET + (i * sizeof(float)), sizeof(float));
+
+        if(moisture == STEMMA_SOIL_SENSOR_INVALID_READING) {
+            continue;
+        }
+
+        char index[4] = "";
+        if(i) {
+            snprintf(index, sizeof(index), "%d", i);
+        }
+
+        written += snprintf(jsonBuffer + written, jsonBufferSize - written,
+            "%s\"%s%s\": %d, \"%s%s\": %.2f",
+            written ? ", " : "",
+            SOIL_MOISTURE_JSON_KEY, index, moisture,
+            SOIL_TEMPERATURE_JSON_KEY, index, temperature
+        );
+    }
 
-    return snprintf(jsonBuffer, jsonBufferSize,
-        "\"%s\": %d",
-        SOIL_MOISTURE_JSON_KEY, moisture
-    );
+    return written;
+}
+
+int StemmaSoilSensor::serializeDataToCBOR(uint8_t* data, uint8_t dataSize, CborWriter& writer) {
+    uint8_t probeCount = data[0];
+    int pairs = 0;
+
+    // Same keys as the JSON
+    for(int i = 0; i < probeCount; ++i) {
+        uint16_t moisture;
+        float temperature;
+        memcpy(&moisture, data + MOISTURE_DATA_OFFSET + (i * sizeof(uint16_t)), sizeof(uint16_t));
+        memcpy(&temperature, data + TEMPERATURE_DATA_OFFSET + (i * sizeof(float)), sizeof(float));
+
+        if(moisture == STEMMA_SOIL_SENSOR_INVALID_READING) {
+            continue;
+        }
+
+        char key[24];
+        snprintf(key, sizeof(key), i ? "%s%d" : "%s", SOIL_MOISTURE_JSON_KEY, i);
+        writer.writeText(key);
+        writer.writeUnsigned(moisture);
+
+        snprintf(key, sizeof(key), i ? "%s%d" : "%s", SOIL_TEMPERATURE_JSON_KEY, i);
+        writer.writeText(key);
+        writer.writeFloat(temperature);
+
+        pairs += 2;
+    }
+
+    return pairs;
+}
+
+Sensor::DataLayout StemmaSoilSensor::getDataLayout() const {
+    return {"StemmaSoil", STEMMA_DATA_FIELDS, (sizeof(STEMMA_DATA_FIELDS) / sizeof(FieldDescriptor))};
 }
 
 Sensor::SensorUpdateResponse StemmaSoilSensor::doUpdate(absolute_time_t currentTime, uint8_t *dataStorageBuffer, size_t bufferSize) {
@@ -106,75 +211,217 @@ Sensor::SensorUpdateResponse StemmaSoilSensor::doUpdate(absolute_time_t currentT
         return make_tuple(SENSOR_INACTIVE, 0);
     }
 
-    uint16_t capValue = getCapacitiveValue();
-    if(capValue != StemmaSoilSensor::STEMMA_SOIL_SENSOR_INVALID_READING) {
-        DEBUG_PRINT(1, "+--------------------------------+");
-        DEBUG_PRINT(1, "|      Stemma Soil Sensor        |");
-        DEBUG_PRINT(1, "| Soil moisture: %4d            |", capValue);
-        DEBUG_PRINT(1, "+--------------------------------+\n");
-
-        memcpy(dataStorageBuffer, &capValue, sizeof(uint16_t));
-        return make_tuple(SENSOR_OK, sizeof(uint16_t));
-    } else {
-        // Got an invalid reading, might be something up with the port
-        DEBUG_PRINT(1, "+--------------------------------+");
-        DEBUG_PRINT(1, "|      Stemma Soil Sensor        |");
-        DEBUG_PRINT(1, "|       * MALFUNCTION *          |", capValue);
-        DEBUG_PRINT(1, "+--------------------------------+\n");
+    if(mMeasuring) {
+        // Still waiting on the sensor
+        return make_tuple(SENSOR_OK_NO_DATA, 0);
+    }
+
+    // Readings are taken in the background between updates, so we report the ones taken since the
+    // last update and start on the next
+    bool measurementTaken = mMeasurementTaken;
+    uint16_t moisture[MAX_PROBES];
+    float temperature[MAX_PROBES];
+    bool anyValid = false;
+    for(int i = 0; i < mProbeCount; ++i) {
+        moisture[i] = mProbes[i].mMoisture;
+        temperature[i] = mProbes[i].mTemperature;
+        anyValid = anyValid || (moisture[i] != STEMMA_SOIL_SENSOR_INVALID_READING);
+    }
+
+    mMeasurementTaken = false;
+    mMeasuring = true;
+    if(!startTask(takeMeasurement())) {
+        mMeasuring = false;
+    }
+
+    if(!measurementTaken) {
+        return make_tuple(SENSOR_OK_NO_DATA, 0);
+    }
+
+    DEBUG_PRINT(1, "+--------------------------------+");
+    DEBUG_PRINT(1, "|      Stemma Soil Sensor        |");
+    for(int i = 0; i < mProbeCount; ++i) {
+        if(moisture[i] != STEMMA_SOIL_SENSOR_INVALID_READING) {
+            DEBUG_PRINT(1, "| 0x%02x: %3d%% %6.2fC  bus %4dus |", mProbes[i].mAddress, moisture[i], temperature[i], mProbes[i].mBusTimeUS);
+        } else {
+            DEBUG_PRINT(1, "| 0x%02x:   * MALFUNCTION *       |", mProbes[i].mAddress);
+        }
+    }
+    DEBUG_PRINT(1, "| Sweep: %6dus                 |", mSweepTimeUS);
+    DEBUG_PRINT(1, "+--------------------------------+\n");
+
+    if(!anyValid) {
+        // Nothing from any of the probes, might be something up with the port
         return make_tuple(SENSOR_MALFUNCTIONING, 0);
     }
 
-    // No idea how we got here, but it's not good
-    return make_tuple(SENSOR_MALFUNCTIONING, 0);
+    memset(dataStorageBuffer, 0, RAW_DATA_SIZE);
+    dataStorageBuffer[0] = mProbeCount;
+    memcpy(dataStorageBuffer + MOISTURE_DATA_OFFSET, moisture, sizeof(uint16_t) * mProbeCount);
+    memcpy(dataStorageBuffer + TEMPERATURE_DATA_OFFSET, temperature, sizeof(float) * mProbeCount);
+
+    return make_tuple(SENSOR_OK, RAW_DATA_SIZE);
+}
+
+Task<> StemmaSoilSensor::takeMeasurement() {
+    static constexpr Sweep SWEEPS[NUM_SWEEPS] = {
+        {SEESAW_TOUCH_BASE,     SEESAW_TOUCH_CHANNEL_OFFSET,    sizeof(uint16_t),   5},
+        {SEESAW_STATUS_BASE,    SEESAW_STATUS_TEMP,             sizeof(uint32_t),   1}
+    };
+
+    absolute_time_t startTime = get_absolute_time();
+    uint8_t activeMask = 0;
+    for(int i = 0; i < mProbeCount; ++i) {
+        activeMask |= mProbes[i].mActive ? (1 << i) : 0;
+        mProbes[i].mMoisture = STEMMA_SOIL_SENSOR_INVALID_READING;
+        mProbes[i].mBusTimeUS = 0;
+    }
+
+    for(int sweep = 0; sweep < NUM_SWEEPS; ++sweep) {
+        uint8_t pendingMask = activeMask;
+        uint8_t failedMask = 0;
+        for(int i = 0; i < mProbeCount; ++i) {
+            if(pendingMask & (1 << i)) {
+                mProbes[i].mPolicy.begin(SWEEP_RETRIES);
+            }
+        }
+
+        while(pendingMask) {
+            uint8_t readMask = co_await runSweep(SWEEPS[sweep], pendingMask);
+
+            for(int i = 0; i < mProbeCount; ++i) {
+                if(!(readMask & (1 << i))) {
+                    continue;
+                }
+
+                const uint8_t* buf = mReadings[i];
+                if(sweep == SWEEP_MOISTURE) {
+                    uint16_t value = ((uint16_t) buf[0] << 8) | buf[1];
+                    if(value < CAPACITIVE_READING_MIN) {
+                        value = CAPACITIVE_READING_MIN;
+                    } else if(value > CAPACITIVE_READING_MAX) {
+                        value = CAPACITIVE_READING_MAX;
+                    }
+
+                    mProbes[i].mMoisture = ((value - CAPACITIVE_READING_MIN) * 100) / (CAPACITIVE_READING_MAX - CAPACITIVE_READING_MIN);
+                } else {
+                    int32_t value = ((uint32_t) buf[0] << 24) | ((uint32_t) buf[1] << 16) | ((uint32_t) buf[2] << 8) | buf[3];
+                    mProbes[i].mTemperature = value / 65536.0f;
+                }
+            }
+
+            // Every probe still pending is on the same attempt, so they share a backoff
+            uint8_t retryMask = 0;
+            uint32_t backoffMS = 0;
+            for(int i = 0; i < mProbeCount; ++i) {
+                if(!(pendingMask & (1 << i))) {
+                    continue;
+                }
+
+                I2CRetryPolicy& policy = mProbes[i].mPolicy;
+                if(!policy.complete(readMask & (1 << i))) {
+                    retryMask |= (1 << i);
+                    backoffMS = policy.getBackoffMS();
+                } else if(!policy.succeeded()) {
+                    failedMask |= (1 << i);
+                }
+            }
+
+            pendingMask = retryMask;
+            if(pendingMask) {
+                co_await sleepFor(backoffMS);
+            }
+        }
+
+        // A probe is only reported if it gave both readings
+        if(sweep == SWEEP_MOISTURE) {
+            activeMask &= ~failedMask;
+        } else {
+            for(int i = 0; i < mProbeCount; ++i) {
+                if(failedMask & (1 << i)) {
+                    mProbes[i].mMoisture = STEMMA_SOIL_SENSOR_INVALID_READING;
+                }
+            }
+        }
+    }
+
+    for(int i = 0; i < mProbeCount; ++i) {
+        if(mProbes[i].mPolicy.takeSensorResetRequest()) {
+            resetProbe(mProbes[i].mAddress);
+        }
+    }
+
+    mSweepTimeUS = absolute_time_diff_us(startTime, get_absolute_time());
+    mMeasurementTaken = true;
+    mMeasuring = false;
 }
 
-uint32_t StemmaSoilSensor::getVersion() {
+Task<uint8_t> StemmaSoilSensor::runSweep(Sweep sweep, uint8_t probeMask) {
+    I2CBusArbiter& arbiter = mI2CInterface.getArbiter();
+    uint8_t sentMask = 0;
+    uint8_t readMask = 0;
+
+    // Start every probe's conversion back to back, on one grant of the bus
+    I2CBusArbiter::AsyncRequest request = I2CBusArbiter::makeAsyncRequest();
+    while(!arbiter.tryAcquire(request)) {
+        co_await sleepFor(I2CBusArbiter::RETRY_PERIOD_MS);
+    }
+
+    for(int i = 0; i < mProbeCount; ++i) {
+        if(probeMask & (1 << i)) {
+            absolute_time_t startTime = get_absolute_time();
+            if(mI2CInterface.writeToI2CRegister(mProbes[i].mAddress, sweep.mRegBase, sweep.mReg, 0, 0) == I2C_RESPONSE_OK) {
+                sentMask |= (1 << i);
+            }
+            mProbes[i].mBusTimeUS += absolute_time_diff_us(startTime, get_absolute_time());
+        }
+    }
+
+    arbiter.release();
+
+    if(!sentMask) {
+        co_return 0;
+    }
+
+    // One wait covers all of the conversions, rather than one after another
+    co_await sleepFor(sweep.mConversionDelayMS);
+
+    request = I2CBusArbiter::makeAsyncRequest(get_absolute_time());
+    while(!arbiter.tryAcquire(request)) {
+        co_await sleepFor(I2CBusArbiter::RETRY_PERIOD_MS);
+    }
+
+    for(int i = 0; i < mProbeCount; ++i) {
+        if(sentMask & (1 << i)) {
+            absolute_time_t startTime = get_absolute_time();
+            if(mI2CInterface.readFromI2C(mProbes[i].mAddress, mReadings[i], sweep.mReadSize) == I2C_RESPONSE_OK) {
+                readMask |= (1 << i);
+            }
+            mProbes[i].mBusTimeUS += absolute_time_diff_us(startTime, get_absolute_time());
+        }
+    }
+
+    arbiter.release();
+
+    co_return readMask;
+}
+
+Task<uint32_t> StemmaSoilSensor::getVersion(uint8_t address) {
     uint8_t buf[4];
 
-    if(mI2CInterface.readFromI2CRegister(
-        mAddress, 
+    if(co_await mI2CInterface.readFromI2CRegisterAsync(
+        address,
         SEESAW_STATUS_BASE,
-        SEESAW_STATUS_VERSION, 
+        SEESAW_STATUS_VERSION,
         buf,
         4,
         100
     ) != I2C_RESPONSE_OK) {
-        return STEMMA_SOIL_SENSOR_INVALID_READING;
+        co_return STEMMA_SOIL_SENSOR_INVALID_READING;
     }
 
-    return (((uint) buf[0] << 24) | 
+    co_return (((uint) buf[0] << 24) |
             ((uint) buf[1] << 16) |
             ((uint) buf[2] << 8) |
             (uint) buf[3]);
 }
-
-uint16_t StemmaSoilSensor::getCapacitiveValue() {
-    static const uint16_t READ_DELAY_MS = 5;
-    static const uint16_t NUM_RETRIES = 3;
-    static const int READING_BUFFER_SIZE = 2;
-    
-    uint8_t buf[READING_BUFFER_SIZE];
-    uint16_t ret = STEMMA_SOIL_SENSOR_INVALID_READING;
-
-    for(uint8_t retry = 0; retry < NUM_RETRIES; retry++) {
-        if(mI2CInterface.readFromI2CRegister(
-            mAddress,
-            SEESAW_TOUCH_BASE, 
-            SEESAW_TOUCH_CHANNEL_OFFSET, 
-            buf, 
-            READING_BUFFER_SIZE, 
-            READ_DELAY_MS
-        ) == I2C_RESPONSE_OK) {
-            ret = ((uint16_t) buf[0] << 8) | buf[1];
-
-            if(ret < CAPACITIVE_READING_MIN) {
-                ret = CAPACITIVE_READING_MIN;
-            } else if(ret > CAPACITIVE_READING_MAX) {
-                ret = CAPACITIVE_READING_MAX;
-            }
-
-            ret = ((ret - CAPACITIVE_READING_MIN) * 100) / (CAPACITIVE_READING_MAX - CAPACITIVE_READING_MIN);
-        }
-    }
-    return ret;
-}
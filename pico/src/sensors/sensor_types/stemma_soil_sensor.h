@@ -4,9 +4,17 @@
 
 #include "sensors/sensor.h"
 #include "sensors/hardware_interfaces/sensor_i2c_interface.h"
+#include "sensors/hardware_interfaces/i2c_retry_policy.h"
 #include "pico/types.h"
 
+#include <initializer_list>
 
+using std::initializer_list;
+
+
+// One or more Adafruit Stemma soil probes sharing a bus. Each measurement is a sweep across all of
+// the probes - the touch command goes to every probe, one wait covers all of their conversions, then
+// they are read back in turn, and the same again for temperature
 class StemmaSoilSensor : public Sensor {
     public:
         enum Addresses {
@@ -17,16 +25,28 @@ class StemmaSoilSensor : public Sensor {
         };
 
         StemmaSoilSensor(I2CInterface& i2cInterface, uint8_t address);
+        StemmaSoilSensor(I2CInterface& i2cInterface, initializer_list<uint8_t> addresses);
 
         virtual void reset();
         virtual void shutdown();
 
         static int serializeDataToJSON(uint8_t* data, uint8_t dataSize, char* jsonBuffer, int jsonBufferSize);
+        static int serializeDataToCBOR(uint8_t* data, uint8_t dataSize, CborWriter& writer);
+        virtual DataLayout getDataLayout() const;
         virtual constexpr uint16_t getRawDataSize() const { return RAW_DATA_SIZE; }
+        virtual uint16_t getBusRoute() const { return mI2CInterface.getRoute(); }
 
-        static const uint32_t RAW_DATA_SIZE = sizeof(uint16_t);
+        static constexpr int MAX_PROBES = 4;
+
+        // [probe count][moisture per probe][temperature per probe], with room for every probe so the
+        // temperatures are always at the same offset
+        static const uint32_t RAW_DATA_SIZE = (
+            sizeof(uint8_t) +
+            (sizeof(uint16_t) * MAX_PROBES) +
+            (sizeof(float) * MAX_PROBES)
+        );
     protected:
-        virtual void doInitialization();
+        virtual Task<> initializationTask();
         virtual SensorUpdateResponse doUpdate(absolute_time_t currentTime, uint8_t *dataStorageBuffer, size_t bufferSize);
 
         constexpr static uint16_t STEMMA_SOIL_SENSOR_INVALID_READING    = -1;
@@ -34,12 +54,39 @@ class StemmaSoilSensor : public Sensor {
         constexpr static uint16_t CAPACITIVE_READING_MAX                = 1000;
 
     private:
-        uint32_t getVersion();
-        uint16_t getCapacitiveValue();
+        // A register read from every probe in one go
+        struct Sweep {
+            uint8_t mRegBase;
+            uint8_t mReg;
+            uint8_t mReadSize;
+            uint16_t mConversionDelayMS;
+        };
+
+        struct Probe {
+            uint8_t mAddress;
+            bool mActive;
+            uint16_t mMoisture;
+            float mTemperature;
+            uint32_t mBusTimeUS;            // Bus held for this probe during the last measurement
+            I2CRetryPolicy mPolicy;
+        };
+
+        Task<bool> initializeProbe(Probe& probe);
+        Task<uint32_t> getVersion(uint8_t address);
+        void resetProbe(uint8_t address);
+
+        // Returns a bit per probe which was read, into mReadings
+        Task<uint8_t> runSweep(Sweep sweep, uint8_t probeMask);
+        Task<> takeMeasurement();
 
         I2CInterface& mI2CInterface;
-        uint8_t mAddress;
+        Probe mProbes[MAX_PROBES];
+        uint8_t mProbeCount;
         bool mActive;
+        volatile bool mMeasuring;           // A measurement task is running
+        volatile bool mMeasurementTaken;    // The probes hold readings not yet reported
+        uint32_t mSweepTimeUS;              // Start to finish of the last measurement
+        uint8_t mReadings[MAX_PROBES][sizeof(uint32_t)];
 };
 
 #endif      // _STEMMA_SOIL_SENSOR_H_
@@ -1,6 +1,7 @@
 #include "serial_controller.h"
 
 #include "util/debug_io.h"
+#include "lwip/ip_addr.h"
 #include <cstring>
 
 bool isTerminatingChar(int c) {
@@ -8,7 +9,8 @@ bool isTerminatingChar(int c) {
 }
 
 SerialController::SerialController() : 
-    mBufferLength(0)
+    mBufferLength(0),
+    mOverflowed(false)
 {
     memset(mBuffer, 0, SerialController::COMMAND_BUFFER_SIZE);
 }
@@ -16,19 +18,26 @@ SerialController::SerialController() :
 bool SerialController::updateUserData(UserData& userData) {
     bool userDataUpdated = false;
 
+    // Only takes what has already arrived, we're woken again when there's more
     bool readLoop = true;
     while(readLoop) {
-        int readResponse = getchar_timeout_us(2000);        // Timeout = 2ms
+        int readResponse = getchar_timeout_us(0);
         if(readResponse != PICO_ERROR_TIMEOUT) {
             if(isTerminatingChar(readResponse)) {
                 // Completed 
-                if(mBufferLength) {
+                if(mOverflowed) {
+                    DEBUG_PRINT(0, "Serial command too long (max %d characters), ignored", COMMAND_BUFFER_SIZE - 1);
+                } else if(mBufferLength) {
                     userDataUpdated = processSerialCommand(userData);
                 }
                 mBufferLength = 0;
+                mOverflowed = false;
                 memset(mBuffer, 0, SerialController::COMMAND_BUFFER_SIZE);
-            } else {
+            } else if(mBufferLength < (COMMAND_BUFFER_SIZE - 1)) {
                 mBuffer[mBufferLength++] = (char) readResponse;
+            } else {
+                // Too long to be a command, so the whole line is thrown away once it ends
+                mOverflowed = true;
             }
         } else {
             readLoop = false;
@@ -101,9 +110,75 @@ bool SerialController::processSerialCommand(UserData& userData) {
             userData.setSensorGroupLocation(groupIndex, commandParams);
             userDataUpdated = true;
             break;
+        case CMD_STIP: {
+            UserData::StaticIPConfig config = {};
+            commandParams = mBuffer + 4;
+            DEBUG_PRINT(0, "Setting static IP (%s)", commandParams);
+            if(parseStaticIP(mBuffer + 4, config)) {
+                userData.setStaticIP(config);
+                userDataUpdated = true;
+            } else {
+                DEBUG_PRINT(0, "Invalid static IP, expected \"<address> <gateway> <netmask>\"");
+            }
+            break;
+        }
+        case CMD_BTCH: {
+            int mode = *(mBuffer + 4) - '0';
+            if((mode >= UserData::PUBLISH_PER_GROUP) && (mode <= UserData::PUBLISH_BATCH_ONLY)) {
+                DEBUG_PRINT(0, "Setting publish mode (%d)", mode);
+                userData.setPublishMode((UserData::PublishMode) mode);
+                userDataUpdated = true;
+            } else {
+                DEBUG_PRINT(0, "Invalid publish mode");
+            }
+            break;
+        }
+        case CMD_FRMT: {
+            int format = *(mBuffer + 4) - '0';
+            if((format >= UserData::PAYLOAD_JSON) && (format <= UserData::PAYLOAD_RAW)) {
+                DEBUG_PRINT(0, "Setting payload format (%d)", format);
+                userData.setPayloadFormat((UserData::PayloadFormat) format);
+                userDataUpdated = true;
+            } else {
+                DEBUG_PRINT(0, "Invalid payload format");
+            }
+            break;
+        }
+        case CMD_SKEY: {
+            int shortKeys = *(mBuffer + 4) - '0';
+            if((shortKeys == 0) || (shortKeys == 1)) {
+                DEBUG_PRINT(0, "Setting short keys (%d)", shortKeys);
+                userData.setShortKeys(shortKeys);
+                userDataUpdated = true;
+            } else {
+                DEBUG_PRINT(0, "Invalid short keys setting");
+            }
+            break;
+        }
         default:
             break;
     }
 
     return userDataUpdated;
 }
+
+bool SerialController::parseStaticIP(char *params, UserData::StaticIPConfig& config) {
+    // No parameters goes back to DHCP
+    if(!*params) {
+        return true;
+    }
+
+    ip_addr_t addresses[3];
+    char *token = strtok(params, " ");
+    for(int i = 0; i < 3; ++i) {
+        if(!token || !ipaddr_aton(token, &addresses[i])) {
+            return false;
+        }
+        token = strtok(nullptr, " ");
+    }
+
+    config.mIPAddress = ip_addr_get_ip4_u32(&addresses[0]);
+    config.mGateway = ip_addr_get_ip4_u32(&addresses[1]);
+    config.mNetmask = ip_addr_get_ip4_u32(&addresses[2]);
+    return true;
+}
@@ -13,6 +13,10 @@
 // WIPE - Wipes all user data
 // GRPN - Sets the name of a specific group
 // GRPL - Sets the location of a specific group
+// STIP - Sets a static IP address, gateway and netmask (empty to use DHCP)
+// BTCH - Sets the publish mode (0 = per group, 1 = per group and batched, 2 = batched only)
+// FRMT - Sets the payload format (0 = JSON, 1 = CBOR, 2 = raw frames)
+// SKEY - Sets whether JSON payloads use abbreviated keys (0 = full keys, 1 = short keys)
 enum SerialCommand {
     CMD_SSID = 0x53534944,
     CMD_PASS = 0x50415353,
@@ -20,7 +24,11 @@ enum SerialCommand {
     CMD_BRKR = 0x42524B52,
     CMD_WIPE = 0x57495045,
     CMD_GRPN = 0x4752504E,
-    CMD_GRPL = 0x4752504C
+    CMD_GRPL = 0x4752504C,
+    CMD_STIP = 0x53544950,
+    CMD_BTCH = 0x42544348,
+    CMD_FRMT = 0x46524D54,
+    CMD_SKEY = 0x534B4559
 };
 
 
@@ -32,11 +40,13 @@ class SerialController {
 
     private:
         bool processSerialCommand(UserData& userData);
+        bool parseStaticIP(char *params, UserData::StaticIPConfig& config);
 
         static constexpr int COMMAND_BUFFER_SIZE = 128;
 
         char mBuffer[COMMAND_BUFFER_SIZE];
         uint8_t mBufferLength;
+        bool mOverflowed;                   // Current line is longer than the buffer
 };
 
 #endif      // _SERIAL_CONTROLLER_H_
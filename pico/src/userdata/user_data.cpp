@@ -25,14 +25,23 @@ extern const int NUM_SENSOR_GROUPS;
     (VALID_DATA_KEY_LENGTH + 1)                                         \
 )
 
+constexpr const char* const EXTENDED_DATA_KEY   = "xXx Extended data xXx";
+constexpr int EXTENDED_DATA_KEY_LENGTH          = 21;
+#define EXTENDED_DATA_FLASH_SIZE  (                                     \
+    (EXTENDED_DATA_KEY_LENGTH + 1) +                                    \
+    sizeof(uint16_t) +                                                  \
+    sizeof(UserData::ExtendedData)                                      \
+)
+
 
 UserData::UserData() : 
     mHostName(MAX_HOST_NAME_LENGTH, 0),
     mSSID(MAX_SSID_LENGTH, 0),
     mPSK(MAX_PSK_LENGTH, 0),
-    mBrokerAddress(MAX_BROKER_LENGTH, 0)
+    mBrokerAddress(MAX_BROKER_LENGTH, 0),
+    mExtendedData{}
 {
-    mScratchMemory = new char[USER_DATA_FLASH_SIZE];
+    mScratchMemory = new char[USER_DATA_FLASH_SIZE + EXTENDED_DATA_FLASH_SIZE];
     mSensorGroupLocations = new string[NUM_SENSOR_GROUPS];
     mSensorGroupNames = new string[NUM_SENSOR_GROUPS];
 }
@@ -77,6 +86,36 @@ void UserData::setBrokerAddress(const char* brokerAddress) {
     mBrokerAddress = brokerAddress;
 }
 
+void UserData::setStaticIP(const StaticIPConfig& config) {
+    mExtendedData.mStaticIP = config;
+}
+
+void UserData::setNetworkCache(const NetworkCache& cache) {
+    mExtendedData.mNetworkCache = cache;
+}
+
+void UserData::setPublishMode(PublishMode mode) {
+    mExtendedData.mPublishMode = mode;
+}
+
+void UserData::setPayloadFormat(PayloadFormat format) {
+    mExtendedData.mPayloadFormat = format;
+}
+
+void UserData::setShortKeys(bool shortKeys) {
+    mExtendedData.mShortKeys = shortKeys;
+}
+
+void UserData::setI2CBaudRate(uint8_t bus, uint32_t baud) {
+    assert(bus < MAX_I2C_BUSES);
+
+    mExtendedData.mI2CBaudRates[bus] = baud;
+}
+
+void UserData::clearNetworkCache() {
+    memset(&mExtendedData.mNetworkCache, 0, sizeof(NetworkCache));
+}
+
 void UserData::wipe() {
     mHostName.clear();
     mSSID.clear();
@@ -87,15 +126,17 @@ void UserData::wipe() {
         mSensorGroupLocations[i].clear();
         mSensorGroupNames[i].clear();
     }
+
+    memset(&mExtendedData, 0, sizeof(ExtendedData));
 }
 
 void UserData::writeToFlash() {
     // Calculate the offset of flash memory at which our reserved memory area begins
-    uint32_t persistentBaseAddress = (uint32_t) ADDR_PERSISTENT_BASE_ADDR;
+    uintptr_t persistentBaseAddress = (uintptr_t) ADDR_PERSISTENT_BASE_ADDR;
     uint32_t offset = (persistentBaseAddress - XIP_BASE);
 
     // Calculate the total amount of flash space we will be writing
-    int userDataSize = USER_DATA_FLASH_SIZE;
+    int userDataSize = USER_DATA_FLASH_SIZE + EXTENDED_DATA_FLASH_SIZE;
     int writeSize = (userDataSize / FLASH_PAGE_SIZE) + 1;                       // How many flash pages our data requires
     int sectorCount = ((writeSize * FLASH_PAGE_SIZE) / FLASH_SECTOR_SIZE) + 1;  // How many flash sectors this takes up
         
@@ -107,6 +148,7 @@ void UserData::writeToFlash() {
     // to disable interrupts (and also the other core) while we are writing to flash and we don't want to do that for
     // longer than necessary
     serializeToByteArray(mScratchMemory, USER_DATA_FLASH_SIZE);
+    serializeExtendedData(mScratchMemory + USER_DATA_FLASH_SIZE);
 
     // Now copy into flash
     uint32_t interrupts = save_and_disable_interrupts();
@@ -118,7 +160,12 @@ void UserData::writeToFlash() {
 
 bool UserData::readFromFlash() {
     const char* flashContents = (const char *) ADDR_PERSISTENT;
-    return serializeFromByteArray(flashContents, USER_DATA_FLASH_SIZE);
+    if(!serializeFromByteArray(flashContents, USER_DATA_FLASH_SIZE)) {
+        return false;
+    }
+
+    serializeExtendedDataFrom(flashContents + USER_DATA_FLASH_SIZE);
+    return true;
 }
 
 const string& UserData::getSSID() const {
@@ -149,6 +196,40 @@ const string& UserData::getBrokerAddress() const {
     return mBrokerAddress;
 }
 
+bool UserData::hasStaticIP() const {
+    return (mExtendedData.mStaticIP.mIPAddress != 0);
+}
+
+const UserData::StaticIPConfig& UserData::getStaticIP() const {
+    return mExtendedData.mStaticIP;
+}
+
+bool UserData::hasNetworkCache() const {
+    return (mExtendedData.mNetworkCache.mIPAddress != 0);
+}
+
+const UserData::NetworkCache& UserData::getNetworkCache() const {
+    return mExtendedData.mNetworkCache;
+}
+
+UserData::PublishMode UserData::getPublishMode() const {
+    return mExtendedData.mPublishMode;
+}
+
+UserData::PayloadFormat UserData::getPayloadFormat() const {
+    return mExtendedData.mPayloadFormat;
+}
+
+bool UserData::getShortKeys() const {
+    return mExtendedData.mShortKeys;
+}
+
+uint32_t UserData::getI2CBaudRate(uint8_t bus) const {
+    assert(bus < MAX_I2C_BUSES);
+
+    return mExtendedData.mI2CBaudRates[bus];
+}
+
 int UserData::serializeToByteArray(char *bytes, int bytesSize) {
     if(!bytes || (bytesSize < USER_DATA_FLASH_SIZE)) {
         return 0;
@@ -257,3 +338,42 @@ bool UserData::serializeFromByteArray(const char *bytes, int bytesSize) {
 
     return true;
 }
+
+int UserData::serializeExtendedData(char *bytes) {
+    char *writePtr = bytes;
+    memset(writePtr, 0, EXTENDED_DATA_FLASH_SIZE);
+
+    //      SERIALIZATION ORDER:
+    //
+    // - Validation string
+    // - Size of the extended data block
+    // - Extended data block
+    memcpy(writePtr, EXTENDED_DATA_KEY, EXTENDED_DATA_KEY_LENGTH);
+    writePtr += (EXTENDED_DATA_KEY_LENGTH + 1);
+
+    uint16_t dataSize = sizeof(ExtendedData);
+    memcpy(writePtr, &dataSize, sizeof(uint16_t));
+    writePtr += sizeof(uint16_t);
+
+    memcpy(writePtr, &mExtendedData, sizeof(ExtendedData));
+    writePtr += sizeof(ExtendedData);
+
+    return (writePtr - bytes);
+}
+
+void UserData::serializeExtendedDataFrom(const char *bytes) {
+    memset(&mExtendedData, 0, sizeof(ExtendedData));
+
+    // Flash written by older firmware won't have this block, so just leave everything at defaults
+    if(strncmp(bytes, EXTENDED_DATA_KEY, EXTENDED_DATA_KEY_LENGTH + 1)) {
+        return;
+    }
+    bytes += (EXTENDED_DATA_KEY_LENGTH + 1);
+
+    // Fields added since the block was written are left at zero
+    uint16_t dataSize;
+    memcpy(&dataSize, bytes, sizeof(uint16_t));
+    bytes += sizeof(uint16_t);
+
+    memcpy(&mExtendedData, bytes, (dataSize < sizeof(ExtendedData)) ? dataSize : sizeof(ExtendedData));
+}
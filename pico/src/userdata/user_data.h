@@ -8,6 +8,40 @@ using std::string;
 
 class UserData {
     public:
+        // Optional fixed interface address, used instead of DHCP when set
+        struct StaticIPConfig {
+            uint32_t mIPAddress;
+            uint32_t mNetmask;
+            uint32_t mGateway;
+        };
+
+        // Details of the last good connection, tried first on the next connect so we can skip the
+        // scan, DHCP and DNS. These are discarded whenever the user data changes
+        struct NetworkCache {
+            uint8_t mBSSID[6];
+            uint8_t mChannel;
+            uint32_t mIPAddress;
+            uint32_t mNetmask;
+            uint32_t mGateway;
+            uint32_t mBrokerAddress;
+
+            bool operator==(const NetworkCache&) const = default;
+        };
+
+        // Where sensor data is published
+        enum PublishMode : uint8_t {
+            PUBLISH_PER_GROUP           = 0,    // One message per group, on the group's own topic
+            PUBLISH_PER_GROUP_AND_BATCH = 1,    // As above, plus changed groups combined on the device topic
+            PUBLISH_BATCH_ONLY          = 2     // Only the combined device topic
+        };
+
+        // How sensor data payloads are encoded
+        enum PayloadFormat : uint8_t {
+            PAYLOAD_JSON                = 0,
+            PAYLOAD_CBOR                = 1,
+            PAYLOAD_RAW                 = 2     // Packed sensor data, described by a retained schema per group
+        };
+
         UserData();
 
         bool hasNetworkUserData();
@@ -19,6 +53,13 @@ class UserData {
         void setSensorGroupLocation(uint8_t groupIndex, const char* location);
         void setSensorGroupName(uint8_t groupIndex, const char* name);
         void setBrokerAddress(const char* brokerAddress);
+        void setStaticIP(const StaticIPConfig& config);
+        void setNetworkCache(const NetworkCache& cache);
+        void setPublishMode(PublishMode mode);
+        void setPayloadFormat(PayloadFormat format);
+        void setShortKeys(bool shortKeys);
+        void setI2CBaudRate(uint8_t bus, uint32_t baud);
+        void clearNetworkCache();
         void wipe();
 
         void writeToFlash();
@@ -30,6 +71,14 @@ class UserData {
         const string& getSensorGroupLocation(uint8_t groupIndex) const;
         const string& getSensorGroupName(uint8_t groupIndex) const;
         const string& getBrokerAddress() const;
+        bool hasStaticIP() const;
+        const StaticIPConfig& getStaticIP() const;
+        bool hasNetworkCache() const;
+        const NetworkCache& getNetworkCache() const;
+        PublishMode getPublishMode() const;
+        PayloadFormat getPayloadFormat() const;
+        bool getShortKeys() const;
+        uint32_t getI2CBaudRate(uint8_t bus) const;         // 0 if the bus hasn't settled on one yet
 
         static constexpr int MAX_SSID_LENGTH                = 32;
         static constexpr int MAX_PSK_LENGTH                 = 64;
@@ -37,10 +86,24 @@ class UserData {
         static constexpr int MAX_GROUP_LOCATION_LENGTH      = 32;
         static constexpr int MAX_GROUP_NAME_LENGTH          = 32;
         static constexpr int MAX_BROKER_LENGTH              = 256;
+        static constexpr int MAX_I2C_BUSES                  = 2;        // By hardware index
 
     private:
+        // Settings added after the original user data layout live in their own block after it, with
+        // their own key and size so older flash contents remain valid. New fields go on the end
+        struct ExtendedData {
+            StaticIPConfig mStaticIP;
+            NetworkCache mNetworkCache;
+            PublishMode mPublishMode;
+            PayloadFormat mPayloadFormat;
+            bool mShortKeys;                    // Abbreviated JSON keys
+            uint32_t mI2CBaudRates[MAX_I2C_BUSES];  // Fastest clock rate each bus ran reliably at
+        };
+
         int serializeToByteArray(char *bytes, int bytesSize);
         bool serializeFromByteArray(const char *bytes, int bytesSize);
+        int serializeExtendedData(char *bytes);
+        void serializeExtendedDataFrom(const char *bytes);
 
 
         string mSSID;
@@ -49,6 +112,7 @@ class UserData {
         string* mSensorGroupLocations;
         string* mSensorGroupNames;
         string mBrokerAddress;
+        ExtendedData mExtendedData;
         char* mScratchMemory;   // Used for temporarily serializing/deserializing the class from flash
 };
 
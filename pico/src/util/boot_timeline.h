@@ -0,0 +1,54 @@
+#ifndef _BOOT_TIMELINE_H_
+#define _BOOT_TIMELINE_H_
+
+#include "pico/time.h"
+#include <cstdint>
+
+// When each stage of bringing the board up first happened, measured from reset. Sensor bring-up on
+// core1 and the network on core0 run side by side, so this shows which one the first publish was
+// actually waiting on.
+//
+// Each event is written once, by the core which owns it, so nothing is locked
+enum BootEvent {
+    BOOT_CORE1_STARTED,             // Core1 - scheduler running, sensor initialization started
+    BOOT_SENSORS_SETTLED,           // Core1 - every sensor has either finished initializing or given up
+    BOOT_FIRST_SENSOR_FRAME,        // Core1 - first frame of readings handed to core0
+    BOOT_WIFI_CONNECTED,            // Core0
+    BOOT_BROKER_CONNECTED,          // Core0 - connected and subscribed
+    BOOT_FIRST_PUBLISH,             // Core0
+
+    NUM_BOOT_EVENTS
+};
+
+class BootTimeline {
+    public:
+        static void mark(BootEvent event) {
+            if(!sEventTimesUS[event]) {
+                sEventTimesUS[event] = (uint32_t) to_us_since_boot(get_absolute_time());
+            }
+        }
+
+        static bool hasHappened(BootEvent event) { return sEventTimesUS[event]; }
+
+        // Milliseconds after reset, 0 if it hasn't happened yet
+        static uint32_t getTimeMS(BootEvent event) { return sEventTimesUS[event] / 1000; }
+
+        static const char* getEventName(BootEvent event) {
+            switch(event) {
+                case BOOT_CORE1_STARTED:        return "core1 started";
+                case BOOT_SENSORS_SETTLED:      return "sensors initialized";
+                case BOOT_FIRST_SENSOR_FRAME:   return "first sensor frame";
+                case BOOT_WIFI_CONNECTED:       return "WiFi connected";
+                case BOOT_BROKER_CONNECTED:     return "broker connected";
+                case BOOT_FIRST_PUBLISH:        return "first publish";
+                default:                        break;
+            }
+
+            return "unknown";
+        }
+
+    private:
+        static inline volatile uint32_t sEventTimesUS[NUM_BOOT_EVENTS] = {};
+};
+
+#endif      // _BOOT_TIMELINE_H_
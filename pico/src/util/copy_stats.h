@@ -0,0 +1,37 @@
+#ifndef _COPY_STATS_H_
+#define _COPY_STATS_H_
+
+#include <cstdint>
+
+// Counts the bytes copied on the way from a sensor reading to lwIP, by stage. Only compiled in with
+// -DCOPY_STATS=ON, otherwise COUNT_COPIED_BYTES() does nothing.
+//
+// Sensor updates and encoding can run on either core, so the counters for those stages can miss the
+// odd update. They are only there for comparing builds, so they aren't locked
+enum CopyStage {
+    COPY_SENSOR_CACHE,          // Either core - cached readings carried into a new frame
+    COPY_MAILBOX,               // Core1/core0 - frames passed between the cores
+    COPY_ENCODE,                // Either core - payloads encoded from a frame
+    COPY_PUBLISH_QUEUE,         // Core0 - messages copied into the publish queue
+    COPY_IN_FLIGHT,             // Core0 - QoS 1 messages kept in case they need resending
+    COPY_LWIP,                  // Core0 - topics and payloads copied into lwIP's output buffer
+
+    NUM_COPY_STAGES
+};
+
+class CopyStats {
+    public:
+        static void count(CopyStage stage, uint32_t bytes) { sCopiedBytes[stage] = sCopiedBytes[stage] + bytes; }
+        static uint32_t getCopiedBytes(CopyStage stage) { return sCopiedBytes[stage]; }
+
+    private:
+        static inline volatile uint32_t sCopiedBytes[NUM_COPY_STAGES] = {};
+};
+
+#if COPY_STATS
+#define COUNT_COPIED_BYTES(stage, bytes)    CopyStats::count(stage, bytes)
+#else
+#define COUNT_COPIED_BYTES(stage, bytes)
+#endif
+
+#endif      // _COPY_STATS_H_
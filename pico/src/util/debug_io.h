@@ -64,6 +64,18 @@ extern const char* CORE_PREFIXES[2];
 #   define DEBUG_PRINT_DEINIT()                            {}
 #endif
 
+// Per-cycle logging (loop stages, individual publishes etc). This can be switched off separately
+// for high-rate runs (see SYNTHETIC_LOAD in CMakeLists.txt) where the UART would become the bottleneck
+#ifndef DEBUG_PRINT_VERBOSE_ON
+#   define DEBUG_PRINT_VERBOSE_ON                          (1)
+#endif
+
+#if DEBUG_PRINT_VERBOSE_ON
+#   define DEBUG_PRINT_VERBOSE(core_num, format, ...)      DEBUG_PRINT(core_num, format __VA_OPT__(,) __VA_ARGS__)
+#else
+#   define DEBUG_PRINT_VERBOSE(core_num, format, ...)      {}
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,16 @@
+#ifndef _FNV_HASH_H_
+#define _FNV_HASH_H_
+
+#include <cstdint>
+
+// 32-bit FNV-1a. Cheap, and good enough for spotting changed payloads and layouts
+inline uint32_t fnv1aHash(const uint8_t* data, int length) {
+    uint32_t hash = 2166136261u;
+    for(int i = 0; i < length; ++i) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+#endif      // _FNV_HASH_H_
@@ -0,0 +1,146 @@
+#ifndef _TASK_H_
+#define _TASK_H_
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <type_traits>
+
+
+// Coroutine frames come from a small fixed pool rather than the heap. Tasks only ever run on core1,
+// but sensor updates on core0 can start them, so the pool is locked
+class TaskFramePool {
+    public:
+        static void* allocate(size_t size);
+        static void free(void* frame);
+
+        static uint8_t getFramesInUse() { return sFramesInUse; }
+        static uint8_t getMaxFramesInUse() { return sMaxFramesInUse; }
+        static uint32_t getAllocationFailures() { return sAllocationFailures; }
+
+        static constexpr size_t FRAME_SIZE          = 256;
+        static constexpr uint8_t NUM_FRAMES         = 16;
+
+    private:
+        alignas(8) static uint8_t sFrames[NUM_FRAMES][FRAME_SIZE];
+        static uint32_t sFreeFrames;                // Bitmask, bit set if the frame is free
+        static uint8_t sFramesInUse;
+        static uint8_t sMaxFramesInUse;
+        static uint32_t sAllocationFailures;
+};
+
+
+template<typename T> class Task;
+
+struct TaskPromiseBase {
+    // Resumes whoever was awaiting this task once it finishes
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+
+        template<typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> handle) noexcept {
+            std::coroutine_handle<> continuation = handle.promise().mContinuation;
+            return continuation ? continuation : std::noop_coroutine();
+        }
+
+        void await_resume() noexcept {}
+    };
+
+    // Tasks don't start until they are awaited or handed to the scheduler
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+
+    // Built without exceptions
+    void unhandled_exception() {}
+
+    static void* operator new(size_t size) noexcept { return TaskFramePool::allocate(size); }
+    static void operator delete(void* frame) { TaskFramePool::free(frame); }
+
+    std::coroutine_handle<> mContinuation;
+};
+
+template<typename T>
+struct TaskPromise : public TaskPromiseBase {
+    Task<T> get_return_object() { return Task<T>{std::coroutine_handle<TaskPromise>::from_promise(*this)}; }
+    static Task<T> get_return_object_on_allocation_failure() { return Task<T>{}; }
+
+    void return_value(T value) { mValue = std::move(value); }
+
+    T mValue{};
+};
+
+template<>
+struct TaskPromise<void> : public TaskPromiseBase {
+    Task<void> get_return_object();
+    static Task<void> get_return_object_on_allocation_failure();
+
+    void return_void() {}
+};
+
+
+// A lazily started coroutine which owns its frame. Awaiting a task runs it to completion (suspending
+// the awaiting coroutine along with it) and gives back its result.
+//
+// A task whose frame couldn't be allocated is invalid. Awaiting one finishes straight away with a
+// default constructed result, so the pool has to be sized for every task which can be alive at once
+template<typename T = void>
+class [[nodiscard]] Task {
+    public:
+        using promise_type = TaskPromise<T>;
+        using Handle = std::coroutine_handle<promise_type>;
+
+        Task() : mHandle{} {}
+        explicit Task(Handle handle) : mHandle{handle} {}
+        Task(Task&& other) : mHandle{std::exchange(other.mHandle, {})} {}
+        Task(const Task&) = delete;
+        ~Task() { destroy(); }
+
+        Task& operator=(Task&& other) {
+            if(this != &other) {
+                destroy();
+                mHandle = std::exchange(other.mHandle, {});
+            }
+            return *this;
+        }
+        Task& operator=(const Task&) = delete;
+
+        bool isValid() const { return (bool) mHandle; }
+        bool isDone() const { return !mHandle || mHandle.done(); }
+
+        // The frame is still owned (and destroyed) by the task
+        Handle getHandle() const { return mHandle; }
+
+        bool await_ready() const { return isDone(); }
+
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) {
+            mHandle.promise().mContinuation = awaiting;
+            return mHandle;
+        }
+
+        T await_resume() {
+            if constexpr (!std::is_void_v<T>) {
+                return mHandle ? std::move(mHandle.promise().mValue) : T{};
+            }
+        }
+
+    private:
+        void destroy() {
+            if(mHandle) {
+                mHandle.destroy();
+                mHandle = {};
+            }
+        }
+
+        Handle mHandle;
+};
+
+inline Task<void> TaskPromise<void>::get_return_object() {
+    return Task<void>{std::coroutine_handle<TaskPromise>::from_promise(*this)};
+}
+
+inline Task<void> TaskPromise<void>::get_return_object_on_allocation_failure() {
+    return Task<void>{};
+}
+
+#endif      // _TASK_H_
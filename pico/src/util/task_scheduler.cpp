@@ -0,0 +1,244 @@
+#include "task_scheduler.h"
+
+#include "util/debug_io.h"
+#include "hardware/gpio.h"
+#include "pico/time.h"
+#include "pico/sync.h"
+#include <cassert>
+
+
+// Guards the frame pool and the scheduler's slots
+auto_init_mutex(sTaskMutex);
+
+
+// Task frame pool
+alignas(8) uint8_t TaskFramePool::sFrames[NUM_FRAMES][FRAME_SIZE];
+uint32_t TaskFramePool::sFreeFrames = (1u << NUM_FRAMES) - 1;
+uint8_t TaskFramePool::sFramesInUse = 0;
+uint8_t TaskFramePool::sMaxFramesInUse = 0;
+uint32_t TaskFramePool::sAllocationFailures = 0;
+
+static_assert(TaskFramePool::NUM_FRAMES <= 32, "Free frame mask only holds 32 frames");
+
+void* TaskFramePool::allocate(size_t size) {
+    mutex_enter_blocking(&sTaskMutex);
+
+    if((size > FRAME_SIZE) || !sFreeFrames) {
+        ++sAllocationFailures;
+        mutex_exit(&sTaskMutex);
+
+        DEBUG_PRINT(1, "Couldn't allocate a %d byte task frame (%d in use)", size, sFramesInUse);
+        return nullptr;
+    }
+
+    int frame = __builtin_ctz(sFreeFrames);
+    sFreeFrames &= ~(1u << frame);
+
+    ++sFramesInUse;
+    if(sFramesInUse > sMaxFramesInUse) {
+        sMaxFramesInUse = sFramesInUse;
+    }
+
+    mutex_exit(&sTaskMutex);
+
+    return sFrames[frame];
+}
+
+void TaskFramePool::free(void* frame) {
+    int index = (static_cast<uint8_t*>(frame) - &sFrames[0][0]) / FRAME_SIZE;
+    assert((index >= 0) && (index < NUM_FRAMES));
+
+    mutex_enter_blocking(&sTaskMutex);
+    sFreeFrames |= (1u << index);
+    --sFramesInUse;
+    mutex_exit(&sTaskMutex);
+}
+
+
+// Scheduler
+TaskScheduler* TaskScheduler::sSchedulers[NUM_CORES] = {};
+
+TaskScheduler::TaskScheduler() :
+    mWaiters{}
+{}
+
+bool TaskScheduler::spawn(Task<> task) {
+    if(!task.isValid()) {
+        return false;
+    }
+
+    bool spawned = false;
+
+    mutex_enter_blocking(&sTaskMutex);
+
+    Waiter* waiter = getFreeWaiter();
+    for(auto& slot : mTasks) {
+        if(waiter && !slot.isValid()) {
+            // Tasks start suspended, so starting one is just a wait which is already over
+            *waiter = {task.getHandle(), nil_time, -1, false, nullptr};
+            slot = std::move(task);
+            spawned = true;
+            break;
+        }
+    }
+
+    mutex_exit(&sTaskMutex);
+
+    // Core1 may be asleep waiting for its next update
+    if(spawned) {
+        __sev();
+    }
+
+    return spawned;
+}
+
+void TaskScheduler::run(absolute_time_t currentTime) {
+    for(auto& waiter : mWaiters) {
+        std::coroutine_handle<> handle;
+
+        mutex_enter_blocking(&sTaskMutex);
+        if(waiter.mHandle) {
+            bool ready = (absolute_time_diff_us(waiter.mWakeTime, currentTime) >= 0);
+            if((waiter.mPin >= 0) && (gpio_get(waiter.mPin) == waiter.mLevel)) {
+                *waiter.mLevelSeen = true;
+                ready = true;
+            }
+
+            // Free the slot first, the task may well wait again before it returns to us
+            if(ready) {
+                handle = waiter.mHandle;
+                waiter.mHandle = {};
+            }
+        }
+        mutex_exit(&sTaskMutex);
+
+        if(handle) {
+            handle.resume();
+        }
+    }
+
+    for(auto& task : mTasks) {
+        // Destroyed outside the lock, freeing the frames takes it
+        Task<> finishedTask;
+
+        mutex_enter_blocking(&sTaskMutex);
+        if(task.isValid() && task.isDone()) {
+            finishedTask = std::move(task);
+        }
+        mutex_exit(&sTaskMutex);
+    }
+}
+
+absolute_time_t TaskScheduler::getNextWakeTime() const {
+    absolute_time_t nextWakeTime = at_the_end_of_time;
+    bool pollingPins = false;
+
+    mutex_enter_blocking(&sTaskMutex);
+    for(auto& waiter : mWaiters) {
+        if(!waiter.mHandle) {
+            continue;
+        }
+
+        if(absolute_time_diff_us(waiter.mWakeTime, nextWakeTime) > 0) {
+            nextWakeTime = waiter.mWakeTime;
+        }
+        pollingPins |= (waiter.mPin >= 0);
+    }
+    mutex_exit(&sTaskMutex);
+
+    if(pollingPins) {
+        absolute_time_t pollTime = make_timeout_time_ms(PIN_POLL_PERIOD_MS);
+        if(absolute_time_diff_us(pollTime, nextWakeTime) > 0) {
+            nextWakeTime = pollTime;
+        }
+    }
+
+    return nextWakeTime;
+}
+
+uint8_t TaskScheduler::getTaskCount() const {
+    uint8_t count = 0;
+
+    mutex_enter_blocking(&sTaskMutex);
+    for(auto& task : mTasks) {
+        count += task.isValid() ? 1 : 0;
+    }
+    mutex_exit(&sTaskMutex);
+
+    return count;
+}
+
+bool TaskScheduler::waitUntil(std::coroutine_handle<> handle, absolute_time_t wakeTime) {
+    mutex_enter_blocking(&sTaskMutex);
+    Waiter* waiter = getFreeWaiter();
+    if(waiter) {
+        *waiter = {handle, wakeTime, -1, false, nullptr};
+    }
+    mutex_exit(&sTaskMutex);
+
+    return waiter;
+}
+
+bool TaskScheduler::waitForPin(std::coroutine_handle<> handle, uint pin, bool level, absolute_time_t timeout, bool* levelSeen) {
+    mutex_enter_blocking(&sTaskMutex);
+    Waiter* waiter = getFreeWaiter();
+    if(waiter) {
+        *waiter = {handle, timeout, (int) pin, level, levelSeen};
+    }
+    mutex_exit(&sTaskMutex);
+
+    return waiter;
+}
+
+TaskScheduler::Waiter* TaskScheduler::getFreeWaiter() {
+    // Called with the lock held
+    for(auto& waiter : mWaiters) {
+        if(!waiter.mHandle) {
+            return &waiter;
+        }
+    }
+
+    return nullptr;
+}
+
+
+// Awaitables. If there's no scheduler to hand the wait to we fall back to blocking, as the drivers
+// did before they were tasks
+bool SleepAwaiter::await_ready() const {
+    return (absolute_time_diff_us(mWakeTime, get_absolute_time()) >= 0);
+}
+
+bool SleepAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    TaskScheduler* scheduler = TaskScheduler::current();
+    if(scheduler && scheduler->waitUntil(handle, mWakeTime)) {
+        return true;
+    }
+
+    sleep_until(mWakeTime);
+    return false;
+}
+
+bool PinAwaiter::await_ready() {
+    mLevelSeen = (gpio_get(mPin) == mLevel);
+    return mLevelSeen;
+}
+
+bool PinAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    TaskScheduler* scheduler = TaskScheduler::current();
+    if(scheduler && scheduler->waitForPin(handle, mPin, mLevel, mTimeout, &mLevelSeen)) {
+        return true;
+    }
+
+    while(!(mLevelSeen = (gpio_get(mPin) == mLevel)) && (absolute_time_diff_us(mTimeout, get_absolute_time()) < 0)) {
+        sleep_ms(TaskScheduler::PIN_POLL_PERIOD_MS);
+    }
+    return false;
+}
+
+SleepAwaiter sleepFor(uint32_t ms) {
+    return {make_timeout_time_ms(ms)};
+}
+
+PinAwaiter waitForPin(uint pin, bool level, uint32_t timeoutMS) {
+    return {pin, level, make_timeout_time_ms(timeoutMS), false};
+}
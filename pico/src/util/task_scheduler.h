@@ -0,0 +1,91 @@
+#ifndef _TASK_SCHEDULER_H_
+#define _TASK_SCHEDULER_H_
+
+#include "util/task.h"
+#include "pico/sync.h"
+#include "pico/types.h"
+
+
+// Cooperative scheduler for the sensor tasks on core1. Tasks run until they co_await a sleep or a
+// GPIO level, and are resumed from run() once it's time, so one sensor waiting on its hardware no
+// longer holds up the others.
+//
+// Everything is fixed size - the scheduler holds at most MAX_TASKS spawned tasks, and since only the
+// innermost coroutine of each is ever waiting, the same number of waits. Tasks can be spawned from
+// either core but are only resumed from run(), on the core the scheduler belongs to
+class TaskScheduler {
+    public:
+        TaskScheduler();
+
+        // Starts the task on the next call to run(). Returns false if the task is invalid or the
+        // scheduler is full
+        bool spawn(Task<> task);
+
+        // Resumes every task whose wait is over, then cleans up any tasks which have finished
+        void run(absolute_time_t currentTime);
+
+        // When run() next has something to do, at_the_end_of_time if nothing is waiting
+        absolute_time_t getNextWakeTime() const;
+
+        uint8_t getTaskCount() const;
+
+        // Registers a suspended coroutine to be resumed. Used by the awaitables below
+        bool waitUntil(std::coroutine_handle<> handle, absolute_time_t wakeTime);
+        bool waitForPin(std::coroutine_handle<> handle, uint pin, bool level, absolute_time_t timeout, bool* levelSeen);
+
+        // The calling core's scheduler, nullptr if it doesn't run one. Waits on a core without a
+        // scheduler block instead
+        static TaskScheduler* current() { return sSchedulers[get_core_num()]; }
+        static TaskScheduler* forCore(uint core) { return sSchedulers[core]; }
+
+        // Called from the core which runs the scheduler
+        static void setCurrent(TaskScheduler& scheduler) { sSchedulers[get_core_num()] = &scheduler; }
+
+        static constexpr int NUM_CORES                  = 2;
+        static constexpr uint8_t MAX_TASKS              = 8;
+        static constexpr uint32_t PIN_POLL_PERIOD_MS    = 1;
+
+    private:
+        struct Waiter {
+            std::coroutine_handle<> mHandle;        // Empty if the slot is free
+            absolute_time_t mWakeTime;              // Timeout if waiting on a pin
+            int mPin;                               // -1 if not waiting on a pin
+            bool mLevel;
+            bool* mLevelSeen;
+        };
+
+        Waiter* getFreeWaiter();
+
+        static TaskScheduler* sSchedulers[NUM_CORES];
+
+        Task<> mTasks[MAX_TASKS];
+        Waiter mWaiters[MAX_TASKS];
+};
+
+
+// co_await sleepFor(ms) - suspends the calling task for at least the given time
+struct SleepAwaiter {
+    bool await_ready() const;
+    bool await_suspend(std::coroutine_handle<> handle);
+    void await_resume() const {}
+
+    absolute_time_t mWakeTime;
+};
+
+// co_await waitForPin(pin, level, timeout) - suspends the calling task until the pin reads the given
+// level, giving back false if it timed out first
+struct PinAwaiter {
+    bool await_ready();
+    bool await_suspend(std::coroutine_handle<> handle);
+    bool await_resume() const { return mLevelSeen; }
+
+    uint mPin;
+    bool mLevel;
+    absolute_time_t mTimeout;
+    bool mLevelSeen;
+};
+
+SleepAwaiter sleepFor(uint32_t ms);
+PinAwaiter waitForPin(uint pin, bool level, uint32_t timeoutMS);
+
+#endif      // _TASK_SCHEDULER_H_
@@ -0,0 +1,335 @@
+#!/usr/bin/env python3
+"""Decodes AutoBloomer sensor module payloads.
+
+Group payloads are published as JSON, CBOR (FRMT1) or raw frames (FRMT2). All of them decode
+to the same structure - a list holding a dict per sensor:
+
+    [{"type": 1, "status": 0, "CO2": 612.5, "Temperature": 23.1, "Humidity": 48.2}, ...]
+
+Batched device messages decode to a dict of these lists, keyed by "<location>/<name>" (or by
+group index for raw frames).
+
+Raw frames are the module's packed sensor data with a small header, and need the group's schema
+to decode. The module publishes these, retained, to "<group topic>/schema" each time it
+connects:
+
+    schema = decode_schema(schema_payload)
+    sequence, sensors = decode_frame(schema, frame_payload)
+
+Only the subset of CBOR the modules produce is supported (definite length integers, strings,
+arrays, maps and floats), with no dependencies outside the standard library.
+"""
+
+import argparse
+import json
+import struct
+import sys
+
+# Sensor type IDs (Sensor::SensorType)
+SENSOR_TYPES = {
+    0x01: "SCD30",
+    0x02: "StemmaSoil",
+    0x03: "Battery",
+    0x04: "Sonar",
+    0xFF: "Dummy",
+}
+
+# Sensor status values (Sensor::SensorStatus)
+SENSOR_STATUSES = {
+    0: "OK",
+    1: "OK_NO_DATA",
+    2: "NOT_CONNECTED",
+    3: "INACTIVE",
+    4: "MALFUNCTIONING",
+}
+
+
+# Abbreviated JSON keys (SKEY1) and the keys they stand for
+SHORT_KEYS = {
+    "t": "type",
+    "s": "status",
+    "co2": "CO2",
+    "tmp": "Temperature",
+    "hum": "Humidity",
+    "sm": "SoilMoisture",
+    "st": "SoilTemperature",
+    "pc": "ProbeCount",
+    "v": "voltage",
+    "d": "distance",
+    "di": "dummyInt",
+    "vs": "virtualSensors",
+    "df": "dummyFloat",
+    "p": "padding",
+}
+
+
+class PayloadError(ValueError):
+    pass
+
+
+class _CborReader:
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def _take(self, length):
+        if self.pos + length > len(self.data):
+            raise PayloadError("Truncated CBOR payload")
+        chunk = self.data[self.pos:self.pos + length]
+        self.pos += length
+        return chunk
+
+    def _argument(self, info):
+        if info < 24:
+            return info
+        if info == 24:
+            return self._take(1)[0]
+        if info == 25:
+            return struct.unpack(">H", self._take(2))[0]
+        if info == 26:
+            return struct.unpack(">I", self._take(4))[0]
+        if info == 27:
+            return struct.unpack(">Q", self._take(8))[0]
+        raise PayloadError("Indefinite lengths are not supported")
+
+    def read(self):
+        initial = self._take(1)[0]
+        major = initial >> 5
+        info = initial & 0x1F
+
+        if major == 7:
+            if info == 20:
+                return False
+            if info == 21:
+                return True
+            if info == 22:
+                return None
+            if info == 25:
+                return struct.unpack(">e", self._take(2))[0]
+            if info == 26:
+                return struct.unpack(">f", self._take(4))[0]
+            if info == 27:
+                return struct.unpack(">d", self._take(8))[0]
+            raise PayloadError("Unsupported simple value %d" % info)
+
+        value = self._argument(info)
+        if major == 0:
+            return value
+        if major == 1:
+            return -1 - value
+        if major == 2:
+            return bytes(self._take(value))
+        if major == 3:
+            return self._take(value).decode("utf-8")
+        if major == 4:
+            return [self.read() for _ in range(value)]
+        if major == 5:
+            result = {}
+            for _ in range(value):
+                key = self.read()
+                result[key] = self.read()
+            return result
+        raise PayloadError("Tags are not supported")
+
+
+def decode_cbor(data):
+    """Decodes a single CBOR item, which must take up the whole of data."""
+    reader = _CborReader(bytes(data))
+    value = reader.read()
+    if reader.pos != len(reader.data):
+        raise PayloadError("Trailing bytes after CBOR item")
+    return value
+
+
+def decode_payload(data):
+    """Decodes a group or batch payload, working out whether it is JSON or CBOR.
+
+    JSON payloads always start with '[' (group) or '{' (batch), neither of which is the first
+    byte of the CBOR the modules send for a group or batch. Abbreviated keys are expanded.
+    """
+    data = bytes(data)
+    if data[:1] in (b"[", b"{"):
+        return _expand_short_keys(json.loads(data.decode("utf-8")))
+    return decode_cbor(data)
+
+
+def _expand_short_keys(decoded):
+    # Batches are a dict of group payloads, groups a list of sensors
+    if isinstance(decoded, dict):
+        return {key: _expand_short_keys(value) for key, value in decoded.items()}
+    return [{SHORT_KEYS.get(key, key): value for key, value in sensor.items()} for sensor in decoded]
+
+
+# Raw field types (Sensor::FieldType) and how to unpack them
+FIELD_FORMATS = {
+    "u8": "<B",
+    "u16": "<H",
+    "i32": "<i",
+    "f32": "<f",
+}
+
+RAW_FRAME_VERSION = 1
+
+
+def decode_schema(data):
+    """Decodes a group schema, checking it is a version this library understands."""
+    schema = json.loads(bytes(data).decode("utf-8"))
+    if schema.get("version") != RAW_FRAME_VERSION:
+        raise PayloadError("Unsupported schema version %s" % schema.get("version"))
+    if schema.get("endian") != "little":
+        raise PayloadError("Unsupported byte order %s" % schema.get("endian"))
+    return schema
+
+
+def _decode_sensor_data(sensor, data):
+    values = {}
+    fields = sensor["fields"]
+    end = 0
+
+    for field in fields:
+        if field["type"] == "bytes":
+            continue
+
+        fmt = FIELD_FORMATS.get(field["type"])
+        if fmt is None:
+            raise PayloadError("Unknown field type %s" % field["type"])
+        size = struct.calcsize(fmt)
+
+        count = values[field["count"]] if "count" in field else None
+        for i in range(1 if count is None else count):
+            offset = field["offset"] + (i * size)
+            if offset + size > len(data):
+                raise PayloadError("Field %s runs past the end of the data" % field["name"])
+
+            # Array elements are named as in the JSON - name, name1, name2...
+            name = field["name"] if not i else "%s%d" % (field["name"], i)
+            values[name] = struct.unpack_from(fmt, data, offset)[0]
+            end = max(end, offset + size)
+
+    for field in fields:
+        if field["type"] == "bytes" and end < len(data):
+            values[field["name"]] = bytes(data[end:])
+
+    return values
+
+
+def decode_frame(schema, data):
+    """Decodes a raw frame using its group's schema, returning (sequence, sensors)."""
+    data = bytes(data)
+    header = schema["header"]
+    if len(data) < header:
+        raise PayloadError("Frame is shorter than its header")
+
+    sequence, schema_id = struct.unpack_from("<HH", data, 0)
+    if schema_id != schema["id"]:
+        raise PayloadError("Frame was sent with schema %d, expected %d" % (schema_id, schema["id"]))
+
+    sensors = []
+    for sensor in schema["sensors"]:
+        offset = sensor["offset"]
+        if offset + 2 + sensor["size"] > len(data):
+            raise PayloadError("Frame is too short for its schema")
+
+        status, length = data[offset], data[offset + 1]
+        entry = {"type": sensor["type"], "status": status}
+        if length:
+            entry.update(_decode_sensor_data(sensor, data[offset + 2:offset + 2 + length]))
+        sensors.append(entry)
+
+    return sequence, sensors
+
+
+def decode_raw_batch(schemas, data):
+    """Decodes a raw batch message. schemas maps group index to that group's schema.
+
+    Returns a dict of group index to (sequence, sensors).
+    """
+    data = bytes(data)
+    frames = {}
+    pos = 0
+    while pos < len(data):
+        if pos + 2 > len(data):
+            raise PayloadError("Truncated batch entry")
+        group, length = data[pos], data[pos + 1]
+        pos += 2
+
+        if group not in schemas:
+            raise PayloadError("No schema for group %d" % group)
+        frames[group] = decode_frame(schemas[group], data[pos:pos + length])
+        pos += length
+
+    return frames
+
+
+class SequenceTracker:
+    """Counts frames lost between the module and here from the frame sequence numbers."""
+
+    def __init__(self):
+        self.last_sequence = None
+        self.received = 0
+        self.lost = 0
+
+    def update(self, sequence):
+        if self.last_sequence is not None:
+            gap = (sequence - self.last_sequence - 1) & 0xFFFF
+            # A large gap is far more likely to be the module restarting than lost frames
+            if gap < 0x8000:
+                self.lost += gap
+        self.last_sequence = sequence
+        self.received += 1
+
+
+def describe(sensors):
+    """Adds readable names for the sensor types and statuses in a decoded group payload."""
+    described = []
+    for sensor in sensors:
+        entry = dict(sensor)
+        entry["typeName"] = SENSOR_TYPES.get(entry.get("type"), "Unknown")
+        entry["statusName"] = SENSOR_STATUSES.get(entry.get("status"), "Unknown")
+        # Byte strings (DummySensor padding) are shown as hex, as in the JSON
+        for key, value in entry.items():
+            if isinstance(value, bytes):
+                entry[key] = value.hex().upper()
+        described.append(entry)
+    return described
+
+
+def _read_input(value):
+    try:
+        return bytes.fromhex(value)
+    except ValueError:
+        with open(value, "rb") as input_file:
+            return input_file.read()
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(description="Decode AutoBloomer sensor module payloads")
+    parser.add_argument("payload", help="payload as hex, or a file holding it")
+    parser.add_argument("--schema", action="append", default=[],
+                        help="schema (hex or file) for decoding raw frames, repeat for raw batches")
+    parser.add_argument("--batch", action="store_true", help="payload is a raw batch message")
+    args = parser.parse_args(argv[1:])
+
+    data = _read_input(args.payload)
+    if args.schema:
+        schemas = [decode_schema(_read_input(s)) for s in args.schema]
+        if args.batch:
+            frames = decode_raw_batch({s["group"]: s for s in schemas}, data)
+            decoded = {group: {"sequence": sequence, "sensors": describe(sensors)}
+                       for group, (sequence, sensors) in frames.items()}
+        else:
+            sequence, sensors = decode_frame(schemas[0], data)
+            decoded = {"sequence": sequence, "sensors": describe(sensors)}
+    else:
+        decoded = decode_payload(data)
+        if isinstance(decoded, dict):
+            decoded = {key: describe(value) for key, value in decoded.items()}
+        else:
+            decoded = describe(decoded)
+
+    print(json.dumps(decoded, indent=2))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))